@@ -9,6 +9,11 @@
 // CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
 // NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
+#import "MAPlatform.h"
+#if !MACHINO_HEADLESS
 #import "MAGraphView.h"
+#endif
 #import "MANode.h"
-#import "MAArrow.h"
\ No newline at end of file
+#import "MAArrow.h"
+#import "MAGraphAnalysis.h"
+#import "MAGraphChange.h"
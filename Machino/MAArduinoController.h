@@ -10,23 +10,31 @@
 // NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #import <Foundation/Foundation.h>
+#import "MAMessageDecoder.h"
 
 @protocol MAArduinoControllerDelegate;
 @class ORSSerialPort;
 @class MABoard;
+@class MACodeSink;
+@class MATraceRecorder;
 
 @interface MAArduinoController : NSObject
 
 @property (nonatomic, weak) id<MAArduinoControllerDelegate> delegate;
 @property (nonatomic, strong) ORSSerialPort *serialPort;
 @property (nonatomic, strong) MABoard *board;
+@property (nonatomic) unsigned long baudRate; // Written into the uploaded sketch and used to connect, defaults to the MessagingBaudRate default or 1 Mbaud
+@property (nonatomic, strong) MATraceRecorder *traceRecorder; // Gets everything decoded, set on connect if the TraceDirectory default is
+@property (nonatomic) BOOL simulatesBoard; // Uploads start the sketch in MASimulator instead and serialPort becomes its pseudo-terminal, defaults to the SimulateBoard default
+@property (nonatomic, readonly, getter = isSendQueueFull) BOOL sendQueueFull; // Set while the serial port's write queue is over its high watermark, back off sending until it clears
 
 // Serial
 - (BOOL)connect;
-- (void)disconnect;
+- (void)disconnect; // Also ends a simulation
 - (void)sendDataToArduino:(NSData *)data;
+- (void)sendDataToArduino:(NSData *)data completion:(void(^)(BOOL sent))completion; // Never blocks, the completion is called on the main queue (right away with NO when not connected)
 // Upload
-- (void)uploadCode:(NSString *)code error:(NSError **)error completion:(void(^)(BOOL success, NSString *output, NSString *errors))completion;
+- (void)uploadCode:(MACodeSink *)code error:(NSError **)error completion:(void(^)(BOOL success, NSString *output, NSString *errors))completion;
 
 @end
 
@@ -39,5 +47,7 @@
 - (void)arduino:(MAArduinoController *)arduino willPerformTransitionWithID:(UInt16)transitionID;
 - (void)arduino:(MAArduinoController *)arduino willPerformActionAtIndex:(UInt16)index forTransitionWithID:(UInt16)transitionID;
 - (void)arduino:(MAArduinoController *)arduino didReceiveUserSerialData:(NSData *)data;
+- (void)arduino:(MAArduinoController *)arduino didDropMessages:(UInt16)count; // Its message buffer was full
+- (void)arduino:(MAArduinoController *)arduino didSendProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count; // Of a profiling sketch, not kept in traces
 
 @end
\ No newline at end of file
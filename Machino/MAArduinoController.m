@@ -12,51 +12,48 @@
 #import "MAArduinoController.h"
 #import "MAArduinoIDE.h"
 #import "MABoard.h"
+#import "MACodeSink.h"
+#import "MAMessageDecoder.h"
+#import "MATraceRecorder.h"
+#import "MASimulator.h"
+#import "MASketchBuilder.h"
+#import "MABuildCache.h"
 #import "Utility.h"
 
 #pragma mark - Constants
 
-static const unsigned long kBaudRate = 9600;
-static const int kMessageStartSequenceLength = 3;
-static const Byte kMessageStartSequence[] = { 17, 31, 23 };
-static const int kMessageHeaderLength = kMessageStartSequenceLength + 3;
-
-typedef NS_ENUM(NSUInteger, MAMessageType) {
-	MAMessageNone = 0,
-	MAMessageIterationStart = 1,
-	MAMessageIterationEnd = 2,
-	MAMessageCurrentState = 3,
-	MAMessageWillCheckCondition = 4,
-	MAMessageWillPerformTransition = 5,
-	MAMessageWillPerformAction = 6
-};
-
-#pragma mark - Private Class - MAMessageInfo
-
-@interface MAMessageInfo : NSObject
-
-@property (nonatomic) NSUInteger headerBytesRead;
-@property (nonatomic) MAMessageType type;
-@property (nonatomic) NSUInteger bodyLength;
-
-@end
-
-@implementation MAMessageInfo
-
-@end
+static const unsigned long kDefaultBaudRate = 1000000; // Exact on 16 MHz AVRs
+static NSString * const kDefaultsKeyBaudRate = @"MessagingBaudRate";
+static NSString * const kMessagingBaudRateDefinitionFormat = @"#define MESSAGING_BAUD_RATE %luUL\n";
+static const unsigned long kVersion1BaudRate = 9600; // What sketches uploaded with protocol version 1 talk at
+static const NSTimeInterval kVersion2Timeout = 3; // Without a version 2 frame by then, listen for version 1, the bootloader's wait included
+static NSString * const kDefaultsKeyTraceDirectory = @"TraceDirectory"; // Hidden setting, records a trace of every run into it
+static NSString * const kTraceFileNameFormat = @"%@.matrace";
+static NSString * const kDefaultsKeySimulateBoard = @"SimulateBoard"; // Hidden setting, runs sketches on the Mac
+static NSString * const kDefaultsKeySimulatorScript = @"SimulatorScript"; // Hidden setting, inputs for simulated sketches
+static NSString * const kDefaultsKeySimulatorSpeed = @"SimulatorSpeed"; // Hidden setting, times real time, 0 for as fast as possible
+static NSString * const kDefaultsKeyArduinoCLIPath = @"ArduinoCLIPath"; // Hidden setting, builds with arduino-cli through the build cache instead of with the Arduino IDE
+static NSString * const kDefaultsKeyBuildCacheSize = @"BuildCacheSize"; // Hidden setting, megabytes
+static const NSTimeInterval kHelloTimeout = 3; // After opening the port, the bootloader's wait included
 
 #pragma mark - MAArduinoController
 
-@interface MAArduinoController () <ORSSerialPortDelegate, VDKQueueDelegate>
+@interface MAArduinoController () <ORSSerialPortDelegate, VDKQueueDelegate, MAMessageDecoderDelegate>
 
-@property (nonatomic, strong, readonly) NSMutableData *receiveBuffer;
-@property (nonatomic, strong) MAMessageInfo *pendingMessageInfo;
+@property (nonatomic, strong, readonly) MAMessageDecoder *decoder;
+@property (nonatomic, strong, readonly) NSMutableData *userSerialData; // Of the current read
+@property (nonatomic, readwrite, getter = isSendQueueFull) BOOL sendQueueFull;
+@property (nonatomic, strong) NSTimer *version1Timer; // Of the current connection
 // IDE Launching
 @property (nonatomic, strong, readonly) MATempDirectory *tempDirectory;
 @property (nonatomic, strong, readonly) VDKQueue *fileMonitor;
 @property (nonatomic, strong) void (^completionCallback)(BOOL success, NSString *output, NSString *errors);
 @property (nonatomic, copy) NSString *lastOutput;
 @property (nonatomic, copy) NSString *lastErrors;
+// Simulation
+@property (nonatomic, strong) MASimulator *simulator; // Of the current run
+// Building with arduino-cli
+@property (nonatomic, strong) MASketchBuilder *sketchBuilder; // Asks for the toolchain version once
 
 @end
 
@@ -81,7 +78,12 @@ typedef NS_ENUM(NSUInteger, MAMessageType) {
         _tempDirectory = [[MATempDirectory alloc] init];
 		_fileMonitor = [[VDKQueue alloc] init];
 		_fileMonitor.delegate = self;
-		_receiveBuffer = [NSMutableData data];
+		_decoder = [[MAMessageDecoder alloc] init];
+		_decoder.delegate = self;
+		_userSerialData = [NSMutableData data];
+		NSInteger baudRate = [[NSUserDefaults standardUserDefaults] integerForKey:kDefaultsKeyBaudRate];
+		_baudRate = (baudRate > 0) ? baudRate : kDefaultBaudRate;
+		_simulatesBoard = [[NSUserDefaults standardUserDefaults] boolForKey:kDefaultsKeySimulateBoard];
     }
     return self;
 }
@@ -95,144 +97,153 @@ typedef NS_ENUM(NSUInteger, MAMessageType) {
 
 - (BOOL)connect
 {
-	[self disconnect];
-	self.serialPort.baudRate = @(kBaudRate);
+	[self closeSerialPort]; // Keeping the simulation, if the port is its pseudo-terminal
+	self.serialPort.baudRate = @(self.baudRate);
 	[self.serialPort open];
-	return self.serialPort.open;
+	if (!self.serialPort.open) return NO;
+	[self startTraceRecorder];
+	if (self.baudRate != kVersion1BaudRate) self.version1Timer = [NSTimer scheduledTimerWithTimeInterval:kVersion2Timeout target:self selector:@selector(version1TimerDidFire:) userInfo:nil repeats:NO];
+	return YES;
 }
 
 - (void)disconnect
+{
+	[self closeSerialPort];
+	[self.simulator terminate];
+	self.simulator = nil;
+}
+
+- (void)closeSerialPort
 {
 	if (self.serialPort.open) [self.serialPort close];
-	self.pendingMessageInfo = nil;
+	[self.version1Timer invalidate];
+	self.version1Timer = nil;
+	self.sendQueueFull = NO;
+	[self.decoder reset];
+	[self.traceRecorder close];
+	self.traceRecorder = nil;
 }
 
-- (void)sendDataToArduino:(NSData *)data
+- (void)version1TimerDidFire:(NSTimer *)timer
 {
-	if (self.serialPort.open) [self.serialPort sendData:data];
+	// Sketches uploaded with version 1 began Serial at 9600 baud, so at our rate they only sent noise
+	self.version1Timer = nil;
+	if (!self.serialPort.open || self.decoder.protocolVersion == MAMessageProtocolVersion2) return;
+	[self.decoder reset];
+	self.serialPort.baudRate = @(kVersion1BaudRate);
 }
 
-- (void)serialPort:(ORSSerialPort *)serialPort didReceiveData:(NSData *)data
+- (void)startTraceRecorder
 {
-	[self.receiveBuffer appendData:data];
-	[self checkForMessages];
+	NSString *directory = [[NSUserDefaults standardUserDefaults] stringForKey:kDefaultsKeyTraceDirectory];
+	if ([directory length] == 0) return;
+	NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+	[formatter setDateFormat:@"yyyy-MM-dd HH.mm.ss"];
+	NSString *name = [NSString stringWithFormat:kTraceFileNameFormat, [formatter stringFromDate:[NSDate date]]];
+	NSError *error = nil;
+	self.traceRecorder = [MATraceRecorder recorderWithPath:[[directory stringByExpandingTildeInPath] stringByAppendingPathComponent:name] error:&error];
+	if (!self.traceRecorder) NSLog(@"Could not record trace: %@", [error localizedDescription]);
 }
 
-- (void)serialPortWasRemovedFromSystem:(ORSSerialPort *)serialPort
+- (void)sendDataToArduino:(NSData *)data
 {
-	self.serialPort = nil;
+	[self sendDataToArduino:data completion:nil];
 }
 
-#pragma mark - Messages
+- (void)sendDataToArduino:(NSData *)data completion:(void(^)(BOOL sent))completion
+{
+	if (self.serialPort.open && [self.serialPort sendData:data completion:completion]) return;
+	if (completion) completion(NO);
+}
 
-- (void)checkForMessages
+- (void)serialPort:(ORSSerialPort *)serialPort writeQueueDidFillToLength:(NSUInteger)length
 {
-	MADataReader *reader = [MADataReader readerWithData:self.receiveBuffer];
-	NSMutableData *userSerialData;
-	while (reader.bytesLeft) {
-		NSUInteger headerBytesRead = self.pendingMessageInfo.headerBytesRead;
-		NSInteger headerBytesLeft = kMessageHeaderLength-headerBytesRead;
-		if (headerBytesLeft <= 0) {
-			// If we don't have the entire message yet, end
-			if (reader.bytesLeft < self.pendingMessageInfo.bodyLength) break;
-			// Read message body
-			NSData *data = [reader readDataOfLength:self.pendingMessageInfo.bodyLength];
-			[self readMessageWithInfo:self.pendingMessageInfo fromData:data];
-			self.pendingMessageInfo = nil;
-		} else if (headerBytesRead >= kMessageStartSequenceLength) {
-			// If we don't have the entire header yet, end
-			if (reader.bytesLeft < headerBytesLeft) break;
-			// Read remaining message header
-			self.pendingMessageInfo.type = (MAMessageType)[reader readUInt8];
-			self.pendingMessageInfo.bodyLength = [reader readUInt16];
-			self.pendingMessageInfo.headerBytesRead = kMessageHeaderLength;
-		} else {
-			// Check for start sequence
-			Byte nextByte = [reader readUInt8];
-			if (nextByte == kMessageStartSequence[headerBytesRead]) {
-				if (!self.pendingMessageInfo) self.pendingMessageInfo = [[MAMessageInfo alloc] init];
-				self.pendingMessageInfo.headerBytesRead++;
-			} else {
-				self.pendingMessageInfo = nil;
-				// User (non-messaging) serial
-				if (!userSerialData) userSerialData = [NSMutableData data];
-				Byte bytes[] = { nextByte };
-				[userSerialData appendBytes:bytes length:1];
-			}
-		}
-	}
-	// User serial data
-	if ([userSerialData length] > 0) {
-		[self.delegate arduino:self didReceiveUserSerialData:userSerialData];
-	}
-	// Delete consumed bytes
-	NSUInteger bytesConsumed = reader.index;
-	if (bytesConsumed > 0) {
-		[self.receiveBuffer replaceBytesInRange:NSMakeRange(0, bytesConsumed) withBytes:NULL length:0];
-	}
+	self.sendQueueFull = YES;
 }
 
-- (void)readMessageWithInfo:(MAMessageInfo *)messageInfo fromData:(NSData *)data
+- (void)serialPort:(ORSSerialPort *)serialPort writeQueueDidDrainToLength:(NSUInteger)length
 {
-	switch (messageInfo.type) {
-		case MAMessageIterationStart: [self readMessageIterationStartFromData:data]; break;
-		case MAMessageIterationEnd: [self readMessageIterationEndFromData:data]; break;
-		case MAMessageCurrentState: [self readMessageCurrentStateFromData:data]; break;
-		case MAMessageWillCheckCondition: [self readMessageWillCheckConditionFromData:data]; break;
-		case MAMessageWillPerformTransition: [self readMessageWillPerformTransition:data]; break;
-		case MAMessageWillPerformAction: [self readMessageWillPerformActionFromData:data]; break;
-		default: NSLog(@"Invalid message type: %li", messageInfo.type); break;
-	}
+	self.sendQueueFull = NO;
 }
 
-- (void)readMessageIterationStartFromData:(NSData *)data
+- (void)serialPort:(ORSSerialPort *)serialPort didReceiveData:(NSData *)data
 {
-	[self.delegate arduinoDidStartIteration:self];
+	[self.decoder decodeData:data];
+	[self sendUserSerialData];
+	[self.traceRecorder flush];
 }
 
-- (void)readMessageIterationEndFromData:(NSData *)data
+- (void)serialPortWasRemovedFromSystem:(ORSSerialPort *)serialPort
+{
+	self.serialPort = nil;
+}
+
+#pragma mark - Messages
+
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeEvents:(const MAMessageEvent *)events count:(NSUInteger)count
 {
-	[self.delegate arduinoDidEndIteration:self];
+	[self sendUserSerialData]; // What came before
+	[self.traceRecorder recordEvents:events count:count];
+	id<MAArduinoControllerDelegate> delegate = self.delegate;
+	for (NSUInteger i = 0; i < count; i++) {
+		const UInt16 *arguments = events[i].arguments;
+		switch (events[i].type) {
+			case MAMessageEventIterationStart: [delegate arduinoDidStartIteration:self]; break;
+			case MAMessageEventIterationEnd: [delegate arduinoDidEndIteration:self]; break;
+			case MAMessageEventCurrentState: [delegate arduino:self didSendCurrentStateID:arguments[0]]; break;
+			case MAMessageEventWillCheckCondition: [delegate arduino:self willCheckConditionWithID:arguments[1] forTransitionWithID:arguments[0]]; break;
+			case MAMessageEventWillPerformTransition: [delegate arduino:self willPerformTransitionWithID:arguments[0]]; break;
+			case MAMessageEventWillPerformAction: [delegate arduino:self willPerformActionAtIndex:arguments[1] forTransitionWithID:arguments[0]]; break;
+			case MAMessageEventDroppedMessages: [delegate arduino:self didDropMessages:arguments[0]]; break;
+		}
+	}
 }
 
-- (void)readMessageCurrentStateFromData:(NSData *)data
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length
 {
-	MADataReader *reader = [MADataReader readerWithData:data];
-	UInt16 stateID = [reader readUInt16];
-	[self.delegate arduino:self didSendCurrentStateID:stateID];
+	// Collected & handed over in one piece, up to the next events
+	[self.userSerialData appendBytes:bytes length:length];
+	[self.traceRecorder recordUserSerialBytes:bytes length:length];
 }
 
-- (void)readMessageWillCheckConditionFromData:(NSData *)data
+- (void)sendUserSerialData
 {
-	MADataReader *reader = [MADataReader readerWithData:data];
-	UInt16 transitionID = [reader readUInt16];
-	UInt16 conditionID = [reader readUInt16];
-	[self.delegate arduino:self willCheckConditionWithID:conditionID forTransitionWithID:transitionID];
+	if ([self.userSerialData length] == 0) return;
+	[self.delegate arduino:self didReceiveUserSerialData:[self.userSerialData copy]];
+	[self.userSerialData setLength:0];
 }
 
-- (void)readMessageWillPerformTransition:(NSData *)data
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveHelloWithBaudRate:(unsigned long)baudRate
 {
-	MADataReader *reader = [MADataReader readerWithData:data];
-	UInt16 transitionID = [reader readUInt16];
-	[self.delegate arduino:self willPerformTransitionWithID:transitionID];
+	// Sent once from setupMessaging(). The rate is our own, compiled into the sketch when uploading; a sketch at another
+	// rate can't be decoded in the first place
 }
 
-- (void)readMessageWillPerformActionFromData:(NSData *)data
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count
 {
-	MADataReader *reader = [MADataReader readerWithData:data];
-	UInt16 transitionID = [reader readUInt16];
-	UInt16 actionIndex = [reader readUInt16];
-	[self.delegate arduino:self willPerformActionAtIndex:actionIndex forTransitionWithID:transitionID];
+	[self sendUserSerialData]; // What came before
+	[self.delegate arduino:self didSendProfileSamples:samples count:count];
 }
 
 #pragma mark - Upload
 
-- (void)uploadCode:(NSString *)code error:(NSError **)error completion:(void(^)(BOOL success, NSString *output, NSString *errors))completion
+- (void)uploadCode:(MACodeSink *)code error:(NSError **)error completion:(void(^)(BOOL success, NSString *output, NSString *errors))completion
 {
+	if (self.simulatesBoard) {
+		[self simulateCode:code completion:completion];
+		return;
+	}
 	// Save sketch
-	NSString *messagingCodePath = [[NSBundle mainBundle] pathForResource:@"Messaging" ofType:@"h"];
-	NSString *sketchPath = [self saveSketchForCode:code additionalFiles:@[ messagingCodePath ]];
+	NSString *tableCodePath = [[NSBundle mainBundle] pathForResource:@"StateMachineTable" ofType:@"h"]; // Only included by table-driven code
+	NSString *sketchPath = [self saveSketchForCode:code additionalFiles:@[ tableCodePath ]];
+	if (sketchPath && ![self saveMessagingCodeNextToSketch:sketchPath]) sketchPath = nil;
 	if (!sketchPath) return;
+	// Build through the cache, if arduino-cli is set up
+	NSString *arduinoCLIPath = [[NSUserDefaults standardUserDefaults] stringForKey:kDefaultsKeyArduinoCLIPath];
+	if ([arduinoCLIPath length] > 0) {
+		[self buildAndUploadSketchAtPath:[sketchPath stringByDeletingLastPathComponent] arduinoCLIPath:[arduinoCLIPath stringByExpandingTildeInPath] completion:completion];
+		return;
+	}
 	// Get Arduino IDE path
 	NSString *arduinoAppPath = [MAArduinoIDE pathWithError:error];
 	if (*error) return;
@@ -254,6 +265,69 @@ typedef NS_ENUM(NSUInteger, MAMessageType) {
 	self.completionCallback = completion;
 }
 
+- (void)simulateCode:(MACodeSink *)code completion:(void(^)(BOOL success, NSString *output, NSString *errors))completion
+{
+	MASimulator *simulator = [[MASimulator alloc] init];
+	simulator.baudRate = self.baudRate;
+	simulator.inputScriptPath = [[[NSUserDefaults standardUserDefaults] stringForKey:kDefaultsKeySimulatorScript] stringByExpandingTildeInPath];
+	if ([[NSUserDefaults standardUserDefaults] objectForKey:kDefaultsKeySimulatorSpeed]) simulator.speed = MAX([[NSUserDefaults standardUserDefaults] doubleForKey:kDefaultsKeySimulatorSpeed], 0);
+	NSString *sketch = [code string];
+	// Built & started in the background, then connected to like a board
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSString *output = nil;
+		NSError *error = nil;
+		BOOL success = [simulator buildCode:sketch output:&output] && [simulator startWithError:&error];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (!success) {
+				[simulator terminate];
+				completion(NO, nil, [error localizedDescription] ?: output);
+				return;
+			}
+			self.serialPort = [ORSSerialPort serialPortWithPath:simulator.serialPortPath];
+			self.simulator = simulator;
+			completion(YES, [NSString stringWithFormat:@"Simulating on %@\n", simulator.serialPortPath], nil);
+		});
+	});
+}
+
+- (void)buildAndUploadSketchAtPath:(NSString *)sketchPath arduinoCLIPath:(NSString *)arduinoCLIPath completion:(void(^)(BOOL success, NSString *output, NSString *errors))completion
+{
+	if (!self.sketchBuilder || ![self.sketchBuilder.arduinoCLIPath isEqualToString:arduinoCLIPath]) {
+		self.sketchBuilder = [[MASketchBuilder alloc] init];
+		self.sketchBuilder.arduinoCLIPath = arduinoCLIPath;
+		NSInteger cacheSize = [[NSUserDefaults standardUserDefaults] integerForKey:kDefaultsKeyBuildCacheSize];
+		if (cacheSize > 0) self.sketchBuilder.cache.maximumSize = (unsigned long long)cacheSize * 1024 * 1024;
+	}
+	MASketchBuilder *builder = self.sketchBuilder;
+	builder.boardIdentifier = [self.board fullIdentifier];
+	NSString *port = self.serialPort.path;
+	unsigned long baudRate = self.baudRate;
+	// Built, checked against the board & uploaded in the background
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSMutableString *output = [NSMutableString string];
+		NSString *taskOutput = nil;
+		NSError *error = nil;
+		MASketchBuild *build = [builder buildSketchAtPath:sketchPath output:&taskOutput error:&error];
+		if (taskOutput) [output appendString:taskOutput];
+		if (build.isCached) [output appendFormat:@"Using the cached build %08X\n", (unsigned int)build.buildID];
+		BOOL success = (build != nil);
+		if (success && port) {
+			// Only a cached build can be on the board already
+			if (build.isCached && [MASketchBuilder buildIDRunningOnPort:port baudRate:baudRate timeout:kHelloTimeout] == build.buildID) {
+				[output appendString:@"The board already runs this build\n"];
+			} else {
+				taskOutput = nil;
+				success = [builder uploadBuild:build toPort:port output:&taskOutput error:&error];
+				if (taskOutput) [output appendString:taskOutput];
+			}
+		}
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (success) completion(YES, output, nil);
+			else completion(NO, nil, [output length] ? output : [error localizedDescription]);
+		});
+	});
+}
+
 - (void)workspaceDidLaunchApplication:(NSNotification *)notification
 {
 	NSRunningApplication *app = [notification userInfo][NSWorkspaceApplicationKey];
@@ -329,7 +403,7 @@ typedef NS_ENUM(NSUInteger, MAMessageType) {
 	}
 }
 
-- (NSString *)saveSketchForCode:(NSString *)code additionalFiles:(NSArray *)additionalFilePaths
+- (NSString *)saveSketchForCode:(MACodeSink *)code additionalFiles:(NSArray *)additionalFilePaths
 {
 	if (!self.tempDirectory.path) return nil;
 	// Prepare
@@ -342,8 +416,7 @@ typedef NS_ENUM(NSUInteger, MAMessageType) {
 	// Create .ino file
 	NSString *inoName = [sketchName stringByAppendingPathExtension:@"ino"];
 	NSString *inoPath = [directoryPath stringByAppendingPathComponent:inoName];
-	NSData *codeAsData = [code dataUsingEncoding:NSUTF8StringEncoding];
-	BOOL inoFileCreated = [fileManager createFileAtPath:inoPath contents:codeAsData attributes:nil];
+	BOOL inoFileCreated = [code writeToFile:inoPath error:nil]; // Already UTF-8, one write
 	if (!inoFileCreated) return nil;
 	// Add additional files
 	for (NSString *path in additionalFilePaths) {
@@ -357,4 +430,15 @@ typedef NS_ENUM(NSUInteger, MAMessageType) {
 	return inoPath;
 }
 
+- (BOOL)saveMessagingCodeNextToSketch:(NSString *)sketchPath
+{
+	// Messaging.h, built for our baud rate
+	NSString *messagingCodePath = [[NSBundle mainBundle] pathForResource:@"Messaging" ofType:@"h"];
+	NSString *messagingCode = [NSString stringWithContentsOfFile:messagingCodePath encoding:NSUTF8StringEncoding error:nil];
+	if (!messagingCode) return NO;
+	messagingCode = [[NSString stringWithFormat:kMessagingBaudRateDefinitionFormat, self.baudRate] stringByAppendingString:messagingCode];
+	NSString *targetPath = [[sketchPath stringByDeletingLastPathComponent] stringByAppendingPathComponent:[messagingCodePath lastPathComponent]];
+	return [messagingCode writeToFile:targetPath atomically:YES encoding:NSUTF8StringEncoding error:nil];
+}
+
 @end
@@ -9,8 +9,9 @@
 // CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
 // NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
-#import <Cocoa/Cocoa.h>
+#import "MAPlatform.h"
 
+@class CALayer;
 @class CATextLayer;
 @class CAShapeLayer;
 @class MANode;
@@ -25,6 +26,7 @@ typedef NS_ENUM(NSUInteger, MAArrowEnd) {
 @interface MACondition : NSObject <NSCoding>
 
 @property (nonatomic, copy, readonly) NSString *name;
+@property (nonatomic, readonly) BOOL isVolatile; // Named with a trailing '!', checked at every use even when conditions are memoized
 
 + (id)conditionWithName:(NSString *)name;
 
@@ -53,6 +55,7 @@ typedef NS_ENUM(NSUInteger, MAArrowEnd) {
 @property (nonatomic) CGPoint midPoint;
 @property (nonatomic, strong) MACondition *condition;
 @property (nonatomic, copy) NSArray *actions;
+#if !MACHINO_HEADLESS
 // Layers
 @property (nonatomic, strong) CAShapeLayer *layer;
 @property (nonatomic, strong) CAShapeLayer *tailLayer;
@@ -61,6 +64,7 @@ typedef NS_ENUM(NSUInteger, MAArrowEnd) {
 @property (nonatomic, strong) CATextLayer *conditionLayer;
 @property (nonatomic, strong) CATextLayer *slashLayer;
 @property (nonatomic, strong) CATextLayer *actionsLayer;
+#endif
 
 - (MANode *)nodeForEnd:(MAArrowEnd)end;
 - (void)setNode:(MANode *)node forEnd:(MAArrowEnd)end;
@@ -1,6 +1,6 @@
 #import "Graph.h"
 #import "MANodeInternal.h"
-#import "Utility.h"
+#import "NSMutableArray+Utility.h"
 
 static NSString * const kCoderConditionNameKey = @"name";
 static NSString * const kCoderActionNameKey = @"name";
@@ -12,6 +12,7 @@ static NSString * const kCoderSourceAngleKey = @"sourceAngle";
 static NSString * const kCoderTargetAngleKey = @"targetAngle";
 static NSString * const kCoderConditionKey = @"condition";
 static NSString * const kCoderActionsKey = @"actions";
+static NSString * const kConditionVolatileSuffix = @"!";
 
 #pragma mark - MACondition
 
@@ -38,6 +39,11 @@ static NSString * const kCoderActionsKey = @"actions";
 	[coder encodeObject:self.name forKey:kCoderConditionNameKey];
 }
 
+- (BOOL)isVolatile
+{
+	return [self.name hasSuffix:kConditionVolatileSuffix];
+}
+
 - (NSString *)description
 {
 	return self.name;
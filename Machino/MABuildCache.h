@@ -0,0 +1,33 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import <Foundation/Foundation.h>
+#import "MAPlatform.h"
+
+// Compiled sketches by a hash of everything that went into them (the sketch's files, the board and the toolchain), so
+// running the same code on the same board again goes straight to uploading. Each entry is a folder of build artifacts,
+// moved in whole so other processes never see half of one. Past the limits, the entries used longest ago are removed.
+@interface MABuildCache : NSObject
+
+@property (nonatomic, copy, readonly) NSString *directory;
+@property (nonatomic) unsigned long long maximumSize; // Bytes (default: 256 MB)
+@property (nonatomic) NSUInteger maximumEntryCount; // Default: 32
+
++ (NSString *)defaultDirectory; // Machino/Builds in the user's caches folder
++ (NSString *)keyForFiles:(NSDictionary *)files boardIdentifier:(NSString *)boardIdentifier toolchainVersion:(NSString *)toolchainVersion; // Files are NSData by relative path, the key is a SHA-256 in hex
++ (UInt32)buildIDForKey:(NSString *)key; // Its first 32 bits (never 0), which a sketch built from it sends in its hello
+
+- (id)initWithDirectory:(NSString *)directory;
+- (NSString *)artifactsPathForKey:(NSString *)key; // Nil if it isn't cached, marks it as used otherwise
+- (NSString *)storeArtifactsAtPath:(NSString *)path forKey:(NSString *)key error:(NSError **)error; // Moves the folder in and evicts, returns its new path
+- (NSUInteger)evictEntries; // Down to the limits, least recently used first, returns how many were removed
+- (unsigned long long)size; // Of all entries
+
+@end
@@ -0,0 +1,282 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MABuildCache.h"
+#import <stdio.h>
+#import <errno.h>
+
+static const unsigned long long kDefaultMaximumSize = 256 * 1024 * 1024;
+static const NSUInteger kDefaultMaximumEntryCount = 32;
+static NSString * const kKeyFormatVersion = @"machino-build-1"; // Change to start over with new keys
+static NSString * const kIncomingPrefix = @".incoming-";
+static const NSTimeInterval kIncomingMaximumAge = 60 * 60; // Left behind by a process that quit halfway
+static NSString * const kEntryPathKey = @"path";
+static NSString * const kEntryDateKey = @"date";
+static NSString * const kEntrySizeKey = @"size";
+
+#pragma mark - SHA-256
+
+typedef struct {
+	UInt32 state[8];
+	Byte block[64];
+	NSUInteger blockLength;
+	UInt64 length; // Bytes
+} MASHA256Context;
+
+static const UInt32 kSHA256RoundConstants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define MARotateRight(value, count) (((value) >> (count)) | ((value) << (32 - (count))))
+
+static void MASHA256Initialize(MASHA256Context *context)
+{
+	static const UInt32 kInitialState[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	memcpy(context->state, kInitialState, sizeof(kInitialState));
+	context->blockLength = 0;
+	context->length = 0;
+}
+
+static void MASHA256Transform(MASHA256Context *context)
+{
+	UInt32 words[64];
+	for (int i = 0; i < 16; i++) {
+		const Byte *bytes = &context->block[i*4];
+		words[i] = ((UInt32)bytes[0] << 24) | ((UInt32)bytes[1] << 16) | ((UInt32)bytes[2] << 8) | bytes[3];
+	}
+	for (int i = 16; i < 64; i++) {
+		UInt32 s0 = MARotateRight(words[i-15], 7) ^ MARotateRight(words[i-15], 18) ^ (words[i-15] >> 3);
+		UInt32 s1 = MARotateRight(words[i-2], 17) ^ MARotateRight(words[i-2], 19) ^ (words[i-2] >> 10);
+		words[i] = words[i-16] + s0 + words[i-7] + s1;
+	}
+	UInt32 a = context->state[0], b = context->state[1], c = context->state[2], d = context->state[3];
+	UInt32 e = context->state[4], f = context->state[5], g = context->state[6], h = context->state[7];
+	for (int i = 0; i < 64; i++) {
+		UInt32 t1 = h + (MARotateRight(e, 6) ^ MARotateRight(e, 11) ^ MARotateRight(e, 25)) + ((e & f) ^ (~e & g)) + kSHA256RoundConstants[i] + words[i];
+		UInt32 t2 = (MARotateRight(a, 2) ^ MARotateRight(a, 13) ^ MARotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	context->state[0] += a; context->state[1] += b; context->state[2] += c; context->state[3] += d;
+	context->state[4] += e; context->state[5] += f; context->state[6] += g; context->state[7] += h;
+}
+
+static void MASHA256Update(MASHA256Context *context, const void *data, NSUInteger length)
+{
+	const Byte *bytes = data;
+	context->length += length;
+	while (length > 0) {
+		NSUInteger count = MIN(64 - context->blockLength, length);
+		memcpy(&context->block[context->blockLength], bytes, count);
+		context->blockLength += count;
+		bytes += count;
+		length -= count;
+		if (context->blockLength == 64) {
+			MASHA256Transform(context);
+			context->blockLength = 0;
+		}
+	}
+}
+
+static void MASHA256Finish(MASHA256Context *context, Byte digest[32])
+{
+	// Padding: a 1 bit, zeros, then the length in bits (big-endian)
+	UInt64 bitLength = context->length * 8;
+	Byte padding = 0x80;
+	MASHA256Update(context, &padding, 1);
+	padding = 0;
+	while (context->blockLength != 56) MASHA256Update(context, &padding, 1);
+	Byte lengthBytes[8];
+	for (int i = 0; i < 8; i++) lengthBytes[i] = (Byte)(bitLength >> (56 - i*8));
+	MASHA256Update(context, lengthBytes, 8);
+	for (int i = 0; i < 32; i++) digest[i] = (Byte)(context->state[i/4] >> (24 - (i%4)*8));
+}
+
+static void MASHA256UpdateField(MASHA256Context *context, const void *data, NSUInteger length)
+{
+	// Length first, so no two sets of fields hash the same bytes
+	Byte lengthBytes[8];
+	for (int i = 0; i < 8; i++) lengthBytes[i] = (Byte)((UInt64)length >> (i*8));
+	MASHA256Update(context, lengthBytes, 8);
+	MASHA256Update(context, data, length);
+}
+
+static void MASHA256UpdateString(MASHA256Context *context, NSString *string)
+{
+	NSData *data = [(string ?: @"") dataUsingEncoding:NSUTF8StringEncoding];
+	MASHA256UpdateField(context, [data bytes], [data length]);
+}
+
+#pragma mark - Private Interface
+
+@interface MABuildCache ()
+
+@property (nonatomic, copy, readwrite) NSString *directory;
+
+@end
+
+#pragma mark - MABuildCache
+
+@implementation MABuildCache
+
++ (NSString *)defaultDirectory
+{
+	NSString *cachesDirectory = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) firstObject];
+	if (!cachesDirectory) cachesDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:NSUserName()];
+	return [cachesDirectory stringByAppendingPathComponent:@"Machino/Builds"];
+}
+
++ (NSString *)keyForFiles:(NSDictionary *)files boardIdentifier:(NSString *)boardIdentifier toolchainVersion:(NSString *)toolchainVersion
+{
+	MASHA256Context context;
+	MASHA256Initialize(&context);
+	MASHA256UpdateString(&context, kKeyFormatVersion);
+	MASHA256UpdateString(&context, boardIdentifier);
+	MASHA256UpdateString(&context, toolchainVersion);
+	for (NSString *path in [[files allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+		NSData *data = files[path];
+		MASHA256UpdateString(&context, path);
+		MASHA256UpdateField(&context, [data bytes], [data length]);
+	}
+	Byte digest[32];
+	MASHA256Finish(&context, digest);
+	NSMutableString *key = [NSMutableString stringWithCapacity:64];
+	for (int i = 0; i < 32; i++) {
+		[key appendFormat:@"%02x", digest[i]];
+	}
+	return key;
+}
+
++ (UInt32)buildIDForKey:(NSString *)key
+{
+	if ([key length] < 8) return 1;
+	unsigned long long buildID = strtoull([[key substringToIndex:8] UTF8String], NULL, 16);
+	return (buildID != 0) ? (UInt32)buildID : 1; // 0 is a sketch without one
+}
+
+#pragma mark - Initialization
+
+- (id)initWithDirectory:(NSString *)directory
+{
+	self = [super init];
+	if (self) {
+		_directory = [directory copy];
+		_maximumSize = kDefaultMaximumSize;
+		_maximumEntryCount = kDefaultMaximumEntryCount;
+	}
+	return self;
+}
+
+#pragma mark - Entries
+
+- (NSString *)artifactsPathForKey:(NSString *)key
+{
+	NSString *path = [self.directory stringByAppendingPathComponent:key];
+	BOOL isDirectory = NO;
+	if (![[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&isDirectory] || !isDirectory) return nil;
+	// Its modification date is when it was last used
+	[[NSFileManager defaultManager] setAttributes:@{ NSFileModificationDate : [NSDate date] } ofItemAtPath:path error:nil];
+	return path;
+}
+
+- (NSString *)storeArtifactsAtPath:(NSString *)artifactsPath forKey:(NSString *)key error:(NSError **)error
+{
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	if (![fileManager createDirectoryAtPath:self.directory withIntermediateDirectories:YES attributes:nil error:error]) return nil;
+	// Moved next to the entry first (the artifacts may be on another volume), then renamed into place in one go
+	NSString *incomingName = [kIncomingPrefix stringByAppendingString:[[NSProcessInfo processInfo] globallyUniqueString]];
+	NSString *incomingPath = [self.directory stringByAppendingPathComponent:incomingName];
+	if (![fileManager moveItemAtPath:artifactsPath toPath:incomingPath error:error]) return nil;
+	NSString *path = [self.directory stringByAppendingPathComponent:key];
+	if (rename([incomingPath fileSystemRepresentation], [path fileSystemRepresentation]) != 0) {
+		int renameError = errno;
+		[fileManager removeItemAtPath:incomingPath error:nil];
+		if (![self artifactsPathForKey:key]) { // Not stored by another process meanwhile
+			if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:renameError userInfo:nil];
+			return nil;
+		}
+	}
+	[fileManager setAttributes:@{ NSFileModificationDate : [NSDate date] } ofItemAtPath:path error:nil];
+	[self evictEntriesKeepingKey:key];
+	return path;
+}
+
+- (NSUInteger)evictEntries
+{
+	return [self evictEntriesKeepingKey:nil];
+}
+
+- (NSUInteger)evictEntriesKeepingKey:(NSString *)keptKey
+{
+	NSArray *entries = [self entries];
+	unsigned long long size = 0;
+	for (NSDictionary *entry in entries) {
+		size += [entry[kEntrySizeKey] unsignedLongLongValue];
+	}
+	// Least recently used first
+	entries = [entries sortedArrayUsingComparator:^NSComparisonResult(NSDictionary *entry1, NSDictionary *entry2) {
+		return [entry1[kEntryDateKey] compare:entry2[kEntryDateKey]];
+	}];
+	NSUInteger entryCount = [entries count];
+	NSUInteger removedCount = 0;
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	for (NSDictionary *entry in entries) {
+		if (size <= self.maximumSize && entryCount <= self.maximumEntryCount) break;
+		NSString *path = entry[kEntryPathKey];
+		if ([[path lastPathComponent] isEqualToString:keptKey]) continue; // Even if it's over the limit by itself
+		if (![fileManager removeItemAtPath:path error:nil]) continue;
+		size -= [entry[kEntrySizeKey] unsignedLongLongValue];
+		entryCount--;
+		removedCount++;
+	}
+	return removedCount;
+}
+
+- (unsigned long long)size
+{
+	unsigned long long size = 0;
+	for (NSDictionary *entry in [self entries]) {
+		size += [entry[kEntrySizeKey] unsignedLongLongValue];
+	}
+	return size;
+}
+
+- (NSArray *)entries
+{
+	// Removes what was left incoming on the way
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	NSMutableArray *entries = [NSMutableArray array];
+	for (NSString *name in [fileManager contentsOfDirectoryAtPath:self.directory error:nil]) {
+		NSString *path = [self.directory stringByAppendingPathComponent:name];
+		NSDictionary *attributes = [fileManager attributesOfItemAtPath:path error:nil];
+		if (![[attributes fileType] isEqualToString:NSFileTypeDirectory]) continue;
+		if ([name hasPrefix:kIncomingPrefix]) {
+			if (-[[attributes fileModificationDate] timeIntervalSinceNow] > kIncomingMaximumAge) [fileManager removeItemAtPath:path error:nil];
+			continue;
+		}
+		if ([name hasPrefix:@"."]) continue;
+		unsigned long long size = 0;
+		NSDirectoryEnumerator *enumerator = [fileManager enumeratorAtPath:path];
+		while ([enumerator nextObject]) {
+			size += [[enumerator fileAttributes] fileSize];
+		}
+		[entries addObject:@{ kEntryPathKey : path, kEntryDateKey : [attributes fileModificationDate] ?: [NSDate distantPast], kEntrySizeKey : @(size) }];
+	}
+	return entries;
+}
+
+@end
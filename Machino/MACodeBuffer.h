@@ -0,0 +1,32 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Piece table holding the code of a template. Characters are only ever appended to one backing store, and the pieces
+// referencing it are kept in a treap ordered by offset, so replacing or extracting text costs O(log n) plus the length of
+// the text involved. Appending to the end (as templates do while writing) just extends the last piece.
+@interface MACodeBuffer : NSObject
+
+- (id)initWithString:(NSString *)string;
+
+- (NSUInteger)length;
+- (unichar)characterAtIndex:(NSUInteger)index;
+- (void)getCharacters:(unichar *)characters range:(NSRange)range;
+- (NSString *)string;
+- (NSString *)substringWithRange:(NSRange)range;
+- (NSRange)lineRangeForRange:(NSRange)range; // Like NSString's
+- (void)appendString:(NSString *)string;
+- (void)appendCharacters:(const unichar *)characters length:(NSUInteger)length;
+- (void)enumerateCharactersUsingBlock:(void(^)(const unichar *characters, NSUInteger length))block; // Piece by piece, in order
+- (void)replaceCharactersInRange:(NSRange)range withString:(NSString *)string;
+
+@end
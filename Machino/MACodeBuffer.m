@@ -0,0 +1,397 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MACodeBuffer.h"
+
+static const NSUInteger kMinimumCompactionGarbage = 4096; // Characters no longer referenced before compacting the store
+static const NSUInteger kCharacterChunkLength = 256; // Characters copied at a time, on the stack
+
+#pragma mark - Piece Table
+
+typedef struct {
+	NSUInteger start; // In the character store
+	NSUInteger length;
+	NSUInteger subtreeLength;
+	UInt32 priority;
+	UInt32 left; // Piece indexes, 0 is none
+	UInt32 right;
+} MAPiece;
+
+typedef struct {
+	unichar *characters;
+	NSUInteger characterCount;
+	NSUInteger characterCapacity;
+	MAPiece *pieces; // Index 0 is unused, so 0 can mean none
+	UInt32 pieceCount;
+	UInt32 pieceCapacity;
+	UInt32 freePiece; // Free list, linked through left
+	UInt32 root;
+	UInt32 randomState;
+} MAPieceTable;
+
+static NSUInteger MAPieceSubtreeLength(MAPieceTable *table, UInt32 piece)
+{
+	return piece ? table->pieces[piece].subtreeLength : 0;
+}
+
+static void MAPieceUpdate(MAPieceTable *table, UInt32 piece)
+{
+	MAPiece *p = &table->pieces[piece];
+	p->subtreeLength = p->length + MAPieceSubtreeLength(table, p->left) + MAPieceSubtreeLength(table, p->right);
+}
+
+static UInt32 MAPieceTableRandom(MAPieceTable *table)
+{
+	UInt32 x = table->randomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	table->randomState = x;
+	return x;
+}
+
+static UInt32 MAPieceCreate(MAPieceTable *table, NSUInteger start, NSUInteger length)
+{
+	UInt32 piece = table->freePiece;
+	if (piece) {
+		table->freePiece = table->pieces[piece].left;
+	} else {
+		if (table->pieceCount == table->pieceCapacity) {
+			table->pieceCapacity = MAX(table->pieceCapacity * 2, 16);
+			table->pieces = realloc(table->pieces, table->pieceCapacity * sizeof(MAPiece));
+		}
+		piece = table->pieceCount++;
+	}
+	MAPiece *p = &table->pieces[piece];
+	p->start = start;
+	p->length = length;
+	p->subtreeLength = length;
+	p->priority = MAPieceTableRandom(table);
+	p->left = 0;
+	p->right = 0;
+	return piece;
+}
+
+static void MAPieceFreeSubtree(MAPieceTable *table, UInt32 piece)
+{
+	if (!piece) return;
+	MAPieceFreeSubtree(table, table->pieces[piece].left);
+	MAPieceFreeSubtree(table, table->pieces[piece].right);
+	table->pieces[piece].left = table->freePiece;
+	table->freePiece = piece;
+}
+
+static UInt32 MAPieceMerge(MAPieceTable *table, UInt32 left, UInt32 right)
+{
+	if (!left) return right;
+	if (!right) return left;
+	if (table->pieces[left].priority >= table->pieces[right].priority) {
+		UInt32 merged = MAPieceMerge(table, table->pieces[left].right, right);
+		table->pieces[left].right = merged;
+		MAPieceUpdate(table, left);
+		return left;
+	} else {
+		UInt32 merged = MAPieceMerge(table, left, table->pieces[right].left);
+		table->pieces[right].left = merged;
+		MAPieceUpdate(table, right);
+		return right;
+	}
+}
+
+// Splits the pieces under piece into the first offset characters and the rest, cutting a piece in two if needed
+static void MAPieceSplit(MAPieceTable *table, UInt32 piece, NSUInteger offset, UInt32 *left, UInt32 *right)
+{
+	if (!piece) {
+		*left = 0;
+		*right = 0;
+		return;
+	}
+	NSUInteger leftLength = MAPieceSubtreeLength(table, table->pieces[piece].left);
+	NSUInteger length = table->pieces[piece].length;
+	if (offset <= leftLength) {
+		UInt32 rest;
+		MAPieceSplit(table, table->pieces[piece].left, offset, left, &rest);
+		table->pieces[piece].left = rest;
+		MAPieceUpdate(table, piece);
+		*right = piece;
+	} else if (offset >= leftLength + length) {
+		UInt32 rest;
+		MAPieceSplit(table, table->pieces[piece].right, offset - leftLength - length, &rest, right);
+		table->pieces[piece].right = rest;
+		MAPieceUpdate(table, piece);
+		*left = piece;
+	} else {
+		NSUInteger cut = offset - leftLength;
+		UInt32 tail = MAPieceCreate(table, table->pieces[piece].start + cut, length - cut); // May move the pieces
+		UInt32 oldRight = table->pieces[piece].right;
+		table->pieces[piece].length = cut;
+		table->pieces[piece].right = 0;
+		MAPieceUpdate(table, piece);
+		*left = piece;
+		*right = MAPieceMerge(table, tail, oldRight);
+	}
+}
+
+static NSUInteger MAPieceTableLength(MAPieceTable *table)
+{
+	return MAPieceSubtreeLength(table, table->root);
+}
+
+static NSUInteger MAPieceTableStore(MAPieceTable *table, const unichar *characters, NSUInteger length)
+{
+	if (table->characterCount + length > table->characterCapacity) {
+		table->characterCapacity = MAX(table->characterCapacity * 2, table->characterCount + length);
+		table->characters = realloc(table->characters, table->characterCapacity * sizeof(unichar));
+	}
+	NSUInteger start = table->characterCount;
+	memcpy(table->characters + start, characters, length * sizeof(unichar));
+	table->characterCount += length;
+	return start;
+}
+
+static void MAPieceTableGetCharacters(MAPieceTable *table, UInt32 piece, NSUInteger location, NSUInteger length, unichar *out)
+{
+	// Copies [location, location+length) of the subtree under piece
+	while (piece && length > 0) {
+		MAPiece *p = &table->pieces[piece];
+		NSUInteger leftLength = MAPieceSubtreeLength(table, p->left);
+		if (location < leftLength) {
+			NSUInteger leftPart = MIN(length, leftLength - location);
+			MAPieceTableGetCharacters(table, p->left, location, leftPart, out);
+			out += leftPart;
+			length -= leftPart;
+			location = leftLength;
+		}
+		if (length == 0) return;
+		NSUInteger offset = location - leftLength;
+		if (offset < p->length) {
+			NSUInteger part = MIN(length, p->length - offset);
+			memcpy(out, table->characters + p->start + offset, part * sizeof(unichar));
+			out += part;
+			length -= part;
+			location += part;
+		}
+		// Continue in the right subtree
+		location -= leftLength + p->length;
+		piece = p->right;
+	}
+}
+
+static void MAPieceTableEnumerate(MAPieceTable *table, UInt32 piece, void(^block)(const unichar *characters, NSUInteger length))
+{
+	// In order, iterating down the right spine
+	while (piece) {
+		MAPiece *p = &table->pieces[piece];
+		MAPieceTableEnumerate(table, p->left, block);
+		if (p->length > 0) block(table->characters + p->start, p->length);
+		piece = p->right;
+	}
+}
+
+static void MAPieceTableAppend(MAPieceTable *table, const unichar *characters, NSUInteger length)
+{
+	if (length == 0) return;
+	NSUInteger start = MAPieceTableStore(table, characters, length);
+	// Extend the last piece if it ends where the new characters start
+	UInt32 last = table->root;
+	while (last && table->pieces[last].right) last = table->pieces[last].right;
+	if (last && table->pieces[last].start + table->pieces[last].length == start) {
+		for (UInt32 piece = table->root; piece; piece = table->pieces[piece].right) {
+			table->pieces[piece].subtreeLength += length;
+		}
+		table->pieces[last].length += length;
+		return;
+	}
+	UInt32 piece = MAPieceCreate(table, start, length);
+	table->root = MAPieceMerge(table, table->root, piece);
+}
+
+static void MAPieceTableCompact(MAPieceTable *table)
+{
+	NSUInteger length = MAPieceTableLength(table);
+	unichar *characters = malloc(MAX(length, 1) * sizeof(unichar));
+	MAPieceTableGetCharacters(table, table->root, 0, length, characters);
+	free(table->characters);
+	table->characters = characters;
+	table->characterCount = length;
+	table->characterCapacity = MAX(length, 1);
+	table->pieceCount = 1;
+	table->freePiece = 0;
+	table->root = length ? MAPieceCreate(table, 0, length) : 0;
+}
+
+static void MAPieceTableReplace(MAPieceTable *table, NSUInteger location, NSUInteger length, const unichar *characters, NSUInteger newLength)
+{
+	UInt32 before, rest, replaced, after;
+	MAPieceSplit(table, table->root, location, &before, &rest);
+	MAPieceSplit(table, rest, length, &replaced, &after);
+	MAPieceFreeSubtree(table, replaced);
+	UInt32 inserted = 0;
+	if (newLength > 0) {
+		NSUInteger start = MAPieceTableStore(table, characters, newLength);
+		inserted = MAPieceCreate(table, start, newLength);
+	}
+	table->root = MAPieceMerge(table, MAPieceMerge(table, before, inserted), after);
+	// Drop replaced characters once they dominate the store
+	NSUInteger garbage = table->characterCount - MAPieceTableLength(table);
+	if (garbage > kMinimumCompactionGarbage && garbage > MAPieceTableLength(table)) MAPieceTableCompact(table);
+}
+
+#pragma mark - Private Interface
+
+@interface MACodeBuffer ()
+{
+	MAPieceTable _table;
+}
+
+@end
+
+#pragma mark - Implementation
+
+@implementation MACodeBuffer
+
+- (id)init
+{
+	return [self initWithString:nil];
+}
+
+- (id)initWithString:(NSString *)string
+{
+	self = [super init];
+	if (self) {
+		_table.pieceCount = 1;
+		_table.pieceCapacity = 16;
+		_table.pieces = calloc(_table.pieceCapacity, sizeof(MAPiece));
+		_table.randomState = 2463534242;
+		if (string) [self appendString:string];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	free(_table.characters);
+	free(_table.pieces);
+}
+
+- (NSUInteger)length
+{
+	return MAPieceTableLength(&_table);
+}
+
+- (unichar)characterAtIndex:(NSUInteger)index
+{
+	NSAssert(index < [self length], @"Index out of bounds.");
+	unichar character;
+	MAPieceTableGetCharacters(&_table, _table.root, index, 1, &character);
+	return character;
+}
+
+- (void)getCharacters:(unichar *)characters range:(NSRange)range
+{
+	NSAssert(NSMaxRange(range) <= [self length], @"Range out of bounds.");
+	MAPieceTableGetCharacters(&_table, _table.root, range.location, range.length, characters);
+}
+
+- (NSString *)string
+{
+	return [self substringWithRange:NSMakeRange(0, [self length])];
+}
+
+- (NSString *)substringWithRange:(NSRange)range
+{
+	if (range.length == 0) return @"";
+	unichar *characters = malloc(range.length * sizeof(unichar));
+	[self getCharacters:characters range:range];
+	return [[NSString alloc] initWithCharactersNoCopy:characters length:range.length freeWhenDone:YES];
+}
+
+- (NSRange)lineRangeForRange:(NSRange)range
+{
+	NSUInteger length = [self length];
+	unichar window[kCharacterChunkLength];
+	// Back to the start of the line
+	NSUInteger start = range.location;
+	BOOL foundStart = NO;
+	while (start > 0 && !foundStart) {
+		NSUInteger windowLength = MIN(start, kCharacterChunkLength);
+		[self getCharacters:window range:NSMakeRange(start - windowLength, windowLength)];
+		for (NSUInteger i = windowLength; i > 0; i--) {
+			if ([self isLineSeparator:window[i-1]]) {
+				foundStart = YES;
+				break;
+			}
+			start--;
+		}
+	}
+	// Forward past the end of the line, unless the range already ends with a separator
+	NSUInteger end = NSMaxRange(range);
+	if (range.length > 0 && [self isLineSeparator:[self characterAtIndex:end-1]]) {
+		if ([self characterAtIndex:end-1] == '\r' && end < length && [self characterAtIndex:end] == '\n') end++;
+		return NSMakeRange(start, end - start);
+	}
+	while (end < length) {
+		NSUInteger windowLength = MIN(length - end, kCharacterChunkLength);
+		[self getCharacters:window range:NSMakeRange(end, windowLength)];
+		for (NSUInteger i = 0; i < windowLength; i++) {
+			unichar character = window[i];
+			end++;
+			if ([self isLineSeparator:character]) {
+				if (character == '\r' && end < length && [self characterAtIndex:end] == '\n') end++;
+				return NSMakeRange(start, end - start);
+			}
+		}
+	}
+	return NSMakeRange(start, end - start);
+}
+
+- (BOOL)isLineSeparator:(unichar)character
+{
+	return (character == '\n' || character == '\r' || character == 0x85 || character == 0x2028 || character == 0x2029);
+}
+
+- (void)appendString:(NSString *)string
+{
+	NSUInteger length = [string length];
+	unichar characters[kCharacterChunkLength];
+	for (NSUInteger location = 0; location < length; location += kCharacterChunkLength) {
+		NSUInteger chunkLength = MIN(length - location, kCharacterChunkLength);
+		[string getCharacters:characters range:NSMakeRange(location, chunkLength)];
+		MAPieceTableAppend(&_table, characters, chunkLength);
+	}
+}
+
+- (void)appendCharacters:(const unichar *)characters length:(NSUInteger)length
+{
+	MAPieceTableAppend(&_table, characters, length);
+}
+
+- (void)enumerateCharactersUsingBlock:(void(^)(const unichar *characters, NSUInteger length))block
+{
+	MAPieceTableEnumerate(&_table, _table.root, block);
+}
+
+- (void)replaceCharactersInRange:(NSRange)range withString:(NSString *)string
+{
+	NSAssert(NSMaxRange(range) <= [self length], @"Range out of bounds.");
+	NSUInteger length = [string length];
+	unichar *characters = malloc(MAX(length, 1) * sizeof(unichar));
+	[string getCharacters:characters range:NSMakeRange(0, length)];
+	MAPieceTableReplace(&_table, range.location, range.length, characters, length);
+	free(characters);
+}
+
+- (NSString *)description
+{
+	return [self string];
+}
+
+@end
@@ -16,6 +16,7 @@
 @class MAAction;
 @class MAStateMachineCodeTemplate;
 @class MAHighlightingTextView;
+@class MACodeSink;
 @protocol MACodeControllerDelegate;
 
 @interface MACodeController : NSObject
@@ -27,8 +28,10 @@
 @property (nonatomic, strong) id executionItem;
 
 - (void)updateCodeForStates:(NSArray *)states transitions:(NSArray *)transitions;
+- (void)updateCodeForStates:(NSArray *)states transitions:(NSArray *)transitions changes:(NSArray *)changes; // In the background, only rewriting what the MAGraphChange's affected
+- (void)flushCodeUpdates; // Shows the code of the latest graph now, rather than once the background generation finishes
 - (NSString *)code;
-- (NSString *)codeWithLogging;
+- (void)writeCodeWithLoggingToSink:(MACodeSink *)sink;
 - (id)objectForSymbolWithID:(UInt64)symbolID;
 - (void)setCodeTemplate:(MAStateMachineCodeTemplate *)codeTemplate mergeOldCode:(BOOL)mergeOldCode;
 // Highlighting & click
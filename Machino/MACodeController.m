@@ -11,18 +11,24 @@
 
 #import "MACodeController.h"
 #import "MAStateMachineCodeTemplate.h"
+#import "MACodeGenerator.h"
 #import "MAHighlightingTextView.h"
 #import "MASymbolManager.h"
 #import "Graph.h"
 #import "Utility.h"
 
 static NSString * const kIndentString = @"  ";
+static NSString * const kDefaultsKeyTableDrivenStateMachines = @"TableDrivenStateMachines"; // Hidden setting, smaller sketches for large graphs
+static NSString * const kDefaultsKeyMemoizeConditions = @"MemoizeConditions"; // Hidden setting, for slow conditions used by many transitions
+static NSString * const kDefaultsKeyChangeOnlyLogging = @"ChangeOnlyLogging"; // Hidden setting, for busy or slow serial links
+static NSString * const kDefaultsKeyProfileStateMachines = @"ProfileStateMachines"; // Hidden setting, runs send timing summaries instead of events
 
 #pragma mark - Private Interface
 
 @interface MACodeController () <NSTextViewDelegate, NSTextStorageDelegate, MAHighlightingTextViewDelegate>
 
 @property (nonatomic, strong, readwrite) MAStateMachineCodeTemplate *codeTemplate;
+@property (nonatomic, strong, readonly) MACodeGenerator *generator; // Off the main thread, except for the initial code & runs
 @property (nonatomic, strong) NSDictionary *uneditableTextAttributes;
 @property (nonatomic, strong) NSDictionary *editableTextAttributes;
 @property (nonatomic) BOOL suppressTextStorageEditEvents;
@@ -39,6 +45,8 @@ static NSString * const kIndentString = @"  ";
 - (void)awakeFromNib
 {
 	self->_hoveredItems = [NSMutableArray array];
+	self->_generator = [[MACodeGenerator alloc] init];
+	self.generator.indentString = kIndentString;
 	// Listen to scroll view notification
 	[self.codeScrollView setPostsBoundsChangedNotifications:YES];
 	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(scrollViewContentViewBoundsDidChange:) name:NSViewBoundsDidChangeNotification object:[self.codeScrollView contentView]];
@@ -187,87 +195,88 @@ static NSString * const kIndentString = @"  ";
 	self.codeTemplate = codeTemplate;
 }
 
+- (void)setCodeTemplate:(MAStateMachineCodeTemplate *)codeTemplate
+{
+	_codeTemplate = codeTemplate;
+	self.generator.codeTemplate = codeTemplate; // Its code is what the user edits
+}
+
 - (void)updateCodeForStates:(NSArray *)states transitions:(NSArray *)transitions
 {
-	self.codeTemplate = [self codeTemplateForStates:states transitions:transitions insertLoggingCode:NO];
-	// Apply attributes
-	NSString *code = [self.codeTemplate code];
-	NSMutableAttributedString *codeAttributed = [[NSMutableAttributedString alloc] initWithString:code attributes:self.uneditableTextAttributes];
-	NSArray *editableRanges = [[self.codeTemplate editableRanges] allValues];
-	for (NSValue *rangeObject in editableRanges) {
-		NSRange range = [rangeObject rangeValue];
-		[codeAttributed setAttributes:self.editableTextAttributes range:range];
+	MAStateMachineCodeTemplate *codeTemplate = [self.generator codeForStates:states transitions:transitions options:[self codeTemplateOptionsWithLoggingCode:NO]];
+	[self showCodeTemplate:codeTemplate replacingAllCode:YES];
+}
+
+- (void)updateCodeForStates:(NSArray *)states transitions:(NSArray *)transitions changes:(NSArray *)changes
+{
+	if (!self.codeTemplate) {
+		[self updateCodeForStates:states transitions:transitions];
+		return;
 	}
-	// Set code
+	__weak MACodeController *controller = self;
+	[self.generator requestCodeForStates:states transitions:transitions changes:changes options:[self codeTemplateOptionsWithLoggingCode:NO] completion:^(MAStateMachineCodeTemplate *codeTemplate) {
+		[controller showCodeTemplate:codeTemplate replacingAllCode:NO];
+	}];
+}
+
+- (void)flushCodeUpdates
+{
+	[self.generator flushRequests];
+}
+
+- (void)showCodeTemplate:(MAStateMachineCodeTemplate *)codeTemplate replacingAllCode:(BOOL)replacesAllCode
+{
+	MAStateMachineCodeTemplate *oldTemplate = self.codeTemplate;
+	NSTextStorage *textStorage = [self.codeTextView textStorage];
+	BOOL isInSync = ([textStorage length] == [oldTemplate codeLength]);
+	BOOL canEdit = (!replacesAllCode && oldTemplate && isInSync);
+	self.codeTemplate = codeTemplate;
 	self.suppressTextStorageEditEvents = YES;
-	CGPoint scrollOffset = [self.codeScrollView documentVisibleRect].origin;
-	[[self.codeTextView textStorage] setAttributedString:codeAttributed];
-	[[self.codeScrollView documentView] scrollPoint:scrollOffset];
+	if (canEdit) {
+		// Apply only the edits, back to front so earlier ranges stay valid
+		NSArray *edits = [codeTemplate editsFromTemplate:oldTemplate];
+		[textStorage beginEditing];
+		for (MACodeEdit *edit in [edits reverseObjectEnumerator]) {
+			[textStorage replaceCharactersInRange:edit.replacedRange withAttributedString:[self attributedCodeInRange:edit.range]];
+		}
+		[textStorage endEditing];
+	} else {
+		// Set code
+		NSRange range = NSMakeRange(0, [codeTemplate codeLength]);
+		CGPoint scrollOffset = [self.codeScrollView documentVisibleRect].origin;
+		[textStorage setAttributedString:[self attributedCodeInRange:range]];
+		[[self.codeScrollView documentView] scrollPoint:scrollOffset];
+	}
 	self.suppressTextStorageEditEvents = NO;
 }
 
-- (MAStateMachineCodeTemplate *)codeTemplateForStates:(NSArray *)states transitions:(NSArray *)transitions insertLoggingCode:(BOOL)insertLoggingCode
+- (NSAttributedString *)attributedCodeInRange:(NSRange)range
 {
-	MAStateMachineCodeTemplate *oldTemplate = self.codeTemplate;
-	MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];;
-	template.states = states;
-	template.transitions = transitions;
-	template.options = insertLoggingCode ? MAInsertLoggingCode : 0;
-	template.indentString = kIndentString;
-	template.symbols = oldTemplate.symbols; // Reuse symbols to persist id's
-	[template generate];
-	[self mergeCodeFromOldTemplate:oldTemplate intoNewTemplate:template];
-	return template;
+	NSString *code = [self.codeTemplate codeInRange:range];
+	NSMutableAttributedString *codeAttributed = [[NSMutableAttributedString alloc] initWithString:code attributes:self.uneditableTextAttributes];
+	// Apply attributes
+	for (id key in [self.codeTemplate keysForEditableRangesTouchingRange:range]) {
+		NSRange editableRange = NSIntersectionRange([self.codeTemplate editableRangeForKey:key], range);
+		if (editableRange.length == 0) continue;
+		editableRange.location -= range.location;
+		[codeAttributed setAttributes:self.editableTextAttributes range:editableRange];
+	}
+	return codeAttributed;
+}
+
+- (MAStateMachineCodeTemplateOptions)codeTemplateOptionsWithLoggingCode:(BOOL)insertLoggingCode
+{
+	MAStateMachineCodeTemplateOptions options = insertLoggingCode ? MAInsertLoggingCode : 0;
+	if ([[NSUserDefaults standardUserDefaults] boolForKey:kDefaultsKeyTableDrivenStateMachines]) options |= MATableDrivenStateMachines;
+	if ([[NSUserDefaults standardUserDefaults] boolForKey:kDefaultsKeyMemoizeConditions]) options |= MAMemoizeConditions;
+	if ([[NSUserDefaults standardUserDefaults] boolForKey:kDefaultsKeyChangeOnlyLogging]) options |= MAChangeOnlyLogging;
+	if ([[NSUserDefaults standardUserDefaults] boolForKey:kDefaultsKeyProfileStateMachines]) options |= MAProfiling;
+	return options;
 }
 
 - (void)mergeCodeFromOldTemplate:(MACodeTemplate *)oldTemplate intoNewTemplate:(MACodeTemplate *)newTemplate
 {
-	if (!oldTemplate) return;
-	// Prepare
-	NSArray *sortedOldKeys = [oldTemplate keysForEditableRangesInOrder];
-	NSArray *sortedNewKeys = [newTemplate keysForEditableRangesInOrder];
-	NSDictionary *oldCode = [oldTemplate codeForEditableRanges];
-	// For all editable pieces of code
-	id previousKey = nil;
-	id orphanedCodeKey = nil;
-	for (id key in sortedOldKeys) {
-		// Get code, and prepend any orphaned code
-		NSString *code = oldCode[key];
-		if (orphanedCodeKey) {
-			BOOL canMerge = [newTemplate canMergeRangeWithKey:orphanedCodeKey withOtherRangeWithKey:key];
-			if (canMerge) code = [oldCode[orphanedCodeKey] stringByAppendingString:code];
-			orphanedCodeKey = nil;
-		}
-		// Try inserting the old code in the spot with the same key
-		BOOL simpleInsert = [newTemplate setCode:code forEditableRangeWithKey:key];
-		if (!simpleInsert) { // The range with that key does not exist anymore in the template
-			// See if it's worth keeping
-			NSString *trimmedCode = [code stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-			if ([trimmedCode length] == 0) continue;
-			// See if there is an unused key after the previously used one
-			NSInteger indexAfterPrevious = previousKey ? [sortedNewKeys indexOfObject:previousKey]+1 : 0;
-			if (indexAfterPrevious < [sortedNewKeys count]) {
-				id nextKey = sortedNewKeys[indexAfterPrevious];
-				BOOL canSubstitute = [newTemplate canSubstituteOldRangeWithKey:key forNewRangeWithKey:nextKey];
-				if (![sortedOldKeys containsObject:nextKey] && canSubstitute) { // If it's not used we put the code there
-					[newTemplate setCode:code forEditableRangeWithKey:nextKey];
-					previousKey = nextKey;
-					continue;
-				}
-			}
-			// If not, append the code to the previously added part
-			if (previousKey && [newTemplate canMergeRangeWithKey:previousKey withOtherRangeWithKey:key]) {
-				NSString *previousCode = [newTemplate codeForEditableRangeWithKey:previousKey];
-				code = [previousCode stringByAppendingString:code];
-				// Set
-				[newTemplate setCode:code forEditableRangeWithKey:previousKey];
-			} else {
-				orphanedCodeKey = key; // No previously added code, mark as orphaned and let the next piece try toj prepend it
-			}
-		} else {
-			previousKey = key;
-		}
-	}
+	[newTemplate mergeCodeFromTemplate:oldTemplate];
 }
 
 - (NSString *)code
@@ -275,12 +284,10 @@ static NSString * const kIndentString = @"  ";
 	return [self.codeTextView string];
 }
 
-- (NSString *)codeWithLogging
+- (void)writeCodeWithLoggingToSink:(MACodeSink *)sink
 {
-	NSArray *states = [self.codeTemplate states];
-	NSArray *transitions = [self.codeTemplate transitions];
-	MAStateMachineCodeTemplate *codeTemplate = [self codeTemplateForStates:states transitions:transitions insertLoggingCode:YES];
-	return [codeTemplate code];
+	// Shows the code of the latest graph first, so the symbol ids the device sends are the ones objectForSymbolWithID: knows
+	[self.generator writeCodeWithOptions:[self codeTemplateOptionsWithLoggingCode:YES] toSink:sink];
 }
 
 - (id)objectForSymbolWithID:(UInt64)symbolID
@@ -339,14 +346,13 @@ static NSString * const kIndentString = @"  ";
 	// Get the new code parts for each editable ranges
 	// We need to do this beforehand, because replacing a range will shift the others making them invalid.
 	NSMutableDictionary *newCodeParts = [NSMutableDictionary dictionary];
-	NSDictionary *editableRanges = [self.codeTemplate editableRanges];
 	NSUInteger count = [ranges count];
 	for (int i=0; i<count; i++) {
 		NSRange range = [ranges[i] rangeValue];
 		NSString *string = strings[i];
 		// Find editable range
-		for (id key in [editableRanges keyEnumerator]) {
-			NSRange editableRange = [editableRanges[key] rangeValue];
+		for (id key in [self.codeTemplate keysForEditableRangesTouchingRange:range]) {
+			NSRange editableRange = [self.codeTemplate editableRangeForKey:key];
 			if (NSRangeContainsRange(editableRange, range)) {
 				// Modify code and store for key
 				NSString *code = [self.codeTemplate codeForEditableRangeWithKey:key];
@@ -410,12 +416,11 @@ static NSString * const kIndentString = @"  ";
 - (NSArray *)editableRangesIntersectingWithRange:(NSRange)range
 {
 	NSMutableArray *result = [NSMutableArray array];
-	NSArray *editableRanges = [self.codeTemplate editableRangesInOrder];
-	for (NSValue *editableRangeObject in editableRanges) {
-		NSRange editableRange = [editableRangeObject rangeValue];
+	for (id key in [self.codeTemplate keysForEditableRangesTouchingRange:range]) {
+		NSRange editableRange = [self.codeTemplate editableRangeForKey:key];
 		BOOL intersectsRange = NSRangeIntersectsRange(range, editableRange) || (range.length == 0 && NSRangeContainsValue(editableRange, range.location));
 		if (intersectsRange) {
-			[result addObject:editableRangeObject];
+			[result addObject:[NSValue valueWithRange:editableRange]];
 		}
 	}
 	return result;
@@ -0,0 +1,39 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import <Foundation/Foundation.h>
+#import "MAStateMachineCodeTemplate.h"
+
+@class MACodeSink;
+
+// Generates code on a background queue, so editing large graphs doesn't wait for it. Each request captures the graph &
+// the user's code on the completion queue, and is generated from a copy of the graph (which the queue keeps, and brings
+// up to date for every request) with a private symbol manager. Requests made in quick succession are debounced into one,
+// a newer request cancels the generation of an older one (between phases & state machines), and a result is only
+// delivered if it's still the latest and the user didn't edit codeTemplate since it was captured (it's generated again
+// then). Delivered templates are keyed by the graph's own objects, like ones generated directly.
+@interface MACodeGenerator : NSObject
+
+// Requests are made on this serial queue, and results delivered on it (default: main)
+#if OS_OBJECT_HAVE_OBJC_SUPPORT
+@property (nonatomic, strong) dispatch_queue_t completionQueue;
+#else
+@property (nonatomic) dispatch_queue_t completionQueue;
+#endif
+@property (nonatomic) NSTimeInterval debounceInterval; // Default: 0.05s
+@property (nonatomic, copy) NSString *indentString;
+@property (nonatomic, strong) MAStateMachineCodeTemplate *codeTemplate; // Shown & edited by the user: every request merges its editable code
+
+- (void)requestCodeForStates:(NSArray *)states transitions:(NSArray *)transitions changes:(NSArray *)changes options:(MAStateMachineCodeTemplateOptions)options completion:(void(^)(MAStateMachineCodeTemplate *codeTemplate))completion; // The MAGraphChange's since the last request, nil for a full generation
+- (MAStateMachineCodeTemplate *)codeForStates:(NSArray *)states transitions:(NSArray *)transitions options:(MAStateMachineCodeTemplateOptions)options; // Right away (cancels requests)
+- (void)flushRequests; // Generates & delivers the latest request right away, if it wasn't delivered yet
+- (void)writeCodeWithOptions:(MAStateMachineCodeTemplateOptions)options toSink:(MACodeSink *)sink; // Of the last graph requested (flushes first), merging codeTemplate's code
+
+@end
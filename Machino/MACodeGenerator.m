@@ -0,0 +1,452 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MACodeGenerator.h"
+#import "MASymbolManager.h"
+#import "MANodeInternal.h"
+#import "Graph.h"
+
+static const NSTimeInterval kDefaultDebounceInterval = 0.05;
+
+#pragma mark - Request
+
+// What a request generates from, captured on the completion queue so the generation queue never reads the graph
+@interface MACodeRequest : NSObject
+
+@property (nonatomic) NSUInteger generation;
+@property (nonatomic, copy) NSArray *states;
+@property (nonatomic, copy) NSArray *transitions;
+@property (nonatomic, strong) NSMutableArray *changes; // nil for a full generation
+@property (nonatomic) MAStateMachineCodeTemplateOptions options;
+@property (nonatomic, copy) void (^completion)(MAStateMachineCodeTemplate *codeTemplate);
+// Graph (NSNull for nil)
+@property (nonatomic, copy) NSArray *stateNames;
+@property (nonatomic, copy) NSIndexSet *initialStateIndexes;
+@property (nonatomic, copy) NSArray *stateArrows;
+@property (nonatomic, copy) NSArray *sourceStates;
+@property (nonatomic, copy) NSArray *targetStates;
+@property (nonatomic, copy) NSArray *conditions;
+@property (nonatomic, copy) NSArray *actions;
+// Code
+@property (nonatomic, copy) NSString *indentString;
+@property (nonatomic, strong) MACodeTemplate *codeToMerge; // Just the editable code, of codeTemplate
+@property (nonatomic, strong) MAStateMachineCodeTemplate *codeTemplate;
+@property (nonatomic) NSUInteger editCount; // Of codeTemplate, when captured
+@property (nonatomic) BOOL startsSymbolsOver; // From symbolsData, new ones if nil
+@property (nonatomic, strong) NSData *symbolsData;
+@property (nonatomic, copy) NSArray *symbolObjects; // By their index in symbolsData
+
++ (id)requestWithChanges:(NSArray *)changes;
+- (void)addChanges:(NSArray *)changes;
+
+@end
+
+@implementation MACodeRequest
+
++ (id)requestWithChanges:(NSArray *)changes
+{
+	MACodeRequest *request = [[self alloc] init];
+	request.changes = changes ? [changes mutableCopy] : nil;
+	return request;
+}
+
+- (void)addChanges:(NSArray *)changes
+{
+	// Once full, a generation stays full
+	if (!changes) self.changes = nil;
+	else [self.changes addObjectsFromArray:changes];
+}
+
+@end
+
+#pragma mark - Private Interface
+
+@interface MACodeGenerator ()
+
+// Completion queue
+@property (nonatomic) NSUInteger latestGeneration; // Also read by the generation queue (under @synchronized)
+@property (nonatomic, strong) MACodeRequest *pendingRequest; // Waiting out the debounce interval
+@property (nonatomic, strong) MACodeRequest *undeliveredRequest; // The latest one, until it's delivered
+@property (nonatomic, strong) MASymbolManager *symbolsSource; // The symbols the generation queue's started from or were delivered as
+// Generation queue
+#if OS_OBJECT_HAVE_OBJC_SUPPORT
+@property (nonatomic, strong) dispatch_queue_t generationQueue;
+#else
+@property (nonatomic) dispatch_queue_t generationQueue;
+#endif
+@property (nonatomic, strong) NSMapTable *copiedStates; // Graph object -> copy
+@property (nonatomic, strong) NSMapTable *copiedTransitions;
+@property (nonatomic, strong) NSMapTable *originals; // Copy -> graph object
+@property (nonatomic, copy) NSArray *stateCopies; // In the graph's order
+@property (nonatomic, copy) NSArray *transitionCopies;
+@property (nonatomic, strong) MASymbolManager *symbols; // Of the copies
+@property (nonatomic, strong) MAStateMachineCodeTemplate *baseTemplate; // The last one generated, whose fragments are reused
+@property (nonatomic, strong) NSMutableArray *carriedChanges; // Since baseTemplate, of requests that didn't finish (nil for a full generation)
+
+@end
+
+#pragma mark - Implementation
+
+@implementation MACodeGenerator
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_completionQueue = dispatch_get_main_queue();
+		_debounceInterval = kDefaultDebounceInterval;
+		_indentString = @"\t";
+		_generationQueue = dispatch_queue_create("machino.code-generation", DISPATCH_QUEUE_SERIAL);
+		_copiedStates = [self objectMapTable];
+		_copiedTransitions = [self objectMapTable];
+		_originals = [self objectMapTable];
+		_carriedChanges = [NSMutableArray array];
+	}
+	return self;
+}
+
+#if !OS_OBJECT_HAVE_OBJC_SUPPORT
+- (void)dealloc
+{
+	dispatch_release(_generationQueue);
+	dispatch_release(_completionQueue);
+}
+
+- (void)setCompletionQueue:(dispatch_queue_t)completionQueue
+{
+	dispatch_retain(completionQueue);
+	dispatch_release(_completionQueue);
+	_completionQueue = completionQueue;
+}
+#endif
+
+- (NSMapTable *)objectMapTable
+{
+	NSPointerFunctionsOptions options = NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality;
+	return [NSMapTable mapTableWithKeyOptions:options valueOptions:options];
+}
+
+#pragma mark - Requests
+
+- (void)requestCodeForStates:(NSArray *)states transitions:(NSArray *)transitions changes:(NSArray *)changes options:(MAStateMachineCodeTemplateOptions)options completion:(void(^)(MAStateMachineCodeTemplate *codeTemplate))completion
+{
+	// Join the request that's still waiting
+	MACodeRequest *request = self.pendingRequest;
+	if (request) [request addChanges:changes];
+	else request = [MACodeRequest requestWithChanges:changes];
+	request.states = states;
+	request.transitions = transitions;
+	request.options = options;
+	request.completion = completion;
+	request.generation = [self nextGeneration];
+	self.pendingRequest = request;
+	self.undeliveredRequest = request;
+	// Start it once no other request came in for the debounce interval
+	NSUInteger generation = request.generation;
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.debounceInterval * NSEC_PER_SEC)), self.completionQueue, ^{
+		if (self.pendingRequest.generation != generation) return;
+		self.pendingRequest = nil;
+		[self startRequest:request];
+	});
+}
+
+- (MAStateMachineCodeTemplate *)codeForStates:(NSArray *)states transitions:(NSArray *)transitions options:(MAStateMachineCodeTemplateOptions)options
+{
+	MACodeRequest *request = [MACodeRequest requestWithChanges:nil];
+	request.states = states;
+	request.transitions = transitions;
+	request.options = options;
+	request.generation = [self nextGeneration];
+	self.pendingRequest = nil;
+	self.undeliveredRequest = nil;
+	MAStateMachineCodeTemplate *codeTemplate = [self generateRequestNow:request];
+	self.symbolsSource = codeTemplate.symbols;
+	return codeTemplate;
+}
+
+- (void)flushRequests
+{
+	MACodeRequest *request = self.undeliveredRequest;
+	if (!request) return;
+	// A request that already started carries its changes over to the next one if it doesn't finish
+	if (request != self.pendingRequest) {
+		MACodeRequest *startedRequest = request;
+		request = [MACodeRequest requestWithChanges:@[]];
+		request.states = startedRequest.states;
+		request.transitions = startedRequest.transitions;
+		request.options = startedRequest.options;
+		request.completion = startedRequest.completion;
+	}
+	request.generation = [self nextGeneration];
+	self.pendingRequest = nil;
+	self.undeliveredRequest = nil;
+	MAStateMachineCodeTemplate *codeTemplate = [self generateRequestNow:request];
+	self.symbolsSource = codeTemplate.symbols;
+	if (request.completion) request.completion(codeTemplate);
+}
+
+- (void)writeCodeWithOptions:(MAStateMachineCodeTemplateOptions)options toSink:(MACodeSink *)sink
+{
+	[self flushRequests];
+	MACodeTemplate *codeToMerge = [self codeToMergeFromTemplate:self.codeTemplate];
+	NSString *indentString = self.indentString;
+	dispatch_sync(self.generationQueue, ^{
+		MAStateMachineCodeTemplate *template = [self templateOfCopiesWithOptions:options indentString:indentString];
+		template.sink = sink;
+		[template generateMergingCodeFromTemplate:codeToMerge];
+		self.symbols = template.symbols;
+	});
+}
+
+- (NSUInteger)nextGeneration
+{
+	@synchronized(self) {
+		return ++self.latestGeneration;
+	}
+}
+
+- (BOOL)isStaleRequest:(MACodeRequest *)request
+{
+	@synchronized(self) {
+		return (request.generation != self.latestGeneration);
+	}
+}
+
+#pragma mark - Completion Queue
+
+- (void)startRequest:(MACodeRequest *)request
+{
+	[self captureRequest:request];
+	dispatch_async(self.generationQueue, ^{
+		MAStateMachineCodeTemplate *codeTemplate = [self generateForRequest:request];
+		if (!codeTemplate) return; // Skipped or cancelled
+		dispatch_async(self.completionQueue, ^{
+			[self deliverTemplate:codeTemplate forRequest:request];
+		});
+	});
+}
+
+- (MAStateMachineCodeTemplate *)generateRequestNow:(MACodeRequest *)request
+{
+	[self captureRequest:request];
+	__block MAStateMachineCodeTemplate *codeTemplate = nil;
+	dispatch_sync(self.generationQueue, ^{
+		codeTemplate = [self generateForRequest:request];
+	});
+	return codeTemplate;
+}
+
+- (void)captureRequest:(MACodeRequest *)request
+{
+	// Graph
+	NSMutableArray *stateNames = [NSMutableArray arrayWithCapacity:[request.states count]];
+	NSMutableIndexSet *initialStateIndexes = [NSMutableIndexSet indexSet];
+	NSMutableArray *stateArrows = [NSMutableArray arrayWithCapacity:[request.states count]];
+	[request.states enumerateObjectsUsingBlock:^(MANode *state, NSUInteger index, BOOL *stop) {
+		[stateNames addObject:(state.name ?: [NSNull null])];
+		if (state.isInitialState) [initialStateIndexes addIndex:index];
+		[stateArrows addObject:state.arrows];
+	}];
+	NSMutableArray *sourceStates = [NSMutableArray arrayWithCapacity:[request.transitions count]];
+	NSMutableArray *targetStates = [NSMutableArray arrayWithCapacity:[request.transitions count]];
+	NSMutableArray *conditions = [NSMutableArray arrayWithCapacity:[request.transitions count]];
+	NSMutableArray *actions = [NSMutableArray arrayWithCapacity:[request.transitions count]];
+	for (MAArrow *transition in request.transitions) {
+		[sourceStates addObject:(transition.sourceNode ?: [NSNull null])];
+		[targetStates addObject:(transition.targetNode ?: [NSNull null])];
+		[conditions addObject:(transition.condition ?: [NSNull null])];
+		[actions addObject:(transition.actions ?: @[])];
+	}
+	request.stateNames = stateNames;
+	request.initialStateIndexes = initialStateIndexes;
+	request.stateArrows = stateArrows;
+	request.sourceStates = sourceStates;
+	request.targetStates = targetStates;
+	request.conditions = conditions;
+	request.actions = actions;
+	// Code
+	MAStateMachineCodeTemplate *codeTemplate = self.codeTemplate;
+	request.indentString = self.indentString;
+	request.codeTemplate = codeTemplate;
+	request.editCount = codeTemplate.editCount;
+	request.codeToMerge = [self codeToMergeFromTemplate:codeTemplate];
+	// Symbols, when the template's aren't the ones the generation queue has
+	if (codeTemplate.symbols != self.symbolsSource) {
+		NSMutableArray *symbolObjects = [NSMutableArray array];
+		request.startsSymbolsOver = YES;
+		request.symbolsData = [codeTemplate.symbols dataWithIndexForObject:^NSUInteger(id object) {
+			[symbolObjects addObject:object];
+			return [symbolObjects count] - 1;
+		}];
+		request.symbolObjects = symbolObjects;
+		self.symbolsSource = codeTemplate.symbols;
+	}
+}
+
+- (MACodeTemplate *)codeToMergeFromTemplate:(MACodeTemplate *)codeTemplate
+{
+	if (!codeTemplate) return nil;
+	return [[MACodeTemplate alloc] initWithCodeForEditableRanges:[codeTemplate codeForEditableRanges] keysInOrder:[codeTemplate keysForEditableRangesInOrder]];
+}
+
+- (void)deliverTemplate:(MAStateMachineCodeTemplate *)codeTemplate forRequest:(MACodeRequest *)request
+{
+	if (request.generation != self.latestGeneration) return; // A newer request will deliver
+	// A late result doesn't get to overwrite what the user typed since it was captured
+	if (self.codeTemplate != request.codeTemplate || self.codeTemplate.editCount != request.editCount) {
+		[self requestCodeForStates:request.states transitions:request.transitions changes:@[] options:request.options completion:request.completion];
+		return;
+	}
+	self.undeliveredRequest = nil;
+	self.symbolsSource = codeTemplate.symbols;
+	if (request.completion) request.completion(codeTemplate);
+}
+
+#pragma mark - Generation Queue
+
+- (MAStateMachineCodeTemplate *)generateForRequest:(MACodeRequest *)request
+{
+	// Even a stale request brings the copies up to date, later ones only carry their changes over
+	[self updateCopiesForRequest:request];
+	if (request.startsSymbolsOver) [self startSymbolsOverForRequest:request];
+	if (self.carriedChanges && request.changes) [self.carriedChanges addObjectsFromArray:[self changesOfCopiesForChanges:request.changes]];
+	else self.carriedChanges = nil;
+	if ([self isStaleRequest:request]) return nil;
+	// Generate
+	MAStateMachineCodeTemplate *template = [self templateOfCopiesWithOptions:request.options indentString:request.indentString];
+	template.cancellationHandler = ^BOOL{
+		return [self isStaleRequest:request];
+	};
+	[template generateFromTemplate:self.baseTemplate changes:self.carriedChanges mergingCodeFromTemplate:request.codeToMerge];
+	template.cancellationHandler = nil;
+	self.symbols = template.symbols;
+	if (template.isCancelled) return nil;
+	self.baseTemplate = template;
+	self.carriedChanges = [NSMutableArray array];
+	// What's delivered refers to the graph's own objects
+	MAStateMachineCodeTemplate *codeTemplate = [template copy];
+	codeTemplate.states = request.states;
+	codeTemplate.transitions = request.transitions;
+	codeTemplate.symbols = [self symbolsOfOriginals];
+	return codeTemplate;
+}
+
+- (MAStateMachineCodeTemplate *)templateOfCopiesWithOptions:(MAStateMachineCodeTemplateOptions)options indentString:(NSString *)indentString
+{
+	MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+	template.states = self.stateCopies;
+	template.transitions = self.transitionCopies;
+	template.options = options;
+	template.indentString = indentString;
+	template.symbols = self.symbols; // Keeps the ids
+	return template;
+}
+
+- (void)updateCopiesForRequest:(MACodeRequest *)request
+{
+	NSMapTable *copiedStates = [self objectMapTable];
+	NSMapTable *copiedTransitions = [self objectMapTable];
+	NSMapTable *originals = [self objectMapTable];
+	NSMutableArray *stateCopies = [NSMutableArray arrayWithCapacity:[request.states count]];
+	NSMutableArray *transitionCopies = [NSMutableArray arrayWithCapacity:[request.transitions count]];
+	// States, new ones get a copy & removed ones lose theirs
+	[request.states enumerateObjectsUsingBlock:^(MANode *state, NSUInteger index, BOOL *stop) {
+		MANode *stateCopy = [self.copiedStates objectForKey:state] ?: [[MANode alloc] init];
+		id name = request.stateNames[index];
+		stateCopy.name = (name != [NSNull null]) ? name : nil;
+		stateCopy.isInitialState = [request.initialStateIndexes containsIndex:index];
+		[copiedStates setObject:stateCopy forKey:state];
+		[originals setObject:state forKey:stateCopy];
+		[stateCopies addObject:stateCopy];
+	}];
+	// Transitions
+	[request.transitions enumerateObjectsUsingBlock:^(MAArrow *transition, NSUInteger index, BOOL *stop) {
+		MAArrow *transitionCopy = [self.copiedTransitions objectForKey:transition] ?: [[MAArrow alloc] init];
+		id condition = request.conditions[index];
+		transitionCopy.sourceNode = [copiedStates objectForKey:request.sourceStates[index]];
+		transitionCopy.targetNode = [copiedStates objectForKey:request.targetStates[index]];
+		transitionCopy.condition = (condition != [NSNull null]) ? condition : nil;
+		transitionCopy.actions = request.actions[index];
+		[copiedTransitions setObject:transitionCopy forKey:transition];
+		[originals setObject:transition forKey:transitionCopy];
+		[transitionCopies addObject:transitionCopy];
+	}];
+	// Arrows of the states in the graph's order (setting the ends above only appends)
+	[stateCopies enumerateObjectsUsingBlock:^(MANode *stateCopy, NSUInteger index, BOOL *stop) {
+		NSMutableArray *arrows = [NSMutableArray arrayWithCapacity:[request.stateArrows[index] count]];
+		for (MAArrow *arrow in request.stateArrows[index]) {
+			MAArrow *arrowCopy = [copiedTransitions objectForKey:arrow];
+			if (arrowCopy) [arrows addObject:arrowCopy];
+		}
+		[stateCopy.arrowsMutable setArray:arrows];
+	}];
+	self.copiedStates = copiedStates;
+	self.copiedTransitions = copiedTransitions;
+	self.originals = originals;
+	self.stateCopies = stateCopies;
+	self.transitionCopies = transitionCopies;
+}
+
+- (id)copyOfObject:(id)object
+{
+	if ([object isKindOfClass:[MANode class]]) return [self.copiedStates objectForKey:object];
+	if ([object isKindOfClass:[MAArrow class]]) return [self.copiedTransitions objectForKey:object];
+	return object; // Conditions & actions never change, they're shared
+}
+
+- (id)originalOfObject:(id)object
+{
+	if ([object isKindOfClass:[MANode class]] || [object isKindOfClass:[MAArrow class]]) return [self.originals objectForKey:object];
+	return object;
+}
+
+- (void)startSymbolsOverForRequest:(MACodeRequest *)request
+{
+	if (!request.symbolsData) {
+		self.symbols = nil;
+		return;
+	}
+	NSArray *symbolObjects = request.symbolObjects;
+	self.symbols = [[MASymbolManager alloc] initWithData:request.symbolsData objectForIndex:^id(NSUInteger index) {
+		return [self copyOfObject:symbolObjects[index]];
+	}];
+}
+
+- (MASymbolManager *)symbolsOfOriginals
+{
+	if (!self.symbols) return nil;
+	NSMutableArray *objects = [NSMutableArray array];
+	NSData *data = [self.symbols dataWithIndexForObject:^NSUInteger(id object) {
+		id original = [self originalOfObject:object];
+		if (!original) return NSNotFound;
+		[objects addObject:original];
+		return [objects count] - 1;
+	}];
+	return [[MASymbolManager alloc] initWithData:data objectForIndex:^id(NSUInteger index) {
+		return objects[index];
+	}];
+}
+
+- (NSArray *)changesOfCopiesForChanges:(NSArray *)changes
+{
+	NSMutableArray *changesOfCopies = [NSMutableArray arrayWithCapacity:[changes count]];
+	for (MAGraphChange *change in changes) {
+		NSMutableArray *affectedNodes = [NSMutableArray arrayWithCapacity:[change.affectedNodes count]];
+		for (MANode *node in change.affectedNodes) {
+			MANode *nodeCopy = [self.copiedStates objectForKey:node];
+			if (nodeCopy) [affectedNodes addObject:nodeCopy]; // Removed states aren't written anyway
+		}
+		id object = [self copyOfObject:change.object] ?: change.object;
+		[changesOfCopies addObject:[MAGraphChange changeWithType:change.type object:object affectedNodes:affectedNodes]];
+	}
+	return changesOfCopies;
+}
+
+@end
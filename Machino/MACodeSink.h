@@ -0,0 +1,33 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Growable UTF-8 byte buffer that code is streamed into, optionally draining into a file descriptor as it fills up. It
+// counts what's appended in UTF-16 units like NSString does (so ranges into the code stay comparable) and remembers where
+// lines end ('\n' only, which is what templates write), for line ranges of code that's no longer in memory.
+@interface MACodeSink : NSObject
+
+- (id)initWithFileDescriptor:(int)fileDescriptor; // Not closed by the sink
+
+- (NSUInteger)length; // In UTF-16 units
+- (NSUInteger)byteCount; // Including bytes already drained
+- (NSRange)lineRangeForRange:(NSRange)range; // Like NSString's
+- (void)appendString:(NSString *)string;
+- (void)appendCharacters:(const unichar *)characters length:(NSUInteger)length;
+// In memory only (without a file descriptor)
+- (const void *)bytes;
+- (NSString *)string;
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error; // One write, atomically
+// With a file descriptor
+- (BOOL)flush:(NSError **)error;
+
+@end
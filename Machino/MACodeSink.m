@@ -0,0 +1,281 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MACodeSink.h"
+#import "MAPlatform.h"
+#import <errno.h>
+#import <fcntl.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+static const NSUInteger kDrainByteCount = 1 << 16; // Buffered before draining into the file descriptor
+static const NSUInteger kCharacterChunkLength = 256; // Copied out of strings at a time, on the stack
+
+#pragma mark - Encoding
+
+typedef struct {
+	UInt8 *bytes;
+	NSUInteger byteCount;
+	NSUInteger byteCapacity;
+	NSUInteger drainedByteCount;
+	NSUInteger length; // In UTF-16 units
+	NSUInteger *lineEnds; // Locations of the '\n's
+	NSUInteger lineEndCount;
+	NSUInteger lineEndCapacity;
+	unichar pendingSurrogate; // High surrogate waiting for its low half
+} MACodeSinkBuffer;
+
+static void MACodeSinkBufferReserve(MACodeSinkBuffer *buffer, NSUInteger byteCount)
+{
+	if (buffer->byteCount + byteCount <= buffer->byteCapacity) return;
+	buffer->byteCapacity = MAX(buffer->byteCapacity * 2, buffer->byteCount + byteCount);
+	buffer->bytes = realloc(buffer->bytes, buffer->byteCapacity);
+}
+
+static void MACodeSinkBufferAddLineEnd(MACodeSinkBuffer *buffer, NSUInteger location)
+{
+	if (buffer->lineEndCount == buffer->lineEndCapacity) {
+		buffer->lineEndCapacity = MAX(buffer->lineEndCapacity * 2, 256);
+		buffer->lineEnds = realloc(buffer->lineEnds, buffer->lineEndCapacity * sizeof(NSUInteger));
+	}
+	buffer->lineEnds[buffer->lineEndCount++] = location;
+}
+
+static void MACodeSinkBufferPutCodePoint(MACodeSinkBuffer *buffer, UInt32 codePoint)
+{
+	UInt8 *out = buffer->bytes + buffer->byteCount;
+	if (codePoint < 0x80) {
+		out[0] = codePoint;
+		buffer->byteCount += 1;
+	} else if (codePoint < 0x800) {
+		out[0] = 0xC0 | (codePoint >> 6);
+		out[1] = 0x80 | (codePoint & 0x3F);
+		buffer->byteCount += 2;
+	} else if (codePoint < 0x10000) {
+		out[0] = 0xE0 | (codePoint >> 12);
+		out[1] = 0x80 | ((codePoint >> 6) & 0x3F);
+		out[2] = 0x80 | (codePoint & 0x3F);
+		buffer->byteCount += 3;
+	} else {
+		out[0] = 0xF0 | (codePoint >> 18);
+		out[1] = 0x80 | ((codePoint >> 12) & 0x3F);
+		out[2] = 0x80 | ((codePoint >> 6) & 0x3F);
+		out[3] = 0x80 | (codePoint & 0x3F);
+		buffer->byteCount += 4;
+	}
+}
+
+static void MACodeSinkBufferAppend(MACodeSinkBuffer *buffer, const unichar *characters, NSUInteger length)
+{
+	MACodeSinkBufferReserve(buffer, length * 3 + 3); // At most 3 bytes per unit, and a dangling surrogate
+	for (NSUInteger i = 0; i < length; i++) {
+		unichar character = characters[i];
+		NSUInteger location = buffer->length + i;
+		if (buffer->pendingSurrogate) {
+			unichar highSurrogate = buffer->pendingSurrogate;
+			buffer->pendingSurrogate = 0;
+			if (character >= 0xDC00 && character <= 0xDFFF) {
+				MACodeSinkBufferPutCodePoint(buffer, 0x10000 + ((highSurrogate - 0xD800) << 10) + (character - 0xDC00));
+				continue;
+			}
+			MACodeSinkBufferPutCodePoint(buffer, 0xFFFD);
+		}
+		if (character < 0x80) {
+			buffer->bytes[buffer->byteCount++] = character;
+			if (character == '\n') MACodeSinkBufferAddLineEnd(buffer, location);
+		} else if (character >= 0xD800 && character <= 0xDBFF) {
+			buffer->pendingSurrogate = character;
+		} else if (character >= 0xDC00 && character <= 0xDFFF) {
+			MACodeSinkBufferPutCodePoint(buffer, 0xFFFD); // Unpaired
+		} else {
+			MACodeSinkBufferPutCodePoint(buffer, character);
+		}
+	}
+	buffer->length += length;
+}
+
+static void MACodeSinkBufferFinish(MACodeSinkBuffer *buffer)
+{
+	if (!buffer->pendingSurrogate) return;
+	buffer->pendingSurrogate = 0;
+	MACodeSinkBufferPutCodePoint(buffer, 0xFFFD);
+}
+
+static BOOL MACodeSinkWriteAll(int fileDescriptor, const UInt8 *bytes, NSUInteger byteCount)
+{
+	while (byteCount > 0) {
+		ssize_t written = write(fileDescriptor, bytes, byteCount);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return NO;
+		}
+		bytes += written;
+		byteCount -= written;
+	}
+	return YES;
+}
+
+static NSError *MACodeSinkError(NSString *path, int errorNumber)
+{
+	NSString *message = [NSString stringWithFormat:@"Could not write %@: %s", path ?: @"code", strerror(errorNumber)];
+	return [NSError errorWithDomain:@"" code:errorNumber userInfo:@{ NSLocalizedDescriptionKey : message }];
+}
+
+#pragma mark - Private Interface
+
+@interface MACodeSink ()
+{
+	MACodeSinkBuffer _buffer;
+}
+
+@property (nonatomic, readonly) int fileDescriptor; // -1 if in memory
+@property (nonatomic) int drainErrorNumber; // Of the first failed drain
+
+@end
+
+#pragma mark - Implementation
+
+@implementation MACodeSink
+
+- (id)init
+{
+	return [self initWithFileDescriptor:-1];
+}
+
+- (id)initWithFileDescriptor:(int)fileDescriptor
+{
+	self = [super init];
+	if (self) {
+		_fileDescriptor = fileDescriptor;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	free(_buffer.bytes);
+	free(_buffer.lineEnds);
+}
+
+#pragma mark - General
+
+- (NSUInteger)length
+{
+	return _buffer.length;
+}
+
+- (NSUInteger)byteCount
+{
+	return _buffer.drainedByteCount + _buffer.byteCount;
+}
+
+- (NSRange)lineRangeForRange:(NSRange)range
+{
+	NSAssert(NSMaxRange(range) <= _buffer.length, @"Range out of bounds.");
+	// Start after the last line end before the range
+	NSUInteger low = 0, high = _buffer.lineEndCount;
+	while (low < high) {
+		NSUInteger middle = low + (high - low) / 2;
+		if (_buffer.lineEnds[middle] < range.location) low = middle + 1;
+		else high = middle;
+	}
+	NSUInteger start = (low > 0) ? _buffer.lineEnds[low-1] + 1 : 0;
+	// End after the first line end at or after its last character
+	NSUInteger last = (range.length > 0) ? NSMaxRange(range) - 1 : range.location;
+	while (low < _buffer.lineEndCount && _buffer.lineEnds[low] < last) low++;
+	NSUInteger end = (low < _buffer.lineEndCount) ? _buffer.lineEnds[low] + 1 : _buffer.length;
+	return NSMakeRange(start, end - start);
+}
+
+- (void)appendString:(NSString *)string
+{
+	NSUInteger length = [string length];
+	unichar characters[kCharacterChunkLength];
+	for (NSUInteger location = 0; location < length; location += kCharacterChunkLength) {
+		NSUInteger chunkLength = MIN(length - location, kCharacterChunkLength);
+		[string getCharacters:characters range:NSMakeRange(location, chunkLength)];
+		[self appendCharacters:characters length:chunkLength];
+	}
+}
+
+- (void)appendCharacters:(const unichar *)characters length:(NSUInteger)length
+{
+	MACodeSinkBufferAppend(&_buffer, characters, length);
+	if (self.fileDescriptor >= 0 && _buffer.byteCount >= kDrainByteCount) [self drain];
+}
+
+#pragma mark - In memory
+
+- (const void *)bytes
+{
+	NSAssert(self.fileDescriptor < 0, @"Bytes are drained into the file descriptor.");
+	MACodeSinkBufferFinish(&_buffer);
+	return _buffer.bytes;
+}
+
+- (NSString *)string
+{
+	NSAssert(self.fileDescriptor < 0, @"Bytes are drained into the file descriptor.");
+	MACodeSinkBufferFinish(&_buffer);
+	return [[NSString alloc] initWithBytes:_buffer.bytes length:_buffer.byteCount encoding:NSUTF8StringEncoding];
+}
+
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error
+{
+	NSAssert(self.fileDescriptor < 0, @"Bytes are drained into the file descriptor.");
+	MACodeSinkBufferFinish(&_buffer);
+	// Write next to it, then move it in place
+	NSString *temporaryPath = [path stringByAppendingString:@".XXXXXX"];
+	char *temporaryPathBuffer = strdup([temporaryPath fileSystemRepresentation]);
+	int fileDescriptor = mkstemp(temporaryPathBuffer);
+	int errorNumber = 0;
+	if (fileDescriptor < 0) {
+		errorNumber = errno;
+	} else {
+		fchmod(fileDescriptor, 0644);
+		if (!MACodeSinkWriteAll(fileDescriptor, _buffer.bytes, _buffer.byteCount)) errorNumber = errno;
+		if (close(fileDescriptor) != 0 && !errorNumber) errorNumber = errno;
+		if (!errorNumber && rename(temporaryPathBuffer, [path fileSystemRepresentation]) != 0) errorNumber = errno;
+		if (errorNumber) unlink(temporaryPathBuffer);
+	}
+	free(temporaryPathBuffer);
+	if (errorNumber) {
+		if (error) *error = MACodeSinkError(path, errorNumber);
+		return NO;
+	}
+	return YES;
+}
+
+#pragma mark - File descriptor
+
+- (BOOL)flush:(NSError **)error
+{
+	NSAssert(self.fileDescriptor >= 0, @"No file descriptor to flush into.");
+	MACodeSinkBufferFinish(&_buffer);
+	[self drain];
+	if (self.drainErrorNumber) {
+		if (error) *error = MACodeSinkError(nil, self.drainErrorNumber);
+		return NO;
+	}
+	return YES;
+}
+
+- (void)drain
+{
+	if (!self.drainErrorNumber && !MACodeSinkWriteAll(self.fileDescriptor, _buffer.bytes, _buffer.byteCount)) {
+		self.drainErrorNumber = errno;
+	}
+	_buffer.drainedByteCount += _buffer.byteCount;
+	_buffer.byteCount = 0;
+}
+
+@end
@@ -12,30 +12,49 @@
 #import <Foundation/Foundation.h>
 
 @class MANode;
+@class MACodeSink;
 
-@interface MACodeTemplate : NSObject <NSCoding>
+@interface MACodeTemplate : NSObject <NSCoding, NSCopying>
 
 @property (nonatomic, copy) NSString *indentString;
 @property (nonatomic, readonly) NSUInteger indentLevel;
+@property (nonatomic, copy) NSDictionary *codeForEditableRangesToWrite; // Written instead of the contents of editable ranges with these keys
+@property (nonatomic, strong) MACodeSink *sink; // If set before writing, the code is streamed into it instead of kept (ranges are still recorded, but the code can't be read back or edited)
+@property (nonatomic, readonly) NSUInteger editCount; // Of editable ranges, so a copy can tell whether the user changed code since
 
+// Initialization
+- (id)initWithCodeForEditableRanges:(NSDictionary *)code keysInOrder:(NSArray *)keys; // Only the code that was in editable ranges, to merge from (MADocumentArchive)
 // General
 - (NSString *)code;
 - (NSString *)codeInRange:(NSRange)range;
+- (NSUInteger)codeLength;
+- (NSRange)lineRangeForRange:(NSRange)range; // Of the code
+- (void)writeCodeToSink:(MACodeSink *)sink; // Without copying it into a string first
 // Editable ranges
 - (NSDictionary *)editableRanges;
 - (NSDictionary *)codeForEditableRanges;
 - (NSArray *)editableRangesInOrder;
 - (NSArray *)keysForEditableRangesInOrder;
+- (NSArray *)keysForEditableRangesTouchingRange:(NSRange)range; // In order, including ranges only bordering it
 - (NSRange)editableRangeForKey:(id)key;
 - (NSString *)codeForEditableRangeWithKey:(id)key;
 - (BOOL)setCode:(NSString *)code forEditableRangeWithKey:(id)key;
 // Key substitution/merger
 - (BOOL)canSubstituteOldRangeWithKey:(id)key forNewRangeWithKey:(id)otherKey; // Should be overriden
 - (BOOL)canMergeRangeWithKey:(id)key withOtherRangeWithKey:(id)otherKey; // Should be overriden
+- (void)mergeCodeFromTemplate:(MACodeTemplate *)oldTemplate; // Moves the code in the old template's editable ranges into ours
+- (NSDictionary *)mergedCodeFromTemplate:(MACodeTemplate *)oldTemplate forKeysInOrder:(NSArray *)sortedNewKeys; // The code the above would set, by key
 // Extra range
 - (NSDictionary *)extraRanges;
 - (NSRange)extraRangeForKey:(id)key;
 - (void)addExtraRange:(NSRange)range forKey:(id)key;
+// Fragments (consecutive top-level pieces of code, which a later template can copy when their inputs did not change)
+- (NSArray *)fragmentKeysInOrder;
+- (NSRange)fragmentRangeForKey:(id)key;
+- (NSArray *)keysForEditableRangesInFragmentWithKey:(id)key;
+- (void)fragment:(void(^)())block withKey:(id<NSCopying>)key;
+- (BOOL)appendFragmentWithKey:(id)key fromTemplate:(MACodeTemplate *)otherTemplate; // Including its editable & extra ranges
+- (NSArray *)editsFromTemplate:(MACodeTemplate *)oldTemplate; // MACodeEdit's turning the old code into ours, keeping appended fragments
 // Writing
 - (void)doIndented:(void(^)())block;
 - (void)write:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2);
@@ -46,3 +65,13 @@
 - (void)writeEditableLine:(NSString *)string withKey:(id<NSCopying>)key;
 
 @end
+
+// Replacement of a range of the old code by a range of the new code, applied back to front
+@interface MACodeEdit : NSObject
+
+@property (nonatomic, readonly) NSRange replacedRange; // In the old code
+@property (nonatomic, readonly) NSRange range; // In the new code
+
+- (id)initWithReplacedRange:(NSRange)replacedRange range:(NSRange)range;
+
+@end
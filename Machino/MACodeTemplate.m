@@ -10,6 +10,9 @@
 // NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #import "MACodeTemplate.h"
+#import "MACodeBuffer.h"
+#import "MACodeSink.h"
+#import "MARangeIndex.h"
 
 static NSString * const kCoderCodeMutableKey = @"codeMutable";
 static NSString * const kCoderEditableRangesMutableKey = @"editableRangesMutable";
@@ -19,16 +22,105 @@ static NSString * const kCoderHasWrittenToLineKey = @"hasWrittenToLine";
 static NSString * const kCoderIndentStringKey = @"indentString";
 static NSString * const kCoderIndentLevelKey = @"indentLevel";
 
+static const NSUInteger kFormatLength = 256; // Longer formats go through NSString
+static const NSUInteger kOutputChunkLength = 256;
+static const NSUInteger kMaximumIntegerLength = 20; // Of a formatted long long
+static const unichar kNewline = '\n';
+
+typedef enum {
+	MARangeSetEditable = 0,
+	MARangeSetExtra,
+	MARangeSetFragment,
+} MARangeSet;
+
+#pragma mark - Formatting
+
+static BOOL MAIsSimpleFormat(NSString *format, unichar *characters, NSUInteger length)
+{
+	// Only %@, %i, %d, %lli, %lld & %%
+	[format getCharacters:characters range:NSMakeRange(0, length)];
+	for (NSUInteger i = 0; i < length; i++) {
+		if (characters[i] != '%') continue;
+		if (++i == length) return NO;
+		unichar specifier = characters[i];
+		if (specifier == '%' || specifier == '@' || specifier == 'i' || specifier == 'd') continue;
+		if (specifier == 'l' && i+2 < length && characters[i+1] == 'l' && (characters[i+2] == 'i' || characters[i+2] == 'd')) {
+			i += 2;
+			continue;
+		}
+		return NO;
+	}
+	return YES;
+}
+
+static NSUInteger MAFormatInteger(long long value, unichar *characters)
+{
+	// Digits backwards, then reversed
+	unsigned long long magnitude = (value < 0) ? -(unsigned long long)value : (unsigned long long)value;
+	NSUInteger length = 0;
+	do {
+		characters[length++] = '0' + (magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude > 0);
+	if (value < 0) characters[length++] = '-';
+	for (NSUInteger i = 0; i < length / 2; i++) {
+		unichar character = characters[i];
+		characters[i] = characters[length-1-i];
+		characters[length-1-i] = character;
+	}
+	return length;
+}
+
+#pragma mark - Fragment
+
+@interface MACodeFragment : NSObject
+
+@property (nonatomic, strong, readonly) NSMutableArray *editableRangeKeys;
+@property (nonatomic, strong, readonly) NSMutableArray *extraRangeKeys;
+@property (nonatomic, strong) MACodeFragment *original; // The fragment this one's code was copied from, where it was written
+
+- (MACodeFragment *)writtenFragment; // The original, or self
+
+@end
+
+@implementation MACodeFragment
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_editableRangeKeys = [NSMutableArray array];
+		_extraRangeKeys = [NSMutableArray array];
+	}
+	return self;
+}
+
+- (MACodeFragment *)writtenFragment
+{
+	return self.original ?: self;
+}
+
+@end
+
 #pragma mark - Private Interface
 
 @interface MACodeTemplate ()
 
-@property (nonatomic, strong, readonly) NSMutableString *codeMutable;
-@property (nonatomic, strong, readonly) NSMutableDictionary *editableRangesMutable;
-@property (nonatomic, strong, readonly) NSMutableDictionary *extraRangesMutable;
+@property (nonatomic, strong, readonly) MACodeBuffer *buffer;
+@property (nonatomic, strong, readonly) MARangeIndex *ranges; // Editable, extra & fragment ranges, moved along with edits
 @property (nonatomic, readwrite) NSUInteger indentLevel;
 @property (nonatomic, copy) id<NSCopying> pendingKey;
+@property (nonatomic) BOOL suppressesOutput; // Inside an editable range whose code is written at its end
+@property (nonatomic, strong, readonly) NSMutableArray *indentPrefixes; // Indent string repeated, by level
 @property (nonatomic) BOOL hasWrittenToLine;
+// Fragments are not archived, a decoded template simply has none
+@property (nonatomic, strong, readonly) NSMutableDictionary *fragmentsMutable;
+@property (nonatomic, strong, readonly) NSMutableArray *fragmentKeysInOrderMutable;
+@property (nonatomic, strong, readonly) NSMutableSet *appendedFragmentKeys;
+@property (nonatomic, strong) MACodeFragment *pendingFragment;
+// Read back from a document, which keeps only the code in editable ranges: this has no code of its own then
+@property (nonatomic, strong) NSDictionary *storedCodeForEditableRanges; // May decode its strings as they are asked for
+@property (nonatomic, copy) NSArray *storedKeysForEditableRanges;
 
 @end
 
@@ -42,151 +134,207 @@ static NSString * const kCoderIndentLevelKey = @"indentLevel";
 {
     self = [super init];
     if (self) {
-		_codeMutable = [NSMutableString string];
-		_editableRangesMutable = [NSMutableDictionary dictionary];
-		_extraRangesMutable = [NSMutableDictionary dictionary];
+		_buffer = [[MACodeBuffer alloc] init];
+		_ranges = [[MARangeIndex alloc] init];
+		_fragmentsMutable = [NSMutableDictionary dictionary];
+		_fragmentKeysInOrderMutable = [NSMutableArray array];
+		_appendedFragmentKeys = [NSMutableSet set];
         _indentString = @"\t";
+		_indentPrefixes = [NSMutableArray array];
     }
     return self;
 }
 
+- (id)initWithCodeForEditableRanges:(NSDictionary *)code keysInOrder:(NSArray *)keys
+{
+	self = [self init];
+	if (self) {
+		_storedCodeForEditableRanges = code;
+		_storedKeysForEditableRanges = [keys copy];
+	}
+	return self;
+}
+
 - (id)initWithCoder:(NSCoder *)coder
 {
     self = [super init];
     if (self) {
-        _codeMutable = [coder decodeObjectForKey:kCoderCodeMutableKey];
-		_editableRangesMutable = [coder decodeObjectForKey:kCoderEditableRangesMutableKey];
-		_extraRangesMutable = [coder decodeObjectForKey:kCoderExtraRangesMutableKey];
+		_buffer = [[MACodeBuffer alloc] initWithString:[coder decodeObjectForKey:kCoderCodeMutableKey]];
+		_ranges = [[MARangeIndex alloc] init];
+		[self addRanges:[coder decodeObjectForKey:kCoderEditableRangesMutableKey] inSet:MARangeSetEditable];
+		[self addRanges:[coder decodeObjectForKey:kCoderExtraRangesMutableKey] inSet:MARangeSetExtra];
 		_indentString = [coder decodeObjectForKey:kCoderIndentStringKey];
+		_indentPrefixes = [NSMutableArray array];
 		_indentLevel = [coder decodeIntegerForKey:kCoderIndentLevelKey];
 		_pendingKey = [coder decodeObjectForKey:kCoderPendingKeyKey];
 		_hasWrittenToLine = [coder decodeBoolForKey:kCoderHasWrittenToLineKey];
+		_fragmentsMutable = [NSMutableDictionary dictionary];
+		_fragmentKeysInOrderMutable = [NSMutableArray array];
+		_appendedFragmentKeys = [NSMutableSet set];
     }
     return self;
 }
 
 - (void)encodeWithCoder:(NSCoder *)coder
 {
-	[coder encodeObject:self.codeMutable forKey:kCoderCodeMutableKey];
-	[coder encodeObject:self.editableRangesMutable forKey:kCoderEditableRangesMutableKey];
-	[coder encodeObject:self.extraRangesMutable forKey:kCoderExtraRangesMutableKey];
+	// Same format as when these were a mutable string & dictionaries
+	[coder encodeObject:[NSMutableString stringWithString:[self.buffer string]] forKey:kCoderCodeMutableKey];
+	[coder encodeObject:[[self.ranges rangesInSet:MARangeSetEditable] mutableCopy] forKey:kCoderEditableRangesMutableKey];
+	[coder encodeObject:[[self.ranges rangesInSet:MARangeSetExtra] mutableCopy] forKey:kCoderExtraRangesMutableKey];
 	[coder encodeObject:self.indentString forKey:kCoderIndentStringKey];
 	[coder encodeInteger:self.indentLevel forKey:kCoderIndentLevelKey];
 	[coder encodeObject:[self.pendingKey copyWithZone:nil] forKey:kCoderPendingKeyKey];
 	[coder encodeBool:self.hasWrittenToLine forKey:kCoderHasWrittenToLineKey];
 }
 
+- (id)copyWithZone:(NSZone *)zone
+{
+	// Fragments are finished once written, so they are shared
+	NSAssert(!self.sink, @"Streamed code can not be copied.");
+	NSAssert(!self.pendingFragment, @"Can not copy while writing a fragment.");
+	MACodeTemplate *copy = [[[self class] allocWithZone:zone] init];
+	copy->_buffer = [[MACodeBuffer alloc] initWithString:[self.buffer string]];
+	copy->_ranges = [self.ranges copy];
+	[copy.fragmentsMutable setDictionary:self.fragmentsMutable];
+	[copy.fragmentKeysInOrderMutable setArray:self.fragmentKeysInOrderMutable];
+	[copy.appendedFragmentKeys setSet:self.appendedFragmentKeys];
+	copy->_indentString = self.indentString;
+	copy->_indentLevel = self.indentLevel;
+	copy->_pendingKey = self.pendingKey;
+	copy->_hasWrittenToLine = self.hasWrittenToLine;
+	copy->_codeForEditableRangesToWrite = self.codeForEditableRangesToWrite;
+	copy->_storedCodeForEditableRanges = self.storedCodeForEditableRanges;
+	copy->_storedKeysForEditableRanges = self.storedKeysForEditableRanges;
+	copy->_editCount = self.editCount;
+	return copy;
+}
+
+- (void)addRanges:(NSDictionary *)ranges inSet:(MARangeSet)set
+{
+	// Enclosing ranges first, so ranges sharing a start nest the way they were written
+	NSArray *keys = [[ranges allKeys] sortedArrayUsingComparator:^NSComparisonResult(id key1, id key2) {
+		NSRange range1 = [ranges[key1] rangeValue];
+		NSRange range2 = [ranges[key2] rangeValue];
+		if (range1.location != range2.location) return range1.location < range2.location ? NSOrderedAscending : NSOrderedDescending;
+		if (range1.length != range2.length) return range1.length > range2.length ? NSOrderedAscending : NSOrderedDescending;
+		return NSOrderedSame;
+	}];
+	for (id key in keys) {
+		[self.ranges setRange:[ranges[key] rangeValue] forKey:key inSet:set];
+	}
+}
+
 #pragma mark - General
 
+- (void)setIndentString:(NSString *)indentString
+{
+	_indentString = [indentString copy];
+	[self.indentPrefixes removeAllObjects];
+}
+
 - (NSString *)code
 {
-	return [self.codeMutable copy];
+	if (self.sink) return [self.sink string];
+	return [self.buffer string];
 }
 
 - (NSString *)codeInRange:(NSRange)range
 {
-	return [self.codeMutable substringWithRange:range];
+	NSAssert(!self.sink, @"Streamed code can not be read back.");
+	return [self.buffer substringWithRange:range];
+}
+
+- (NSUInteger)codeLength
+{
+	if (self.sink) return [self.sink length];
+	return [self.buffer length];
+}
+
+- (NSRange)lineRangeForRange:(NSRange)range
+{
+	if (self.sink) return [self.sink lineRangeForRange:range];
+	return [self.buffer lineRangeForRange:range];
+}
+
+- (void)writeCodeToSink:(MACodeSink *)sink
+{
+	NSAssert(!self.sink, @"Code is already streamed.");
+	[self.buffer enumerateCharactersUsingBlock:^(const unichar *characters, NSUInteger length) {
+		[sink appendCharacters:characters length:length];
+	}];
 }
 
 #pragma mark - Editable ranges
 
 - (NSDictionary *)editableRanges
 {
-	return [self.editableRangesMutable copy];
+	return [self.ranges rangesInSet:MARangeSetEditable];
 }
 
 - (NSDictionary *)codeForEditableRanges
 {
-	NSMutableDictionary *codeDictionary = [NSMutableDictionary dictionary];
-	for (id key in [self.editableRangesMutable keyEnumerator]) {
-		NSRange range = [self.editableRangesMutable[key] rangeValue];
-		codeDictionary[key] = [self.codeMutable substringWithRange:range];
+	if (self.storedCodeForEditableRanges) return self.storedCodeForEditableRanges;
+	NSAssert(!self.sink, @"Streamed code can not be read back.");
+	NSDictionary *editableRanges = [self.ranges rangesInSet:MARangeSetEditable];
+	NSMutableDictionary *codeDictionary = [NSMutableDictionary dictionaryWithCapacity:[editableRanges count]];
+	for (id key in [editableRanges keyEnumerator]) {
+		codeDictionary[key] = [self.buffer substringWithRange:[editableRanges[key] rangeValue]];
 	}
 	return codeDictionary;
 }
 
 - (NSArray *)editableRangesInOrder
 {
-	NSArray *ranges = [self.editableRangesMutable allValues];
-	NSArray *sortedRanges = [ranges sortedArrayUsingComparator:^NSComparisonResult(id obj1, id obj2) {
-		return [self compareRange:[obj1 rangeValue] toRange:[obj2 rangeValue]];
-	}];
-	return sortedRanges;
+	NSArray *keys = [self.ranges keysInOrderInSet:MARangeSetEditable];
+	NSMutableArray *ranges = [NSMutableArray arrayWithCapacity:[keys count]];
+	for (id key in keys) {
+		[ranges addObject:[NSValue valueWithRange:[self.ranges rangeForKey:key inSet:MARangeSetEditable]]];
+	}
+	return ranges;
 }
 
 - (NSArray *)keysForEditableRangesInOrder
 {
-	NSArray *keys = [self.editableRangesMutable allKeys];
-	NSArray *sortedKeys = [keys sortedArrayUsingComparator:^NSComparisonResult(id key1, id key2) {
-		NSRange range1 = [self.editableRangesMutable[key1] rangeValue];
-		NSRange range2 = [self.editableRangesMutable[key2] rangeValue];
-		return [self compareRange:range1 toRange:range2];
-	}];
-	return sortedKeys;
+	if (self.storedKeysForEditableRanges) return self.storedKeysForEditableRanges;
+	return [self.ranges keysInOrderInSet:MARangeSetEditable];
 }
 
-- (NSComparisonResult)compareRange:(NSRange)range1 toRange:(NSRange)range2
+- (NSArray *)keysForEditableRangesTouchingRange:(NSRange)range
 {
-	if (range1.location < range2.location) return NSOrderedAscending;
-	if (range1.location > range2.location) return NSOrderedDescending;
-	return NSOrderedSame;
+	return [self.ranges keysOfRangesTouchingRange:range inSet:MARangeSetEditable];
 }
 
 - (NSRange)editableRangeForKey:(id)key
 {
-	NSValue *rangeObject = self.editableRangesMutable[key];
-	if (!rangeObject) return NSMakeRange(NSNotFound, 0);
-	return [rangeObject rangeValue];
+	return [self.ranges rangeForKey:key inSet:MARangeSetEditable];
 }
 
 - (NSString *)codeForEditableRangeWithKey:(id)key
 {
+	if (self.storedCodeForEditableRanges) return self.storedCodeForEditableRanges[key];
 	// Get range
-	NSValue *rangeObject = self.editableRangesMutable[key];
-	if (!rangeObject) return nil;
-	NSRange range = [rangeObject rangeValue];
+	NSRange range = [self.ranges rangeForKey:key inSet:MARangeSetEditable];
+	if (range.location == NSNotFound) return nil;
+	NSAssert(!self.sink, @"Streamed code can not be read back.");
 	// Return code
-	return [self.codeMutable substringWithRange:range];
+	return [self.buffer substringWithRange:range];
 }
 
 - (BOOL)setCode:(NSString *)newCodeForRange forEditableRangeWithKey:(id)key
 {
 	// Get range
-	NSValue *rangeObject = self.editableRangesMutable[key];
-	if (!rangeObject) return false;
-	NSRange range = [rangeObject rangeValue];
+	NSRange range = [self.ranges rangeForKey:key inSet:MARangeSetEditable];
+	if (range.location == NSNotFound) return false;
+	NSAssert(!self.sink, @"Streamed code can not be edited.");
 	// Replace code
-	[self.codeMutable replaceCharactersInRange:range withString:newCodeForRange];
-	// Update range
-	NSRange oldRange = range;
-	range = NSMakeRange(oldRange.location, [newCodeForRange length]);
-	self.editableRangesMutable[key] = [NSValue valueWithRange:range];
-	// Update other ranges
-	NSInteger lengthChange = range.length - oldRange.length;
-	[self updateRanges:self.editableRangesMutable forLengthChange:lengthChange ofRange:oldRange withKey:key];
-	[self updateRanges:self.extraRangesMutable forLengthChange:lengthChange ofRange:oldRange withKey:key];
+	[self.buffer replaceCharactersInRange:range withString:newCodeForRange];
+	// Update range (which moves all others along)
+	[self.ranges setLength:[newCodeForRange length] ofRangeWithKey:key inSet:MARangeSetEditable];
+	_editCount++;
 	// Return
 	return true;
 }
 
-- (void)updateRanges:(NSMutableDictionary *)ranges forLengthChange:(NSInteger)lengthChange ofRange:(NSRange)oldRange withKey:(id)changedRangeKey
-{
-	for (id key in [[ranges copy] keyEnumerator]) { // Use copy to allow modification
-		if ([key isEqual:changedRangeKey]) continue;
-		NSRange range = [ranges[key] rangeValue];
-		if (NSMaxRange(oldRange) <= range.location) { // Range is after changed range
-			range.location += lengthChange;
-		} else if (oldRange.location < NSMaxRange(range)) { // Range intersects with changed range
-			if (NSMaxRange(oldRange) <= NSMaxRange(range)) {
-				range.length += lengthChange;
-			} else {
-				NSAssert(false, @"Invalidly intersecting ranges in code, unable to properly adjust range.");
-			}
-		}
-		ranges[key] = [NSValue valueWithRange:range];
-	}
-}
-
 - (BOOL)canSubstituteOldRangeWithKey:(id)key forNewRangeWithKey:(id)otherKey
 {
 	return NO;
@@ -197,21 +345,185 @@ static NSString * const kCoderIndentLevelKey = @"indentLevel";
 	return NO;
 }
 
+#pragma mark - Merging
+
+- (void)mergeCodeFromTemplate:(MACodeTemplate *)oldTemplate
+{
+	if (!oldTemplate) return;
+	NSDictionary *mergedCode = [self mergedCodeFromTemplate:oldTemplate forKeysInOrder:[self keysForEditableRangesInOrder]];
+	for (id key in [mergedCode keyEnumerator]) {
+		[self setCode:mergedCode[key] forEditableRangeWithKey:key];
+	}
+}
+
+- (NSDictionary *)mergedCodeFromTemplate:(MACodeTemplate *)oldTemplate forKeysInOrder:(NSArray *)sortedNewKeys
+{
+	NSMutableDictionary *mergedCode = [NSMutableDictionary dictionary];
+	if (!oldTemplate) return mergedCode;
+	// Prepare
+	NSArray *sortedOldKeys = [oldTemplate keysForEditableRangesInOrder];
+	NSSet *oldKeys = [NSSet setWithArray:sortedOldKeys];
+	NSDictionary *oldCode = [oldTemplate codeForEditableRanges];
+	NSMutableDictionary *newKeyIndexes = [NSMutableDictionary dictionaryWithCapacity:[sortedNewKeys count]];
+	[sortedNewKeys enumerateObjectsUsingBlock:^(id key, NSUInteger index, BOOL *stop) {
+		newKeyIndexes[key] = @(index);
+	}];
+	// For all editable pieces of code
+	id previousKey = nil;
+	id orphanedCodeKey = nil;
+	for (id key in sortedOldKeys) {
+		// Get code, and prepend any orphaned code
+		NSString *code = oldCode[key];
+		if (orphanedCodeKey) {
+			BOOL canMerge = [self canMergeRangeWithKey:orphanedCodeKey withOtherRangeWithKey:key];
+			if (canMerge) code = [oldCode[orphanedCodeKey] stringByAppendingString:code];
+			orphanedCodeKey = nil;
+		}
+		// Try inserting the old code in the spot with the same key
+		if (newKeyIndexes[key]) {
+			mergedCode[key] = code;
+			previousKey = key;
+			continue;
+		}
+		// The range with that key does not exist anymore in the template, see if it's worth keeping
+		NSString *trimmedCode = [code stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+		if ([trimmedCode length] == 0) continue;
+		// See if there is an unused key after the previously used one
+		NSUInteger indexAfterPrevious = previousKey ? [newKeyIndexes[previousKey] unsignedIntegerValue]+1 : 0;
+		if (indexAfterPrevious < [sortedNewKeys count]) {
+			id nextKey = sortedNewKeys[indexAfterPrevious];
+			BOOL canSubstitute = [self canSubstituteOldRangeWithKey:key forNewRangeWithKey:nextKey];
+			if (![oldKeys containsObject:nextKey] && canSubstitute) { // If it's not used we put the code there
+				mergedCode[nextKey] = code;
+				previousKey = nextKey;
+				continue;
+			}
+		}
+		// If not, append the code to the previously added part
+		if (previousKey && [self canMergeRangeWithKey:previousKey withOtherRangeWithKey:key]) {
+			mergedCode[previousKey] = [mergedCode[previousKey] stringByAppendingString:code];
+		} else {
+			orphanedCodeKey = key; // No previously added code, mark as orphaned and let the next piece try to prepend it
+		}
+	}
+	return mergedCode;
+}
+
 #pragma mark - Extra ranges
 
 - (NSDictionary *)extraRanges
 {
-	return [self.extraRangesMutable copy];
+	return [self.ranges rangesInSet:MARangeSetExtra];
 }
 
 - (NSRange)extraRangeForKey:(id)key
 {
-	return [self.extraRangesMutable[key] rangeValue];
+	NSRange range = [self.ranges rangeForKey:key inSet:MARangeSetExtra];
+	if (range.location == NSNotFound) return NSMakeRange(0, 0);
+	return range;
 }
 
 - (void)addExtraRange:(NSRange)range forKey:(id)key
 {
-	self.extraRangesMutable[key] = [NSValue valueWithRange:range];
+	[self.ranges setRange:range forKey:key inSet:MARangeSetExtra];
+	[self.pendingFragment.extraRangeKeys addObject:key];
+}
+
+#pragma mark - Fragments
+
+- (NSArray *)fragmentKeysInOrder
+{
+	return [self.fragmentKeysInOrderMutable copy];
+}
+
+- (NSRange)fragmentRangeForKey:(id)key
+{
+	return [self.ranges rangeForKey:key inSet:MARangeSetFragment];
+}
+
+- (NSArray *)keysForEditableRangesInFragmentWithKey:(id)key
+{
+	MACodeFragment *fragment = self.fragmentsMutable[key];
+	return [fragment.editableRangeKeys copy];
+}
+
+- (void)fragment:(void(^)())block withKey:(id<NSCopying>)key
+{
+	NSAssert(!self.pendingFragment, @"Fragments can not be nested.");
+	MACodeFragment *fragment = [[MACodeFragment alloc] init];
+	NSUInteger location = [self codeLength];
+	self.pendingFragment = fragment;
+	block();
+	self.pendingFragment = nil;
+	[self addFragment:fragment withKey:key range:NSMakeRange(location, [self codeLength] - location)];
+}
+
+- (BOOL)appendFragmentWithKey:(id)key fromTemplate:(MACodeTemplate *)otherTemplate
+{
+	MACodeFragment *otherFragment = otherTemplate.fragmentsMutable[key];
+	if (!otherFragment || self.pendingFragment || self.pendingKey) return NO;
+	// Copy code
+	NSRange otherRange = [otherTemplate fragmentRangeForKey:key];
+	NSUInteger location = [self codeLength];
+	unichar characters[kOutputChunkLength];
+	for (NSUInteger offset = 0; offset < otherRange.length; offset += kOutputChunkLength) {
+		NSUInteger length = MIN(otherRange.length - offset, kOutputChunkLength);
+		[otherTemplate.buffer getCharacters:characters range:NSMakeRange(otherRange.location + offset, length)];
+		[self appendCharacters:characters length:length];
+	}
+	if (otherRange.length > 0) self.hasWrittenToLine = YES;
+	// Copy ranges, moved to their new location
+	MACodeFragment *fragment = [[MACodeFragment alloc] init];
+	fragment.original = [otherFragment writtenFragment];
+	[self addFragment:fragment withKey:key range:NSMakeRange(location, otherRange.length)];
+	for (id rangeKey in otherFragment.editableRangeKeys) {
+		NSRange range = [otherTemplate.ranges rangeForKey:rangeKey inSet:MARangeSetEditable];
+		range.location = range.location - otherRange.location + location;
+		[self.ranges setRange:range forKey:rangeKey inSet:MARangeSetEditable];
+		[fragment.editableRangeKeys addObject:rangeKey];
+	}
+	for (id rangeKey in otherFragment.extraRangeKeys) {
+		NSRange range = [otherTemplate.ranges rangeForKey:rangeKey inSet:MARangeSetExtra];
+		range.location = range.location - otherRange.location + location;
+		[self.ranges setRange:range forKey:rangeKey inSet:MARangeSetExtra];
+		[fragment.extraRangeKeys addObject:rangeKey];
+	}
+	[self.appendedFragmentKeys addObject:key];
+	return YES;
+}
+
+- (NSArray *)editsFromTemplate:(MACodeTemplate *)oldTemplate
+{
+	NSMutableArray *edits = [NSMutableArray array];
+	NSUInteger oldLocation = 0;
+	NSUInteger newLocation = 0;
+	// Keep the appended fragments that are still in the same order, and replace everything in between. Only if the old
+	// template has the same code for them, copied from the same fragment (they may come from a template that wasn't shown).
+	for (id key in self.fragmentKeysInOrderMutable) {
+		if (![self.appendedFragmentKeys containsObject:key]) continue;
+		MACodeFragment *oldFragment = oldTemplate.fragmentsMutable[key];
+		if ([oldFragment writtenFragment] != [self.fragmentsMutable[key] writtenFragment]) continue;
+		NSRange oldRange = [oldTemplate fragmentRangeForKey:key];
+		if (oldRange.location == NSNotFound || oldRange.location < oldLocation) continue;
+		NSRange newRange = [self fragmentRangeForKey:key];
+		NSRange replacedRange = NSMakeRange(oldLocation, oldRange.location - oldLocation);
+		[self addEditReplacingRange:replacedRange ofTemplate:oldTemplate withRange:NSMakeRange(newLocation, newRange.location - newLocation) toEdits:edits];
+		oldLocation = NSMaxRange(oldRange);
+		newLocation = NSMaxRange(newRange);
+	}
+	NSRange replacedRange = NSMakeRange(oldLocation, [oldTemplate codeLength] - oldLocation);
+	[self addEditReplacingRange:replacedRange ofTemplate:oldTemplate withRange:NSMakeRange(newLocation, [self codeLength] - newLocation) toEdits:edits];
+	return edits;
+}
+
+- (void)addEditReplacingRange:(NSRange)replacedRange ofTemplate:(MACodeTemplate *)oldTemplate withRange:(NSRange)range toEdits:(NSMutableArray *)edits
+{
+	if (replacedRange.length == range.length) {
+		if (range.length == 0) return;
+		NSString *oldCode = [oldTemplate.buffer substringWithRange:replacedRange];
+		if ([oldCode isEqualToString:[self.buffer substringWithRange:range]]) return; // Regenerated, but identical
+	}
+	[edits addObject:[[MACodeEdit alloc] initWithReplacedRange:replacedRange range:range]];
 }
 
 #pragma mark - Writing functions
@@ -225,33 +537,26 @@ static NSString * const kCoderIndentLevelKey = @"indentLevel";
 
 - (void)write:(NSString *)format, ...
 {
-	// Get string
 	va_list args;
 	va_start(args, format);
-	NSString *string = [[NSString alloc] initWithFormat:format arguments:args];
+	[self appendFormat:format arguments:args];
 	va_end(args);
-	// Append
-	[self.codeMutable appendString:string];
 	self.hasWrittenToLine = YES;
 }
 
 - (void)writeLine:(NSString *)format, ...
 {
-	// Get string
-	va_list args;
-	va_start(args, format);
-	NSString *string = [[NSString alloc] initWithFormat:format arguments:args];
-	va_end(args);
 	// Write new line
 	if (self.hasWrittenToLine) {
-		[self.codeMutable appendString:@"\n"];
+		[self appendCharacters:&kNewline length:1];
 	}
 	// Write indent
-	for (int i=0; i<self.indentLevel; i++) {
-		[self.codeMutable appendString:self.indentString];
-	}
+	[self appendString:[self indentPrefix]];
 	// Write code
-	[self.codeMutable appendString:string];
+	va_list args;
+	va_start(args, format);
+	[self appendFormat:format arguments:args];
+	va_end(args);
 	self.hasWrittenToLine = YES;
 }
 
@@ -288,18 +593,130 @@ static NSString * const kCoderIndentLevelKey = @"indentLevel";
 - (void)beginEditableRangeWithKey:(id<NSCopying>)key
 {
 	if (self.pendingKey) [self endEditableRange];
-	NSRange range = NSMakeRange([self.codeMutable length], 0);
-	self.editableRangesMutable[key] = [NSValue valueWithRange:range];
+	NSRange range = NSMakeRange([self codeLength], 0);
+	[self.ranges setRange:range forKey:key inSet:MARangeSetEditable];
 	self.pendingKey = key;
+	self.suppressesOutput = (self.sink && self.codeForEditableRangesToWrite[key]); // Can't take back what's streamed
+	[self.pendingFragment.editableRangeKeys addObject:key];
 }
 
 - (void)endEditableRange
 {
 	if (!self.pendingKey) return;
-	NSRange range = [self.editableRangesMutable[self.pendingKey] rangeValue];
-	range.length = [self.codeMutable length] - range.location;
-	self.editableRangesMutable[self.pendingKey] = [NSValue valueWithRange:range];
+	NSRange range = [self.ranges rangeForKey:self.pendingKey inSet:MARangeSetEditable];
+	NSString *code = self.codeForEditableRangesToWrite[self.pendingKey];
+	if (code && self.sink) { // Nothing was written, write it now
+		self.suppressesOutput = NO;
+		[self appendString:code];
+	} else if (code) { // Replace what was written (so the state of the writer is kept as is)
+		[self.buffer replaceCharactersInRange:NSMakeRange(range.location, [self.buffer length] - range.location) withString:code];
+	}
+	[self.ranges setLength:[self codeLength] - range.location ofRangeWithKey:self.pendingKey inSet:MARangeSetEditable];
 	self.pendingKey = nil;
 }
 
+- (NSString *)indentPrefix
+{
+	while ([self.indentPrefixes count] <= self.indentLevel) {
+		NSString *previousPrefix = [self.indentPrefixes lastObject];
+		[self.indentPrefixes addObject:(previousPrefix ? [previousPrefix stringByAppendingString:self.indentString] : @"")];
+	}
+	return self.indentPrefixes[self.indentLevel];
+}
+
+- (void)appendCharacters:(const unichar *)characters length:(NSUInteger)length
+{
+	if (self.suppressesOutput) return;
+	if (self.sink) [self.sink appendCharacters:characters length:length];
+	else [self.buffer appendCharacters:characters length:length];
+}
+
+- (void)appendString:(NSString *)string
+{
+	if (self.suppressesOutput) return;
+	if (self.sink) [self.sink appendString:string];
+	else [self.buffer appendString:string];
+}
+
+- (void)appendFormat:(NSString *)format arguments:(va_list)args
+{
+	// Formats the specifiers the templates use straight into the output, anything else goes through NSString
+	NSUInteger formatLength = [format length];
+	unichar formatCharacters[kFormatLength];
+	if (formatLength > kFormatLength || !MAIsSimpleFormat(format, formatCharacters, formatLength)) {
+		[self appendString:[[NSString alloc] initWithFormat:format arguments:args]];
+		return;
+	}
+	unichar output[kOutputChunkLength];
+	NSUInteger outputLength = 0;
+	for (NSUInteger i = 0; i < formatLength; i++) {
+		unichar character = formatCharacters[i];
+		if (character != '%') {
+			if (outputLength == kOutputChunkLength) {
+				[self appendCharacters:output length:outputLength];
+				outputLength = 0;
+			}
+			output[outputLength++] = character;
+			continue;
+		}
+		// Specifier
+		unichar specifier = formatCharacters[++i];
+		if (specifier == '%') {
+			if (outputLength == kOutputChunkLength) {
+				[self appendCharacters:output length:outputLength];
+				outputLength = 0;
+			}
+			output[outputLength++] = '%';
+		} else if (specifier == '@') {
+			[self appendCharacters:output length:outputLength];
+			outputLength = 0;
+			id object = va_arg(args, id);
+			[self appendString:(object ? [object description] : @"(null)")];
+		} else {
+			long long value;
+			if (specifier == 'l') { // %lli
+				i += 2;
+				value = va_arg(args, long long);
+			} else {
+				value = va_arg(args, int);
+			}
+			if (outputLength + kMaximumIntegerLength > kOutputChunkLength) {
+				[self appendCharacters:output length:outputLength];
+				outputLength = 0;
+			}
+			outputLength += MAFormatInteger(value, output + outputLength);
+		}
+	}
+	[self appendCharacters:output length:outputLength];
+}
+
+- (void)addFragment:(MACodeFragment *)fragment withKey:(id<NSCopying>)key range:(NSRange)range
+{
+	NSAssert(!self.fragmentsMutable[key], @"Duplicate fragment key.");
+	self.fragmentsMutable[key] = fragment;
+	[self.ranges setRange:range forKey:key inSet:MARangeSetFragment];
+	[self.fragmentKeysInOrderMutable addObject:key];
+}
+
+@end
+
+#pragma mark - Edit
+
+@implementation MACodeEdit
+
+- (id)initWithReplacedRange:(NSRange)replacedRange range:(NSRange)range
+{
+	self = [super init];
+	if (self) {
+		_replacedRange = replacedRange;
+		_range = range;
+	}
+	return self;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"%@ -> %@", NSStringFromRange(self.replacedRange), NSStringFromRange(self.range)];
+}
+
 @end
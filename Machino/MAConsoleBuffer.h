@@ -0,0 +1,51 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAPlatform.h"
+
+extern const NSUInteger kConsoleMaximumLineLength; // In UTF-16 units, like NSString lengths
+
+// What changed in a console since the view last took an update: text to remove from the start of what it shows, then
+// text to append to the end. Applying both leaves the view showing exactly the lines the buffer keeps.
+@interface MAConsoleUpdate : NSObject
+
+@property (nonatomic, readonly) NSUInteger removedLength;
+@property (nonatomic, copy, readonly) NSAttributedString *appendedText;
+
+@end
+
+// The text of a console, with only the last lineCapacity lines of it in memory: a ring of each kept line's offset into
+// everything appended, plus the text appended since the view last took an update. Every line also goes to a spill file
+// in the temporary directory, which saving the full log and searching it stream from. Lines longer than
+// kConsoleMaximumLineLength count as several, so a sketch printing without newlines can't grow one line without bound. Like
+// MATelemetryCoalescer it doesn't schedule anything itself: the first change after an update was taken calls
+// updateRequestHandler, and the owner takes the update when the display is due. Not thread-safe, use it from one queue.
+@interface MAConsoleBuffer : NSObject
+
+@property (nonatomic, copy) void (^updateRequestHandler)(void);
+@property (nonatomic, readonly) NSUInteger lineCapacity;
+@property (nonatomic, readonly) NSUInteger lineCount; // Kept, the last one possibly unfinished (so at least 1)
+@property (nonatomic, readonly) NSUInteger length; // Of the kept lines
+@property (nonatomic, readonly) unsigned long long totalLength; // Of everything appended since the last clear
+@property (nonatomic, readonly) BOOL hasPendingUpdate;
+@property (nonatomic, copy, readonly) NSString *spillPath; // nil if the spill file couldn't be created
+
+- (id)initWithLineCapacity:(NSUInteger)lineCapacity;
+
+- (void)appendString:(NSString *)string attributes:(NSDictionary *)attributes;
+- (MAConsoleUpdate *)takeUpdate; // nil if nothing changed since the last one
+- (NSRange)rangeOfLineAtIndex:(NSUInteger)index; // Of a kept line in the kept text, newline included
+- (void)clear; // Empties the spill file too, without an update: the view should empty itself
+
+// Both stream from the spill file, so they cover everything since the last clear, not only the kept lines
+- (BOOL)writeFullLogToPath:(NSString *)path error:(NSError **)error; // Replaces any file at path
+- (BOOL)enumerateLinesContainingString:(NSString *)string options:(NSStringCompareOptions)options usingBlock:(void (^)(unsigned long long lineNumber, NSString *line, BOOL *stop))block; // Line numbers from 1, newline left off. NO if reading failed
+
+@end
@@ -0,0 +1,300 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAConsoleBuffer.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <errno.h>
+#import <stdio.h>
+
+const NSUInteger kConsoleMaximumLineLength = 4096;
+static const NSUInteger kSpillBufferLength = 65536; // Written out once full, and with every update
+static const NSUInteger kSpillCopyLength = 65536;
+
+#pragma mark - Private Interfaces
+
+@interface MAConsoleUpdate ()
+
+@property (nonatomic, readwrite) NSUInteger removedLength;
+@property (nonatomic, copy, readwrite) NSAttributedString *appendedText;
+
+@end
+
+@interface MAConsoleBuffer () {
+	UInt64 *_lineOffsets; // Ring of lineCapacity, from firstLine on
+}
+
+@property (nonatomic, readwrite) NSUInteger lineCapacity;
+@property (nonatomic, readwrite) NSUInteger lineCount;
+@property (nonatomic, readwrite) unsigned long long totalLength;
+@property (nonatomic, readwrite) BOOL hasPendingUpdate;
+@property (nonatomic, copy, readwrite) NSString *spillPath;
+@property (nonatomic) NSUInteger firstLine;
+@property (nonatomic) UInt64 shownStart; // What the view shows as of the last update, as offsets into everything appended
+@property (nonatomic) UInt64 shownEnd;
+@property (nonatomic, strong) NSMutableAttributedString *pendingText; // Appended since, up to totalLength
+@property (nonatomic) int spillDescriptor; // -1 if there's no spill file
+@property (nonatomic, strong) NSMutableData *spillBuffer;
+
+@end
+
+#pragma mark - MAConsoleUpdate
+
+@implementation MAConsoleUpdate
+
+@end
+
+#pragma mark - MAConsoleBuffer
+
+@implementation MAConsoleBuffer
+
+- (id)initWithLineCapacity:(NSUInteger)lineCapacity
+{
+	self = [super init];
+	if (self) {
+		_lineCapacity = MAX(lineCapacity, 1);
+		_lineOffsets = calloc(_lineCapacity, sizeof(UInt64));
+		_lineCount = 1; // The empty first line
+		_pendingText = [[NSMutableAttributedString alloc] init];
+		_spillBuffer = [NSMutableData dataWithCapacity:kSpillBufferLength];
+		// Spill file, unlinked when done
+		NSString *template = [NSTemporaryDirectory() stringByAppendingPathComponent:@"MachinoConsole.XXXXXX"];
+		char *path = strdup([template fileSystemRepresentation]);
+		_spillDescriptor = mkstemp(path);
+		if (_spillDescriptor >= 0) {
+			fcntl(_spillDescriptor, F_SETFL, O_APPEND); // Still at the end after clearing
+			_spillPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:path length:strlen(path)];
+		} else {
+			NSLog(@"Couldn't create console spill file: %s", strerror(errno));
+		}
+		free(path);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	free(_lineOffsets);
+	if (_spillDescriptor >= 0) {
+		close(_spillDescriptor);
+		unlink([_spillPath fileSystemRepresentation]);
+	}
+}
+
+#pragma mark - Lines
+
+- (UInt64)startOffset
+{
+	return _lineOffsets[self.firstLine];
+}
+
+- (NSUInteger)length
+{
+	return (NSUInteger)(self.totalLength - [self startOffset]);
+}
+
+- (void)startLineAtOffset:(UInt64)offset
+{
+	// Drops the first line once the ring is full
+	if (self.lineCount == self.lineCapacity) {
+		self.firstLine = (self.firstLine + 1) % self.lineCapacity;
+		self.lineCount--;
+	}
+	_lineOffsets[(self.firstLine + self.lineCount) % self.lineCapacity] = offset;
+	self.lineCount++;
+}
+
+- (NSRange)rangeOfLineAtIndex:(NSUInteger)index
+{
+	if (index >= self.lineCount) return NSMakeRange(NSNotFound, 0);
+	UInt64 start = _lineOffsets[(self.firstLine + index) % self.lineCapacity];
+	UInt64 end = (index + 1 < self.lineCount) ? _lineOffsets[(self.firstLine + index + 1) % self.lineCapacity] : self.totalLength;
+	return NSMakeRange((NSUInteger)(start - [self startOffset]), (NSUInteger)(end - start));
+}
+
+#pragma mark - Appending
+
+- (void)appendString:(NSString *)string attributes:(NSDictionary *)attributes
+{
+	NSUInteger length = [string length];
+	if (length == 0) return;
+	[self spillString:string];
+	// Index the lines it starts
+	UInt64 offset = self.totalLength;
+	UInt64 lineStart = _lineOffsets[(self.firstLine + self.lineCount - 1) % self.lineCapacity];
+	unichar characters[256];
+	for (NSUInteger chunk = 0; chunk < length; chunk += 256) {
+		NSUInteger chunkLength = MIN(length - chunk, 256);
+		[string getCharacters:characters range:NSMakeRange(chunk, chunkLength)];
+		for (NSUInteger i = 0; i < chunkLength; i++, offset++) {
+			unichar character = characters[i];
+			BOOL isLowSurrogate = (character >= 0xDC00 && character <= 0xDFFF);
+			if (character != '\n' && !isLowSurrogate && offset - lineStart >= kConsoleMaximumLineLength) {
+				[self startLineAtOffset:offset]; // Overlong, the rest counts as the next line
+				lineStart = offset;
+			}
+			if (character == '\n') {
+				[self startLineAtOffset:offset + 1];
+				lineStart = offset + 1;
+			}
+		}
+	}
+	UInt64 appendStart = self.totalLength;
+	self.totalLength = offset;
+	// Pending text, without what's dropped already
+	UInt64 startOffset = [self startOffset];
+	UInt64 pendingStart = self.totalLength - length - [self.pendingText length];
+	if (startOffset > pendingStart) {
+		NSUInteger dropLength = (NSUInteger)MIN(startOffset - pendingStart, [self.pendingText length]);
+		[self.pendingText deleteCharactersInRange:NSMakeRange(0, dropLength)];
+	}
+	NSUInteger skipLength = (startOffset > appendStart) ? (NSUInteger)(startOffset - appendStart) : 0;
+	NSString *appended = (skipLength > 0) ? [string substringFromIndex:skipLength] : string;
+	NSAttributedString *appendedText = [[NSAttributedString alloc] initWithString:appended attributes:attributes];
+	[self.pendingText appendAttributedString:appendedText];
+	[self noteChange];
+}
+
+- (void)noteChange
+{
+	if (self.hasPendingUpdate) return;
+	self.hasPendingUpdate = YES;
+	if (self.updateRequestHandler) self.updateRequestHandler();
+}
+
+- (MAConsoleUpdate *)takeUpdate
+{
+	if (!self.hasPendingUpdate) return nil;
+	[self flushSpillBuffer];
+	UInt64 startOffset = [self startOffset];
+	MAConsoleUpdate *update = [[MAConsoleUpdate alloc] init];
+	update.removedLength = (NSUInteger)(MIN(startOffset, self.shownEnd) - self.shownStart);
+	update.appendedText = self.pendingText;
+	self.pendingText = [[NSMutableAttributedString alloc] init];
+	self.shownStart = startOffset;
+	self.shownEnd = self.totalLength;
+	self.hasPendingUpdate = NO;
+	return update;
+}
+
+- (void)clear
+{
+	self.firstLine = 0;
+	self.lineCount = 1;
+	_lineOffsets[0] = 0;
+	self.totalLength = 0;
+	self.shownStart = 0;
+	self.shownEnd = 0;
+	self.pendingText = [[NSMutableAttributedString alloc] init];
+	self.hasPendingUpdate = NO;
+	[self.spillBuffer setLength:0];
+	if (self.spillDescriptor >= 0 && ftruncate(self.spillDescriptor, 0) != 0) {
+		NSLog(@"Couldn't empty console spill file: %s", strerror(errno));
+	}
+}
+
+#pragma mark - Spill File
+
+- (void)spillString:(NSString *)string
+{
+	if (self.spillDescriptor < 0) return;
+	NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+	[self.spillBuffer appendData:data];
+	if ([self.spillBuffer length] >= kSpillBufferLength) [self flushSpillBuffer];
+}
+
+- (BOOL)flushSpillBuffer
+{
+	if (self.spillDescriptor < 0) return NO;
+	const Byte *bytes = [self.spillBuffer bytes];
+	NSUInteger length = [self.spillBuffer length];
+	NSUInteger written = 0;
+	while (written < length) {
+		ssize_t result = write(self.spillDescriptor, bytes + written, length - written);
+		if (result < 0 && errno == EINTR) continue;
+		if (result < 0) {
+			NSLog(@"Couldn't write console spill file: %s", strerror(errno));
+			[self.spillBuffer setLength:0];
+			return NO;
+		}
+		written += result;
+	}
+	[self.spillBuffer setLength:0];
+	return YES;
+}
+
+- (BOOL)writeFullLogToPath:(NSString *)path error:(NSError **)error
+{
+	if (![self flushSpillBuffer]) {
+		if (error) *error = [NSError errorWithDomain:@"" code:0 userInfo:@{NSLocalizedDescriptionKey: @"The console log couldn't be kept."}];
+		return NO;
+	}
+	int fileDescriptor = open([path fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fileDescriptor < 0) {
+		if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+		return NO;
+	}
+	// Copy in chunks
+	Byte *buffer = malloc(kSpillCopyLength);
+	off_t offset = 0;
+	BOOL success = YES;
+	while (success) {
+		ssize_t readLength = pread(self.spillDescriptor, buffer, kSpillCopyLength, offset);
+		if (readLength < 0 && errno == EINTR) continue;
+		if (readLength <= 0) {
+			success = (readLength == 0);
+			break;
+		}
+		for (ssize_t written = 0; written < readLength; ) {
+			ssize_t result = write(fileDescriptor, buffer + written, readLength - written);
+			if (result < 0 && errno == EINTR) continue;
+			if (result < 0) {
+				success = NO;
+				break;
+			}
+			written += result;
+		}
+		offset += readLength;
+	}
+	if (!success && error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+	free(buffer);
+	if (close(fileDescriptor) != 0 && success) {
+		if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+		success = NO;
+	}
+	return success;
+}
+
+- (BOOL)enumerateLinesContainingString:(NSString *)string options:(NSStringCompareOptions)options usingBlock:(void (^)(unsigned long long lineNumber, NSString *line, BOOL *stop))block
+{
+	if (![self flushSpillBuffer]) return NO;
+	FILE *file = fopen([self.spillPath fileSystemRepresentation], "r");
+	if (!file) return NO;
+	char *bytes = NULL;
+	size_t capacity = 0;
+	ssize_t length;
+	unsigned long long lineNumber = 0;
+	BOOL stop = NO;
+	while (!stop && (length = getline(&bytes, &capacity, file)) >= 0) {
+		lineNumber++;
+		if (length > 0 && bytes[length-1] == '\n') length--;
+		@autoreleasepool {
+			NSString *line = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+			if (!line) line = [[NSString alloc] initWithBytes:bytes length:length encoding:NSISOLatin1StringEncoding]; // Cut off mid-character
+			if ([line rangeOfString:string options:options].location != NSNotFound) block(lineNumber, line, &stop);
+		}
+	}
+	BOOL success = !ferror(file);
+	free(bytes);
+	fclose(file);
+	return success;
+}
+
+@end
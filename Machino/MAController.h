@@ -27,6 +27,8 @@
 
 - (IBAction)run:(id)sender;
 - (IBAction)stop:(id)sender;
+- (IBAction)saveConsoleLog:(id)sender;
+- (IBAction)searchConsoleLog:(id)sender;
 - (void)updateBoardsMenu:(NSMenu *)menu;
 - (void)updateSerialPortsMenu:(NSMenu *)menu;
 
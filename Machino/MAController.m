@@ -12,13 +12,21 @@
 #import <QuartzCore/QuartzCore.h>
 #import "MAController.h"
 #import "MACodeController.h"
+#import "MACodeSink.h"
 #import "Graph.h"
 #import "Arduino.h"
+#import "MAProfile.h"
+#import "MATelemetryCoalescer.h"
+#import "MAConsoleBuffer.h"
 #import "Utility.h"
 
 const CGFloat kDefaultConsoleHeight = 160;
 const CGFloat kMinConsoleHeight = 120;
 const CGFloat kMinCodeViewWidth = 260;
+const CFTimeInterval kTelemetryFrameInterval = 1.0 / 60; // Running sketches update the views at most this often
+const NSUInteger kDefaultConsoleLineCapacity = 10000;
+static NSString * const kDefaultsKeyConsoleLineCapacity = @"ConsoleLineCapacity"; // Hidden setting, lines each console keeps in memory
+static const NSUInteger kMaximumConsoleSearchResults = 1000; // Lines listed by Search Whole Console Log
 
 typedef NS_ENUM(NSUInteger, MAConsoleMode) {
 	MAOutputConsole = 0,
@@ -36,6 +44,12 @@ typedef NS_ENUM(NSInteger, MAState) {
 @property (nonatomic) MAState state;
 @property (nonatomic) CGRect consoleFrameBeforeCollapse;
 @property (nonatomic) CGFloat sidebarDividerPositionBeforeCollapse;
+@property (nonatomic, strong) MAProfile *profile; // Of the current run, if the sketch profiles
+@property (nonatomic, strong, readonly) MATelemetryCoalescer *telemetryCoalescer;
+@property (nonatomic) CFTimeInterval lastTelemetryFrameTime;
+@property (nonatomic, strong, readonly) MAConsoleBuffer *outputConsole;
+@property (nonatomic, strong, readonly) MAConsoleBuffer *serialConsole;
+@property (nonatomic) CFTimeInterval lastConsoleUpdateTime;
 // Other outlets
 @property (nonatomic, weak) IBOutlet NSWindow *patternWindow;
 // Console outlets
@@ -104,6 +118,20 @@ typedef NS_ENUM(NSInteger, MAState) {
     if (self) {
         _arduino = [[MAArduinoController alloc] init];
 		_arduino.delegate = self;
+		_telemetryCoalescer = [[MATelemetryCoalescer alloc] init];
+		__weak MAController *controller = self;
+		_telemetryCoalescer.frameRequestHandler = ^{
+			[controller scheduleTelemetryFrame];
+		};
+		// Consoles
+		NSInteger lineCapacity = [[NSUserDefaults standardUserDefaults] integerForKey:kDefaultsKeyConsoleLineCapacity];
+		if (lineCapacity <= 0) lineCapacity = kDefaultConsoleLineCapacity;
+		_outputConsole = [[MAConsoleBuffer alloc] initWithLineCapacity:lineCapacity];
+		_serialConsole = [[MAConsoleBuffer alloc] initWithLineCapacity:lineCapacity];
+		_outputConsole.updateRequestHandler = ^{
+			[controller scheduleConsoleUpdate];
+		};
+		_serialConsole.updateRequestHandler = _outputConsole.updateRequestHandler;
     }
     return self;
 }
@@ -126,6 +154,9 @@ typedef NS_ENUM(NSInteger, MAState) {
 	[[self.outputTextView textContainer] setWidthTracksTextView:NO];
 	[[self.serialTextView textContainer] setContainerSize:NSMakeSize(CGFLOAT_MAX, CGFLOAT_MAX)];
 	[[self.serialTextView textContainer] setWidthTracksTextView:NO];
+	// Only lay out the lines scrolled into view
+	[[self.outputTextView layoutManager] setAllowsNonContiguousLayout:YES];
+	[[self.serialTextView layoutManager] setAllowsNonContiguousLayout:YES];
 	// Set font
 	NSFont *font = [NSFont fontWithName:@"Monaco" size:10];
 	[self.outputTextView setFont:font];
@@ -207,11 +238,11 @@ typedef NS_ENUM(NSInteger, MAState) {
 
 #pragma mark - Graph View Delegate
 
-- (void)graphDidChangeForGraphView:(MAGraphView *)graphView
+- (void)graphView:(MAGraphView *)graphView didChangeGraphWithChanges:(NSArray *)changes
 {
 	NSArray *states = [graphView getNodes];
 	NSArray *transitions = [graphView getArrows];
-	[self.codeController updateCodeForStates:states transitions:transitions];
+	[self.codeController updateCodeForStates:states transitions:transitions changes:changes];
 	[self stop:self];
 }
 
@@ -273,8 +304,8 @@ typedef NS_ENUM(NSInteger, MAState) {
 		NSLog(@"Invalid state id %i", stateID);
 		return;
 	}
-	// Show
-	[self.graphView makeNodeActive:state];
+	// Show, deactivating the state machine's other states (change-only logging only sends the states entered)
+	[self.telemetryCoalescer noteState:state];
 }
 
 - (void)arduino:(MAArduinoController *)arduino willCheckConditionWithID:(UInt16)conditionID forTransitionWithID:(UInt16)transitionID
@@ -288,8 +319,7 @@ typedef NS_ENUM(NSInteger, MAState) {
 		return;
 	}
 	// Show
-	[self.graphView makeConditionActive:condition arrow:transition];
-	[self.codeController setExecutionItem:condition];
+	[self.telemetryCoalescer noteCondition:condition arrow:transition];
 }
 
 - (void)arduino:(MAArduinoController *)arduino willPerformActionAtIndex:(UInt16)index forTransitionWithID:(UInt16)transitionID
@@ -301,8 +331,25 @@ typedef NS_ENUM(NSInteger, MAState) {
 		NSLog(@"Invalid transition id or index: %i/%i", transitionID, index);
 		return;
 	}
-	[self.graphView makeActionAtIndexActive:index arrow:transition];
-	[self.codeController setExecutionItem:transition.actions[index]];
+	[self.telemetryCoalescer noteActionAtIndex:index arrow:transition];
+}
+
+- (void)scheduleTelemetryFrame
+{
+	// Once the last frame is an interval ago, right away if it's been longer
+	CFTimeInterval delay = MAX(self.lastTelemetryFrameTime + kTelemetryFrameInterval - CACurrentMediaTime(), 0);
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+		[self showTelemetryFrame];
+	});
+}
+
+- (void)showTelemetryFrame
+{
+	MATelemetryFrame *frame = [self.telemetryCoalescer takeFrame];
+	if (!frame || !self.isRunning) return;
+	self.lastTelemetryFrameTime = CACurrentMediaTime();
+	[self.graphView showTelemetryFrame:frame];
+	if (frame.executionItem) [self.codeController setExecutionItem:frame.executionItem];
 }
 
 - (void)arduino:(MAArduinoController *)arduino didReceiveUserSerialData:(NSData *)data
@@ -310,12 +357,40 @@ typedef NS_ENUM(NSInteger, MAState) {
 	if (!self.isRunning) return; // Otherwise sometimes partial non-user serial messages on shutdown get misinterpreted as user serial
 	NSString *string = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
 	[string stringByTrimmingCharactersInSet:[NSCharacterSet controlCharacterSet]]; // Almost certainly message start sequence leftovers
-	if ([string length] > 0 && [[self.serialTextView textStorage] length] == 0 && [self currentConsoleMode] != MASerialConsole) {
+	if ([string length] > 0 && self.serialConsole.totalLength == 0 && [self currentConsoleMode] != MASerialConsole) {
 		[self setCurrentConsoleMode:MASerialConsole];
 	}
 	[self appendString:string toTextView:self.serialTextView];
 }
 
+- (void)arduino:(MAArduinoController *)arduino didDropMessages:(UInt16)count
+{
+	if (!self.isRunning) return;
+	NSLog(@"Arduino dropped %i messages (message buffer full)", count);
+}
+
+- (void)arduino:(MAArduinoController *)arduino didSendProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count
+{
+	if (!self.isRunning) return;
+	if (!self.profile) self.profile = [[MAProfile alloc] init];
+	[self.profile addSamples:samples count:count];
+}
+
+- (void)showProfile
+{
+	// In the output console, once the run stops
+	NSString *report = [self.profile reportWithNameForSymbolID:^NSString *(UInt16 symbolID, BOOL *isState) {
+		id object = [self.codeController objectForSymbolWithID:symbolID];
+		*isState = [object isKindOfClass:[MANode class]];
+		if (*isState) return [NSString stringWithFormat:@"state %@", [object name]];
+		if ([object isKindOfClass:[MACondition class]]) return [NSString stringWithFormat:@"condition %@", [object name]];
+		if ([object isKindOfClass:[MAAction class]]) return [NSString stringWithFormat:@"action %@", [object name]];
+		return nil;
+	}];
+	[self appendString:[@"\nProfile\n" stringByAppendingString:report] toTextView:self.outputTextView];
+	[self setCurrentConsoleMode:MAOutputConsole];
+}
+
 // Currently not handled:
 - (void)arduinoDidStartIteration:(MAArduinoController *)arduino { }
 - (void)arduinoDidEndIteration:(MAArduinoController *)arduino { }
@@ -371,10 +446,11 @@ typedef NS_ENUM(NSInteger, MAState) {
 	if (self.state == MAStateUploading) return;
 	[self stop:sender];
 	// Clear log
-	[self.outputTextView setString:@""];
-	[self.serialTextView setString:@""];
+	[self clearTextView:self.outputTextView];
+	[self clearTextView:self.serialTextView];
 	// Get code
-	NSString *code = [self.codeController codeWithLogging];
+	MACodeSink *code = [[MACodeSink alloc] init];
+	[self.codeController writeCodeWithLoggingToSink:code];
 	// Set serial port & board
 	self.arduino.board = [self selectedBoard];
 	self.arduino.serialPort = [self selectedSerialPort];
@@ -420,16 +496,52 @@ typedef NS_ENUM(NSInteger, MAState) {
 
 - (void)appendString:(NSString *)string toTextView:(NSTextView *)textView withAttributes:(NSDictionary *)attributes
 {
-	if (!string) return;
+	// Shows up with the next console update
+	[[self consoleForTextView:textView] appendString:string attributes:attributes];
+}
+
+- (MAConsoleBuffer *)consoleForTextView:(NSTextView *)textView
+{
+	return (textView == self.serialTextView) ? self.serialConsole : self.outputConsole;
+}
+
+- (void)clearTextView:(NSTextView *)textView
+{
+	[[self consoleForTextView:textView] clear];
+	[textView setString:@""];
+}
+
+- (void)scheduleConsoleUpdate
+{
+	// Like telemetry frames, once the last update is an interval ago
+	CFTimeInterval delay = MAX(self.lastConsoleUpdateTime + kTelemetryFrameInterval - CACurrentMediaTime(), 0);
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+		[self showConsoleUpdates];
+	});
+}
+
+- (void)showConsoleUpdates
+{
+	self.lastConsoleUpdateTime = CACurrentMediaTime();
+	[self showConsoleUpdate:[self.outputConsole takeUpdate] inTextView:self.outputTextView];
+	[self showConsoleUpdate:[self.serialConsole takeUpdate] inTextView:self.serialTextView];
+}
+
+- (void)showConsoleUpdate:(MAConsoleUpdate *)update inTextView:(NSTextView *)textView
+{
+	if (!update) return;
 	// Get scroll position
 	BOOL isScrollAtBottom = YES;
 	NSScrollView *scrollView = (NSScrollView *)[[textView superview] superview];
 	if ([scrollView isKindOfClass:[NSScrollView class]]) { // Just to check
 		isScrollAtBottom = CGRectGetMaxY([[scrollView contentView] bounds]) == [textView frame].size.height;
 	}
-	// Set string
-	NSAttributedString *stringAttributed = [[NSAttributedString alloc] initWithString:string attributes:attributes];
-	[[textView textStorage] appendAttributedString:stringAttributed];
+	// Drop the lines the console no longer keeps, add the new ones
+	NSTextStorage *textStorage = [textView textStorage];
+	[textStorage beginEditing];
+	[textStorage deleteCharactersInRange:NSMakeRange(0, MIN(update.removedLength, [textStorage length]))];
+	[textStorage appendAttributedString:update.appendedText];
+	[textStorage endEditing];
 	// Update scroll position
 	if (isScrollAtBottom) {
 		CGRect bounds = [[scrollView contentView] bounds];
@@ -441,6 +553,9 @@ typedef NS_ENUM(NSInteger, MAState) {
 - (IBAction)stop:(id)sender
 {
 	[self.arduino disconnect];
+	if (self.profile) [self showProfile];
+	self.profile = nil;
+	[self.telemetryCoalescer reset];
 	[self.graphView clearActiveObjects];
 	[self.codeController setExecutionItem:nil];
 	self.state = MAStateIdle;
@@ -449,8 +564,60 @@ typedef NS_ENUM(NSInteger, MAState) {
 - (IBAction)clearConsole:(id)sender
 {
 	MAConsoleMode consoleMode = [self currentConsoleMode];
-	if (consoleMode == MAOutputConsole) [self.outputTextView setString:@""];
-	if (consoleMode == MASerialConsole) [self.serialTextView setString:@""];
+	if (consoleMode == MAOutputConsole) [self clearTextView:self.outputTextView];
+	if (consoleMode == MASerialConsole) [self clearTextView:self.serialTextView];
+}
+
+- (IBAction)saveConsoleLog:(id)sender
+{
+	// Everything since the console was last cleared, from its spill file
+	MAConsoleMode consoleMode = [self currentConsoleMode];
+	MAConsoleBuffer *console = (consoleMode == MASerialConsole) ? self.serialConsole : self.outputConsole;
+	NSSavePanel *panel = [NSSavePanel savePanel];
+	[panel setNameFieldStringValue:(consoleMode == MASerialConsole) ? @"Serial Log.txt" : @"Output Log.txt"];
+	[panel setAllowedFileTypes:@[@"txt"]];
+	[panel beginSheetModalForWindow:[self.graphView window] completionHandler:^(NSInteger result) {
+		if (result != NSFileHandlingPanelOKButton) return;
+		NSError *error = nil;
+		if (![console writeFullLogToPath:[[panel URL] path] error:&error]) {
+			[[NSAlert alertWithError:error] runModal];
+		}
+	}];
+}
+
+- (IBAction)searchConsoleLog:(id)sender
+{
+	// What the find bar searches for, in everything since the console was last cleared instead of only the kept lines
+	NSString *string = [[NSPasteboard pasteboardWithName:NSFindPboard] stringForType:NSStringPboardType];
+	if ([string length] == 0) {
+		NSBeep();
+		return;
+	}
+	MAConsoleMode consoleMode = [self currentConsoleMode];
+	MAConsoleBuffer *console = (consoleMode == MASerialConsole) ? self.serialConsole : self.outputConsole;
+	NSMutableString *results = [NSMutableString string];
+	__block NSUInteger count = 0;
+	BOOL success = [console enumerateLinesContainingString:string options:NSCaseInsensitiveSearch usingBlock:^(unsigned long long lineNumber, NSString *line, BOOL *stop) {
+		if (count < kMaximumConsoleSearchResults) [results appendFormat:@"%llu: %@\n", lineNumber, line];
+		count++;
+	}];
+	// Listed in a sheet, by line number
+	NSAlert *alert = [[NSAlert alloc] init];
+	if (!success) {
+		[alert setMessageText:@"The console log couldn't be read."];
+	} else {
+		[alert setMessageText:[NSString stringWithFormat:@"%lu lines of the %@ log contain “%@”", (unsigned long)count, (consoleMode == MASerialConsole) ? @"serial" : @"output", string]];
+		if (count > kMaximumConsoleSearchResults) [alert setInformativeText:[NSString stringWithFormat:@"Showing the first %lu, save the log for the rest.", (unsigned long)kMaximumConsoleSearchResults]];
+		NSScrollView *scrollView = [[NSScrollView alloc] initWithFrame:NSMakeRect(0, 0, 480, 240)];
+		[scrollView setHasVerticalScroller:YES];
+		NSTextView *textView = [[NSTextView alloc] initWithFrame:[[scrollView contentView] bounds]];
+		[textView setEditable:NO];
+		[textView setFont:[self.outputTextView font]];
+		[textView setString:results];
+		[scrollView setDocumentView:textView];
+		[alert setAccessoryView:scrollView];
+	}
+	[alert beginSheetModalForWindow:[self.graphView window] modalDelegate:nil didEndSelector:NULL contextInfo:NULL];
 }
 
 - (IBAction)toggleCollapseConsole:(NSButton *)sender
@@ -14,19 +14,14 @@
 #import "MAController.h"
 #import "Graph.h"
 #import "MACodeController.h"
-#import "MAStateMachineCodeTemplate.h"
-#import "MASymbolManager.h"
-
-static NSString * const kCoderNodesKey = @"nodes";
-static NSString * const kCoderArrowsKey = @"arrows";
-static NSString * const kCoderCodeTemplateKey = @"codeTemplate";
+#import "MADocumentArchive.h"
 
 @interface MADocument ()
 
 @property (nonatomic, strong, readonly) NSMutableArray *nodes;
 @property (nonatomic, strong, readonly) NSMutableArray *arrows;
 @property (nonatomic, strong, readonly) MAStateMachineCodeTemplate *codeTemplate;
-
+@property (nonatomic, strong) MADocumentArchive *archive; // Last read or saved, knows what's in the file
 
 @end
 
@@ -52,6 +47,16 @@ static NSString * const kCoderCodeTemplateKey = @"codeTemplate";
 	[self.controller stop:sender];
 }
 
+- (IBAction)saveConsoleLog:(id)sender
+{
+	[self.controller saveConsoleLog:sender];
+}
+
+- (IBAction)searchConsoleLog:(id)sender
+{
+	[self.controller searchConsoleLog:sender];
+}
+
 - (NSString *)windowNibName
 {
 	return @"MADocument";
@@ -74,35 +79,47 @@ static NSString * const kCoderCodeTemplateKey = @"codeTemplate";
 	[self.controller.codeController updateCodeForStates:self.nodes transitions:self.arrows];
 }
 
-- (void)encodeDataWithCoder:(NSCoder *)coder
+- (MADocumentArchive *)archiveForSaving
+{
+	if (!self.archive) self.archive = [[MADocumentArchive alloc] initWithNodes:self.nodes arrows:self.arrows codeTemplate:nil];
+	[self.controller.codeController flushCodeUpdates]; // So the code matches the graph
+	self.archive.codeTemplate = self.controller.codeController.codeTemplate;
+	return self.archive;
+}
+
+- (NSData *)dataOfType:(NSString *)typeName error:(NSError **)outError
 {
-	[coder encodeObject:self.nodes forKey:kCoderNodesKey];
-	[coder encodeObject:self.arrows forKey:kCoderArrowsKey];
-	[coder encodeObject:self.controller.codeController.codeTemplate forKey:kCoderCodeTemplateKey];
+	return [[self archiveForSaving] data];
 }
 
-- (void)setDataWithCoder:(NSCoder *)coder
+- (BOOL)writeSafelyToURL:(NSURL *)url ofType:(NSString *)typeName forSaveOperation:(NSSaveOperationType)saveOperation error:(NSError **)outError
 {
-	_nodes = [coder decodeObjectForKey:kCoderNodesKey];
-	_arrows = [coder decodeObjectForKey:kCoderArrowsKey];
-	_codeTemplate = [coder decodeObjectForKey:kCoderCodeTemplateKey];
-	[_codeTemplate.symbols regenerateSymbolIDs];
-	[self setDataOnUI];
+	// Autosaving in place only appends what changed, the format is safe against being cut off
+	if (saveOperation == NSAutosaveInPlaceOperation && [url isFileURL] && [url isEqual:[self fileURL]]) {
+		return [[self archiveForSaving] writeChangesToFile:[url path] error:outError];
+	}
+	return [super writeSafelyToURL:url ofType:typeName forSaveOperation:saveOperation error:outError];
 }
 
-- (NSData *)dataOfType:(NSString *)typeName error:(NSError **)outError
+- (BOOL)readFromURL:(NSURL *)url ofType:(NSString *)typeName error:(NSError **)outError
 {
-	NSMutableData *data = [NSMutableData data];
-	NSKeyedArchiver *archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
-	[self encodeDataWithCoder:archiver];
-	[archiver finishEncoding];
-	return data;
+	if (![url isFileURL]) return [super readFromURL:url ofType:typeName error:outError];
+	return [self readFromArchive:[MADocumentArchive archiveWithContentsOfFile:[url path] error:outError]];
 }
 
 - (BOOL)readFromData:(NSData *)data ofType:(NSString *)typeName error:(NSError **)outError
 {
-	NSKeyedUnarchiver *unarchiver = [[NSKeyedUnarchiver alloc] initForReadingWithData:data];
-	[self setDataWithCoder:unarchiver];
+	return [self readFromArchive:[MADocumentArchive archiveWithData:data error:outError]];
+}
+
+- (BOOL)readFromArchive:(MADocumentArchive *)archive
+{
+	if (!archive) return false;
+	self.archive = archive;
+	_nodes = archive.nodes;
+	_arrows = archive.arrows;
+	_codeTemplate = archive.codeTemplate;
+	[self setDataOnUI];
 	return true;
 }
 
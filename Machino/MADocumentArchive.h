@@ -0,0 +1,35 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+@class MAStateMachineCodeTemplate;
+
+// The contents of a .machino document, without any of the UI around it. Written in the chunked format of
+// MADocumentFormat.h, which saves only the user's code of the code template (the rest is generated again after opening);
+// keyed archives from before version 2 are still read. An archive remembers what's in the file it last read or wrote, so
+// saving it there again can append just what changed.
+@interface MADocumentArchive : NSObject
+
+@property (nonatomic, strong, readonly) NSMutableArray *nodes;
+@property (nonatomic, strong, readonly) NSMutableArray *arrows;
+@property (nonatomic, strong) MAStateMachineCodeTemplate *codeTemplate; // Read back with only the code in its editable ranges
+
++ (id)archiveWithData:(NSData *)data error:(NSError **)error;
++ (id)archiveWithContentsOfFile:(NSString *)path error:(NSError **)error; // Mapped, code is decoded when it's merged
+- (id)initWithNodes:(NSMutableArray *)nodes arrows:(NSMutableArray *)arrows codeTemplate:(MAStateMachineCodeTemplate *)codeTemplate;
+
+- (NSData *)data; // The whole document
+- (NSData *)keyedArchiveData; // In the format from before version 2
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error; // Whole & atomically, which compacts it
+- (BOOL)writeChangesToFile:(NSString *)path error:(NSError **)error; // Appends the chunks that changed, or writes it whole if path isn't the file last read or written, or would be mostly replaced chunks
+
+@end
@@ -0,0 +1,680 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MADocumentArchive.h"
+#import "MADocumentFormat.h"
+#import "MAStateMachineCodeTemplate.h"
+#import "MASymbolManager.h"
+#import "MANodeInternal.h"
+#import "Graph.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/stat.h>
+
+static NSString * const kCoderNodesKey = @"nodes";
+static NSString * const kCoderArrowsKey = @"arrows";
+static NSString * const kCoderCodeTemplateKey = @"codeTemplate";
+static NSString * const kErrorInvalidDocumentFormat = @"The document could not be read because it is not a valid Machino document (%@).";
+static NSString * const kErrorNewerDocumentFormat = @"The document could not be read because it was saved by a newer version of Machino.";
+static const UInt64 kCompactionMinimumLength = 64 * 1024; // Smaller files are appended to until they're rewritten anyway
+
+#pragma mark - Utility
+
+static NSError *MADocumentFormatError(NSString *reason)
+{
+	NSString *message = [NSString stringWithFormat:kErrorInvalidDocumentFormat, reason];
+	return [NSError errorWithDomain:@"" code:0 userInfo:@{ NSLocalizedDescriptionKey : message }];
+}
+
+static NSUInteger MADocumentPaddedLength(NSUInteger length)
+{
+	return (length + kDocumentChunkAlignment - 1) / kDocumentChunkAlignment * kDocumentChunkAlignment;
+}
+
+static UInt64 MADocumentNewFileID(void)
+{
+	// Different for every whole write, within and across processes
+	static UInt64 writeCount = 0;
+	UInt64 time = (UInt64)([NSDate timeIntervalSinceReferenceDate] * 1e9);
+	return (time ^ ((UInt64)getpid() << 40) ^ (++writeCount << 20)) ?: 1;
+}
+
+static BOOL MADocumentWriteAll(int fileDescriptor, const UInt8 *bytes, NSUInteger length, off_t offset)
+{
+	while (length > 0) {
+		ssize_t written = pwrite(fileDescriptor, bytes, length, offset);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return NO;
+		bytes += written;
+		length -= written;
+		offset += written;
+	}
+	return YES;
+}
+
+#pragma mark - Private Class - MADocumentChunk
+
+@interface MADocumentChunk : NSObject
+
+@property (nonatomic, readonly) UInt32 type;
+@property (nonatomic, copy, readonly) NSString *key;
+@property (nonatomic, strong, readonly) NSData *payload;
+
++ (id)chunkWithType:(UInt32)type key:(NSString *)key payload:(NSData *)payload;
++ (NSString *)identifierForType:(UInt32)type key:(NSString *)key;
+- (NSString *)identifier; // Later chunks with the same one replace it
+- (NSUInteger)fileLength; // Header, key & payload, padded
+- (void)appendToData:(NSMutableData *)data;
+
+@end
+
+@implementation MADocumentChunk
+
++ (id)chunkWithType:(UInt32)type key:(NSString *)key payload:(NSData *)payload
+{
+	MADocumentChunk *chunk = [[self alloc] init];
+	chunk->_type = type;
+	chunk->_key = [key copy] ?: @"";
+	chunk->_payload = payload ?: [NSData data];
+	return chunk;
+}
+
++ (NSString *)identifierForType:(UInt32)type key:(NSString *)key
+{
+	return [NSString stringWithFormat:@"%u$%@", (unsigned int)type, key];
+}
+
+- (NSString *)identifier
+{
+	return [[self class] identifierForType:self.type key:self.key];
+}
+
+- (NSUInteger)fileLength
+{
+	NSUInteger keyLength = [self.key lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+	return MADocumentPaddedLength(sizeof(MADocumentChunkHeader) + keyLength + [self.payload length]);
+}
+
+- (void)appendToData:(NSMutableData *)data
+{
+	NSData *keyData = [self.key dataUsingEncoding:NSUTF8StringEncoding];
+	MADocumentChunkHeader header;
+	header.type = NSSwapHostIntToLittle(self.type);
+	header.keyLength = NSSwapHostIntToLittle((UInt32)[keyData length]);
+	header.length = NSSwapHostLongLongToLittle([self.payload length]);
+	NSUInteger start = [data length];
+	[data appendBytes:&header length:sizeof(header)];
+	[data appendData:keyData];
+	[data appendData:self.payload];
+	[data increaseLengthBy:MADocumentPaddedLength([data length] - start) - ([data length] - start)]; // Zeroes
+}
+
+@end
+
+#pragma mark - Private Class - MADocumentCodeDictionary
+
+// The code in editable ranges as read, each piece decoded from its UTF-8 the first time it's asked for
+@interface MADocumentCodeDictionary : NSDictionary
+
+- (id)initWithPayloads:(NSDictionary *)payloads fileData:(NSData *)fileData;
+
+@end
+
+@implementation MADocumentCodeDictionary {
+	NSDictionary *_payloads; // Key -> UTF-8, pointing into fileData
+	NSData *_fileData; // Kept for the payloads
+	NSMutableDictionary *_decodedCode;
+}
+
+- (id)initWithPayloads:(NSDictionary *)payloads fileData:(NSData *)fileData
+{
+	self = [super init];
+	if (self) {
+		_payloads = [payloads copy];
+		_fileData = fileData;
+		_decodedCode = [NSMutableDictionary dictionaryWithCapacity:[payloads count]];
+	}
+	return self;
+}
+
+- (NSUInteger)count
+{
+	return [_payloads count];
+}
+
+- (id)objectForKey:(id)key
+{
+	@synchronized(self) {
+		NSString *code = _decodedCode[key];
+		if (code || !_payloads[key]) return code;
+		code = [[NSString alloc] initWithData:_payloads[key] encoding:NSUTF8StringEncoding] ?: @"";
+		_decodedCode[key] = code;
+		return code;
+	}
+}
+
+- (NSEnumerator *)keyEnumerator
+{
+	return [_payloads keyEnumerator];
+}
+
+@end
+
+#pragma mark - Private Interface
+
+@interface MADocumentArchive ()
+
+@property (nonatomic, strong) NSData *fileData; // Read from, the read chunks point into it
+// What's in the file last read or written
+@property (nonatomic) UInt64 writtenFileID; // 0 if none
+@property (nonatomic) UInt64 writtenLength;
+@property (nonatomic) UInt64 liveLength; // Of the header & the chunks no later one replaces
+@property (nonatomic, strong) NSMutableDictionary *writtenChunks; // Identifier -> MADocumentChunk
+
+@end
+
+@implementation MADocumentArchive
+
+#pragma mark - Initialization
+
++ (id)archiveWithData:(NSData *)data error:(NSError **)error
+{
+	if ([data length] >= sizeof(MADocumentHeader) && memcmp([data bytes], kDocumentMagic, sizeof(kDocumentMagic)) == 0) {
+		return [[self alloc] initWithDocumentData:data error:error];
+	}
+	// Keyed archive, from before version 2
+	MADocumentArchive *archive = nil;
+	@try {
+		NSKeyedUnarchiver *unarchiver = [[NSKeyedUnarchiver alloc] initForReadingWithData:data];
+		archive = [[self alloc] initWithCoder:unarchiver];
+		[unarchiver finishDecoding];
+	} @catch (NSException *exception) {
+		if (error) *error = MADocumentFormatError([exception reason]);
+		return nil;
+	}
+	return archive;
+}
+
++ (id)archiveWithContentsOfFile:(NSString *)path error:(NSError **)error
+{
+	NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:error];
+	if (!data) return nil;
+	return [self archiveWithData:data error:error];
+}
+
+- (id)initWithNodes:(NSMutableArray *)nodes arrows:(NSMutableArray *)arrows codeTemplate:(MAStateMachineCodeTemplate *)codeTemplate
+{
+	self = [super init];
+	if (self) {
+		_nodes = nodes ?: [NSMutableArray array];
+		_arrows = arrows ?: [NSMutableArray array];
+		_codeTemplate = codeTemplate;
+		_writtenChunks = [NSMutableDictionary dictionary];
+	}
+	return self;
+}
+
+- (id)initWithCoder:(NSCoder *)coder
+{
+	NSMutableArray *nodes = [[coder decodeObjectForKey:kCoderNodesKey] mutableCopy];
+	NSMutableArray *arrows = [[coder decodeObjectForKey:kCoderArrowsKey] mutableCopy];
+	MAStateMachineCodeTemplate *codeTemplate = [coder decodeObjectForKey:kCoderCodeTemplateKey];
+	return [self initWithNodes:nodes arrows:arrows codeTemplate:codeTemplate];
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder
+{
+	[coder encodeObject:self.nodes forKey:kCoderNodesKey];
+	[coder encodeObject:self.arrows forKey:kCoderArrowsKey];
+	[coder encodeObject:self.codeTemplate forKey:kCoderCodeTemplateKey];
+}
+
+#pragma mark - Reading
+
+- (id)initWithDocumentData:(NSData *)data error:(NSError **)error
+{
+	MADocumentHeader header;
+	memcpy(&header, [data bytes], sizeof(header));
+	if (NSSwapLittleIntToHost(header.version) > kDocumentVersion) {
+		if (error) *error = [NSError errorWithDomain:@"" code:0 userInfo:@{ NSLocalizedDescriptionKey : kErrorNewerDocumentFormat }];
+		return nil;
+	}
+	// Chunks, up to the last commit (anything after is a save that was cut off)
+	const UInt8 *bytes = [data bytes];
+	NSUInteger length = [data length];
+	NSUInteger offset = sizeof(header);
+	NSUInteger committedLength = 0;
+	NSMutableDictionary *chunks = [NSMutableDictionary dictionary];
+	NSMutableArray *pendingChunks = [NSMutableArray array];
+	while (length - offset >= sizeof(MADocumentChunkHeader)) {
+		MADocumentChunkHeader chunkHeader;
+		memcpy(&chunkHeader, bytes + offset, sizeof(chunkHeader));
+		NSUInteger keyOffset = offset + sizeof(chunkHeader);
+		UInt64 keyLength = NSSwapLittleIntToHost(chunkHeader.keyLength);
+		UInt64 payloadLength = NSSwapLittleLongLongToHost(chunkHeader.length);
+		if (keyLength > length - keyOffset || payloadLength > length - keyOffset - keyLength) break;
+		NSString *key = [[NSString alloc] initWithBytes:bytes + keyOffset length:(NSUInteger)keyLength encoding:NSUTF8StringEncoding];
+		if (!key) break;
+		NSUInteger payloadOffset = keyOffset + (NSUInteger)keyLength;
+		NSData *payload = [NSData dataWithBytesNoCopy:(void *)(bytes + payloadOffset) length:(NSUInteger)payloadLength freeWhenDone:NO];
+		UInt32 type = NSSwapLittleIntToHost(chunkHeader.type);
+		offset = MADocumentPaddedLength(payloadOffset + (NSUInteger)payloadLength);
+		if (type != kDocumentChunkCommit) {
+			[pendingChunks addObject:[MADocumentChunk chunkWithType:type key:key payload:payload]];
+		} else if (offset <= length) {
+			for (MADocumentChunk *chunk in pendingChunks) {
+				chunks[[chunk identifier]] = chunk;
+			}
+			[pendingChunks removeAllObjects];
+			committedLength = offset;
+		}
+		if (offset > length) break;
+	}
+	if (committedLength == 0) {
+		if (error) *error = MADocumentFormatError(@"no complete save");
+		return nil;
+	}
+	// Graph
+	NSMutableArray *nodes = [NSMutableArray array];
+	NSMutableArray *arrows = [NSMutableArray array];
+	NSMutableArray *objects = [NSMutableArray array];
+	MADocumentChunk *topologyChunk = chunks[[MADocumentChunk identifierForType:kDocumentChunkTopology key:@""]];
+	if (!topologyChunk || ![[self class] readTopology:topologyChunk.payload intoNodes:nodes arrows:arrows objects:objects]) {
+		if (error) *error = MADocumentFormatError(@"bad topology");
+		return nil;
+	}
+	MADocumentChunk *layoutChunk = chunks[[MADocumentChunk identifierForType:kDocumentChunkLayout key:@""]];
+	if (layoutChunk && ![[self class] readLayout:layoutChunk.payload intoNodes:nodes arrows:arrows]) {
+		if (error) *error = MADocumentFormatError(@"bad layout");
+		return nil;
+	}
+	// Code template
+	MAStateMachineCodeTemplate *codeTemplate = nil;
+	MADocumentChunk *templateChunk = chunks[[MADocumentChunk identifierForType:kDocumentChunkTemplate key:@""]];
+	if (templateChunk) {
+		codeTemplate = [[self class] templateFromData:templateChunk.payload chunks:chunks fileData:data];
+		MADocumentChunk *symbolsChunk = chunks[[MADocumentChunk identifierForType:kDocumentChunkSymbols key:@""]];
+		if (codeTemplate && symbolsChunk) {
+			codeTemplate.symbols = [[MASymbolManager alloc] initWithData:symbolsChunk.payload objectForIndex:^id(NSUInteger index) {
+				return (index < [objects count]) ? objects[index] : nil;
+			}];
+			if (!codeTemplate.symbols) codeTemplate = nil;
+		}
+		if (!codeTemplate) {
+			if (error) *error = MADocumentFormatError(@"bad code template");
+			return nil;
+		}
+		codeTemplate.states = nodes;
+		codeTemplate.transitions = arrows;
+	}
+	self = [self initWithNodes:nodes arrows:arrows codeTemplate:codeTemplate];
+	if (self) {
+		_fileData = data;
+		_writtenFileID = NSSwapLittleLongLongToHost(header.fileID);
+		_writtenLength = committedLength;
+		_liveLength = sizeof(header);
+		for (MADocumentChunk *chunk in [chunks objectEnumerator]) {
+			_liveLength += [chunk fileLength];
+		}
+		[_writtenChunks setDictionary:chunks];
+	}
+	return self;
+}
+
++ (BOOL)readTopology:(NSData *)data intoNodes:(NSMutableArray *)nodes arrows:(NSMutableArray *)arrows objects:(NSMutableArray *)objects
+{
+	MADocumentReader reader = MADocumentReaderMake(data);
+	// Nodes, conditions & actions
+	UInt64 nodeCount = MADocumentReadVarint(&reader);
+	for (UInt64 i = 0; i < nodeCount && !reader.failed; i++) {
+		MANode *node = [[MANode alloc] init];
+		node.name = MADocumentReadString(&reader);
+		node.isInitialState = (MADocumentReadVarint(&reader) != 0);
+		[nodes addObject:node];
+	}
+	NSMutableArray *conditions = [NSMutableArray array];
+	UInt64 conditionCount = MADocumentReadVarint(&reader);
+	for (UInt64 i = 0; i < conditionCount && !reader.failed; i++) {
+		[conditions addObject:[MACondition conditionWithName:MADocumentReadString(&reader)]];
+	}
+	NSMutableArray *actions = [NSMutableArray array];
+	UInt64 actionCount = MADocumentReadVarint(&reader);
+	for (UInt64 i = 0; i < actionCount && !reader.failed; i++) {
+		[actions addObject:[MAAction actionWithName:MADocumentReadString(&reader)]];
+	}
+	// Arrows, by index + 1 (0 for none)
+	UInt64 arrowCount = MADocumentReadVarint(&reader);
+	for (UInt64 i = 0; i < arrowCount && !reader.failed; i++) {
+		MAArrow *arrow = [[MAArrow alloc] init];
+		UInt64 sourceIndex = MADocumentReadVarint(&reader);
+		UInt64 targetIndex = MADocumentReadVarint(&reader);
+		UInt64 conditionIndex = MADocumentReadVarint(&reader);
+		if (sourceIndex > [nodes count] || targetIndex > [nodes count] || conditionIndex > [conditions count]) return NO;
+		if (sourceIndex) arrow.sourceNode = nodes[(NSUInteger)sourceIndex - 1];
+		if (targetIndex) arrow.targetNode = nodes[(NSUInteger)targetIndex - 1];
+		if (conditionIndex) arrow.condition = conditions[(NSUInteger)conditionIndex - 1];
+		UInt64 arrowActionCount = MADocumentReadVarint(&reader);
+		NSMutableArray *arrowActions = [NSMutableArray array];
+		for (UInt64 j = 0; j < arrowActionCount && !reader.failed; j++) {
+			UInt64 actionIndex = MADocumentReadVarint(&reader);
+			if (actionIndex >= [actions count]) return NO;
+			[arrowActions addObject:actions[(NSUInteger)actionIndex]];
+		}
+		arrow.actions = arrowActions;
+		[arrows addObject:arrow];
+	}
+	// Each node's arrows, in their order
+	for (MANode *node in nodes) {
+		UInt64 nodeArrowCount = MADocumentReadVarint(&reader);
+		NSMutableArray *nodeArrows = [NSMutableArray array];
+		for (UInt64 j = 0; j < nodeArrowCount && !reader.failed; j++) {
+			UInt64 arrowIndex = MADocumentReadVarint(&reader);
+			if (arrowIndex >= [arrows count]) return NO;
+			[nodeArrows addObject:arrows[(NSUInteger)arrowIndex]];
+		}
+		[node.arrowsMutable setArray:nodeArrows];
+	}
+	// Symbols refer to objects by their index in this order
+	[objects addObjectsFromArray:nodes];
+	[objects addObjectsFromArray:conditions];
+	[objects addObjectsFromArray:actions];
+	[objects addObjectsFromArray:arrows];
+	return MADocumentReaderIsAtEnd(&reader);
+}
+
++ (BOOL)readLayout:(NSData *)data intoNodes:(NSArray *)nodes arrows:(NSArray *)arrows
+{
+	MADocumentReader reader = MADocumentReaderMake(data);
+	for (MANode *node in nodes) {
+		CGFloat x = MADocumentReadDouble(&reader);
+		CGFloat y = MADocumentReadDouble(&reader);
+		node.position = CGPointMake(x, y);
+	}
+	for (MAArrow *arrow in arrows) {
+		CGFloat sourceX = MADocumentReadDouble(&reader);
+		CGFloat sourceY = MADocumentReadDouble(&reader);
+		CGFloat targetX = MADocumentReadDouble(&reader);
+		CGFloat targetY = MADocumentReadDouble(&reader);
+		arrow.sourcePoint = CGPointMake(sourceX, sourceY);
+		arrow.targetPoint = CGPointMake(targetX, targetY);
+		arrow.sourceAngle = MADocumentReadDouble(&reader);
+		arrow.targetAngle = MADocumentReadDouble(&reader);
+	}
+	return MADocumentReaderIsAtEnd(&reader);
+}
+
++ (MAStateMachineCodeTemplate *)templateFromData:(NSData *)data chunks:(NSDictionary *)chunks fileData:(NSData *)fileData
+{
+	MADocumentReader reader = MADocumentReaderMake(data);
+	MAStateMachineCodeTemplateOptions options = (MAStateMachineCodeTemplateOptions)MADocumentReadVarint(&reader);
+	NSString *indentString = MADocumentReadString(&reader);
+	UInt64 keyCount = MADocumentReadVarint(&reader);
+	NSMutableArray *keys = [NSMutableArray array];
+	NSMutableDictionary *payloads = [NSMutableDictionary dictionary];
+	for (UInt64 i = 0; i < keyCount && !reader.failed; i++) {
+		NSString *key = MADocumentReadString(&reader);
+		if (!key) continue;
+		[keys addObject:key];
+		MADocumentChunk *codeChunk = chunks[[MADocumentChunk identifierForType:kDocumentChunkUserCode key:key]];
+		payloads[key] = codeChunk.payload ?: [NSData data];
+	}
+	if (!MADocumentReaderIsAtEnd(&reader)) return nil;
+	NSDictionary *code = [[MADocumentCodeDictionary alloc] initWithPayloads:payloads fileData:fileData];
+	MAStateMachineCodeTemplate *codeTemplate = [[MAStateMachineCodeTemplate alloc] initWithCodeForEditableRanges:code keysInOrder:keys];
+	codeTemplate.options = options;
+	if (indentString) codeTemplate.indentString = indentString;
+	return codeTemplate;
+}
+
+#pragma mark - Writing
+
+- (NSData *)data
+{
+	return [self dataWithChunks:[self chunks]];
+}
+
+- (NSData *)keyedArchiveData
+{
+	NSMutableData *data = [NSMutableData data];
+	NSKeyedArchiver *archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
+	[self encodeWithCoder:archiver];
+	[archiver finishEncoding];
+	return data;
+}
+
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error
+{
+	return [[self data] writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+- (BOOL)writeChangesToFile:(NSString *)path error:(NSError **)error
+{
+	NSArray *chunks = [self chunks];
+	if (self.writtenFileID == 0) return [[self dataWithChunks:chunks] writeToFile:path options:NSDataWritingAtomic error:error];
+	// What changed since, and how much of the file that leaves replaced
+	UInt64 liveLength = self.liveLength;
+	NSMutableArray *changedChunks = [NSMutableArray array];
+	NSMutableSet *identifiers = [NSMutableSet setWithCapacity:[chunks count]];
+	for (MADocumentChunk *chunk in chunks) {
+		NSString *identifier = [chunk identifier];
+		[identifiers addObject:identifier];
+		MADocumentChunk *writtenChunk = self.writtenChunks[identifier];
+		if (writtenChunk && [writtenChunk.payload isEqualToData:chunk.payload]) continue;
+		[changedChunks addObject:chunk];
+		liveLength = liveLength + [chunk fileLength] - [writtenChunk fileLength];
+	}
+	NSMutableArray *removedIdentifiers = [NSMutableArray array];
+	for (NSString *identifier in self.writtenChunks) {
+		if ([identifiers containsObject:identifier]) continue;
+		// Code of ranges that are gone is left out by the template chunk, other chunks can only go by rewriting
+		MADocumentChunk *writtenChunk = self.writtenChunks[identifier];
+		if (writtenChunk.type != kDocumentChunkUserCode) return [[self dataWithChunks:chunks] writeToFile:path options:NSDataWritingAtomic error:error];
+		[removedIdentifiers addObject:identifier];
+		liveLength -= [writtenChunk fileLength];
+	}
+	if ([changedChunks count] == 0) return YES;
+	NSMutableData *appendedData = [NSMutableData data];
+	for (MADocumentChunk *chunk in changedChunks) {
+		[chunk appendToData:appendedData];
+	}
+	[[MADocumentChunk chunkWithType:kDocumentChunkCommit key:nil payload:nil] appendToData:appendedData];
+	// Compact when most of it would be replaced chunks
+	UInt64 fileLength = self.writtenLength + [appendedData length];
+	if (fileLength > kCompactionMinimumLength && fileLength - liveLength > liveLength) {
+		return [[self dataWithChunks:chunks] writeToFile:path options:NSDataWritingAtomic error:error];
+	}
+	// Append, if it's still the file last read or written
+	int fileDescriptor = open([path fileSystemRepresentation], O_RDWR);
+	if (fileDescriptor < 0) return [[self dataWithChunks:chunks] writeToFile:path options:NSDataWritingAtomic error:error];
+	MADocumentHeader header;
+	struct stat status;
+	BOOL isWrittenFile = (pread(fileDescriptor, &header, sizeof(header), 0) == sizeof(header) && fstat(fileDescriptor, &status) == 0
+		&& memcmp(header.magic, kDocumentMagic, sizeof(kDocumentMagic)) == 0 && NSSwapLittleLongLongToHost(header.fileID) == self.writtenFileID
+		&& (UInt64)status.st_size == self.writtenLength);
+	if (!isWrittenFile) {
+		close(fileDescriptor);
+		return [[self dataWithChunks:chunks] writeToFile:path options:NSDataWritingAtomic error:error];
+	}
+	BOOL isWritten = MADocumentWriteAll(fileDescriptor, [appendedData bytes], [appendedData length], (off_t)self.writtenLength) && fsync(fileDescriptor) == 0;
+	if (!isWritten) {
+		// Cut off what made it, so the last commit is the end again
+		int writeErrno = errno;
+		ftruncate(fileDescriptor, (off_t)self.writtenLength);
+		close(fileDescriptor);
+		if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:writeErrno userInfo:nil];
+		return NO;
+	}
+	close(fileDescriptor);
+	// Remember
+	for (MADocumentChunk *chunk in changedChunks) {
+		self.writtenChunks[[chunk identifier]] = chunk;
+	}
+	[self.writtenChunks removeObjectsForKeys:removedIdentifiers];
+	self.writtenLength = fileLength;
+	self.liveLength = liveLength;
+	return YES;
+}
+
+- (NSData *)dataWithChunks:(NSArray *)chunks
+{
+	MADocumentHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kDocumentMagic, sizeof(header.magic));
+	header.version = NSSwapHostIntToLittle(kDocumentVersion);
+	UInt64 fileID = MADocumentNewFileID();
+	header.fileID = NSSwapHostLongLongToLittle(fileID);
+	NSMutableData *data = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+	for (MADocumentChunk *chunk in chunks) {
+		[chunk appendToData:data];
+	}
+	UInt64 liveLength = [data length];
+	[[MADocumentChunk chunkWithType:kDocumentChunkCommit key:nil payload:nil] appendToData:data];
+	// Remember, for appending to it later (which checks it's really this file first)
+	self.writtenFileID = fileID;
+	self.writtenLength = [data length];
+	self.liveLength = liveLength;
+	[self.writtenChunks removeAllObjects];
+	for (MADocumentChunk *chunk in chunks) {
+		self.writtenChunks[[chunk identifier]] = chunk;
+	}
+	return data;
+}
+
+- (NSArray *)chunks
+{
+	NSMutableArray *chunks = [NSMutableArray array];
+	NSMapTable *objectIndexes = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	[chunks addObject:[MADocumentChunk chunkWithType:kDocumentChunkTopology key:nil payload:[self topologyDataWithObjectIndexes:objectIndexes]]];
+	[chunks addObject:[MADocumentChunk chunkWithType:kDocumentChunkLayout key:nil payload:[self layoutData]]];
+	MAStateMachineCodeTemplate *codeTemplate = self.codeTemplate;
+	if (!codeTemplate) return chunks;
+	if (codeTemplate.symbols) {
+		NSData *symbolsData = [codeTemplate.symbols dataWithIndexForObject:^NSUInteger(id object) {
+			NSNumber *index = [objectIndexes objectForKey:object];
+			return index ? [index unsignedIntegerValue] : NSNotFound;
+		}];
+		[chunks addObject:[MADocumentChunk chunkWithType:kDocumentChunkSymbols key:nil payload:symbolsData]];
+	}
+	// The template's options & the keys of its editable ranges, then the code in each
+	NSMutableData *templateData = [NSMutableData data];
+	MADocumentAppendVarint(templateData, codeTemplate.options);
+	MADocumentAppendString(templateData, codeTemplate.indentString);
+	NSMutableArray *keys = [NSMutableArray array];
+	for (id key in [codeTemplate keysForEditableRangesInOrder]) {
+		if ([key isKindOfClass:[NSString class]]) [keys addObject:key];
+	}
+	MADocumentAppendVarint(templateData, [keys count]);
+	for (NSString *key in keys) {
+		MADocumentAppendString(templateData, key);
+	}
+	[chunks addObject:[MADocumentChunk chunkWithType:kDocumentChunkTemplate key:nil payload:templateData]];
+	for (NSString *key in keys) {
+		NSData *code = [[codeTemplate codeForEditableRangeWithKey:key] dataUsingEncoding:NSUTF8StringEncoding];
+		[chunks addObject:[MADocumentChunk chunkWithType:kDocumentChunkUserCode key:key payload:code]];
+	}
+	return chunks;
+}
+
+- (NSData *)topologyDataWithObjectIndexes:(NSMapTable *)objectIndexes
+{
+	// Conditions & actions once each, by identity (arrows can share them), in the order the arrows have them
+	NSMutableOrderedSet *conditions = [NSMutableOrderedSet orderedSet];
+	NSMutableOrderedSet *actions = [NSMutableOrderedSet orderedSet];
+	NSMapTable *conditionIndexes = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	NSMapTable *actionIndexes = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	for (MAArrow *arrow in self.arrows) {
+		if (arrow.condition && ![conditionIndexes objectForKey:arrow.condition]) {
+			[conditionIndexes setObject:@([conditions count]) forKey:arrow.condition];
+			[conditions addObject:arrow.condition];
+		}
+		for (MAAction *action in arrow.actions) {
+			if ([actionIndexes objectForKey:action]) continue;
+			[actionIndexes setObject:@([actions count]) forKey:action];
+			[actions addObject:action];
+		}
+	}
+	// Symbols refer to objects by their index in this order
+	NSMutableArray *objects = [NSMutableArray arrayWithArray:self.nodes];
+	[objects addObjectsFromArray:[conditions array]];
+	[objects addObjectsFromArray:[actions array]];
+	[objects addObjectsFromArray:self.arrows];
+	[objects enumerateObjectsUsingBlock:^(id object, NSUInteger index, BOOL *stop) {
+		if (![objectIndexes objectForKey:object]) [objectIndexes setObject:@(index) forKey:object];
+	}];
+	NSMapTable *nodeIndexes = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	NSMapTable *arrowIndexes = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	[self.nodes enumerateObjectsUsingBlock:^(id node, NSUInteger index, BOOL *stop) {
+		[nodeIndexes setObject:@(index) forKey:node];
+	}];
+	[self.arrows enumerateObjectsUsingBlock:^(id arrow, NSUInteger index, BOOL *stop) {
+		[arrowIndexes setObject:@(index) forKey:arrow];
+	}];
+	// Write
+	NSMutableData *data = [NSMutableData data];
+	MADocumentAppendVarint(data, [self.nodes count]);
+	for (MANode *node in self.nodes) {
+		MADocumentAppendString(data, node.name);
+		MADocumentAppendVarint(data, node.isInitialState);
+	}
+	MADocumentAppendVarint(data, [conditions count]);
+	for (MACondition *condition in conditions) {
+		MADocumentAppendString(data, condition.name);
+	}
+	MADocumentAppendVarint(data, [actions count]);
+	for (MAAction *action in actions) {
+		MADocumentAppendString(data, action.name);
+	}
+	MADocumentAppendVarint(data, [self.arrows count]);
+	for (MAArrow *arrow in self.arrows) {
+		NSNumber *sourceIndex = arrow.sourceNode ? [nodeIndexes objectForKey:arrow.sourceNode] : nil;
+		NSNumber *targetIndex = arrow.targetNode ? [nodeIndexes objectForKey:arrow.targetNode] : nil;
+		NSNumber *conditionIndex = arrow.condition ? [conditionIndexes objectForKey:arrow.condition] : nil;
+		MADocumentAppendVarint(data, sourceIndex ? [sourceIndex unsignedIntegerValue] + 1 : 0);
+		MADocumentAppendVarint(data, targetIndex ? [targetIndex unsignedIntegerValue] + 1 : 0);
+		MADocumentAppendVarint(data, conditionIndex ? [conditionIndex unsignedIntegerValue] + 1 : 0);
+		MADocumentAppendVarint(data, [arrow.actions count]);
+		for (MAAction *action in arrow.actions) {
+			MADocumentAppendVarint(data, [[actionIndexes objectForKey:action] unsignedIntegerValue]);
+		}
+	}
+	for (MANode *node in self.nodes) {
+		NSMutableArray *nodeArrowIndexes = [NSMutableArray array];
+		for (MAArrow *arrow in node.arrowsMutable) {
+			NSNumber *arrowIndex = [arrowIndexes objectForKey:arrow];
+			if (arrowIndex) [nodeArrowIndexes addObject:arrowIndex];
+		}
+		MADocumentAppendVarint(data, [nodeArrowIndexes count]);
+		for (NSNumber *arrowIndex in nodeArrowIndexes) {
+			MADocumentAppendVarint(data, [arrowIndex unsignedIntegerValue]);
+		}
+	}
+	return data;
+}
+
+- (NSData *)layoutData
+{
+	NSMutableData *data = [NSMutableData dataWithCapacity:([self.nodes count] * 2 + [self.arrows count] * 6) * sizeof(double)];
+	for (MANode *node in self.nodes) {
+		MADocumentAppendDouble(data, node.position.x);
+		MADocumentAppendDouble(data, node.position.y);
+	}
+	for (MAArrow *arrow in self.arrows) {
+		MADocumentAppendDouble(data, arrow.sourcePoint.x);
+		MADocumentAppendDouble(data, arrow.sourcePoint.y);
+		MADocumentAppendDouble(data, arrow.targetPoint.x);
+		MADocumentAppendDouble(data, arrow.targetPoint.y);
+		MADocumentAppendDouble(data, arrow.sourceAngle);
+		MADocumentAppendDouble(data, arrow.targetAngle);
+	}
+	return data;
+}
+
+@end
@@ -0,0 +1,141 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAPlatform.h"
+
+// Machino documents (.machino) from version 2, written & read by MADocumentArchive: a header, then chunks, each a header,
+// its key (UTF-8) and its payload, padded to 8 bytes, all little-endian. A chunk replaces any earlier one with the same
+// type & key, so a save can append just the chunks that changed followed by a commit chunk; chunks after the last commit
+// are a save that was cut off, and are ignored. Generated code isn't stored but written again after opening, only the
+// code in each editable range is, a chunk per range so it can be left undecoded until it's merged. Documents from before
+// version 2 are keyed archives, and still open.
+
+static const char kDocumentMagic[8] = "MACHINO";
+static const UInt32 kDocumentVersion = 2;
+static const NSUInteger kDocumentChunkAlignment = 8;
+
+// Chunk types
+static const UInt32 kDocumentChunkTopology = 1; // States, arrows, conditions & actions, with their names & connections
+static const UInt32 kDocumentChunkLayout = 2; // State positions & arrow ends, in topology order
+static const UInt32 kDocumentChunkSymbols = 3; // See MASymbolManager's -dataWithIndexForObject:
+static const UInt32 kDocumentChunkTemplate = 4; // Code options, indent string & editable range keys in order
+static const UInt32 kDocumentChunkUserCode = 5; // Code in the editable range with the chunk's key
+static const UInt32 kDocumentChunkCommit = 6; // Empty, ends a save
+
+typedef struct {
+	char magic[8];
+	UInt32 version;
+	UInt32 reserved;
+	UInt64 fileID; // Different for every whole write, so a later save can tell it's still appending to the same file
+} MADocumentHeader;
+
+typedef struct {
+	UInt32 type;
+	UInt32 keyLength;
+	UInt64 length; // Of the payload
+} MADocumentChunkHeader;
+
+#pragma mark - Payload Encoding
+
+// Payloads are unsigned LEB128 varints (counts, indexes), strings as their UTF-8 length + 1 then the bytes (0 for nil),
+// and doubles as their bits
+
+static inline void MADocumentAppendVarint(NSMutableData *data, UInt64 value)
+{
+	UInt8 bytes[10];
+	NSUInteger length = 0;
+	do {
+		bytes[length] = value & 0x7F;
+		value >>= 7;
+		if (value) bytes[length] |= 0x80;
+		length++;
+	} while (value);
+	[data appendBytes:bytes length:length];
+}
+
+static inline void MADocumentAppendString(NSMutableData *data, NSString *string)
+{
+	if (!string) {
+		MADocumentAppendVarint(data, 0);
+		return;
+	}
+	NSData *bytes = [string dataUsingEncoding:NSUTF8StringEncoding];
+	MADocumentAppendVarint(data, [bytes length] + 1);
+	[data appendData:bytes];
+}
+
+static inline void MADocumentAppendDouble(NSMutableData *data, double value)
+{
+	UInt64 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	bits = NSSwapHostLongLongToLittle(bits);
+	[data appendBytes:&bits length:sizeof(bits)];
+}
+
+typedef struct {
+	const UInt8 *bytes;
+	NSUInteger length;
+	NSUInteger offset;
+	BOOL failed; // Ran past the end or read something malformed, everything read after is 0 or nil
+} MADocumentReader;
+
+static inline MADocumentReader MADocumentReaderMake(NSData *data)
+{
+	MADocumentReader reader = { [data bytes], [data length], 0, NO };
+	return reader;
+}
+
+static inline UInt64 MADocumentReadVarint(MADocumentReader *reader)
+{
+	UInt64 value = 0;
+	for (NSUInteger shift = 0; !reader->failed && shift < 64; shift += 7) {
+		if (reader->offset >= reader->length) break;
+		UInt8 byte = reader->bytes[reader->offset++];
+		value |= (UInt64)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) return value;
+	}
+	reader->failed = YES;
+	return 0;
+}
+
+static inline NSString *MADocumentReadString(MADocumentReader *reader)
+{
+	UInt64 length = MADocumentReadVarint(reader);
+	if (length == 0 || reader->failed) return nil;
+	length--;
+	if (length > reader->length - reader->offset) {
+		reader->failed = YES;
+		return nil;
+	}
+	NSString *string = [[NSString alloc] initWithBytes:reader->bytes + reader->offset length:(NSUInteger)length encoding:NSUTF8StringEncoding];
+	reader->offset += (NSUInteger)length;
+	if (!string) reader->failed = YES;
+	return string;
+}
+
+static inline double MADocumentReadDouble(MADocumentReader *reader)
+{
+	UInt64 bits;
+	if (reader->failed || reader->length - reader->offset < sizeof(bits)) {
+		reader->failed = YES;
+		return 0;
+	}
+	memcpy(&bits, reader->bytes + reader->offset, sizeof(bits));
+	reader->offset += sizeof(bits);
+	bits = NSSwapLittleLongLongToHost(bits);
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static inline BOOL MADocumentReaderIsAtEnd(MADocumentReader *reader)
+{
+	return (!reader->failed && reader->offset == reader->length);
+}
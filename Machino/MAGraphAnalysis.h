@@ -0,0 +1,39 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+@class MANode;
+@class MAArrow;
+
+// One-off analysis of a snapshot of the graph. Everything is computed lazily in (near) linear time, nodes reached through
+// arrows but missing from the node list are picked up along the way. Orders match the old recursive searches.
+@interface MAGraphAnalysis : NSObject
+
+@property (nonatomic, copy, readonly) NSArray *nodes;
+@property (nonatomic, copy, readonly) NSArray *arrows;
+
++ (id)analysisWithNodes:(NSArray *)nodes arrows:(NSArray *)arrows;
++ (id)analysisWithNodes:(NSArray *)nodes arrows:(NSArray *)arrows ignoringArrows:(NSArray *)ignoredArrows;
+
+// Connectivity (arrows in either direction)
+- (NSArray *)components; // In order of their first node in nodes, each depth-first from that node
+- (NSArray *)nodesConnectedToNode:(MANode *)node; // Depth-first from node, like -[MANode findConnectedNodes]
+- (BOOL)isNode:(MANode *)node connectedToNode:(MANode *)otherNode;
+- (MANode *)initialStateConnectedToNode:(MANode *)node;
+// Reachability (arrows from source to target)
+- (NSArray *)nodesReachableFromNode:(MANode *)node; // Breadth-first
+- (NSArray *)nodesUnreachableFromInitialStates; // Per component, from where the generated state machine starts
+// Symbols
+- (NSArray *)conditions; // Used by the arrows, in order of first use
+- (NSArray *)actions; // Used by the arrows, in order of first use
+
+@end
@@ -0,0 +1,251 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAGraphAnalysis.h"
+#import "Graph.h"
+
+#pragma mark - Private Class - MAGraphSearchFrame
+
+@interface MAGraphSearchFrame : NSObject
+
+@property (nonatomic, strong) MANode *node;
+@property (nonatomic, copy) NSArray *arrows;
+@property (nonatomic) NSUInteger arrowIndex;
+
++ (id)frameWithNode:(MANode *)node;
+
+@end
+
+@implementation MAGraphSearchFrame
+
++ (id)frameWithNode:(MANode *)node
+{
+	MAGraphSearchFrame *frame = [[self alloc] init];
+	frame.node = node;
+	frame.arrows = node.arrows;
+	return frame;
+}
+
+@end
+
+#pragma mark - Private Interface
+
+@interface MAGraphAnalysis ()
+
+@property (nonatomic, strong, readonly) NSHashTable *ignoredArrows;
+@property (nonatomic, strong) NSMutableArray *componentsMutable;
+@property (nonatomic, strong) NSMapTable *componentIndexByNode;
+@property (nonatomic, copy) NSArray *conditionsInOrder;
+@property (nonatomic, copy) NSArray *actionsInOrder;
+
+@end
+
+@implementation MAGraphAnalysis
+
+#pragma mark - Initialization
+
++ (id)analysisWithNodes:(NSArray *)nodes arrows:(NSArray *)arrows
+{
+	return [self analysisWithNodes:nodes arrows:arrows ignoringArrows:nil];
+}
+
++ (id)analysisWithNodes:(NSArray *)nodes arrows:(NSArray *)arrows ignoringArrows:(NSArray *)ignoredArrows
+{
+	return [[self alloc] initWithNodes:nodes arrows:arrows ignoringArrows:ignoredArrows];
+}
+
+- (id)initWithNodes:(NSArray *)nodes arrows:(NSArray *)arrows ignoringArrows:(NSArray *)ignoredArrows
+{
+	self = [super init];
+	if (self) {
+		_nodes = [nodes copy] ?: @[];
+		_arrows = [arrows copy] ?: @[];
+		_ignoredArrows = [[self class] identityHashTable];
+		for (MAArrow *arrow in ignoredArrows) {
+			[_ignoredArrows addObject:arrow];
+		}
+	}
+	return self;
+}
+
++ (NSHashTable *)identityHashTable
+{
+	return [NSHashTable hashTableWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality];
+}
+
++ (NSMapTable *)identityMapTable
+{
+	NSPointerFunctionsOptions keyOptions = NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality;
+	return [NSMapTable mapTableWithKeyOptions:keyOptions valueOptions:NSPointerFunctionsStrongMemory];
+}
+
+#pragma mark - Connectivity
+
+- (NSArray *)components
+{
+	for (MANode *node in self.nodes) {
+		[self componentIndexForNode:node];
+	}
+	return [self.componentsMutable copy];
+}
+
+- (NSArray *)nodesConnectedToNode:(MANode *)node
+{
+	if (!node) return @[];
+	// Reuse the component if it was searched from this node
+	NSArray *component = self.componentsMutable[[self componentIndexForNode:node]];
+	if (component[0] == node) return component;
+	return [self depthFirstSearchFromNode:node visitedNodes:[[self class] identityHashTable]];
+}
+
+- (BOOL)isNode:(MANode *)node connectedToNode:(MANode *)otherNode
+{
+	if (!node || !otherNode) return NO;
+	return ([self componentIndexForNode:node] == [self componentIndexForNode:otherNode]);
+}
+
+- (MANode *)initialStateConnectedToNode:(MANode *)node
+{
+	for (MANode *connectedNode in [self nodesConnectedToNode:node]) {
+		if (connectedNode.isInitialState) return connectedNode;
+	}
+	return nil;
+}
+
+- (NSUInteger)componentIndexForNode:(MANode *)node
+{
+	if (!self.componentsMutable) {
+		self.componentsMutable = [NSMutableArray array];
+		self.componentIndexByNode = [[self class] identityMapTable];
+	}
+	NSNumber *index = [self.componentIndexByNode objectForKey:node];
+	if (index) return [index unsignedIntegerValue];
+	// Search new component
+	NSHashTable *visitedNodes = [[self class] identityHashTable];
+	NSArray *component = [self depthFirstSearchFromNode:node visitedNodes:visitedNodes];
+	index = @([self.componentsMutable count]);
+	[self.componentsMutable addObject:component];
+	for (MANode *componentNode in component) {
+		[self.componentIndexByNode setObject:index forKey:componentNode];
+	}
+	return [index unsignedIntegerValue];
+}
+
+- (NSArray *)depthFirstSearchFromNode:(MANode *)node visitedNodes:(NSHashTable *)visitedNodes
+{
+	NSMutableArray *nodes = [NSMutableArray arrayWithObject:node];
+	[visitedNodes addObject:node];
+	// Explicit stack, visiting nodes in the same order a recursive search over each node's arrows would
+	NSMutableArray *stack = [NSMutableArray arrayWithObject:[MAGraphSearchFrame frameWithNode:node]];
+	while ([stack count] > 0) {
+		MAGraphSearchFrame *frame = [stack lastObject];
+		if (frame.arrowIndex >= [frame.arrows count]) {
+			[stack removeLastObject];
+			continue;
+		}
+		MAArrow *arrow = frame.arrows[frame.arrowIndex];
+		frame.arrowIndex++;
+		if ([self.ignoredArrows containsObject:arrow]) continue;
+		// Get node on arrow that isn't the current one
+		MANode *otherNode = nil;
+		if (arrow.targetNode == frame.node && arrow.sourceNode != frame.node) otherNode = arrow.sourceNode;
+		if (arrow.sourceNode == frame.node && arrow.targetNode != frame.node) otherNode = arrow.targetNode;
+		// Add that node and continue from there
+		if (otherNode && ![visitedNodes containsObject:otherNode]) {
+			[visitedNodes addObject:otherNode];
+			[nodes addObject:otherNode];
+			[stack addObject:[MAGraphSearchFrame frameWithNode:otherNode]];
+		}
+	}
+	return nodes;
+}
+
+#pragma mark - Reachability
+
+- (NSArray *)nodesReachableFromNode:(MANode *)node
+{
+	if (!node) return @[];
+	return [self breadthFirstSearchFromNodes:@[ node ] visitedNodes:[[self class] identityHashTable]];
+}
+
+- (NSArray *)nodesUnreachableFromInitialStates
+{
+	// The generated state machine starts at the (last) initial state, or the first state if there's none
+	NSMutableArray *startNodes = [NSMutableArray array];
+	for (NSArray *component in [self components]) {
+		MANode *startNode = component[0];
+		for (MANode *node in component) {
+			if (node.isInitialState) startNode = node;
+		}
+		[startNodes addObject:startNode];
+	}
+	NSHashTable *reachedNodes = [[self class] identityHashTable];
+	[self breadthFirstSearchFromNodes:startNodes visitedNodes:reachedNodes];
+	// Collect the rest
+	NSMutableArray *unreachableNodes = [NSMutableArray array];
+	for (NSArray *component in [self components]) {
+		for (MANode *node in component) {
+			if (![reachedNodes containsObject:node]) [unreachableNodes addObject:node];
+		}
+	}
+	return unreachableNodes;
+}
+
+- (NSArray *)breadthFirstSearchFromNodes:(NSArray *)startNodes visitedNodes:(NSHashTable *)visitedNodes
+{
+	NSMutableArray *nodes = [NSMutableArray array];
+	for (MANode *node in startNodes) {
+		if ([visitedNodes containsObject:node]) continue;
+		[visitedNodes addObject:node];
+		[nodes addObject:node];
+	}
+	// The result doubles as the queue
+	for (NSUInteger i = 0; i < [nodes count]; i++) {
+		MANode *node = nodes[i];
+		for (MAArrow *arrow in node.arrows) {
+			if (arrow.sourceNode != node || [self.ignoredArrows containsObject:arrow]) continue;
+			MANode *targetNode = arrow.targetNode;
+			if (!targetNode || [visitedNodes containsObject:targetNode]) continue;
+			[visitedNodes addObject:targetNode];
+			[nodes addObject:targetNode];
+		}
+	}
+	return nodes;
+}
+
+#pragma mark - Symbols
+
+- (NSArray *)conditions
+{
+	if (!self.conditionsInOrder) [self collectConditionsAndActions];
+	return self.conditionsInOrder;
+}
+
+- (NSArray *)actions
+{
+	if (!self.actionsInOrder) [self collectConditionsAndActions];
+	return self.actionsInOrder;
+}
+
+- (void)collectConditionsAndActions
+{
+	NSMutableOrderedSet *conditions = [NSMutableOrderedSet orderedSet];
+	NSMutableOrderedSet *actions = [NSMutableOrderedSet orderedSet];
+	for (MAArrow *arrow in self.arrows) {
+		if ([self.ignoredArrows containsObject:arrow]) continue;
+		if (arrow.condition) [conditions addObject:arrow.condition];
+		[actions addObjectsFromArray:arrow.actions];
+	}
+	self.conditionsInOrder = [conditions array];
+	self.actionsInOrder = [actions array];
+}
+
+@end
@@ -0,0 +1,41 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+@class MANode;
+@class MAArrow;
+
+typedef NS_ENUM(NSUInteger, MAGraphChangeType) {
+	MAGraphChangeNodeAdded,
+	MAGraphChangeNodeRemoved,
+	MAGraphChangeNodeRenamed,
+	MAGraphChangeNodeInitialStateChanged,
+	MAGraphChangeArrowAdded,
+	MAGraphChangeArrowRemoved,
+	MAGraphChangeArrowNodeChanged, // Source or target moved to another node
+	MAGraphChangeArrowConditionChanged,
+	MAGraphChangeArrowActionsChanged
+};
+
+// A single edit of the graph, as reported by the graph view along with its change notification
+@interface MAGraphChange : NSObject
+
+@property (nonatomic, readonly) MAGraphChangeType type;
+@property (nonatomic, strong, readonly) id object; // MANode or MAArrow
+@property (nonatomic, copy, readonly) NSArray *affectedNodes; // Nodes whose state or outgoing transitions changed
+
++ (id)changeWithType:(MAGraphChangeType)type object:(id)object affectedNodes:(NSArray *)affectedNodes;
++ (id)changeWithType:(MAGraphChangeType)type node:(MANode *)node;
++ (id)changeWithType:(MAGraphChangeType)type arrow:(MAArrow *)arrow; // Affects the arrow's current source
++ (id)changeWithType:(MAGraphChangeType)type arrow:(MAArrow *)arrow previousSourceNode:(MANode *)previousSourceNode;
+
+@end
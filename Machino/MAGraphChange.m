@@ -0,0 +1,51 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAGraphChange.h"
+#import "Graph.h"
+
+@implementation MAGraphChange
+
++ (id)changeWithType:(MAGraphChangeType)type object:(id)object affectedNodes:(NSArray *)affectedNodes
+{
+	MAGraphChange *change = [[self alloc] init];
+	change->_type = type;
+	change->_object = object;
+	change->_affectedNodes = [affectedNodes copy];
+	return change;
+}
+
++ (id)changeWithType:(MAGraphChangeType)type node:(MANode *)node
+{
+	return [self changeWithType:type object:node affectedNodes:(node ? @[ node ] : @[])];
+}
+
++ (id)changeWithType:(MAGraphChangeType)type arrow:(MAArrow *)arrow
+{
+	return [self changeWithType:type arrow:arrow previousSourceNode:nil];
+}
+
++ (id)changeWithType:(MAGraphChangeType)type arrow:(MAArrow *)arrow previousSourceNode:(MANode *)previousSourceNode
+{
+	NSMutableArray *affectedNodes = [NSMutableArray array];
+	if (arrow.sourceNode) [affectedNodes addObject:arrow.sourceNode];
+	if (previousSourceNode && previousSourceNode != arrow.sourceNode) [affectedNodes addObject:previousSourceNode];
+	return [self changeWithType:type object:arrow affectedNodes:affectedNodes];
+}
+
+- (NSString *)description
+{
+	NSArray *typeNames = @[ @"node added", @"node removed", @"node renamed", @"initial state changed", @"arrow added",
+		@"arrow removed", @"arrow node changed", @"condition changed", @"actions changed" ];
+	return [NSString stringWithFormat:@"%@: %@", typeNames[self.type], self.object];
+}
+
+@end
@@ -15,6 +15,7 @@
 @class MANode;
 @class MAArrow;
 @class MACondition;
+@class MATelemetryFrame;
 
 #pragma mark - Constants
 
@@ -43,6 +44,7 @@ extern NSString * const MAGraphMouseEventActionIndexKey;
 - (void)makeNodeActive:(MANode *)node;
 - (void)makeConditionActive:(MACondition *)condition arrow:(MAArrow *)arrow;
 - (void)makeActionAtIndexActive:(NSUInteger)index arrow:(MAArrow *)arrow;
+- (void)showTelemetryFrame:(MATelemetryFrame *)frame; // Like making its states, condition & action active one by one, updating colors once
 // Hovered
 - (void)setHoveredItemsToItems:(NSArray *)hoveredItems;
 
@@ -54,6 +56,7 @@ extern NSString * const MAGraphMouseEventActionIndexKey;
 
 @optional
 - (void)graphDidChangeForGraphView:(MAGraphView *)graphView;
+- (void)graphView:(MAGraphView *)graphView didChangeGraphWithChanges:(NSArray *)changes; // MAGraphChange objects, preferred over the above
 - (void)graphView:(MAGraphView *)graphView mouseHoverEventWithInfo:(NSDictionary *)info;
 - (void)graphView:(MAGraphView *)graphView mouseClickEventWithInfo:(NSDictionary *)info;
 
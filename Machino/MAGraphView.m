@@ -11,6 +11,7 @@
 
 #import <QuartzCore/QuartzCore.h>
 #import "Graph.h"
+#import "MATelemetryCoalescer.h"
 #import "Utility.h"
 
 #pragma mark - Constants & Enums
@@ -110,6 +111,8 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 @property (nonatomic, readwrite) NSUInteger activeActionIndex;
 @property (nonatomic, strong, readonly) NSMutableArray *hoveredItems;
 
+@property (nonatomic, strong, readonly) NSMutableArray *pendingChanges; // Since the last delegate notification
+
 @end
 
 #pragma mark - Implementation
@@ -163,6 +166,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 		_selectedObjectStrokeColor = [NSColor alternateSelectedControlColor];
 		_activatedNodesMutable = [NSMutableArray array];
 		_hoveredItems = [NSMutableArray array];
+		_pendingChanges = [NSMutableArray array];
 		[self initialize];
     }    
     return self;
@@ -230,6 +234,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 		[self addArrow:arrow];
 		[self updateArrow:arrow];
 	}
+	[self.pendingChanges removeAllObjects];
 }
 
 #pragma mark - View Updates
@@ -303,6 +308,19 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 	[self updateAllColors];
 }
 
+- (void)showTelemetryFrame:(MATelemetryFrame *)frame
+{
+	for (MANode *node in frame.states) {
+		[self makeNodeActive:node updateColors:NO];
+	}
+	if (frame.hasActivity) {
+		self.activeCondition = frame.activeCondition;
+		self.activeArrow = frame.activeArrow;
+		self.activeActionIndex = frame.activeActionIndex;
+	}
+	[self updateAllColors];
+}
+
 - (void)updateAllColors
 {
 	[self updateNodeColors];
@@ -892,12 +910,12 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 	if ([hitObject isKindOfClass:[MANode class]]) {
 		MANode *node = hitObject;
 		if (node != oldNode) {
-			[arrow setNode:node forEnd:arrowEnd];
+			[self setNode:node forEnd:arrowEnd ofArrow:arrow];
 		}
 		CGFloat angle = CGPointAngleToPoint(node.position, p);
 		[arrow setAngle:angle forEnd:arrowEnd];
 	} else {
-		[arrow setNode:nil forEnd:arrowEnd];
+		[self setNode:nil forEnd:arrowEnd ofArrow:arrow];
 		[arrow setPoint:p forEnd:arrowEnd];
 		arrow.targetPoint = p;
 	}
@@ -930,7 +948,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 {
 	MAArrow *arrow = self.draggedArrow;
 	MAArrowEnd end = self.draggedArrowEnd;
-	[arrow setNode:self.arrowEndNodeBeforeDrag forEnd:end];
+	[self setNode:self.arrowEndNodeBeforeDrag forEnd:end ofArrow:arrow];
 	[arrow setAngle:self.arrowEndAngleBeforeDrag forEnd:end];
 	[self updateArrow:arrow];
 }
@@ -1139,6 +1157,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 - (void)setCondition:(MACondition *)condition forArrow:(MAArrow *)arrow
 {
 	arrow.condition = condition;
+	[self recordChange:[MAGraphChange changeWithType:MAGraphChangeArrowConditionChanged arrow:arrow]];
 	// Get display string
 	NSString *displayString = condition ? condition.name : @"condition";
 	// Add attributes
@@ -1154,6 +1173,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 - (void)setActions:(NSArray *)actions forArrow:(MAArrow *)arrow
 {
 	arrow.actions = actions;
+	[self recordChange:[MAGraphChange changeWithType:MAGraphChangeArrowActionsChanged arrow:arrow]];
 	// Get display string
 	BOOL hasActions = ([actions count] > 0);
 	NSString *displayString = hasActions ? [actions componentsJoinedByString:@", "] : @"actions";
@@ -1203,6 +1223,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 		[self endEditing];
 	}
 	[self.arrows removeObject:arrow];
+	[self recordChange:[MAGraphChange changeWithType:MAGraphChangeArrowRemoved arrow:arrow]];
 	arrow.sourceNode = nil;
 	arrow.targetNode = nil;
 	[self doWithoutAnimation:^{ [arrow.layer removeFromSuperlayer]; }];
@@ -1336,6 +1357,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 - (void)addNode:(MANode *)node
 {
 	if (![self.nodes containsObject:node]) [self.nodes addObject:node];
+	[self recordChange:[MAGraphChange changeWithType:MAGraphChangeNodeAdded node:node]];
 	[self.nodesLayer addSublayer:node.layer];
 	node.layer.position = CGPointRound(node.position);
 	// Misc UI update
@@ -1347,6 +1369,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 	if (![self.arrows containsObject:arrow]) {
 		[self.arrows addObject:arrow];
 	}
+	[self recordChange:[MAGraphChange changeWithType:MAGraphChangeArrowAdded arrow:arrow]];
 	[self.arrowsLayer addSublayer:arrow.layer];
 }
 
@@ -1357,6 +1380,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 		[self endEditing];
 	}
 	[self.nodes removeObject:node];
+	[self recordChange:[MAGraphChange changeWithType:MAGraphChangeNodeRemoved node:node]];
 	[self doWithoutAnimation:^{ [node.layer removeFromSuperlayer]; }];
 	while ([node.arrows count] > 0) {
 		MAArrow *arrow = [node.arrows objectAtIndex:0];
@@ -1370,6 +1394,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 - (void)setName:(NSString *)text forNode:(MANode *)node
 {
 	node.name = text;
+	[self recordChange:[MAGraphChange changeWithType:MAGraphChangeNodeRenamed node:node]];
 	// Create attributed string
 	NSDictionary *textAttributes = @{ NSFontAttributeName : [self defaultNodeFont] };
 	NSAttributedString *string = [[NSAttributedString alloc] initWithString:node.name attributes:textAttributes];
@@ -1394,37 +1419,37 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 	}
 	// Set
 	node.isInitialState = isInitialState;
+	[self recordChange:[MAGraphChange changeWithType:MAGraphChangeNodeInitialStateChanged node:node]];
 	// Update
 	[self doWithoutAnimation:^{
 		node.secondBorderLayer.hidden = !isInitialState;
 	}];
 }
 
+- (void)setNode:(MANode *)node forEnd:(MAArrowEnd)arrowEnd ofArrow:(MAArrow *)arrow
+{
+	MANode *previousSourceNode = arrow.sourceNode;
+	[arrow setNode:node forEnd:arrowEnd];
+	[self recordChange:[MAGraphChange changeWithType:MAGraphChangeArrowNodeChanged arrow:arrow previousSourceNode:previousSourceNode]];
+}
+
 - (MANode *)unsetInitialStateForAddingArrow:(MAArrow *)arrow // For managing conflict of initial state when two node networks are connected
 {
-	// Get nodes connected to source (before this arrow was there)
-	NSArray *sourceNodes = [arrow.sourceNode findConnectedNodesIgnoringArrows:@[ arrow ]];
+	// Look at the networks as they were before this arrow was there
+	MAGraphAnalysis *analysis = [MAGraphAnalysis analysisWithNodes:self.nodes arrows:self.arrows ignoringArrows:@[ arrow ]];
 	// If they were already connected there shouldn't be a conflict
-	if ([sourceNodes containsObject:arrow.targetNode]) return nil;
-	// Get initial state in source network
-	MANode *sourceInitialState = [sourceNodes objectPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) { return [obj isInitialState]; }];
+	if ([analysis isNode:arrow.sourceNode connectedToNode:arrow.targetNode]) return nil;
 	// If the source network doesn't contain an intial state, no conflict
+	MANode *sourceInitialState = [analysis initialStateConnectedToNode:arrow.sourceNode];
 	if (!sourceInitialState) return nil;
-	// Get nodes connected to target (before this arrow was there)
-	NSArray *targetNodes = [arrow.targetNode findConnectedNodesIgnoringArrows:@[ arrow ]];
-	// Get initial state in target network
-	MANode *targetInitialState = [targetNodes objectPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) { return [obj isInitialState]; }];
 	// We'll unset the initial state from the target's network
-	return targetInitialState;
+	return [analysis initialStateConnectedToNode:arrow.targetNode];
 }
 
 - (MANode *)getInitialStateConnectedToNode:(MANode *)node
 {
-	NSArray *connectedNodes = [node findConnectedNodes];
-	for (MANode *connectedNode in connectedNodes) {
-		if (connectedNode.isInitialState) return connectedNode;
-	}
-	return nil;
+	MAGraphAnalysis *analysis = [MAGraphAnalysis analysisWithNodes:self.nodes arrows:self.arrows];
+	return [analysis initialStateConnectedToNode:node];
 }
 
 - (void)updateNodeColors
@@ -1743,7 +1768,7 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 	CGFloat oldAngle = [arrow angleForEnd:arrowEnd];
 	[self registerUndoActionMoveArrowEnd:arrowEnd forArrow:arrow oldNode:oldNode oldAngle:oldAngle];
 	// Execute
-	[arrow setNode:node forEnd:arrowEnd];
+	[self setNode:node forEnd:arrowEnd ofArrow:arrow];
 	[arrow setAngle:angle forEnd:arrowEnd];
 	[self updateArrow:arrow];
 	// Notify delegate
@@ -1796,9 +1821,18 @@ typedef NS_OPTIONS(NSUInteger, MAHitTests) {
 //	[self updateAllArrows];
 //}
 
+- (void)recordChange:(MAGraphChange *)change
+{
+	[self.pendingChanges addObject:change];
+}
+
 - (void)notifyDelegateOfChange
 {
-	if ([self.delegate respondsToSelector:@selector(graphDidChangeForGraphView:)]) {
+	NSArray *changes = [self.pendingChanges copy];
+	[self.pendingChanges removeAllObjects];
+	if ([self.delegate respondsToSelector:@selector(graphView:didChangeGraphWithChanges:)]) {
+		[self.delegate graphView:self didChangeGraphWithChanges:changes];
+	} else if ([self.delegate respondsToSelector:@selector(graphDidChangeForGraphView:)]) {
 		[self.delegate graphDidChangeForGraphView:self];
 	}
 }
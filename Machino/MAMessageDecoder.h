@@ -0,0 +1,75 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAPlatform.h"
+
+@protocol MAMessageDecoderDelegate;
+
+typedef NS_ENUM(NSUInteger, MAMessageProtocolVersion) {
+	MAMessageProtocolUnknown = 0,
+	MAMessageProtocolVersion1 = 1, // Start sequence, type & length per message
+	MAMessageProtocolVersion2 = 2 // COBS frames with a CRC-16, packed events with varint ids
+};
+
+typedef NS_ENUM(UInt8, MAMessageEventType) {
+	MAMessageEventIterationStart = 1,
+	MAMessageEventIterationEnd = 2,
+	MAMessageEventCurrentState = 3, // State id
+	MAMessageEventWillCheckCondition = 4, // Transition id, condition id
+	MAMessageEventWillPerformTransition = 5, // Transition id
+	MAMessageEventWillPerformAction = 6, // Transition id, action index
+	MAMessageEventDroppedMessages = 7 // Count
+};
+
+typedef struct {
+	MAMessageEventType type;
+	UInt16 arguments[2];
+} MAMessageEvent;
+
+typedef NS_ENUM(UInt8, MAProfileSampleKind) {
+	MAProfileSampleLoop = 1, // loop() calls
+	MAProfileSampleSymbol = 2 // Stays in a state, or calls of a condition or action
+};
+
+typedef struct {
+	MAProfileSampleKind kind;
+	UInt16 symbolID; // Of the state, condition or action
+	UInt32 count; // Since the last summary
+	UInt32 totalTime; // Microseconds
+	UInt32 maximumTime;
+} MAProfileSample;
+
+// Decodes what the Messaging.h in a sketch sends over serial, separating it from user serial output. The protocol
+// version is worked out from the stream itself (the first valid version 2 frame or version 1 message), so sketches
+// uploaded by older versions of Machino keep working. Decoding is resumable at any byte and allocates nothing: events
+// are decoded into a fixed array and handed over in batches, and user serial output is handed over as spans of the
+// data passed in wherever possible. Only the bytes of a frame or message split across calls are kept, up to a frame.
+@interface MAMessageDecoder : NSObject
+
+@property (nonatomic, weak) id<MAMessageDecoderDelegate> delegate;
+@property (nonatomic, readonly) MAMessageProtocolVersion protocolVersion;
+@property (nonatomic, readonly) UInt32 buildID; // Sent in the last hello by sketches from the build cache, 0 otherwise
+
+- (void)decodeBytes:(const Byte *)bytes length:(NSUInteger)length;
+- (void)decodeData:(NSData *)data;
+- (void)reset; // For a new connection
+
+@end
+
+// Events and user serial output are handed over in the order they were sent. The pointers are only valid during the call.
+@protocol MAMessageDecoderDelegate <NSObject>
+
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeEvents:(const MAMessageEvent *)events count:(NSUInteger)count;
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length;
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveHelloWithBaudRate:(unsigned long)baudRate;
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count; // A summary frame of a profiling sketch
+
+@end
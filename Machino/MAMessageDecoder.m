@@ -0,0 +1,467 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAMessageDecoder.h"
+
+#pragma mark - Constants
+
+enum {
+	// Version 1
+	kMessageStartSequenceLength = 3,
+	kMessageHeaderLength = kMessageStartSequenceLength + 3, // Type & big-endian body length
+	kMessageMaximumBodyLength = 6,
+	kMessageHello = 8, // Version 1 only, version 2 has a hello frame
+	// Version 2
+	kFrameMaximumLength = 256, // Encoded, longer runs without a delimiter are user serial
+	kFrameCRCLength = 2,
+	kFrameEvents = 1,
+	kFrameUserSerial = 2,
+	kFrameHello = 3,
+	kFrameProfile = 4,
+	kHelloBaudRateUnit = 100,
+	kProfileSampleMinimumLength = 4, // Kind, count, total & maximum of a loop sample
+	// Until the protocol is known
+	kMaximumUndecidedLength = 1024, // Then version 1 is assumed
+	// Output
+	kEventBatchCapacity = 256
+};
+
+static const Byte kMessageStartSequence[kMessageStartSequenceLength] = { 17, 31, 23 };
+static const NSUInteger kArgumentCounts[] = { 0, 0, 0, 1, 2, 1, 2, 1 }; // By event type
+
+#pragma mark - State
+
+typedef struct {
+	void *decoder; // To hand over to
+	MAMessageProtocolVersion protocolVersion;
+	UInt32 buildID; // From the last hello
+	// Until the protocol is known
+	Byte undecidedBytes[kMaximumUndecidedLength];
+	NSUInteger undecidedLength;
+	// Version 1, the message being read
+	Byte header[kMessageHeaderLength];
+	NSUInteger headerLength;
+	Byte body[kMessageMaximumBodyLength];
+	NSUInteger bodyLength;
+	NSUInteger bodyBytesRead;
+	// Version 2, the encoded frame read so far & the decoded frame
+	Byte pendingFrame[kFrameMaximumLength];
+	NSUInteger pendingFrameLength;
+	BOOL frameOverflowed; // The bytes up to the next delimiter are user serial
+	Byte frame[kFrameMaximumLength];
+	// Decoded events not handed over yet
+	MAMessageEvent events[kEventBatchCapacity];
+	NSUInteger eventCount;
+	// The samples of a profile frame
+	MAProfileSample profileSamples[kFrameMaximumLength / kProfileSampleMinimumLength];
+} MAMessageDecoderState;
+
+// Implemented by MAMessageDecoder
+static void MAHandOverEvents(MAMessageDecoderState *state);
+static void MAHandOverUserSerial(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length);
+static void MAHandOverHello(MAMessageDecoderState *state, unsigned long baudRate);
+static void MAHandOverProfileSamples(MAMessageDecoderState *state, NSUInteger count);
+
+#pragma mark - Output
+
+static void MAFlushEvents(MAMessageDecoderState *state)
+{
+	if (state->eventCount == 0) return;
+	MAHandOverEvents(state);
+	state->eventCount = 0;
+}
+
+static void MAAddEvent(MAMessageDecoderState *state, MAMessageEventType type, UInt16 argument0, UInt16 argument1)
+{
+	if (state->eventCount == kEventBatchCapacity) MAFlushEvents(state);
+	MAMessageEvent *event = &state->events[state->eventCount++];
+	event->type = type;
+	event->arguments[0] = argument0;
+	event->arguments[1] = argument1;
+}
+
+static void MASendUserSerial(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length)
+{
+	if (length == 0) return;
+	MAFlushEvents(state); // Keep the order
+	MAHandOverUserSerial(state, bytes, length);
+}
+
+static void MASendHello(MAMessageDecoderState *state, unsigned long baudRate)
+{
+	MAFlushEvents(state);
+	MAHandOverHello(state, baudRate);
+}
+
+static void MASendProfileSamples(MAMessageDecoderState *state, NSUInteger count)
+{
+	if (count == 0) return;
+	MAFlushEvents(state);
+	MAHandOverProfileSamples(state, count);
+}
+
+#pragma mark - Version 1
+
+static BOOL MAIsValidVersion1Header(const Byte *header)
+{
+	NSUInteger type = header[kMessageStartSequenceLength];
+	NSUInteger bodyLength = (header[kMessageStartSequenceLength+1] << 8) | header[kMessageStartSequenceLength+2];
+	return (type >= MAMessageEventIterationStart && type <= kMessageHello && bodyLength <= kMessageMaximumBodyLength);
+}
+
+static void MAReadVersion1Message(MAMessageDecoderState *state)
+{
+	// Big-endian arguments, missing ones are 0
+	UInt16 arguments[2] = { 0, 0 };
+	for (NSUInteger i = 0; i < 2 && i*2+1 < state->bodyLength; i++) {
+		arguments[i] = (state->body[i*2] << 8) | state->body[i*2+1];
+	}
+	NSUInteger type = state->header[kMessageStartSequenceLength];
+	if (type == kMessageHello) {
+		state->buildID = 0;
+		MASendHello(state, ((unsigned long)arguments[0] << 16) | arguments[1]);
+	}
+	else MAAddEvent(state, (MAMessageEventType)type, arguments[0], arguments[1]);
+}
+
+static void MADecodeVersion1(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length)
+{
+	NSUInteger runStart = 0; // Of user serial, while outside a message
+	for (NSUInteger i = 0; i < length; i++) {
+		if (state->headerLength == 0) {
+			// Skip to the next possible start sequence
+			const Byte *start = memchr(&bytes[i], kMessageStartSequence[0], length - i);
+			if (!start) break;
+			i = start - bytes;
+		}
+		Byte byte = bytes[i];
+		if (state->headerLength < kMessageStartSequenceLength) {
+			// Start sequence
+			if (state->headerLength > 0 && byte != kMessageStartSequence[state->headerLength]) {
+				MASendUserSerial(state, kMessageStartSequence, state->headerLength); // Not one after all
+				state->headerLength = 0;
+				runStart = i;
+			}
+			if (byte == kMessageStartSequence[state->headerLength]) {
+				if (state->headerLength == 0) MASendUserSerial(state, &bytes[runStart], i - runStart);
+				state->header[state->headerLength++] = byte;
+			}
+		} else if (state->headerLength < kMessageHeaderLength) {
+			// Type & length
+			state->header[state->headerLength++] = byte;
+			if (state->headerLength < kMessageHeaderLength) continue;
+			if (!MAIsValidVersion1Header(state->header)) {
+				MASendUserSerial(state, state->header, kMessageHeaderLength);
+				state->headerLength = 0;
+				runStart = i+1;
+				continue;
+			}
+			state->bodyLength = (state->header[kMessageStartSequenceLength+1] << 8) | state->header[kMessageStartSequenceLength+2];
+			state->bodyBytesRead = 0;
+		} else {
+			state->body[state->bodyBytesRead++] = byte;
+		}
+		// Complete message
+		if (state->headerLength == kMessageHeaderLength && state->bodyBytesRead == state->bodyLength) {
+			MAReadVersion1Message(state);
+			state->headerLength = 0;
+			runStart = i+1;
+		}
+	}
+	if (state->headerLength == 0) MASendUserSerial(state, &bytes[runStart], length - runStart);
+}
+
+#pragma mark - Version 2
+
+static UInt16 MAFrameCRC(const Byte *bytes, NSUInteger length)
+{
+	// CRC-16/CCITT-FALSE, like Messaging.h
+	UInt16 crc = 0xFFFF;
+	for (NSUInteger i = 0; i < length; i++) {
+		crc ^= (UInt16)bytes[i] << 8;
+		for (int bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (UInt16)((crc << 1) ^ 0x1021) : (UInt16)(crc << 1);
+	}
+	return crc;
+}
+
+static NSUInteger MADecodeFrame(const Byte *bytes, NSUInteger length, Byte *frame)
+{
+	// Undo COBS into frame (of kFrameMaximumLength), 0 if not a valid frame
+	if (length < 2 || length > kFrameMaximumLength) return 0;
+	NSUInteger frameLength = 0;
+	NSUInteger i = 0;
+	while (i < length) {
+		Byte code = bytes[i];
+		if (code == 0 || i + code > length) return 0;
+		memcpy(&frame[frameLength], &bytes[i+1], code - 1);
+		frameLength += code - 1;
+		i += code;
+		if (code < 0xFF && i < length) frame[frameLength++] = 0;
+	}
+	// Check
+	if (frameLength < 1 + kFrameCRCLength || frame[0] < kFrameEvents || frame[0] > kFrameProfile) return 0;
+	UInt16 crc = (frame[frameLength-2] << 8) | frame[frameLength-1];
+	if (MAFrameCRC(frame, frameLength - kFrameCRCLength) != crc) return 0;
+	return frameLength - kFrameCRCLength;
+}
+
+static UInt32 MAReadVarint32(const Byte *bytes, NSUInteger length, NSUInteger *index)
+{
+	UInt64 value = 0;
+	for (int shift = 0; *index < length && shift < 35; shift += 7) {
+		Byte byte = bytes[(*index)++];
+		value |= (UInt64)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) break;
+	}
+	return (UInt32)value;
+}
+
+static UInt16 MAReadVarint(const Byte *bytes, NSUInteger length, NSUInteger *index)
+{
+	UInt32 value = 0;
+	for (int shift = 0; *index < length && shift < 21; shift += 7) {
+		Byte byte = bytes[(*index)++];
+		value |= (UInt32)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) break;
+	}
+	return (UInt16)value;
+}
+
+static void MAReadProfileFrame(MAMessageDecoderState *state, const Byte *frame, NSUInteger length)
+{
+	NSUInteger index = 1;
+	NSUInteger count = 0;
+	NSUInteger capacity = sizeof(state->profileSamples) / sizeof(MAProfileSample);
+	while (index < length && count < capacity) {
+		MAProfileSample *sample = &state->profileSamples[count];
+		sample->kind = frame[index++];
+		if (sample->kind != MAProfileSampleLoop && sample->kind != MAProfileSampleSymbol) break; // Can't be, the CRC matched
+		sample->symbolID = (sample->kind == MAProfileSampleSymbol) ? MAReadVarint(frame, length, &index) : 0;
+		sample->count = MAReadVarint32(frame, length, &index);
+		sample->totalTime = MAReadVarint32(frame, length, &index);
+		sample->maximumTime = MAReadVarint32(frame, length, &index);
+		count++;
+	}
+	MASendProfileSamples(state, count);
+}
+
+static void MAReadFrame(MAMessageDecoderState *state, const Byte *frame, NSUInteger length)
+{
+	NSUInteger index = 1;
+	switch (frame[0]) {
+		case kFrameEvents:
+			while (index < length) {
+				NSUInteger type = frame[index++];
+				if (type < MAMessageEventIterationStart || type > MAMessageEventDroppedMessages) return; // Can't be, the CRC matched
+				UInt16 arguments[2] = { 0, 0 };
+				for (NSUInteger i = 0; i < kArgumentCounts[type]; i++) {
+					arguments[i] = MAReadVarint(frame, length, &index);
+				}
+				MAAddEvent(state, (MAMessageEventType)type, arguments[0], arguments[1]);
+			}
+			break;
+		case kFrameUserSerial:
+			MASendUserSerial(state, &frame[1], length - 1);
+			break;
+		case kFrameHello:
+		{
+			index++; // Protocol version
+			unsigned long baudRate = (unsigned long)MAReadVarint(frame, length, &index) * kHelloBaudRateUnit;
+			MAReadVarint(frame, length, &index); // Buffer size
+			state->buildID = (index < length) ? MAReadVarint32(frame, length, &index) : 0; // Only from the build cache
+			MASendHello(state, baudRate);
+			break;
+		}
+		case kFrameProfile:
+			MAReadProfileFrame(state, frame, length);
+			break;
+	}
+}
+
+static void MAReadChunk(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length)
+{
+	// Between two delimiters, a frame or user serial
+	NSUInteger frameLength = MADecodeFrame(bytes, length, state->frame);
+	if (frameLength > 0) MAReadFrame(state, state->frame, frameLength);
+	else MASendUserSerial(state, bytes, length);
+}
+
+static void MAHoldFrameBytes(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length)
+{
+	if (!state->frameOverflowed && state->pendingFrameLength + length > kFrameMaximumLength) {
+		// Too long for a frame, user serial up to the next delimiter
+		MASendUserSerial(state, state->pendingFrame, state->pendingFrameLength);
+		state->pendingFrameLength = 0;
+		state->frameOverflowed = YES;
+	}
+	if (state->frameOverflowed) {
+		MASendUserSerial(state, bytes, length);
+		return;
+	}
+	memcpy(&state->pendingFrame[state->pendingFrameLength], bytes, length);
+	state->pendingFrameLength += length;
+}
+
+static void MADecodeVersion2(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length)
+{
+	NSUInteger index = 0;
+	while (index < length) {
+		const Byte *delimiter = memchr(&bytes[index], 0, length - index);
+		if (!delimiter) {
+			MAHoldFrameBytes(state, &bytes[index], length - index); // Until the rest comes in
+			break;
+		}
+		NSUInteger end = delimiter - bytes;
+		if (state->pendingFrameLength == 0 && !state->frameOverflowed) {
+			MAReadChunk(state, &bytes[index], end - index); // In place
+		} else {
+			MAHoldFrameBytes(state, &bytes[index], end - index);
+			if (!state->frameOverflowed) MAReadChunk(state, state->pendingFrame, state->pendingFrameLength);
+			state->pendingFrameLength = 0;
+			state->frameOverflowed = NO;
+		}
+		index = end + 1;
+	}
+}
+
+#pragma mark - Protocol Detection
+
+static MAMessageProtocolVersion MADetectProtocolVersion(MAMessageDecoderState *state)
+{
+	// Whichever valid message comes first, once no earlier one can still come in
+	const Byte *bytes = state->undecidedBytes;
+	NSUInteger length = state->undecidedLength;
+	BOOL isFull = (length == kMaximumUndecidedLength);
+	NSUInteger version1Index = NSNotFound;
+	for (NSUInteger i = 0; i + kMessageHeaderLength <= length; i++) {
+		if (memcmp(&bytes[i], kMessageStartSequence, kMessageStartSequenceLength) == 0 && MAIsValidVersion1Header(&bytes[i])) {
+			version1Index = i;
+			break;
+		}
+	}
+	NSUInteger frameStart = 0;
+	for (NSUInteger i = 0; i < length && frameStart < version1Index; i++) {
+		if (bytes[i] != 0) continue;
+		if (MADecodeFrame(&bytes[frameStart], i - frameStart, state->frame) > 0) {
+			BOOL version1Checked = (frameStart + kMessageHeaderLength - 1 <= length); // Headers starting before the frame
+			return (version1Checked || isFull) ? MAMessageProtocolVersion2 : MAMessageProtocolUnknown;
+		}
+		frameStart = i+1;
+	}
+	if (version1Index != NSNotFound) {
+		BOOL frameIncomplete = (frameStart < version1Index && length - frameStart <= kFrameMaximumLength); // No delimiter yet
+		return (!frameIncomplete || isFull) ? MAMessageProtocolVersion1 : MAMessageProtocolUnknown;
+	}
+	return isFull ? MAMessageProtocolVersion1 : MAMessageProtocolUnknown;
+}
+
+static void MADecodeBytes(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length);
+
+static void MADecodeUndecidedBytes(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length)
+{
+	// Hold on to what comes in until the protocol is known, then decode it all
+	NSUInteger heldLength = MIN(length, kMaximumUndecidedLength - state->undecidedLength);
+	memcpy(&state->undecidedBytes[state->undecidedLength], bytes, heldLength);
+	state->undecidedLength += heldLength;
+	state->protocolVersion = MADetectProtocolVersion(state);
+	if (state->protocolVersion == MAMessageProtocolUnknown) return;
+	MADecodeBytes(state, state->undecidedBytes, state->undecidedLength);
+	state->undecidedLength = 0;
+	MADecodeBytes(state, &bytes[heldLength], length - heldLength);
+}
+
+static void MADecodeBytes(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length)
+{
+	switch (state->protocolVersion) {
+		case MAMessageProtocolUnknown: MADecodeUndecidedBytes(state, bytes, length); break;
+		case MAMessageProtocolVersion1: MADecodeVersion1(state, bytes, length); break;
+		case MAMessageProtocolVersion2: MADecodeVersion2(state, bytes, length); break;
+	}
+}
+
+#pragma mark - Private Interface
+
+@interface MAMessageDecoder ()
+{
+	MAMessageDecoderState _state;
+}
+
+@end
+
+#pragma mark - Implementation
+
+@implementation MAMessageDecoder
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_state.decoder = (__bridge void *)self;
+	}
+	return self;
+}
+
+- (MAMessageProtocolVersion)protocolVersion
+{
+	return _state.protocolVersion;
+}
+
+- (UInt32)buildID
+{
+	return _state.buildID;
+}
+
+- (void)reset
+{
+	memset(&_state, 0, sizeof(_state));
+	_state.decoder = (__bridge void *)self;
+}
+
+#pragma mark - Decoding
+
+- (void)decodeBytes:(const Byte *)bytes length:(NSUInteger)length
+{
+	MADecodeBytes(&_state, bytes, length);
+	MAFlushEvents(&_state);
+}
+
+- (void)decodeData:(NSData *)data
+{
+	[self decodeBytes:[data bytes] length:[data length]];
+}
+
+@end
+
+#pragma mark - Handing Over
+
+static void MAHandOverEvents(MAMessageDecoderState *state)
+{
+	MAMessageDecoder *decoder = (__bridge MAMessageDecoder *)state->decoder;
+	[decoder.delegate decoder:decoder didDecodeEvents:state->events count:state->eventCount];
+}
+
+static void MAHandOverUserSerial(MAMessageDecoderState *state, const Byte *bytes, NSUInteger length)
+{
+	MAMessageDecoder *decoder = (__bridge MAMessageDecoder *)state->decoder;
+	[decoder.delegate decoder:decoder didReceiveUserSerialBytes:bytes length:length];
+}
+
+static void MAHandOverHello(MAMessageDecoderState *state, unsigned long baudRate)
+{
+	MAMessageDecoder *decoder = (__bridge MAMessageDecoder *)state->decoder;
+	[decoder.delegate decoder:decoder didReceiveHelloWithBaudRate:baudRate];
+}
+
+static void MAHandOverProfileSamples(MAMessageDecoderState *state, NSUInteger count)
+{
+	MAMessageDecoder *decoder = (__bridge MAMessageDecoder *)state->decoder;
+	[decoder.delegate decoder:decoder didDecodeProfileSamples:state->profileSamples count:count];
+}
@@ -9,9 +9,10 @@
 // CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
 // NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
-#import <Cocoa/Cocoa.h>
+#import "MAPlatform.h"
 
 @class MANodeGroup;
+@class CALayer;
 @class CATextLayer;
 
 @interface MANode : NSObject <NSCoding>
@@ -20,9 +21,11 @@
 @property (nonatomic, strong, readonly) NSArray *arrows; // Automatically managed when setting arrow's source/target
 @property (nonatomic) CGPoint position;
 @property (nonatomic) BOOL isInitialState;
+#if !MACHINO_HEADLESS
 @property (nonatomic, strong) CALayer *layer;
 @property (nonatomic, strong) CALayer *secondBorderLayer;
 @property (nonatomic, strong) CATextLayer *textLayer;
+#endif
 
 - (NSArray *)findConnectedNodes;
 - (NSArray *)findConnectedNodesIgnoringArrows:(NSArray *)ignoredArrows;
@@ -69,25 +69,8 @@ static NSString * const kCoderIsInitialStateKey = @"isInitialStateKey";
 
 - (NSArray *)findConnectedNodesIgnoringArrows:(NSArray *)ignoredArrows
 {
-	NSMutableArray *nodes = [NSMutableArray arrayWithObject:self];
-	[self addConnectedNodesToArray:nodes ignoringArrows:ignoredArrows];
-	return nodes;
-}
-
-- (void)addConnectedNodesToArray:(NSMutableArray *)array ignoringArrows:(NSArray *)ignoredArrows
-{
-	for (MAArrow *arrow in self.arrows) {
-		if ([ignoredArrows containsObject:arrow]) continue;
-		// Get node on arrow that isn't self
-		MANode *otherNode = nil;
-		if (arrow.targetNode == self && arrow.sourceNode != self) otherNode = arrow.sourceNode;
-		if (arrow.sourceNode == self && arrow.targetNode != self) otherNode = arrow.targetNode;
-		// Add that node and it's connected nodes
-		if (otherNode && ![array containsObject:otherNode]) {
-			[array addObject:otherNode];
-			[otherNode addConnectedNodesToArray:array ignoringArrows:ignoredArrows];
-		}
-	}
+	MAGraphAnalysis *analysis = [MAGraphAnalysis analysisWithNodes:@[ self ] arrows:nil ignoringArrows:ignoredArrows];
+	return [analysis nodesConnectedToNode:self];
 }
 
 @end
@@ -0,0 +1,32 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// The graph model, symbol manager and code templates only need Foundation. Building with MACHINO_HEADLESS=1 (machino-gen,
+// GNUstep) leaves out the AppKit/QuartzCore parts, which are only the layers the graph view hangs off the model objects.
+#ifndef MACHINO_HEADLESS
+#define MACHINO_HEADLESS 0
+#endif
+
+#if !MACHINO_HEADLESS
+#import <Cocoa/Cocoa.h>
+#endif
+
+#ifndef __APPLE__
+#import <stdint.h>
+typedef uint8_t UInt8;
+typedef uint16_t UInt16;
+typedef uint32_t UInt32;
+typedef uint64_t UInt64;
+typedef uint8_t Byte;
+typedef NSPoint CGPoint;
+#endif
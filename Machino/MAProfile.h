@@ -0,0 +1,43 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAPlatform.h"
+#import "MAMessageDecoder.h"
+
+#define MAProfileHistogramBucketCount 24 // Powers of two, from under 2 microseconds to over 8 seconds
+
+// What a profiling sketch measured for loop(), a state (the time per stay in it) or a condition or action (per call).
+// Summaries only carry the count, total & maximum of each interval, so the histogram has the maximum in its bucket and
+// the other calls at the mean of the rest: exact for steady times, and it still shows the outliers.
+@interface MAProfileEntry : NSObject
+
+@property (nonatomic, readonly) MAProfileSampleKind kind;
+@property (nonatomic, readonly) UInt16 symbolID;
+@property (nonatomic, readonly) UInt64 count;
+@property (nonatomic, readonly) UInt64 totalTime; // Microseconds
+@property (nonatomic, readonly) UInt32 maximumTime;
+@property (nonatomic, readonly) double meanTime;
+
+- (UInt64)countInHistogramBucket:(NSUInteger)bucket; // Of the times from 2^bucket up to 2^(bucket+1) microseconds, the first from 0 and the last without an end
+
+@end
+
+// Adds up the summaries a profiling sketch sends (see MAProfiling), into an entry for loop() and one per symbol.
+@interface MAProfile : NSObject
+
+@property (nonatomic, strong, readonly) MAProfileEntry *loopEntry; // nil until a summary came in
+@property (nonatomic, copy, readonly) NSArray *entries; // Of the symbols, most total time first
+
+- (void)addSamples:(const MAProfileSample *)samples count:(NSUInteger)count;
+- (void)reset;
+- (NSString *)reportWithNameForSymbolID:(NSString *(^)(UInt16 symbolID, BOOL *isState))nameForSymbolID; // Unnamed symbols are left out
+
+@end
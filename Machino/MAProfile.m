@@ -0,0 +1,183 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAProfile.h"
+
+static NSString * const kHistogramLevels = @" .:-=+*#"; // Relative to the entry's largest bucket
+static const NSUInteger kReportNameWidth = 32;
+
+#pragma mark - Private Interfaces
+
+@interface MAProfileEntry () {
+	UInt64 _histogram[MAProfileHistogramBucketCount];
+}
+
+@property (nonatomic, readwrite) MAProfileSampleKind kind;
+@property (nonatomic, readwrite) UInt16 symbolID;
+@property (nonatomic, readwrite) UInt64 count;
+@property (nonatomic, readwrite) UInt64 totalTime;
+@property (nonatomic, readwrite) UInt32 maximumTime;
+
+- (void)addSample:(const MAProfileSample *)sample;
+
+@end
+
+@interface MAProfile ()
+
+@property (nonatomic, strong, readwrite) MAProfileEntry *loopEntry;
+@property (nonatomic, strong) NSMutableDictionary *symbolEntries; // By symbol id
+
+@end
+
+#pragma mark - Utility
+
+static NSUInteger MAHistogramBucketForTime(UInt64 time)
+{
+	NSUInteger bucket = 0;
+	while (time > 1 && bucket < MAProfileHistogramBucketCount-1) {
+		time >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+static NSString *MAStringForTime(double microseconds)
+{
+	if (microseconds < 1000) return [NSString stringWithFormat:@"%.0f us", microseconds];
+	if (microseconds < 1000000) return [NSString stringWithFormat:@"%.1f ms", microseconds / 1000];
+	return [NSString stringWithFormat:@"%.2f s", microseconds / 1000000];
+}
+
+#pragma mark - MAProfileEntry
+
+@implementation MAProfileEntry
+
+- (double)meanTime
+{
+	return (self.count > 0) ? (double)self.totalTime / self.count : 0;
+}
+
+- (UInt64)countInHistogramBucket:(NSUInteger)bucket
+{
+	return (bucket < MAProfileHistogramBucketCount) ? _histogram[bucket] : 0;
+}
+
+- (void)addSample:(const MAProfileSample *)sample
+{
+	if (sample->count == 0) return;
+	self.count += sample->count;
+	self.totalTime += sample->totalTime;
+	self.maximumTime = MAX(self.maximumTime, sample->maximumTime);
+	// The maximum, and the others at the mean of the rest
+	_histogram[MAHistogramBucketForTime(sample->maximumTime)]++;
+	if (sample->count > 1) {
+		UInt64 restTime = (sample->totalTime > sample->maximumTime) ? sample->totalTime - sample->maximumTime : 0;
+		_histogram[MAHistogramBucketForTime(restTime / (sample->count - 1))] += sample->count - 1;
+	}
+}
+
+- (NSString *)histogramString
+{
+	UInt64 largestCount = 0;
+	for (NSUInteger i = 0; i < MAProfileHistogramBucketCount; i++) {
+		largestCount = MAX(largestCount, _histogram[i]);
+	}
+	NSMutableString *string = [NSMutableString stringWithCapacity:MAProfileHistogramBucketCount];
+	NSUInteger levelCount = [kHistogramLevels length];
+	for (NSUInteger i = 0; i < MAProfileHistogramBucketCount; i++) {
+		// Anything at all shows
+		NSUInteger level = (_histogram[i] == 0 || largestCount == 0) ? 0 : 1 + (NSUInteger)(_histogram[i] * (levelCount - 2) / largestCount);
+		[string appendString:[kHistogramLevels substringWithRange:NSMakeRange(MIN(level, levelCount-1), 1)]];
+	}
+	return string;
+}
+
+@end
+
+#pragma mark - MAProfile
+
+@implementation MAProfile
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_symbolEntries = [NSMutableDictionary dictionary];
+	}
+	return self;
+}
+
+- (NSArray *)entries
+{
+	return [[self.symbolEntries allValues] sortedArrayUsingComparator:^NSComparisonResult(MAProfileEntry *entry, MAProfileEntry *otherEntry) {
+		if (entry.totalTime == otherEntry.totalTime) return NSOrderedSame;
+		return (entry.totalTime > otherEntry.totalTime) ? NSOrderedAscending : NSOrderedDescending;
+	}];
+}
+
+- (void)addSamples:(const MAProfileSample *)samples count:(NSUInteger)count
+{
+	for (NSUInteger i = 0; i < count; i++) {
+		const MAProfileSample *sample = &samples[i];
+		MAProfileEntry *entry = (sample->kind == MAProfileSampleLoop) ? self.loopEntry : self.symbolEntries[@(sample->symbolID)];
+		if (!entry) {
+			entry = [[MAProfileEntry alloc] init];
+			entry.kind = sample->kind;
+			entry.symbolID = sample->symbolID;
+			if (sample->kind == MAProfileSampleLoop) self.loopEntry = entry;
+			else self.symbolEntries[@(sample->symbolID)] = entry;
+		}
+		[entry addSample:sample];
+	}
+}
+
+- (void)reset
+{
+	self.loopEntry = nil;
+	[self.symbolEntries removeAllObjects];
+}
+
+#pragma mark - Report
+
+- (NSString *)reportWithNameForSymbolID:(NSString *(^)(UInt16 symbolID, BOOL *isState))nameForSymbolID
+{
+	// Calls first, the states' times include the calls made while in them
+	NSMutableArray *callLines = [NSMutableArray array];
+	NSMutableArray *stateLines = [NSMutableArray array];
+	for (MAProfileEntry *entry in self.entries) {
+		BOOL isState = NO;
+		NSString *name = nameForSymbolID(entry.symbolID, &isState);
+		if (!name) continue;
+		[(isState ? stateLines : callLines) addObject:[self reportLineForEntry:entry name:name]];
+	}
+	NSString *header = [NSString stringWithFormat:@"%-*s %10s %10s %10s %10s   %-*s", (int)kReportNameWidth, "", "count", "mean", "max", "total",
+		(int)MAProfileHistogramBucketCount, "1 us .. 8 s"];
+	NSMutableArray *lines = [NSMutableArray arrayWithObject:header];
+	if (self.loopEntry) [lines addObject:[self reportLineForEntry:self.loopEntry name:@"loop()"]];
+	if ([callLines count] > 0) {
+		[lines addObject:@"conditions & actions, per call:"];
+		[lines addObjectsFromArray:callLines];
+	}
+	if ([stateLines count] > 0) {
+		[lines addObject:@"states, per stay:"];
+		[lines addObjectsFromArray:stateLines];
+	}
+	return [[lines componentsJoinedByString:@"\n"] stringByAppendingString:@"\n"];
+}
+
+- (NSString *)reportLineForEntry:(MAProfileEntry *)entry name:(NSString *)name
+{
+	if ([name length] > kReportNameWidth) name = [[name substringToIndex:kReportNameWidth-3] stringByAppendingString:@"..."];
+	return [NSString stringWithFormat:@"%-*s %10llu %10s %10s %10s  |%@|", (int)kReportNameWidth, [name UTF8String], (unsigned long long)entry.count,
+		[MAStringForTime(entry.meanTime) UTF8String], [MAStringForTime(entry.maximumTime) UTF8String], [MAStringForTime(entry.totalTime) UTF8String], [entry histogramString]];
+}
+
+@end
@@ -0,0 +1,30 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+#define MARangeIndexSetCount 4
+
+// Ranges over a text that move along with edits of it, like the editable, extra & fragment ranges of a code template. Each
+// range is a start and an end marker in text order. A Fenwick tree of offset deltas over the markers makes moving
+// everything after a point O(log n), and each set keeps its ranges in order so iterating needs no sorting. Ranges have to
+// nest or be disjoint (as ranges of written code do), and within a set they have to be disjoint for the touching query.
+@interface MARangeIndex : NSObject <NSCopying>
+
+- (NSUInteger)countOfRangesInSet:(NSUInteger)set;
+- (NSRange)rangeForKey:(id)key inSet:(NSUInteger)set; // {NSNotFound, 0} if there is none
+- (void)setRange:(NSRange)range forKey:(id<NSCopying>)key inSet:(NSUInteger)set;
+- (void)setLength:(NSUInteger)length ofRangeWithKey:(id)key inSet:(NSUInteger)set; // Moves everything after its end along
+- (NSArray *)keysInOrderInSet:(NSUInteger)set;
+- (NSArray *)keysOfRangesTouchingRange:(NSRange)range inSet:(NSUInteger)set; // In order, including ranges only bordering it
+- (NSDictionary *)rangesInSet:(NSUInteger)set; // NSValue's by key
+
+@end
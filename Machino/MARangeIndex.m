@@ -0,0 +1,356 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MARangeIndex.h"
+#import "MAPlatform.h"
+
+#pragma mark - Markers
+
+typedef struct {
+	NSUInteger position; // Before applying the deltas
+	UInt32 entry;
+	BOOL isEnd;
+} MARangeMarker;
+
+typedef struct {
+	NSUInteger start; // Marker indexes
+	NSUInteger end;
+	NSUInteger set;
+} MARangeEntry;
+
+typedef struct {
+	MARangeMarker *markers;
+	NSUInteger markerCount;
+	NSUInteger markerCapacity;
+	NSInteger *deltas; // Per marker, applied to it and all markers after it
+	NSInteger *tree; // Fenwick tree over the deltas, 1-based
+	BOOL hasDeltas;
+	MARangeEntry *entries;
+	UInt32 entryCount;
+	UInt32 entryCapacity;
+	UInt32 *order[MARangeIndexSetCount]; // Entries of each set by start marker
+	NSUInteger orderCount[MARangeIndexSetCount];
+	NSUInteger orderCapacity[MARangeIndexSetCount];
+} MARangeMarkers;
+
+static NSInteger MARangeMarkersDeltaSum(MARangeMarkers *markers, NSUInteger count) // Of the first count markers
+{
+	NSInteger sum = 0;
+	for (NSUInteger i = count; i > 0; i -= i & -i) sum += markers->tree[i];
+	return sum;
+}
+
+static NSUInteger MARangeMarkersPosition(MARangeMarkers *markers, NSUInteger index)
+{
+	NSUInteger position = markers->markers[index].position;
+	if (markers->hasDeltas) position += MARangeMarkersDeltaSum(markers, index + 1);
+	return position;
+}
+
+static void MARangeMarkersFlatten(MARangeMarkers *markers)
+{
+	if (!markers->hasDeltas) return;
+	NSInteger sum = 0;
+	for (NSUInteger i = 0; i < markers->markerCount; i++) {
+		sum += markers->deltas[i];
+		markers->markers[i].position += sum;
+	}
+	memset(markers->deltas, 0, markers->markerCapacity * sizeof(NSInteger));
+	memset(markers->tree, 0, (markers->markerCapacity + 1) * sizeof(NSInteger));
+	markers->hasDeltas = NO;
+}
+
+static NSUInteger MARangeMarkersLowerBound(MARangeMarkers *markers, NSUInteger position, NSUInteger from)
+{
+	NSUInteger low = from, high = markers->markerCount;
+	while (low < high) {
+		NSUInteger middle = low + (high - low) / 2;
+		if (MARangeMarkersPosition(markers, middle) < position) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+static void MARangeMarkersReindex(MARangeMarkers *markers, NSUInteger from)
+{
+	for (NSUInteger i = from; i < markers->markerCount; i++) {
+		MARangeEntry *entry = &markers->entries[markers->markers[i].entry];
+		if (markers->markers[i].isEnd) entry->end = i;
+		else entry->start = i;
+	}
+}
+
+static void MARangeMarkersInsert(MARangeMarkers *markers, NSUInteger index, NSUInteger position, UInt32 entry, BOOL isEnd)
+{
+	if (markers->markerCount == markers->markerCapacity) {
+		NSUInteger oldCapacity = markers->markerCapacity;
+		markers->markerCapacity = MAX(oldCapacity * 2, 32);
+		markers->markers = realloc(markers->markers, markers->markerCapacity * sizeof(MARangeMarker));
+		markers->deltas = realloc(markers->deltas, markers->markerCapacity * sizeof(NSInteger));
+		markers->tree = realloc(markers->tree, (markers->markerCapacity + 1) * sizeof(NSInteger));
+		memset(markers->deltas + oldCapacity, 0, (markers->markerCapacity - oldCapacity) * sizeof(NSInteger));
+		memset(markers->tree + oldCapacity + 1, 0, (markers->markerCapacity - oldCapacity) * sizeof(NSInteger));
+		if (oldCapacity == 0) markers->tree[0] = 0;
+	}
+	NSUInteger count = markers->markerCount;
+	if (index == count) {
+		// Appending keeps the deltas, the new marker's own delta is 0
+		NSInteger sum = MARangeMarkersDeltaSum(markers, count);
+		NSUInteger treeIndex = count + 1;
+		markers->tree[treeIndex] = sum - MARangeMarkersDeltaSum(markers, treeIndex - (treeIndex & -treeIndex));
+		markers->deltas[count] = 0;
+		markers->markers[count] = (MARangeMarker){ position - sum, entry, isEnd };
+		markers->markerCount++;
+	} else {
+		MARangeMarkersFlatten(markers);
+		memmove(&markers->markers[index + 1], &markers->markers[index], (count - index) * sizeof(MARangeMarker));
+		markers->markers[index] = (MARangeMarker){ position, entry, isEnd };
+		markers->markerCount++;
+	}
+	MARangeMarkersReindex(markers, index);
+}
+
+static void MARangeMarkersRemove(MARangeMarkers *markers, NSUInteger index)
+{
+	MARangeMarkersFlatten(markers);
+	memmove(&markers->markers[index], &markers->markers[index + 1], (markers->markerCount - index - 1) * sizeof(MARangeMarker));
+	markers->markerCount--;
+	MARangeMarkersReindex(markers, index);
+}
+
+static NSUInteger MARangeMarkersOrderIndex(MARangeMarkers *markers, NSUInteger set, NSUInteger startMarker)
+{
+	// First index in the set's order with a start marker at or after startMarker
+	NSUInteger low = 0, high = markers->orderCount[set];
+	while (low < high) {
+		NSUInteger middle = low + (high - low) / 2;
+		if (markers->entries[markers->order[set][middle]].start < startMarker) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+static void MARangeMarkersAddRange(MARangeMarkers *markers, UInt32 entry, NSUInteger set, NSUInteger location, NSUInteger length)
+{
+	NSUInteger end = location + length;
+	// Start goes after ends and starts of enclosing ranges at the same position, before the starts of ranges inside
+	NSUInteger startIndex = MARangeMarkersLowerBound(markers, location, 0);
+	while (startIndex < markers->markerCount && MARangeMarkersPosition(markers, startIndex) == location) {
+		MARangeMarker marker = markers->markers[startIndex];
+		if (!marker.isEnd && MARangeMarkersPosition(markers, markers->entries[marker.entry].end) <= end) break;
+		startIndex++;
+	}
+	markers->entries[entry] = (MARangeEntry){ startIndex, startIndex, set };
+	MARangeMarkersInsert(markers, startIndex, location, entry, NO);
+	// End goes after the ends of ranges inside, before the ends of enclosing ranges and the starts of later ones
+	NSUInteger endIndex = MARangeMarkersLowerBound(markers, end, startIndex + 1);
+	while (endIndex < markers->markerCount && MARangeMarkersPosition(markers, endIndex) == end) {
+		MARangeMarker marker = markers->markers[endIndex];
+		if (!marker.isEnd || markers->entries[marker.entry].start < startIndex) break;
+		endIndex++;
+	}
+	MARangeMarkersInsert(markers, endIndex, end, entry, YES);
+	// Add to the set's order
+	if (markers->orderCount[set] == markers->orderCapacity[set]) {
+		markers->orderCapacity[set] = MAX(markers->orderCapacity[set] * 2, 16);
+		markers->order[set] = realloc(markers->order[set], markers->orderCapacity[set] * sizeof(UInt32));
+	}
+	NSUInteger orderIndex = MARangeMarkersOrderIndex(markers, set, markers->entries[entry].start);
+	memmove(&markers->order[set][orderIndex + 1], &markers->order[set][orderIndex], (markers->orderCount[set] - orderIndex) * sizeof(UInt32));
+	markers->order[set][orderIndex] = entry;
+	markers->orderCount[set]++;
+}
+
+static void MARangeMarkersRemoveRange(MARangeMarkers *markers, UInt32 entry)
+{
+	MARangeEntry removed = markers->entries[entry];
+	NSUInteger orderIndex = MARangeMarkersOrderIndex(markers, removed.set, removed.start);
+	memmove(&markers->order[removed.set][orderIndex], &markers->order[removed.set][orderIndex + 1], (markers->orderCount[removed.set] - orderIndex - 1) * sizeof(UInt32));
+	markers->orderCount[removed.set]--;
+	MARangeMarkersRemove(markers, removed.end);
+	MARangeMarkersRemove(markers, removed.start);
+}
+
+static void MARangeMarkersSetLength(MARangeMarkers *markers, UInt32 entry, NSUInteger length)
+{
+	MARangeEntry range = markers->entries[entry];
+	NSUInteger location = MARangeMarkersPosition(markers, range.start);
+	NSInteger lengthChange = (NSInteger)length - (NSInteger)(MARangeMarkersPosition(markers, range.end) - location);
+	if (lengthChange == 0) return;
+	if (range.end == markers->markerCount - 1) { // Nothing after it
+		markers->markers[range.end].position += lengthChange;
+		return;
+	}
+	markers->deltas[range.end] += lengthChange;
+	for (NSUInteger i = range.end + 1; i <= markers->markerCount; i += i & -i) markers->tree[i] += lengthChange;
+	markers->hasDeltas = YES;
+}
+
+static NSRange MARangeMarkersRange(MARangeMarkers *markers, UInt32 entry)
+{
+	NSUInteger location = MARangeMarkersPosition(markers, markers->entries[entry].start);
+	return NSMakeRange(location, MARangeMarkersPosition(markers, markers->entries[entry].end) - location);
+}
+
+static NSUInteger MARangeMarkersFirstTouching(MARangeMarkers *markers, NSUInteger set, NSUInteger location)
+{
+	// Disjoint ranges in order have their ends in order too
+	NSUInteger low = 0, high = markers->orderCount[set];
+	while (low < high) {
+		NSUInteger middle = low + (high - low) / 2;
+		if (MARangeMarkersPosition(markers, markers->entries[markers->order[set][middle]].end) < location) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+static void *MADuplicateBytes(const void *bytes, size_t length)
+{
+	if (!bytes) return NULL;
+	void *copy = malloc(length);
+	memcpy(copy, bytes, length);
+	return copy;
+}
+
+#pragma mark - Private Interface
+
+@interface MARangeIndex ()
+{
+	MARangeMarkers _markers;
+}
+
+@property (nonatomic, strong, readonly) NSMutableArray *entryKeys;
+@property (nonatomic, strong, readonly) NSArray *entriesByKey; // Dictionary per set
+
+@end
+
+#pragma mark - Implementation
+
+@implementation MARangeIndex
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_entryKeys = [NSMutableArray array];
+		NSMutableArray *entriesByKey = [NSMutableArray array];
+		for (NSUInteger set = 0; set < MARangeIndexSetCount; set++) {
+			[entriesByKey addObject:[NSMutableDictionary dictionary]];
+		}
+		_entriesByKey = entriesByKey;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	free(_markers.markers);
+	free(_markers.deltas);
+	free(_markers.tree);
+	free(_markers.entries);
+	for (NSUInteger set = 0; set < MARangeIndexSetCount; set++) {
+		free(_markers.order[set]);
+	}
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+	MARangeIndex *copy = [[[self class] allocWithZone:zone] init];
+	[copy.entryKeys setArray:self.entryKeys];
+	for (NSUInteger set = 0; set < MARangeIndexSetCount; set++) {
+		[copy.entriesByKey[set] setDictionary:self.entriesByKey[set]];
+	}
+	// Markers & entries as they are, deltas included
+	MARangeMarkers *markers = &copy->_markers;
+	*markers = _markers;
+	markers->markers = MADuplicateBytes(_markers.markers, _markers.markerCapacity * sizeof(MARangeMarker));
+	markers->deltas = MADuplicateBytes(_markers.deltas, _markers.markerCapacity * sizeof(NSInteger));
+	markers->tree = MADuplicateBytes(_markers.tree, (_markers.markerCapacity + 1) * sizeof(NSInteger));
+	markers->entries = MADuplicateBytes(_markers.entries, _markers.entryCapacity * sizeof(MARangeEntry));
+	for (NSUInteger set = 0; set < MARangeIndexSetCount; set++) {
+		markers->order[set] = MADuplicateBytes(_markers.order[set], _markers.orderCapacity[set] * sizeof(UInt32));
+	}
+	return copy;
+}
+
+- (NSUInteger)countOfRangesInSet:(NSUInteger)set
+{
+	return _markers.orderCount[set];
+}
+
+- (NSRange)rangeForKey:(id)key inSet:(NSUInteger)set
+{
+	NSNumber *entry = self.entriesByKey[set][key];
+	if (!entry) return NSMakeRange(NSNotFound, 0);
+	return MARangeMarkersRange(&_markers, [entry unsignedIntValue]);
+}
+
+- (void)setRange:(NSRange)range forKey:(id<NSCopying>)key inSet:(NSUInteger)set
+{
+	NSAssert(set < MARangeIndexSetCount, @"Invalid range set.");
+	NSMutableDictionary *entriesByKey = self.entriesByKey[set];
+	NSNumber *entryObject = entriesByKey[key];
+	if (entryObject) {
+		MARangeMarkersRemoveRange(&_markers, [entryObject unsignedIntValue]);
+	} else {
+		if (_markers.entryCount == _markers.entryCapacity) {
+			_markers.entryCapacity = MAX(_markers.entryCapacity * 2, 16);
+			_markers.entries = realloc(_markers.entries, _markers.entryCapacity * sizeof(MARangeEntry));
+		}
+		entryObject = @(_markers.entryCount++);
+		id copiedKey = [(id)key copyWithZone:nil]; // Immutable keys, so the dictionary shares this copy
+		entriesByKey[copiedKey] = entryObject;
+		[self.entryKeys addObject:copiedKey];
+	}
+	MARangeMarkersAddRange(&_markers, [entryObject unsignedIntValue], set, range.location, range.length);
+}
+
+- (void)setLength:(NSUInteger)length ofRangeWithKey:(id)key inSet:(NSUInteger)set
+{
+	NSNumber *entry = self.entriesByKey[set][key];
+	NSAssert(entry, @"No range with that key.");
+	MARangeMarkersSetLength(&_markers, [entry unsignedIntValue], length);
+}
+
+- (NSArray *)keysInOrderInSet:(NSUInteger)set
+{
+	NSUInteger count = _markers.orderCount[set];
+	NSMutableArray *keys = [NSMutableArray arrayWithCapacity:count];
+	for (NSUInteger i = 0; i < count; i++) {
+		[keys addObject:self.entryKeys[_markers.order[set][i]]];
+	}
+	return keys;
+}
+
+- (NSArray *)keysOfRangesTouchingRange:(NSRange)range inSet:(NSUInteger)set
+{
+	NSMutableArray *keys = [NSMutableArray array];
+	for (NSUInteger i = MARangeMarkersFirstTouching(&_markers, set, range.location); i < _markers.orderCount[set]; i++) {
+		UInt32 entry = _markers.order[set][i];
+		if (MARangeMarkersPosition(&_markers, _markers.entries[entry].start) > NSMaxRange(range)) break;
+		[keys addObject:self.entryKeys[entry]];
+	}
+	return keys;
+}
+
+- (NSDictionary *)rangesInSet:(NSUInteger)set
+{
+	NSUInteger count = _markers.orderCount[set];
+	NSMutableDictionary *ranges = [NSMutableDictionary dictionaryWithCapacity:count];
+	MARangeMarkersFlatten(&_markers); // Makes the positions O(1)
+	for (NSUInteger i = 0; i < count; i++) {
+		UInt32 entry = _markers.order[set][i];
+		ranges[self.entryKeys[entry]] = [NSValue valueWithRange:MARangeMarkersRange(&_markers, entry)];
+	}
+	return ranges;
+}
+
+@end
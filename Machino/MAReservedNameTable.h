@@ -0,0 +1,80 @@
+// Written by machino-gen --reserved-names-table from ReservedSymbolNames.txt, don't edit
+
+static const NSUInteger kReservedNameCount = 186;
+static const NSUInteger kReservedNameMaximumLength = 32;
+static const NSUInteger kReservedNameBucketCount = 47;
+static const NSUInteger kReservedNameSlotCount = 232;
+
+static const char * const kReservedNames[] = {
+	"updateStateMachines", "currenState", "state", "sendMessageIterationStart",
+	"sendMessageIterationEnd", "sendMessageCurrentState", "sendMessageWillCheckCondition", "sendMessageWillPerformTransition",
+	"sendMessageWillPerformAction", "sendMessageHello", "setupMessaging", "beginMessage",
+	"sendFrame", "beginFrame", "bufferUInt8", "SymbolID",
+	"readSymbolID", "bufferEncodedFrame", "writeVarint", "writeUInt8",
+	"messageFrame", "messageFrameLength", "messageFrameEventCount", "messageFrameReportsDrops",
+	"messageFrameCRC", "MessagingSerial", "MessagingSerialClass", "sendBufferedMessages",
+	"bufferedFrameLength", "messageBuffer", "messageBufferStart", "messageBufferLength",
+	"droppedMessageCount", "beginMessagingUpdate", "endMessagingUpdate", "sendMessageIfStateEntered",
+	"sendMessageIfConditionChanged", "isMessagingKeyframe", "isLoggedStateEntered", "lastMessagingKeyframeTime",
+	"millis", "kMessagingProtocolVersion", "kMessageMaximumLength", "kFrameCRCLength",
+	"FrameType", "kFrameEvents", "kFrameUserSerial", "kFrameHello",
+	"MessageType", "kMessageNone", "kMessageIterationStart", "kMessageIterationEnd",
+	"kMessageCurrentState", "kMessageWillCheckCondition", "kMessageWillPerformTransition", "kMessageWillPerformAction",
+	"kMessageDroppedMessages", "writeVarint32", "kFrameProfile", "kProfileEntryMaximumLength",
+	"ProfileKind", "kProfileLoop", "kProfileSymbol", "ProfileAccumulator",
+	"ProfiledState", "kProfileCount", "profileIDs", "profiles",
+	"loopProfile", "profiledIterationStartTime", "lastProfileTime", "profileSendIndex",
+	"addProfileSample", "profileCondition", "profileAction", "profileState",
+	"sendProfileFrame", "beginProfiledIteration", "endProfiledIteration", "micros",
+	"runStateMachineTable", "readStateMachineIndex", "readStateMachineCondition", "readStateMachineAction",
+	"stateMachineConditions", "stateMachineActions", "StateMachineIndex", "StateMachineTransition",
+	"StateMachineCondition", "StateMachineAction", "clearConditionCache", "checkCondition",
+	"evaluatedConditions", "conditionResults", "kCachedConditionCount", "setup",
+	"loop", "if", "else", "for",
+	"switch", "case", "while", "do",
+	"break", "continue", "return", "goto",
+	"HIGH", "LOW", "INPUT", "OUTPUT",
+	"INPUT_PULLUP", "alignas", "alignof", "and",
+	"and_eq", "asm", "auto", "bitand",
+	"bitor", "bool", "catch", "char",
+	"char16_t", "char32_t", "class", "compl",
+	"const", "constexpr", "const_cast", "decltype",
+	"default", "delete", "double", "dynamic_cast",
+	"enum", "explicit", "export", "extern",
+	"false", "float", "friend", "inline",
+	"int", "long", "mutable", "namespace",
+	"new", "noexcept", "not", "not_eq",
+	"nullptr", "operator", "or", "or_eq",
+	"private", "protected", "public", "register",
+	"reinterpret_cast", "short", "signed", "sizeof",
+	"static", "static_assert", "static_cast", "struct",
+	"template", "this", "thread_local", "throw",
+	"true", "try", "typedef", "typeid",
+	"typename", "union", "unsigned", "using",
+	"virtual", "void", "volatile", "wchar_t",
+	"xor", "xor_eq",
+};
+
+static const uint16_t kReservedNameDisplacements[] = { // Seeds the second hash, per bucket of the first
+	1, 48, 10, 8, 1, 12, 10, 8, 3, 5, 18, 1, 0, 1, 11, 2,
+	1, 2, 19, 54, 66, 1, 2, 3, 9, 4, 1, 3, 4, 4, 36, 4,
+	1, 83, 2, 3, 61, 0, 59, 15, 16, 16, 19, 24, 7, 21, 10,
+};
+
+static const int16_t kReservedNameSlots[] = { // Index into kReservedNames, -1 for none
+	161, 22, 34, 138, 129, 82, 144, -1, 176, 74, 36, 123, 60, 140, 4, 119,
+	-1, 31, 90, 167, 143, 18, -1, 68, 118, 56, 62, 53, -1, 155, 87, 92,
+	3, 103, 21, 39, 109, 126, 137, 50, 55, 26, -1, 164, 10, 130, -1, 76,
+	77, 11, 13, 174, 151, 150, 27, -1, 12, 71, 108, -1, -1, -1, 95, 171,
+	14, 42, 52, 15, 46, 139, -1, 45, 168, 175, -1, 184, 177, -1, 57, 158,
+	113, 61, 25, 120, 81, 145, 97, 180, 86, -1, 54, 65, 111, 107, 67, 70,
+	148, -1, 178, -1, -1, 94, -1, 5, 122, -1, -1, 132, 49, 172, 47, 162,
+	-1, 29, 96, 149, 9, 63, 160, 98, 125, 19, 110, 85, 170, -1, 104, 64,
+	-1, 58, 179, 169, -1, -1, 142, 1, 181, 88, 183, 2, 17, -1, 72, 165,
+	131, -1, 28, -1, 141, 163, 91, -1, 38, 43, -1, -1, 135, -1, 23, 115,
+	7, -1, 101, 134, 83, -1, 156, 44, -1, 79, 102, 182, 173, 6, -1, 127,
+	37, 136, 40, -1, 124, -1, -1, 75, -1, -1, 69, 93, 185, -1, 66, 41,
+	152, 116, 166, 117, -1, 121, 159, -1, 106, 153, 32, 157, -1, 48, 133, 146,
+	100, 105, 33, 24, 89, 112, 80, 73, 30, 16, 78, 154, 8, 84, 99, 128,
+	51, 20, 147, 59, 114, 0, -1, 35,
+};
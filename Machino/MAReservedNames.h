@@ -0,0 +1,21 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAPlatform.h"
+
+// The names symbols can't take because the generated code or the Arduino core already uses them, from
+// ReservedSymbolNames.txt. They're compiled in as a perfect hash table (MAReservedNameTable.h), so checking a name is two
+// hashes and a string compare, and nothing is read or parsed at run time. After editing the text file, write the table
+// again with machino-gen --reserved-names-table -o Machino/MAReservedNameTable.h.
+
+BOOL MAIsBuiltInReservedName(NSString *name);
+NSArray *MABuiltInReservedNames(void); // In the order of the text file, without duplicates
+NSArray *MAReservedNamesFromString(NSString *string); // Separated by whitespace, without duplicates
+NSString *MAReservedNameTableSource(NSArray *names); // nil if no table could be found for them
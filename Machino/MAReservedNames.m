@@ -0,0 +1,166 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAReservedNames.h"
+#import "MAReservedNameTable.h"
+
+static const UInt32 kHashOffsetBasis = 2166136261u; // FNV-1a
+static const UInt32 kHashPrime = 16777619u;
+static const NSUInteger kNamesPerBucket = 4; // On average, by the first hash
+static const NSUInteger kTableNamesPerLine = 4;
+static const NSUInteger kTableValuesPerLine = 16;
+static NSString * const kTableHeader = @"// Written by machino-gen --reserved-names-table from ReservedSymbolNames.txt, don't edit\n\n";
+
+#pragma mark - Hashing
+
+static UInt32 MAReservedNameHash(const char *bytes, NSUInteger length, UInt32 seed)
+{
+	UInt32 hash = kHashOffsetBasis ^ (seed * kHashPrime);
+	for (NSUInteger i = 0; i < length; i++) {
+		hash ^= (UInt8)bytes[i];
+		hash *= kHashPrime;
+	}
+	return hash;
+}
+
+#pragma mark - Built-in Names
+
+BOOL MAIsBuiltInReservedName(NSString *name)
+{
+	// Longer or non-ascii names can't be one
+	char bytes[kReservedNameMaximumLength + 1];
+	if (![name getCString:bytes maxLength:sizeof(bytes) encoding:NSASCIIStringEncoding]) return NO;
+	NSUInteger length = strlen(bytes);
+	// The first hash picks the bucket, whose displacement seeds the second one that picks the slot
+	UInt32 bucket = MAReservedNameHash(bytes, length, 0) % kReservedNameBucketCount;
+	UInt32 slot = MAReservedNameHash(bytes, length, kReservedNameDisplacements[bucket]) % kReservedNameSlotCount;
+	int index = kReservedNameSlots[slot];
+	return (index >= 0 && strcmp(kReservedNames[index], bytes) == 0);
+}
+
+NSArray *MABuiltInReservedNames(void)
+{
+	NSMutableArray *names = [NSMutableArray arrayWithCapacity:kReservedNameCount];
+	for (NSUInteger i = 0; i < kReservedNameCount; i++) {
+		[names addObject:@(kReservedNames[i])];
+	}
+	return names;
+}
+
+NSArray *MAReservedNamesFromString(NSString *string)
+{
+	NSArray *parts = [string componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+	NSMutableOrderedSet *names = [NSMutableOrderedSet orderedSetWithCapacity:[parts count]];
+	for (NSString *part in parts) {
+		if ([part length] > 0) [names addObject:part];
+	}
+	return [names array];
+}
+
+#pragma mark - Table Source
+
+static void MAAppendTableRows(NSMutableString *source, NSArray *values, NSUInteger valuesPerLine)
+{
+	for (NSUInteger i = 0; i < [values count]; i += valuesPerLine) {
+		NSArray *line = [values subarrayWithRange:NSMakeRange(i, MIN(valuesPerLine, [values count] - i))];
+		[source appendFormat:@"\t%@,\n", [line componentsJoinedByString:@", "]];
+	}
+}
+
+NSString *MAReservedNameTableSource(NSArray *names)
+{
+	NSUInteger nameCount = [names count];
+	if (nameCount == 0 || nameCount > INT16_MAX) return nil;
+	NSUInteger bucketCount = (nameCount + kNamesPerBucket - 1) / kNamesPerBucket;
+	NSUInteger slotCount = nameCount + nameCount / 4; // Some room makes the displacements much quicker to find
+	// Hash the names into buckets
+	NSCharacterSet *unquotableCharacters = [NSCharacterSet characterSetWithCharactersInString:@"\"\\"];
+	NSMutableArray *nameData = [NSMutableArray arrayWithCapacity:nameCount];
+	NSMutableArray *buckets = [NSMutableArray arrayWithCapacity:bucketCount];
+	for (NSUInteger i = 0; i < bucketCount; i++) {
+		[buckets addObject:[NSMutableArray array]];
+	}
+	NSUInteger maximumLength = 0;
+	for (NSUInteger i = 0; i < nameCount; i++) {
+		NSString *name = names[i];
+		NSData *data = [name dataUsingEncoding:NSASCIIStringEncoding];
+		if (!data || [name rangeOfCharacterFromSet:unquotableCharacters].location != NSNotFound) return nil;
+		[nameData addObject:data];
+		maximumLength = MAX(maximumLength, [data length]);
+		[buckets[MAReservedNameHash([data bytes], [data length], 0) % bucketCount] addObject:@(i)];
+	}
+	// Place the biggest buckets first, while there's most room: each gets the first displacement that puts all its names
+	// in distinct free slots
+	NSMutableArray *bucketOrder = [NSMutableArray arrayWithCapacity:bucketCount];
+	for (NSUInteger i = 0; i < bucketCount; i++) {
+		[bucketOrder addObject:@(i)];
+	}
+	[bucketOrder sortUsingComparator:^NSComparisonResult(NSNumber *bucketA, NSNumber *bucketB) {
+		NSUInteger countA = [buckets[[bucketA unsignedIntegerValue]] count];
+		NSUInteger countB = [buckets[[bucketB unsignedIntegerValue]] count];
+		if (countA != countB) return (countA > countB) ? NSOrderedAscending : NSOrderedDescending;
+		return [bucketA compare:bucketB];
+	}];
+	NSMutableData *slotData = [NSMutableData dataWithLength:slotCount * sizeof(int16_t)];
+	int16_t *slots = [slotData mutableBytes];
+	memset(slots, 0xFF, [slotData length]); // All -1
+	NSMutableArray *displacements = [NSMutableArray arrayWithCapacity:bucketCount];
+	for (NSUInteger i = 0; i < bucketCount; i++) {
+		[displacements addObject:@0];
+	}
+	for (NSNumber *bucketIndex in bucketOrder) {
+		NSArray *bucket = buckets[[bucketIndex unsignedIntegerValue]];
+		NSUInteger bucketSize = [bucket count];
+		if (bucketSize == 0) continue;
+		NSUInteger candidates[bucketSize];
+		UInt32 displacement;
+		for (displacement = 1; displacement <= UINT16_MAX; displacement++) {
+			BOOL fits = YES;
+			for (NSUInteger i = 0; i < bucketSize && fits; i++) {
+				NSData *data = nameData[[bucket[i] unsignedIntegerValue]];
+				candidates[i] = MAReservedNameHash([data bytes], [data length], displacement) % slotCount;
+				if (slots[candidates[i]] >= 0) fits = NO;
+				for (NSUInteger j = 0; j < i && fits; j++) {
+					if (candidates[j] == candidates[i]) fits = NO;
+				}
+			}
+			if (fits) break;
+		}
+		if (displacement > UINT16_MAX) return nil;
+		for (NSUInteger i = 0; i < bucketSize; i++) {
+			slots[candidates[i]] = (int16_t)[bucket[i] integerValue];
+		}
+		displacements[[bucketIndex unsignedIntegerValue]] = @(displacement);
+	}
+	// Write it out
+	NSMutableArray *quotedNames = [NSMutableArray arrayWithCapacity:nameCount];
+	for (NSString *name in names) {
+		[quotedNames addObject:[NSString stringWithFormat:@"\"%@\"", name]];
+	}
+	NSMutableArray *slotValues = [NSMutableArray arrayWithCapacity:slotCount];
+	for (NSUInteger i = 0; i < slotCount; i++) {
+		[slotValues addObject:@(slots[i])];
+	}
+	NSMutableString *source = [NSMutableString stringWithString:kTableHeader];
+	[source appendFormat:@"static const NSUInteger kReservedNameCount = %lu;\n", (unsigned long)nameCount];
+	[source appendFormat:@"static const NSUInteger kReservedNameMaximumLength = %lu;\n", (unsigned long)maximumLength];
+	[source appendFormat:@"static const NSUInteger kReservedNameBucketCount = %lu;\n", (unsigned long)bucketCount];
+	[source appendFormat:@"static const NSUInteger kReservedNameSlotCount = %lu;\n\n", (unsigned long)slotCount];
+	[source appendString:@"static const char * const kReservedNames[] = {\n"];
+	MAAppendTableRows(source, quotedNames, kTableNamesPerLine);
+	[source appendString:@"};\n\n"];
+	[source appendString:@"static const uint16_t kReservedNameDisplacements[] = { // Seeds the second hash, per bucket of the first\n"];
+	MAAppendTableRows(source, displacements, kTableValuesPerLine);
+	[source appendString:@"};\n\n"];
+	[source appendString:@"static const int16_t kReservedNameSlots[] = { // Index into kReservedNames, -1 for none\n"];
+	MAAppendTableRows(source, slotValues, kTableValuesPerLine);
+	[source appendString:@"};\n"];
+	return source;
+}
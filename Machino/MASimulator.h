@@ -0,0 +1,38 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAPlatform.h"
+
+// Builds a sketch for the host against SimulatedArduino.h (standing in for Arduino.h) and runs it, so state machines can
+// be tried without a board and far faster than real time. Its Serial is a pseudo-terminal that MAArduinoController
+// connects to like a board's serial port, or a file, to record what the sketch sends.
+@interface MASimulator : NSObject
+
+@property (nonatomic, copy) NSString *compiler; // Defaults to $CXX, or c++
+@property (nonatomic, copy) NSString *arduinoHeaderPath; // SimulatedArduino.h, the headers default to the main bundle's
+@property (nonatomic, copy) NSString *messagingHeaderPath;
+@property (nonatomic, copy) NSString *tableHeaderPath; // StateMachineTable.h
+@property (nonatomic) unsigned long baudRate; // Defines MESSAGING_BAUD_RATE if set
+@property (nonatomic) double speed; // Times real time, 0 for as fast as possible (default: 1)
+@property (nonatomic) unsigned long duration; // Milliseconds of virtual time to run for, 0 until terminated
+@property (nonatomic, copy) NSString *inputScriptPath; // See SimulatedArduino.h
+@property (nonatomic, copy) NSString *serialOutputPath; // Records Serial here instead of opening a pseudo-terminal
+@property (nonatomic, copy) void (^pinHandler)(NSString *line); // Outputs that changed ("<milliseconds> <pin> <value>"), on a background queue
+@property (nonatomic, copy, readonly) NSString *serialPortPath; // The pseudo-terminal, once started
+@property (nonatomic, readonly, getter = isRunning) BOOL running;
+
++ (NSString *)hostSourceForCode:(NSString *)code; // With the functions declared up front, like the Arduino IDE does
+
+- (BOOL)buildCode:(NSString *)code output:(NSString **)output; // The compiler's output
+- (BOOL)startWithError:(NSError **)error; // Returns once Serial is open
+- (int)waitUntilExit; // The exit status
+- (void)terminate; // Also removes the build
+
+@end
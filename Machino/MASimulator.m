@@ -0,0 +1,191 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MASimulator.h"
+
+static NSString * const kSimulatorMainSource = @"#define SIMULATED_ARDUINO_MAIN\n#include \"Arduino.h\"\n";
+static NSString * const kSimulatorSerialLinePrefix = @"serial ";
+
+#pragma mark - Private Interface
+
+@interface MASimulator ()
+
+@property (nonatomic, copy, readwrite) NSString *serialPortPath;
+@property (nonatomic, copy) NSString *buildDirectory;
+@property (nonatomic, copy) NSString *executablePath;
+@property (nonatomic, strong) NSTask *task;
+@property (nonatomic, strong) NSPipe *errorPipe;
+
+@end
+
+#pragma mark - MASimulator
+
+@implementation MASimulator
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_compiler = [[NSProcessInfo processInfo] environment][@"CXX"] ?: @"c++";
+		_arduinoHeaderPath = [[NSBundle mainBundle] pathForResource:@"SimulatedArduino" ofType:@"h"];
+		_messagingHeaderPath = [[NSBundle mainBundle] pathForResource:@"Messaging" ofType:@"h"];
+		_tableHeaderPath = [[NSBundle mainBundle] pathForResource:@"StateMachineTable" ofType:@"h"];
+		_speed = 1;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[self terminate];
+}
+
+- (BOOL)isRunning
+{
+	return [self.task isRunning];
+}
+
+#pragma mark - Building
+
++ (NSString *)hostSourceForCode:(NSString *)code
+{
+	NSMutableString *source = [NSMutableString stringWithString:@"#include \"Arduino.h\"\n"];
+	NSRegularExpression *functionExpression = [NSRegularExpression regularExpressionWithPattern:@"^(void|boolean) (\\w+)\\(\\) \\{$" options:NSRegularExpressionAnchorsMatchLines error:nil];
+	for (NSTextCheckingResult *match in [functionExpression matchesInString:code options:0 range:NSMakeRange(0, [code length])]) {
+		[source appendFormat:@"%@ %@();\n", [code substringWithRange:[match rangeAtIndex:1]], [code substringWithRange:[match rangeAtIndex:2]]];
+	}
+	[source appendString:code];
+	[source appendString:@"\n"];
+	return source;
+}
+
+- (BOOL)buildCode:(NSString *)code output:(NSString **)output
+{
+	[self terminate];
+	// Headers next to the sketch, SimulatedArduino.h as Arduino.h
+	static NSUInteger buildCount = 0;
+	NSString *name = [NSString stringWithFormat:@"machino-simulator-%d-%lu", [[NSProcessInfo processInfo] processIdentifier], (unsigned long)++buildCount];
+	self.buildDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	if (![fileManager createDirectoryAtPath:self.buildDirectory withIntermediateDirectories:YES attributes:nil error:nil]) {
+		if (output) *output = [NSString stringWithFormat:@"Could not create %@\n", self.buildDirectory];
+		return NO;
+	}
+	NSDictionary *headers = @{ @"Arduino.h" : self.arduinoHeaderPath ?: @"", @"Messaging.h" : self.messagingHeaderPath ?: @"", @"StateMachineTable.h" : self.tableHeaderPath ?: @"" };
+	for (NSString *headerName in headers) {
+		if (![fileManager copyItemAtPath:headers[headerName] toPath:[self.buildDirectory stringByAppendingPathComponent:headerName] error:nil]) {
+			if (output) *output = [NSString stringWithFormat:@"%@ not found\n", headerName];
+			return NO;
+		}
+	}
+	NSString *sourcePath = [self.buildDirectory stringByAppendingPathComponent:@"Sketch.cpp"];
+	NSString *mainPath = [self.buildDirectory stringByAppendingPathComponent:@"main.cpp"];
+	[[[self class] hostSourceForCode:code] writeToFile:sourcePath atomically:NO encoding:NSUTF8StringEncoding error:nil];
+	[kSimulatorMainSource writeToFile:mainPath atomically:NO encoding:NSUTF8StringEncoding error:nil];
+	// Compile
+	self.executablePath = [self.buildDirectory stringByAppendingPathComponent:@"Sketch"];
+	NSMutableArray *arguments = [NSMutableArray arrayWithObjects:self.compiler, @"-O1", @"-w", @"-I", self.buildDirectory, nil];
+	if (self.baudRate > 0) [arguments addObject:[NSString stringWithFormat:@"-DMESSAGING_BAUD_RATE=%luUL", self.baudRate]];
+	[arguments addObjectsFromArray:@[ sourcePath, mainPath, @"-o", self.executablePath ]];
+	NSTask *task = [[NSTask alloc] init];
+	[task setLaunchPath:@"/usr/bin/env"]; // So the compiler is looked up in PATH
+	[task setArguments:arguments];
+	NSPipe *pipe = [NSPipe pipe];
+	[task setStandardOutput:pipe];
+	[task setStandardError:pipe];
+	[task launch];
+	NSData *data = [[pipe fileHandleForReading] readDataToEndOfFile];
+	[task waitUntilExit];
+	if (output) *output = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+	return ([task terminationStatus] == 0);
+}
+
+#pragma mark - Running
+
+- (BOOL)startWithError:(NSError **)error
+{
+	if (!self.executablePath || self.task) return NO;
+	// Arguments
+	NSMutableArray *arguments = [NSMutableArray arrayWithObjects:@"--speed", [NSString stringWithFormat:@"%g", self.speed], nil];
+	if (self.duration > 0) [arguments addObjectsFromArray:@[ @"--duration", [NSString stringWithFormat:@"%lu", self.duration] ]];
+	if (self.inputScriptPath) [arguments addObjectsFromArray:@[ @"--script", self.inputScriptPath ]];
+	if (self.serialOutputPath) [arguments addObjectsFromArray:@[ @"--serial-output", self.serialOutputPath ]];
+	if (self.pinHandler) [arguments addObject:@"--pins"];
+	// Launch
+	self.task = [[NSTask alloc] init];
+	[self.task setLaunchPath:self.executablePath];
+	[self.task setArguments:arguments];
+	NSPipe *outputPipe = [NSPipe pipe];
+	self.errorPipe = [NSPipe pipe];
+	[self.task setStandardOutput:outputPipe];
+	[self.task setStandardError:self.errorPipe];
+	[self.task launch];
+	// Wait for the pseudo-terminal, then hand the rest of the output to the pin handler
+	NSFileHandle *outputHandle = [outputPipe fileHandleForReading];
+	NSMutableString *pending = [NSMutableString string];
+	while (!self.serialOutputPath && !self.serialPortPath) {
+		NSData *data = [outputHandle availableData];
+		if ([data length] == 0) break;
+		[pending appendString:[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] ?: @""];
+		[self handleOutput:pending];
+	}
+	if (!self.serialOutputPath && !self.serialPortPath) {
+		[self.task waitUntilExit];
+		NSData *errorData = [[self.errorPipe fileHandleForReading] readDataToEndOfFile];
+		NSString *message = [[NSString alloc] initWithData:errorData encoding:NSUTF8StringEncoding];
+		if (error) *error = [NSError errorWithDomain:@"" code:[self.task terminationStatus] userInfo:@{ NSLocalizedDescriptionKey : [message length] ? message : @"The simulator quit" }];
+		self.task = nil;
+		return NO;
+	}
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		for (NSData *data = [outputHandle availableData]; [data length] > 0; data = [outputHandle availableData]) {
+			[pending appendString:[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] ?: @""];
+			[self handleOutput:pending];
+		}
+	});
+	return YES;
+}
+
+- (void)handleOutput:(NSMutableString *)pending
+{
+	// Complete lines only, the rest stays pending
+	NSRange lineEnd;
+	while ((lineEnd = [pending rangeOfString:@"\n"]).location != NSNotFound) {
+		NSString *line = [pending substringToIndex:lineEnd.location];
+		[pending deleteCharactersInRange:NSMakeRange(0, NSMaxRange(lineEnd))];
+		if (!self.serialPortPath && [line hasPrefix:kSimulatorSerialLinePrefix]) {
+			self.serialPortPath = [line substringFromIndex:[kSimulatorSerialLinePrefix length]];
+		} else if (self.pinHandler) {
+			self.pinHandler(line);
+		}
+	}
+}
+
+- (int)waitUntilExit
+{
+	[self.task waitUntilExit];
+	return [self.task terminationStatus];
+}
+
+- (void)terminate
+{
+	if ([self.task isRunning]) {
+		[self.task terminate];
+		[self.task waitUntilExit];
+	}
+	self.task = nil;
+	self.errorPipe = nil;
+	self.serialPortPath = nil;
+	self.executablePath = nil;
+	if (self.buildDirectory) [[NSFileManager defaultManager] removeItemAtPath:self.buildDirectory error:nil];
+	self.buildDirectory = nil;
+}
+
+@end
@@ -0,0 +1,41 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import <Foundation/Foundation.h>
+#import "MAPlatform.h"
+
+@class MABuildCache;
+
+// A sketch compiled for a board, from the build cache or just now
+@interface MASketchBuild : NSObject
+
+@property (nonatomic, copy, readonly) NSString *key; // In the build cache
+@property (nonatomic, readonly) UInt32 buildID; // Defined as MESSAGING_BUILD_ID when it was compiled
+@property (nonatomic, copy, readonly) NSString *artifactsPath;
+@property (nonatomic, readonly, getter = isCached) BOOL cached; // Came from the cache instead of the compiler
+
+@end
+
+// Compiles sketches with arduino-cli and uploads them, through an MABuildCache: a sketch built for the same board and
+// toolchain before is only uploaded, and callers can skip even that when the board says it already runs the build.
+// Everything blocks until arduino-cli is done, so call it off the main thread.
+@interface MASketchBuilder : NSObject
+
+@property (nonatomic, copy) NSString *arduinoCLIPath; // Defaults to arduino-cli, looked up in PATH
+@property (nonatomic, copy) NSString *boardIdentifier; // Fully qualified board name, like arduino:avr:uno
+@property (nonatomic, strong) MABuildCache *cache; // Defaults to one in MABuildCache's default directory
+
++ (UInt32)buildIDRunningOnPort:(NSString *)port baudRate:(unsigned long)baudRate timeout:(NSTimeInterval)timeout; // From the hello the board sends once opening the port reset it, 0 if none came
+
+- (NSString *)toolchainVersionWithError:(NSError **)error; // Of arduino-cli & the installed cores, asked once
+- (MASketchBuild *)buildSketchAtPath:(NSString *)sketchPath output:(NSString **)output error:(NSError **)error; // The sketch folder, which is left as is
+- (BOOL)uploadBuild:(MASketchBuild *)build toPort:(NSString *)port output:(NSString **)output error:(NSError **)error;
+
+@end
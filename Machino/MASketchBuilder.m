@@ -0,0 +1,240 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MASketchBuilder.h"
+#import "MABuildCache.h"
+#import "MAMessageDecoder.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <errno.h>
+#import <poll.h>
+#import <termios.h>
+
+static NSString * const kDefaultArduinoCLIPath = @"arduino-cli";
+static NSString * const kSketchExtension = @"ino";
+static NSString * const kBuildIDDefinitionFormat = @"#define MESSAGING_BUILD_ID 0x%08XUL\n";
+static const NSUInteger kProbeReadLength = 256;
+
+#pragma mark - MASketchBuild
+
+@interface MASketchBuild ()
+
+@property (nonatomic, copy, readwrite) NSString *key;
+@property (nonatomic, readwrite) UInt32 buildID;
+@property (nonatomic, copy, readwrite) NSString *artifactsPath;
+@property (nonatomic, readwrite, getter = isCached) BOOL cached;
+
+@end
+
+@implementation MASketchBuild
+
+@end
+
+#pragma mark - MAHelloListener
+
+// Waits for the hello, ignoring everything else
+@interface MAHelloListener : NSObject <MAMessageDecoderDelegate>
+
+@property (nonatomic) BOOL receivedHello;
+
+@end
+
+@implementation MAHelloListener
+
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeEvents:(const MAMessageEvent *)events count:(NSUInteger)count { }
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length { }
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count { }
+
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveHelloWithBaudRate:(unsigned long)baudRate
+{
+	self.receivedHello = YES;
+}
+
+@end
+
+#pragma mark - Private Interface
+
+@interface MASketchBuilder ()
+
+@property (nonatomic, copy) NSString *toolchainVersion;
+
+@end
+
+#pragma mark - MASketchBuilder
+
+@implementation MASketchBuilder
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_arduinoCLIPath = kDefaultArduinoCLIPath;
+		_cache = [[MABuildCache alloc] initWithDirectory:[MABuildCache defaultDirectory]];
+	}
+	return self;
+}
+
+#pragma mark - Board
+
++ (UInt32)buildIDRunningOnPort:(NSString *)port baudRate:(unsigned long)baudRate timeout:(NSTimeInterval)timeout
+{
+	// Opening the port resets most boards, and the sketch says hello from setupMessaging()
+	int fileDescriptor = open([port fileSystemRepresentation], O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (fileDescriptor < 0) return 0;
+	struct termios options;
+	if (tcgetattr(fileDescriptor, &options) == 0) {
+		cfmakeraw(&options);
+		options.c_cflag |= HUPCL | CLOCAL | CREAD;
+		cfsetspeed(&options, baudRate); // Like ORSSerialPort
+		tcsetattr(fileDescriptor, TCSANOW, &options);
+	}
+	MAMessageDecoder *decoder = [[MAMessageDecoder alloc] init];
+	MAHelloListener *listener = [[MAHelloListener alloc] init];
+	decoder.delegate = listener;
+	NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+	Byte buffer[kProbeReadLength];
+	while (!listener.receivedHello) {
+		NSTimeInterval remainingTime = [deadline timeIntervalSinceNow];
+		if (remainingTime <= 0) break;
+		struct pollfd pollDescriptor = { fileDescriptor, POLLIN, 0 };
+		int readyCount = poll(&pollDescriptor, 1, (int)ceil(remainingTime * 1000));
+		if (readyCount < 0 && errno == EINTR) continue;
+		if (readyCount <= 0) break;
+		ssize_t length = read(fileDescriptor, buffer, sizeof(buffer));
+		if (length < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+		if (length <= 0) break;
+		[decoder decodeBytes:buffer length:length];
+	}
+	close(fileDescriptor);
+	return listener.receivedHello ? decoder.buildID : 0;
+}
+
+#pragma mark - Building
+
+- (NSString *)toolchainVersionWithError:(NSError **)error
+{
+	@synchronized(self) {
+		if (self.toolchainVersion) return self.toolchainVersion;
+	}
+	NSString *version = nil;
+	NSString *cores = nil;
+	if (![self runArduinoCLIWithArguments:@[ @"version" ] output:&version error:error]) return nil;
+	if (![self runArduinoCLIWithArguments:@[ @"core", @"list" ] output:&cores error:error]) return nil;
+	@synchronized(self) {
+		self.toolchainVersion = [version stringByAppendingString:cores];
+		return self.toolchainVersion;
+	}
+}
+
+- (MASketchBuild *)buildSketchAtPath:(NSString *)sketchPath output:(NSString **)output error:(NSError **)error
+{
+	NSString *boardIdentifier = self.boardIdentifier;
+	if ([boardIdentifier length] == 0) {
+		if (error) *error = [NSError errorWithDomain:@"" code:0 userInfo:@{ NSLocalizedDescriptionKey : @"No board to build for." }];
+		return nil;
+	}
+	// Key
+	NSString *toolchainVersion = [self toolchainVersionWithError:error];
+	if (!toolchainVersion) return nil;
+	NSDictionary *files = [self filesOfSketchAtPath:sketchPath error:error];
+	if (!files) return nil;
+	MASketchBuild *build = [[MASketchBuild alloc] init];
+	build.key = [MABuildCache keyForFiles:files boardIdentifier:boardIdentifier toolchainVersion:toolchainVersion];
+	build.buildID = [MABuildCache buildIDForKey:build.key];
+	// Cached?
+	build.artifactsPath = [self.cache artifactsPathForKey:build.key];
+	if (build.artifactsPath) {
+		build.cached = YES;
+		return build;
+	}
+	// Compile a copy with the build id in it, then keep what came out
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	NSString *buildDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]];
+	NSString *sketchName = [sketchPath lastPathComponent];
+	NSString *stagedSketchPath = [buildDirectory stringByAppendingPathComponent:sketchName];
+	NSString *artifactsPath = [buildDirectory stringByAppendingPathComponent:@"build"];
+	BOOL success = [fileManager createDirectoryAtPath:buildDirectory withIntermediateDirectories:YES attributes:nil error:error]
+		&& [fileManager copyItemAtPath:sketchPath toPath:stagedSketchPath error:error];
+	if (success) {
+		NSString *inoPath = [stagedSketchPath stringByAppendingPathComponent:[sketchName stringByAppendingPathExtension:kSketchExtension]];
+		NSString *code = [NSString stringWithContentsOfFile:inoPath encoding:NSUTF8StringEncoding error:error];
+		success = (code != nil) && [[[NSString stringWithFormat:kBuildIDDefinitionFormat, (unsigned int)build.buildID] stringByAppendingString:code]
+			writeToFile:inoPath atomically:NO encoding:NSUTF8StringEncoding error:error];
+	}
+	if (success) {
+		NSArray *arguments = @[ @"compile", @"--fqbn", boardIdentifier, @"--output-dir", artifactsPath, stagedSketchPath ];
+		success = [self runArduinoCLIWithArguments:arguments output:output error:error];
+	}
+	if (success) build.artifactsPath = [self.cache storeArtifactsAtPath:artifactsPath forKey:build.key error:error];
+	[fileManager removeItemAtPath:buildDirectory error:nil];
+	return build.artifactsPath ? build : nil;
+}
+
+- (NSDictionary *)filesOfSketchAtPath:(NSString *)sketchPath error:(NSError **)error
+{
+	// By relative path, without hidden ones
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	NSDirectoryEnumerator *enumerator = [fileManager enumeratorAtPath:sketchPath];
+	if (!enumerator) {
+		if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:ENOENT userInfo:nil];
+		return nil;
+	}
+	NSMutableDictionary *files = [NSMutableDictionary dictionary];
+	for (NSString *path in enumerator) {
+		if ([[path lastPathComponent] hasPrefix:@"."]) {
+			if ([[[enumerator fileAttributes] fileType] isEqualToString:NSFileTypeDirectory]) [enumerator skipDescendants];
+			continue;
+		}
+		if (![[[enumerator fileAttributes] fileType] isEqualToString:NSFileTypeRegular]) continue;
+		NSData *data = [NSData dataWithContentsOfFile:[sketchPath stringByAppendingPathComponent:path] options:0 error:error];
+		if (!data) return nil;
+		files[path] = data;
+	}
+	return files;
+}
+
+#pragma mark - Uploading
+
+- (BOOL)uploadBuild:(MASketchBuild *)build toPort:(NSString *)port output:(NSString **)output error:(NSError **)error
+{
+	NSArray *arguments = @[ @"upload", @"--fqbn", self.boardIdentifier ?: @"", @"--port", port, @"--input-dir", build.artifactsPath ];
+	return [self runArduinoCLIWithArguments:arguments output:output error:error];
+}
+
+#pragma mark - Utility
+
+- (BOOL)runArduinoCLIWithArguments:(NSArray *)arguments output:(NSString **)output error:(NSError **)error
+{
+	// Through env, so a bare name is looked up in PATH
+	NSTask *task = [[NSTask alloc] init];
+	[task setLaunchPath:@"/usr/bin/env"];
+	[task setArguments:[@[ self.arduinoCLIPath ] arrayByAddingObjectsFromArray:arguments]];
+	NSPipe *pipe = [NSPipe pipe];
+	[task setStandardOutput:pipe];
+	[task setStandardError:pipe];
+	@try {
+		[task launch];
+	} @catch (NSException *exception) {
+		if (error) *error = [NSError errorWithDomain:@"" code:0 userInfo:@{ NSLocalizedDescriptionKey : [exception reason] ?: @"Could not launch arduino-cli." }];
+		return NO;
+	}
+	NSData *data = [[pipe fileHandleForReading] readDataToEndOfFile];
+	[task waitUntilExit];
+	NSString *taskOutput = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] ?: @"";
+	if (output) *output = taskOutput;
+	if ([task terminationStatus] == 0) return YES;
+	if (error) {
+		NSString *description = [NSString stringWithFormat:@"arduino-cli %@ failed (%i).", [arguments firstObject], [task terminationStatus]];
+		*error = [NSError errorWithDomain:@"" code:[task terminationStatus] userInfo:@{ NSLocalizedDescriptionKey : description }];
+	}
+	return NO;
+}
+
+@end
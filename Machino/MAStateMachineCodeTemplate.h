@@ -17,7 +17,18 @@
 @class MAAction;
 
 typedef NS_OPTIONS(NSUInteger, MAStateMachineCodeTemplateOptions) {
-	MAInsertLoggingCode = 1
+	MAInsertLoggingCode = 1,
+	MATableDrivenStateMachines = 2, // Transition tables in PROGMEM, run by the interpreter in StateMachineTable.h
+	MAMemoizeConditions = 4, // Checks each condition at most once per updateStateMachines(), except volatile ones
+	MAChangeOnlyLogging = 8, // With MAInsertLoggingCode, logs states when entered and conditions when their result changed, plus keyframes
+	MAProfiling = 16 // With MAInsertLoggingCode, times loop(), the conditions, actions & states on the device and sends summaries instead of events
+};
+
+typedef NS_ENUM(NSUInteger, MAGenerationPhase) {
+	MAGenerationPhaseStateGroups,
+	MAGenerationPhaseActionsAndConditions,
+	MAGenerationPhaseSymbolNames,
+	MAGenerationPhaseWriteCode
 };
 
 @interface MAStateMachineCodeTemplate : MACodeTemplate <NSCoding>
@@ -26,8 +37,17 @@ typedef NS_OPTIONS(NSUInteger, MAStateMachineCodeTemplateOptions) {
 @property (nonatomic, copy) NSArray *states;
 @property (nonatomic, copy) NSArray *transitions;
 @property (nonatomic, strong) MASymbolManager *symbols;
+@property (nonatomic, copy) BOOL (^cancellationHandler)(void); // Asked between phases & state machines, generation stops when it returns YES
+@property (nonatomic, readonly) BOOL isCancelled; // The code is incomplete then
+@property (nonatomic) NSUInteger writerCount; // Threads writing state machines side by side, 0 (the default) for one per active processor. The code is the same for any count.
+
++ (void)setReservedSymbolNamesPath:(NSString *)path; // Instead of the built-in names (MAReservedNames.h), nil for those
 
 - (void)generate;
+- (void)generateWithPhaseHandler:(void(^)(MAGenerationPhase phase))phaseHandler; // Handler is called after each phase
+- (void)generateMergingCodeFromTemplate:(MACodeTemplate *)oldTemplate; // Same result as generate followed by mergeCodeFromTemplate:, but writes the merged code in place (so it works with a sink)
+- (void)generateFromTemplate:(MAStateMachineCodeTemplate *)oldTemplate changes:(NSArray *)changes; // Same result as generate followed by mergeCodeFromTemplate:, but copies the fragments the MAGraphChange's didn't affect
+- (void)generateFromTemplate:(MAStateMachineCodeTemplate *)oldTemplate changes:(NSArray *)changes mergingCodeFromTemplate:(MACodeTemplate *)codeTemplate; // The same, but merges the code the user has in codeTemplate since (fragments with other code are written again)
 - (id)objectForSymbolWithID:(UInt64)symbolID;
 - (NSRange)rangeForCondition:(MACondition *)condition;
 - (NSRange)rangeForAction:(MAAction *)action;
@@ -11,9 +11,10 @@
 
 #import "MAStateMachineCodeTemplate.h"
 #import "MASymbolManager.h"
+#import "MAReservedNames.h"
 #import "MACodeTemplate.h"
 #import "Graph.h"
-#import "Utility.h"
+#import "NSArray+Utility.h"
 
 // Coder keys
 static NSString * const kCoderStatesKey = @"states";
@@ -27,6 +28,33 @@ static NSString * const kFunctionNameSetup = @"setup";
 static NSString * const kFunctionNameLoop = @"loop";
 static NSString * const kFunctionNameUpdateStateMachines = @"updateStateMachines";
 static NSString * const kFunctionNameFormatUpdateStateMachine = @"updateStateMachine%i";
+static NSString * const kFunctionNameRunStateMachineTable = @"runStateMachineTable";
+// Tables
+static NSString * const kTableHeaderName = @"StateMachineTable.h";
+static NSString * const kTableNameConditions = @"stateMachineConditions";
+static NSString * const kTableNameActions = @"stateMachineActions";
+static NSString * const kTableNameFormatOffsets = @"stateMachine%iOffsets";
+static NSString * const kTableNameFormatTransitions = @"stateMachine%iTransitions";
+static NSString * const kTableNameFormatActions = @"stateMachine%iActions";
+static NSString * const kTableNameFormatStateIDs = @"stateMachine%iStateIDs";
+static NSString * const kTableNameFormatTransitionIDs = @"stateMachine%iTransitionIDs";
+static NSString * const kTableNameFormatConditionIDs = @"stateMachine%iConditionIDs";
+static const NSUInteger kTableValuesPerLine = 16;
+static const NSUInteger kTableMaximumByteIndex = 255; // Larger indexes need the 16-bit StateMachineIndex
+// Condition cache
+static NSString * const kFunctionNameClearConditionCache = @"clearConditionCache";
+static NSString * const kFunctionNameCheckCondition = @"checkCondition";
+static NSString * const kVariableNameEvaluatedConditions = @"evaluatedConditions";
+static NSString * const kVariableNameConditionResults = @"conditionResults";
+static NSString * const kConstantNameCachedConditionCount = @"kCachedConditionCount";
+// Change-only logging
+static NSString * const kVariableNameFormatLoggedState = @"loggedState%i";
+static NSString * const kVariableNameFormatLoggedConditions = @"loggedConditions%i";
+// Profiling
+static NSString * const kVariableNameFormatProfiledState = @"profiledState%i";
+static NSString * const kVariableNameProfiles = @"profiles";
+static NSString * const kTableNameProfileIDs = @"profileIDs";
+static NSString * const kConstantNameProfileCount = @"kProfileCount";
 static NSString * const kSectionNameLibraries = @"Libraries";
 static NSString * const kSectionNameVariables = @"Variables";
 static NSString * const kSectionNameSetupAndLoop = @"Setup & Loop";
@@ -45,15 +73,40 @@ static NSString * const kRangeUtilityKey = @"Utility";
 // Key formats & keys for extra range
 static NSString * const kRangeConditionKeyFormat = @"Condition$%@";
 static NSString * const kRangeActionKeyFormat = @"Action$%@";
+// Fragment keys & formats. Conditions and actions use their extra range key, the text of each fragment only depends on its key,
+// the editable code in it and (for state machines) the states.
+static NSString * const kFragmentPrologueKey = @"Prologue";
+static NSString * const kFragmentActionsHeaderKey = @"ActionsHeader";
+static NSString * const kFragmentStateMachinesKeyFormat = @"StateMachines$%lu";
+static NSString * const kFragmentStateMachineKeyFormat = @"StateMachine$%i";
+static NSString * const kFragmentStateMachineTablesKey = @"StateMachineTables"; // Depends on the conditions & actions, never reused
+static NSString * const kFragmentConditionCacheKey = @"ConditionCache"; // Depends on the cached conditions, never reused
+static NSString * const kFragmentProfilesKey = @"Profiles"; // Depends on all states, conditions & actions, never reused
+
+static NSArray *reservedSymbolNames = nil; // From setReservedSymbolNamesPath:, nil for the built-in ones
 
 #pragma mark - Private Interface
 
 @interface MAStateMachineCodeTemplate ()
 
+@property (nonatomic, strong) MAGraphAnalysis *graphAnalysis;
 @property (nonatomic, copy) NSArray *stateGroups;
 @property (nonatomic, copy) NSArray *conditions;
 @property (nonatomic, copy) NSArray *actions;
 @property (nonatomic, readonly) BOOL insertLoggingCode;
+@property (nonatomic, readonly) BOOL writesTables;
+@property (nonatomic, readonly) BOOL memoizesConditions;
+@property (nonatomic, readonly) BOOL logsChangesOnly;
+@property (nonatomic, readonly) BOOL insertsProfilingCode;
+@property (nonatomic, readonly) BOOL logsEvents; // Logging code without profiling
+@property (nonatomic, copy) NSArray *cachedConditions; // The non-volatile conditions when memoizing, in cache order
+@property (nonatomic, strong) NSMapTable *conditionCacheIndexes;
+@property (nonatomic, copy) NSArray *profiledObjects; // When profiling: the table conditions, the actions, then the states by state machine
+@property (nonatomic, strong) NSMapTable *profileIndexes;
+// Symbol names & ids the code was written with, to find what changed in later incremental generations
+@property (nonatomic, strong) NSMapTable *writtenSymbolNames;
+@property (nonatomic, strong) NSMapTable *writtenSymbolIDs;
+@property (nonatomic) NSUInteger writtenSymbolIDWidth;
 
 @end
 
@@ -64,6 +117,31 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 	return ((self.options & MAInsertLoggingCode) == MAInsertLoggingCode);
 }
 
+- (BOOL)writesTables
+{
+	return ((self.options & MATableDrivenStateMachines) == MATableDrivenStateMachines);
+}
+
+- (BOOL)memoizesConditions
+{
+	return ((self.options & MAMemoizeConditions) == MAMemoizeConditions);
+}
+
+- (BOOL)logsChangesOnly
+{
+	return (self.logsEvents && (self.options & MAChangeOnlyLogging) == MAChangeOnlyLogging);
+}
+
+- (BOOL)insertsProfilingCode
+{
+	return (self.insertLoggingCode && (self.options & MAProfiling) == MAProfiling);
+}
+
+- (BOOL)logsEvents
+{
+	return (self.insertLoggingCode && !self.insertsProfilingCode);
+}
+
 #pragma mark - Initialization
 
 - (id)initWithCoder:(NSCoder *)coder
@@ -80,6 +158,19 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
     return self;
 }
 
+- (id)copyWithZone:(NSZone *)zone
+{
+	// Like a decoded template, a copy isn't reused by incremental generation (it doesn't have what the code was written from)
+	MAStateMachineCodeTemplate *copy = [super copyWithZone:zone];
+	copy->_states = self.states;
+	copy->_transitions = self.transitions;
+	copy->_conditions = self.conditions;
+	copy->_actions = self.actions;
+	copy->_symbols = self.symbols;
+	copy->_options = self.options;
+	return copy;
+}
+
 - (void)encodeWithCoder:(NSCoder *)coder
 {
 	[super encodeWithCoder:coder];
@@ -93,12 +184,85 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 
 #pragma mark - General
 
++ (void)setReservedSymbolNamesPath:(NSString *)path
+{
+	// Read once here, rather than by every template
+	NSArray *names = nil;
+	if (path) {
+		NSString *namesString = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:nil];
+		names = MAReservedNamesFromString(namesString) ?: @[];
+	}
+	@synchronized(self) {
+		reservedSymbolNames = names;
+	}
+}
+
 - (void)generate
+{
+	[self generateWithPhaseHandler:nil];
+}
+
+- (void)generateWithPhaseHandler:(void(^)(MAGenerationPhase phase))phaseHandler
 {
 	[self getStateGroups];
+	if (phaseHandler) phaseHandler(MAGenerationPhaseStateGroups);
 	[self getActionsAndConditions];
+	if (phaseHandler) phaseHandler(MAGenerationPhaseActionsAndConditions);
 	[self assignNamesToSymbols];
+	if (phaseHandler) phaseHandler(MAGenerationPhaseSymbolNames);
 	[self writeCode];
+	if (phaseHandler) phaseHandler(MAGenerationPhaseWriteCode);
+}
+
+- (void)generateFromTemplate:(MAStateMachineCodeTemplate *)oldTemplate changes:(NSArray *)changes
+{
+	[self generateFromTemplate:oldTemplate changes:changes mergingCodeFromTemplate:oldTemplate];
+}
+
+- (void)generateFromTemplate:(MAStateMachineCodeTemplate *)oldTemplate changes:(NSArray *)changes mergingCodeFromTemplate:(MACodeTemplate *)codeTemplate
+{
+	if (!changes || ![self canGenerateIncrementallyFromTemplate:oldTemplate]) {
+		[self generateMergingCodeFromTemplate:codeTemplate reusingFragmentsFromTemplate:nil changes:nil];
+		return;
+	}
+	// Merge the editable code up front, so fragments are written with it and are copied if it's unchanged
+	[self generateMergingCodeFromTemplate:codeTemplate reusingFragmentsFromTemplate:oldTemplate changes:changes];
+}
+
+- (void)generateMergingCodeFromTemplate:(MACodeTemplate *)oldTemplate
+{
+	[self generateMergingCodeFromTemplate:oldTemplate reusingFragmentsFromTemplate:nil changes:nil];
+}
+
+- (void)generateMergingCodeFromTemplate:(MACodeTemplate *)codeTemplate reusingFragmentsFromTemplate:(MAStateMachineCodeTemplate *)oldTemplate changes:(NSArray *)changes
+{
+	[self getStateGroups];
+	if ([self checkForCancellation]) return;
+	[self getActionsAndConditions];
+	if ([self checkForCancellation]) return;
+	[self assignNamesToSymbols];
+	if ([self checkForCancellation]) return;
+	self.codeForEditableRangesToWrite = [self mergedCodeFromTemplate:codeTemplate forKeysInOrder:[self keysForEditableRangesToWrite]];
+	if (changes) {
+		NSHashTable *affectedStates = [self statesAffectedByChanges:changes sinceTemplate:oldTemplate];
+		[self writeCodeReusingTemplate:oldTemplate affectedStates:affectedStates];
+	} else {
+		[self writeCode];
+	}
+	self.codeForEditableRangesToWrite = nil;
+}
+
+- (BOOL)checkForCancellation
+{
+	if (!self.isCancelled && self.cancellationHandler && self.cancellationHandler()) _isCancelled = YES;
+	return self.isCancelled;
+}
+
+- (BOOL)canGenerateIncrementallyFromTemplate:(MAStateMachineCodeTemplate *)oldTemplate
+{
+	if (!oldTemplate.writtenSymbolIDs || [[oldTemplate fragmentKeysInOrder] count] == 0) return NO; // Decoded or never generated
+	if (!self.symbols || self.symbols != oldTemplate.symbols) return NO;
+	return (self.options == oldTemplate.options && [self.indentString isEqualToString:oldTemplate.indentString]);
 }
 
 - (id)objectForSymbolWithID:(UInt64)symbolID
@@ -122,14 +286,14 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 
 - (BOOL)canSubstituteOldRangeWithKey:(id)key forNewRangeWithKey:(id)otherKey
 {
-	if ([key isEqualTo:otherKey]) return YES;
+	if ([key isEqual:otherKey]) return YES;
 	if ([self isRangeInsideFunctionGivenKey:key] == [self isRangeInsideFunctionGivenKey:otherKey]) return YES;
 	return NO;
 }
 
 - (BOOL)canMergeRangeWithKey:(id)key withOtherRangeWithKey:(id)otherKey
 {
-	if ([key isEqualTo:otherKey]) return YES;
+	if ([key isEqual:otherKey]) return YES;
 	if (![self isRangeInsideFunctionGivenKey:key] && ![self isRangeInsideFunctionGivenKey:otherKey]) return YES;
 	return NO;
 }
@@ -144,91 +308,173 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 
 - (void)writeCode
 {
-	// Includes
-	if (self.insertLoggingCode) [self writeLine:@"#include \"Messaging.h\"\n"];
-	[self writeSectionHeader:kSectionNameLibraries];
-	[self writeEditableLine:@"" withKey:kRangeLibrariesKey];
-	// Variables
-	[self writeSectionHeader:kSectionNameVariables];
-	[self writeEditableLine:@"" withKey:kSectionNameVariables];
-	// Setup & Loop
-	[self writeSectionHeader:kSectionNameSetupAndLoop];
-	[self writeLine:@""];
-	[self writeFunctionWithReturnType:@"void" name:kFunctionNameSetup contents:^{
-		[self writeEditableLine:@"// Add setup code here" withKey:[NSString stringWithFormat:kRangeInsideFunctionKeyFormat, kFunctionNameSetup]];
-		if (self.insertLoggingCode) [self writeLine:@"setupMessaging();"];
-	}];
-	[self writeLine:@""];
-	[self writeFunctionWithReturnType:@"void" name:kFunctionNameLoop contents:^{
-		[self writeLine:@"%@();", kFunctionNameUpdateStateMachines];
+	[self writeCodeReusingTemplate:nil affectedStates:nil];
+}
+
+- (void)writeCodeReusingTemplate:(MAStateMachineCodeTemplate *)oldTemplate affectedStates:(NSHashTable *)affectedStates
+{
+	BOOL isSymbolIDWidthUnchanged = (oldTemplate.writtenSymbolIDWidth == [self.symbols symbolIDWidth]);
+	[self writeFragmentWithKey:kFragmentPrologueKey reusingTemplate:(isSymbolIDWidthUnchanged ? oldTemplate : nil) contents:^{
+		// Includes
+		if (self.insertsProfilingCode) [self writeLine:@"#define MESSAGING_PROFILING"];
+		if (self.insertLoggingCode && [self.symbols symbolIDWidth] == 8) [self writeLine:@"#define MESSAGING_SYMBOL_ID_TYPE uint8_t"];
+		if (self.insertLoggingCode) [self writeLine:@"#include \"Messaging.h\"\n"];
+		[self writeSectionHeader:kSectionNameLibraries];
+		[self writeEditableLine:@"" withKey:kRangeLibrariesKey];
+		// Variables
+		[self writeSectionHeader:kSectionNameVariables];
+		[self writeEditableLine:@"" withKey:kSectionNameVariables];
+		// Setup & Loop
+		[self writeSectionHeader:kSectionNameSetupAndLoop];
+		[self writeLine:@""];
+		[self writeFunctionWithReturnType:@"void" name:kFunctionNameSetup contents:^{
+			[self writeEditableLine:@"// Add setup code here" withKey:[NSString stringWithFormat:kRangeInsideFunctionKeyFormat, kFunctionNameSetup]];
+			if (self.insertLoggingCode) [self writeLine:@"setupMessaging();"];
+		}];
+		[self writeLine:@""];
+		[self writeFunctionWithReturnType:@"void" name:kFunctionNameLoop contents:^{
+			if (self.insertsProfilingCode) [self writeLine:@"beginProfiledIteration();"];
+			[self writeLine:@"%@();", kFunctionNameUpdateStateMachines];
+			if (self.insertsProfilingCode) [self writeLine:@"endProfiledIteration();"];
+		}];
+		[self writeLine:@""];
+		// Conditions
+		[self writeSectionHeader:kSectionNameConditions];
+		[self writeLine:@""];
 	}];
-	[self writeLine:@""];
-	// Conditions
-	[self writeSectionHeader:kSectionNameConditions];
-	[self writeLine:@""];
-	[self writeConditions];
+	[self writeConditionsReusingTemplate:oldTemplate];
 	// Action
-	[self writeSectionHeader:kSectionNameActions];
-	[self writeLine:@""];
-	[self writeActions];
+	[self writeFragmentWithKey:kFragmentActionsHeaderKey reusingTemplate:oldTemplate contents:^{
+		[self writeSectionHeader:kSectionNameActions];
+		[self writeLine:@""];
+	}];
+	[self writeActionsReusingTemplate:oldTemplate];
 	// Utility
-	[self writeSectionHeader:kSectionNameUtility];
-	[self writeEditableLine:@"" withKey:kSectionNameUtility];
-	// State machine
-	[self writeSectionHeader:kSectionNameStateMachine];
-	[self writeLine:@""];
-	[self writeFunctionUpdateStateMachines];
+	NSString *stateMachinesKey = [NSString stringWithFormat:kFragmentStateMachinesKeyFormat, (unsigned long)[self.stateGroups count]];
+	[self writeFragmentWithKey:stateMachinesKey reusingTemplate:oldTemplate contents:^{
+		[self writeSectionHeader:kSectionNameUtility];
+		[self writeEditableLine:@"" withKey:kSectionNameUtility];
+		// State machine
+		[self writeSectionHeader:kSectionNameStateMachine];
+		[self writeLine:@""];
+		[self writeFunctionUpdateStateMachines];
+	}];
+	if (self.memoizesConditions) {
+		[self writeFragmentWithKey:kFragmentConditionCacheKey reusingTemplate:nil contents:^{
+			[self writeLine:@""];
+			[self writeConditionCache];
+		}];
+	}
+	if (self.insertsProfilingCode) {
+		[self writeFragmentWithKey:kFragmentProfilesKey reusingTemplate:nil contents:^{
+			[self writeLine:@""];
+			[self writeProfiles];
+		}];
+	}
+	if (self.writesTables) {
+		[self writeFragmentWithKey:kFragmentStateMachineTablesKey reusingTemplate:nil contents:^{
+			[self writeLine:@""];
+			[self writeStateMachineTablesPrologue];
+		}];
+	}
+	// State machines, the ones that can't be copied written side by side first
+	NSMutableIndexSet *reusableIndexes = [NSMutableIndexSet indexSet];
 	[self.stateGroups enumerateObjectsUsingBlock:^(NSArray *stateGroup, NSUInteger index, BOOL *stop) {
+		NSString *key = [NSString stringWithFormat:kFragmentStateMachineKeyFormat, (int)index+1];
+		BOOL isReusable = !self.writesTables && [self canReuseStateGroupAtIndex:index fromTemplate:oldTemplate affectedStates:affectedStates]; // Tables index the conditions & actions
+		if (self.memoizesConditions && ![self.cachedConditions isEqualToArray:oldTemplate.cachedConditions]) isReusable = NO; // Cache indexes moved
+		if (self.insertsProfilingCode) isReusable = NO; // Profile indexes count all states, conditions & actions
+		if (isReusable && [self canReuseFragmentWithKey:key fromTemplate:oldTemplate]) [reusableIndexes addIndex:index];
+	}];
+	NSArray *writers = [self writersForStateGroupsExceptIndexes:reusableIndexes];
+	[self.stateGroups enumerateObjectsUsingBlock:^(NSArray *stateGroup, NSUInteger index, BOOL *stop) {
+		if ([self checkForCancellation]) {
+			*stop = YES;
+			return;
+		}
 		int number = (int)index+1;
-		[self writeLine:@""];
-		[self writeStateVariablesForStates:stateGroup withNumber:number];
-		[self writeLine:@""];
-		[self writeStateMachineForStates:stateGroup withNumber:number];
+		NSString *key = [NSString stringWithFormat:kFragmentStateMachineKeyFormat, number];
+		id writer = writers[index]; // Nil or NSNull if it wasn't written side by side
+		if (writer != [NSNull null] && [self appendFragmentWithKey:key fromTemplate:writer]) return;
+		BOOL isReusable = [reusableIndexes containsIndex:index];
+		[self writeFragmentWithKey:key reusingTemplate:(isReusable ? oldTemplate : nil) contents:^{
+			[self writeStateGroup:stateGroup withNumber:number];
+		}];
 	}];
 }
 
-- (void)writeConditions
+- (void)writeStateGroup:(NSArray *)states withNumber:(int)number
+{
+	[self writeLine:@""];
+	[self writeStateVariablesForStates:states withNumber:number];
+	[self writeLine:@""];
+	if (self.writesTables) [self writeStateMachineTableForStates:states withNumber:number];
+	else [self writeStateMachineForStates:states withNumber:number];
+}
+
+- (NSArray *)keysForEditableRangesToWrite // In the order writeCode writes them
+{
+	NSMutableArray *keys = [NSMutableArray arrayWithObjects:kRangeLibrariesKey, kSectionNameVariables, nil];
+	[keys addObject:[NSString stringWithFormat:kRangeInsideFunctionKeyFormat, kFunctionNameSetup]];
+	for (MACondition *condition in self.conditions) {
+		[keys addObject:[NSString stringWithFormat:kRangeInsideFunctionKeyFormat, [self.symbols symbolNameForObject:condition]]];
+	}
+	for (MAAction *action in self.actions) {
+		[keys addObject:[NSString stringWithFormat:kRangeInsideFunctionKeyFormat, [self.symbols symbolNameForObject:action]]];
+	}
+	[keys addObject:kSectionNameUtility];
+	return keys;
+}
+
+- (void)writeConditionsReusingTemplate:(MAStateMachineCodeTemplate *)oldTemplate
 {
 	// For all conditions
 	for (MACondition *condition in self.conditions) {
 		NSString *conditionSymbolName = [self.symbols symbolNameForObject:condition];
-		// Write
-		NSRange range = [self writeFunctionWithReturnType:@"boolean" name:conditionSymbolName contents:^{
-			[self writeEditableLine:@"return false; // TODO: Return whether condition is true" withKey:[NSString stringWithFormat:kRangeInsideFunctionKeyFormat, conditionSymbolName]];
-		}];
-		[self writeLine:@""];
-		// Mark range
-		range = [[self code] lineRangeForRange:range];
 		NSString *key = [NSString stringWithFormat:kRangeConditionKeyFormat, conditionSymbolName];
-		[self addExtraRange:range forKey:key];
+		[self writeFragmentWithKey:key reusingTemplate:oldTemplate contents:^{
+			// Write
+			NSRange range = [self writeFunctionWithReturnType:@"boolean" name:conditionSymbolName contents:^{
+				[self writeEditableLine:@"return false; // TODO: Return whether condition is true" withKey:[NSString stringWithFormat:kRangeInsideFunctionKeyFormat, conditionSymbolName]];
+			}];
+			[self writeLine:@""];
+			// Mark range
+			range = [self lineRangeForRange:range];
+			[self addExtraRange:range forKey:key];
+		}];
 	}
 }
 
-- (void)writeActions
+- (void)writeActionsReusingTemplate:(MAStateMachineCodeTemplate *)oldTemplate
 {
 	// For all actions
 	for (MAAction *action in self.actions) {
 		NSString *actionSymbolName = [self.symbols symbolNameForObject:action];
-		// Write
-		NSRange range = [self writeFunctionWithReturnType:@"void" name:actionSymbolName contents:^{
-			[self writeEditableLine:@"// TODO: Write code to perform this action" withKey:[NSString stringWithFormat:kRangeInsideFunctionKeyFormat, actionSymbolName]];
-		}];
-		[self writeLine:@""];
-		// Mark range
-		range = [[self code] lineRangeForRange:range];
 		NSString *key = [NSString stringWithFormat:kRangeActionKeyFormat, actionSymbolName];
-		[self addExtraRange:range forKey:key];
+		[self writeFragmentWithKey:key reusingTemplate:oldTemplate contents:^{
+			// Write
+			NSRange range = [self writeFunctionWithReturnType:@"void" name:actionSymbolName contents:^{
+				[self writeEditableLine:@"// TODO: Write code to perform this action" withKey:[NSString stringWithFormat:kRangeInsideFunctionKeyFormat, actionSymbolName]];
+			}];
+			[self writeLine:@""];
+			// Mark range
+			range = [self lineRangeForRange:range];
+			[self addExtraRange:range forKey:key];
+		}];
 	}
 }
 
 - (void)writeFunctionUpdateStateMachines
 {
 	[self writeFunctionWithReturnType:@"void" name:kFunctionNameUpdateStateMachines contents:^{
+		if (self.memoizesConditions) [self writeLine:@"%@();", kFunctionNameClearConditionCache];
+		if (self.logsChangesOnly) [self writeLine:@"beginMessagingUpdate();"];
 		NSUInteger stateGroupCount = [self.stateGroups count];
 		for (int i=0; i<stateGroupCount; i++) {
 			NSString *functionName = [NSString stringWithFormat:kFunctionNameFormatUpdateStateMachine, i+1];
 			[self writeLine:@"%@();", functionName];
 		}
+		if (self.logsChangesOnly) [self writeLine:@"endMessagingUpdate();"];
 	}];
 }
 
@@ -243,26 +489,44 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 		i++;
 	}
 	[self writeLine:@"int currentState%i = %@;", number, startingStateName];
+	if (self.logsChangesOnly) {
+		// The state last logged, and per transition (in checking order) the result its condition was last logged with
+		NSUInteger transitionCount = 0;
+		for (MANode *state in states) {
+			transitionCount += [[self transitionsInCheckingOrderForState:state] count];
+		}
+		[self writeLine:@"int %@ = -1;", [NSString stringWithFormat:kVariableNameFormatLoggedState, number]];
+		[self writeLine:@"byte %@[%lu];", [NSString stringWithFormat:kVariableNameFormatLoggedConditions, number], (unsigned long)MAX((transitionCount+7)/8, 1)];
+	}
+	if (self.insertsProfilingCode) [self writeLine:@"ProfiledState %@ = { -1, 0 };", [NSString stringWithFormat:kVariableNameFormatProfiledState, number]];
 }
 
 - (void)writeStateMachineForStates:(NSArray *)states withNumber:(int)number
 {
 	NSString *functionName = [NSString stringWithFormat:kFunctionNameFormatUpdateStateMachine, number];
 	[self writeFunctionWithReturnType:@"void" name:functionName contents:^{
+		if (self.insertsProfilingCode) [self writeProfilingStateForStates:states withNumber:number];
 		[self writeLine:@"switch (currentState%i) {", number];
 		[self doIndented:^{
 			// For all states
 			int i=0;
+			NSUInteger firstTransitionIndex = 0;
 			for (MANode *state in states) {
 				NSString *stateName = [self.symbols symbolNameForObject:state];
 				UInt64 stateID = [self.symbols symbolIDForObject:state];
 				if (i != 0) [self writeLine:@""];
 				[self writeLine:@"case %@:", stateName];
 				[self doIndented:^{
-					if (self.insertLoggingCode) [self writeLine:@"sendMessageCurrentState(%lli);", stateID];
-					[self writeTransitionsForState:state withNumber:number];
+					if (self.logsChangesOnly) {
+						NSString *loggedStateName = [NSString stringWithFormat:kVariableNameFormatLoggedState, number];
+						[self writeLine:@"sendMessageIfStateEntered(&%@, %@, %lli);", loggedStateName, stateName, stateID];
+					} else if (self.logsEvents) {
+						[self writeLine:@"sendMessageCurrentState(%lli);", stateID];
+					}
+					[self writeTransitionsForState:state withNumber:number firstTransitionIndex:firstTransitionIndex];
 					[self writeLine:@"break;"];
 				}];
+				firstTransitionIndex += [[self transitionsInCheckingOrderForState:state] count];
 				i++;
 			}
 		}];
@@ -270,7 +534,7 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 	}];
 }
 
-- (void)writeTransitionsForState:(MANode *)state withNumber:(int)number
+- (void)writeTransitionsForState:(MANode *)state withNumber:(int)number firstTransitionIndex:(NSUInteger)transitionIndex
 {
 	// Conditions
 	NSMutableArray *nothingTransitions = [NSMutableArray array];
@@ -280,11 +544,12 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 			NSString *conditionName = [self.symbols symbolNameForObject:transition.condition];
 			UInt64 conditionID = [self.symbols symbolIDForObject:transition.condition];
 			UInt64 transitionID = [self.symbols symbolIDForObject:transition];
-			NSString *conditionCode;
-			if (self.insertLoggingCode) {
-				conditionCode = [NSString stringWithFormat:@"sendMessageWillCheckCondition(%lli, %lli) && %@()", transitionID, conditionID, conditionName];
-			} else {
-				conditionCode = [NSString stringWithFormat:@"%@()", conditionName];
+			NSString *conditionCode = [self codeCheckingCondition:transition.condition];
+			if (self.logsChangesOnly) {
+				NSString *loggedConditionsName = [NSString stringWithFormat:kVariableNameFormatLoggedConditions, number];
+				conditionCode = [NSString stringWithFormat:@"sendMessageIfConditionChanged(%@, %lu, %lli, %lli, %@)", loggedConditionsName, (unsigned long)transitionIndex++, transitionID, conditionID, conditionCode];
+			} else if (self.logsEvents) {
+				conditionCode = [NSString stringWithFormat:@"sendMessageWillCheckCondition(%lli, %lli) && %@", transitionID, conditionID, conditionCode];
 			}
 			[self writeLine:@"if (%@) {", conditionCode];
 			[self doIndented:^{ [self writeTransition:transition withStateGroupNumber:number isLast:NO]; }];
@@ -302,16 +567,26 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 	}
 }
 
+- (NSString *)codeCheckingCondition:(MACondition *)condition
+{
+	NSString *conditionName = [self.symbols symbolNameForObject:condition];
+	NSNumber *cacheIndex = [self.conditionCacheIndexes objectForKey:condition];
+	if (!cacheIndex && self.insertsProfilingCode) return [NSString stringWithFormat:@"profileCondition(%@, %@)", [self.profileIndexes objectForKey:condition], conditionName];
+	if (!cacheIndex) return [NSString stringWithFormat:@"%@()", conditionName];
+	return [NSString stringWithFormat:@"%@(%@, %@)", kFunctionNameCheckCondition, cacheIndex, conditionName];
+}
+
 - (void)writeTransition:(MAArrow *)transition withStateGroupNumber:(int)number isLast:(BOOL)isLast
 {
 	UInt64 transitionID = [self.symbols symbolIDForObject:transition];
-	if (self.insertLoggingCode) [self writeLine:@"sendMessageWillPerformTransition(%lli);", transitionID];
+	if (self.logsEvents) [self writeLine:@"sendMessageWillPerformTransition(%lli);", transitionID];
 	// Write actions, if there are any
 	for (MAAction *action in transition.actions) {
 		NSString *actionName = [self.symbols symbolNameForObject:action];
 		NSUInteger actionIndex = [transition.actions indexOfObject:action];
-		if (self.insertLoggingCode) [self writeLine:@"sendMessageWillPerformAction(%lli, %i);", transitionID, (int)actionIndex];
-		[self writeLine:@"%@();", actionName];
+		if (self.logsEvents) [self writeLine:@"sendMessageWillPerformAction(%lli, %i);", transitionID, (int)actionIndex];
+		if (self.insertsProfilingCode) [self writeLine:@"profileAction(%@, %@);", [self.profileIndexes objectForKey:action], actionName];
+		else [self writeLine:@"%@();", actionName];
 	}
 	// Write transition to another state, if applicable
 	if (transition.targetNode != transition.sourceNode) {
@@ -321,15 +596,288 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 	}
 }
 
+#pragma mark Writing State Machines Side by Side
+
+- (NSArray *)writersForStateGroupsExceptIndexes:(NSIndexSet *)skippedIndexes
+{
+	// A state machine's code only depends on its states, the symbols & the options, so each one can be written by a template
+	// of its own (with its own code & ranges), then appended in order, which moves its ranges into place. Per state group:
+	// the writer holding its fragment, or NSNull. Nil if they're written in turn.
+	NSUInteger groupCount = [self.stateGroups count];
+	NSUInteger writerCount = self.writerCount ?: [[NSProcessInfo processInfo] activeProcessorCount];
+	if (writerCount < 2 || groupCount - [skippedIndexes count] < 2) return nil;
+	NSMutableArray *writers = [NSMutableArray arrayWithCapacity:groupCount];
+	NSMutableArray *order = [NSMutableArray array];
+	for (NSUInteger i=0; i<groupCount; i++) {
+		BOOL isSkipped = [skippedIndexes containsIndex:i];
+		[writers addObject:(isSkipped ? [NSNull null] : [self stateGroupWriter])];
+		if (!isSkipped) [order addObject:@(i)];
+	}
+	// Largest first, so the last ones taken are small and the threads finish at about the same time
+	[order sortUsingComparator:^NSComparisonResult(NSNumber *index1, NSNumber *index2) {
+		NSUInteger count1 = [self.stateGroups[[index1 unsignedIntegerValue]] count];
+		NSUInteger count2 = [self.stateGroups[[index2 unsignedIntegerValue]] count];
+		if (count1 != count2) return (count1 > count2) ? NSOrderedAscending : NSOrderedDescending;
+		return [index1 compare:index2];
+	}];
+	// Each thread takes the next state machine until none are left (the template is only read meanwhile)
+	NSUInteger orderCount = [order count];
+	__block long nextPosition = 0;
+	dispatch_apply(MIN(writerCount, orderCount), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+		for (long position = __sync_fetch_and_add(&nextPosition, 1); position < (long)orderCount; position = __sync_fetch_and_add(&nextPosition, 1)) {
+			if (self.cancellationHandler && self.cancellationHandler()) return; // Noted by the next checkForCancellation
+			@autoreleasepool {
+				NSUInteger index = [order[position] unsignedIntegerValue];
+				MAStateMachineCodeTemplate *writer = writers[index];
+				int number = (int)index+1;
+				[writer fragment:^{
+					[writer writeStateGroup:self.stateGroups[index] withNumber:number];
+				} withKey:[NSString stringWithFormat:kFragmentStateMachineKeyFormat, number]];
+			}
+		}
+	});
+	return writers;
+}
+
+- (MAStateMachineCodeTemplate *)stateGroupWriter
+{
+	// Shares what writing a state machine reads
+	MAStateMachineCodeTemplate *writer = [[[self class] alloc] init];
+	writer.indentString = self.indentString;
+	writer.options = self.options;
+	writer.symbols = self.symbols;
+	writer.stateGroups = self.stateGroups;
+	writer.conditions = self.conditions;
+	writer.actions = self.actions;
+	writer.cachedConditions = self.cachedConditions;
+	writer.conditionCacheIndexes = self.conditionCacheIndexes;
+	writer.profiledObjects = self.profiledObjects;
+	writer.profileIndexes = self.profileIndexes;
+	[writer write:@""]; // Each state machine is written after a line, so its first line starts a new one
+	return writer;
+}
+
+#pragma mark Writing Tables
+
+- (void)writeStateMachineTablesPrologue
+{
+	if (self.logsEvents) [self writeLine:@"#define STATE_MACHINE_TABLE_LOGGING"];
+	if (self.logsChangesOnly) [self writeLine:@"#define STATE_MACHINE_TABLE_CHANGE_ONLY_LOGGING"];
+	if (self.insertsProfilingCode) {
+		[self writeLine:@"#define STATE_MACHINE_TABLE_PROFILING"];
+		[self writeLine:@"#define STATE_MACHINE_FIRST_ACTION_PROFILE %lu", (unsigned long)[[self tableConditions] count]];
+	}
+	if ([self largestTableIndex] > kTableMaximumByteIndex) [self writeLine:@"#define STATE_MACHINE_INDEX_TYPE uint16_t"];
+	if (self.memoizesConditions) [self writeLine:@"#define STATE_MACHINE_CACHED_CONDITION_COUNT %@", kConstantNameCachedConditionCount];
+	[self writeLine:@"#include \"%@\"", kTableHeaderName];
+	[self writeLine:@""];
+	// Function tables, shared by all state machines
+	NSMutableArray *conditionNames = [NSMutableArray arrayWithCapacity:[self.conditions count]];
+	for (MACondition *condition in [self tableConditions]) {
+		[conditionNames addObject:[self.symbols symbolNameForObject:condition]];
+	}
+	NSMutableArray *actionNames = [NSMutableArray arrayWithCapacity:[self.actions count]];
+	for (MAAction *action in self.actions) {
+		[actionNames addObject:[self.symbols symbolNameForObject:action]];
+	}
+	[self writeTableWithType:@"StateMachineCondition" name:kTableNameConditions values:conditionNames];
+	[self writeTableWithType:@"StateMachineAction" name:kTableNameActions values:actionNames];
+}
+
+- (void)writeStateMachineTableForStates:(NSArray *)states withNumber:(int)number
+{
+	NSDictionary *conditionIndexes = [self tableIndexesForSymbolsOfObjects:[self tableConditions]];
+	NSDictionary *actionIndexes = [self tableIndexesForSymbolsOfObjects:self.actions];
+	// Collect the transitions of each state in the order the switch form checks them
+	NSMutableArray *offsets = [NSMutableArray arrayWithObject:@"0"];
+	NSMutableArray *records = [NSMutableArray array];
+	NSMutableArray *actions = [NSMutableArray array];
+	NSMutableArray *stateIDs = [NSMutableArray arrayWithCapacity:[states count]];
+	NSMutableArray *transitionIDs = [NSMutableArray array];
+	NSMutableArray *conditionIDs = [NSMutableArray array];
+	for (MANode *state in states) {
+		[stateIDs addObject:[self messageIDForObject:state]];
+		for (MAArrow *transition in [self transitionsInCheckingOrderForState:state]) {
+			NSString *conditionName = transition.condition ? [self.symbols symbolNameForObject:transition.condition] : nil;
+			NSUInteger conditionIndex = conditionName ? [conditionIndexes[conditionName] unsignedIntegerValue]+1 : 0;
+			NSString *targetStateName = [self.symbols symbolNameForObject:transition.targetNode];
+			NSString *record = [NSString stringWithFormat:@"{ %lu, %lu, %lu, %@ },", (unsigned long)conditionIndex,
+				(unsigned long)[actions count], (unsigned long)[transition.actions count], targetStateName];
+			if (conditionName) record = [record stringByAppendingFormat:@" // %@", conditionName];
+			[records addObject:record];
+			for (MAAction *action in transition.actions) {
+				[actions addObject:[actionIndexes[[self.symbols symbolNameForObject:action]] stringValue]];
+			}
+			[transitionIDs addObject:[self messageIDForObject:transition]];
+			[conditionIDs addObject:(transition.condition ? [self messageIDForObject:transition.condition] : @"0")];
+		}
+		[offsets addObject:[NSString stringWithFormat:@"%lu", (unsigned long)[records count]]];
+	}
+	// Tables
+	[self writeLine:@""];
+	[self writeTableWithType:@"StateMachineIndex" name:[NSString stringWithFormat:kTableNameFormatOffsets, number] values:offsets];
+	[self writeLine:@"const StateMachineTransition %@[] PROGMEM = {", [NSString stringWithFormat:kTableNameFormatTransitions, number]];
+	[self doIndented:^{
+		for (NSString *record in records) {
+			[self writeLine:@"%@", record];
+		}
+		if ([records count] == 0) [self writeLine:@"{ 0, 0, 0, 0 },"]; // No empty arrays in C++
+	}];
+	[self writeLine:@"};"];
+	[self writeTableWithType:@"StateMachineIndex" name:[NSString stringWithFormat:kTableNameFormatActions, number] values:actions];
+	NSMutableArray *arguments = [NSMutableArray arrayWithObjects:[NSString stringWithFormat:@"currentState%i", number],
+		[NSString stringWithFormat:kTableNameFormatOffsets, number], [NSString stringWithFormat:kTableNameFormatTransitions, number],
+		[NSString stringWithFormat:kTableNameFormatActions, number], nil];
+	if (self.logsEvents) {
+		NSArray *names = @[ [NSString stringWithFormat:kTableNameFormatStateIDs, number], [NSString stringWithFormat:kTableNameFormatTransitionIDs, number],
+			[NSString stringWithFormat:kTableNameFormatConditionIDs, number] ];
+		[self writeTableWithType:@"SymbolID" name:names[0] values:stateIDs];
+		[self writeTableWithType:@"SymbolID" name:names[1] values:transitionIDs];
+		[self writeTableWithType:@"SymbolID" name:names[2] values:conditionIDs];
+		[arguments addObjectsFromArray:names];
+	}
+	if (self.logsChangesOnly) {
+		[arguments addObject:[@"&" stringByAppendingFormat:kVariableNameFormatLoggedState, number]];
+		[arguments addObject:[NSString stringWithFormat:kVariableNameFormatLoggedConditions, number]];
+	}
+	// Function
+	[self writeLine:@""];
+	NSString *functionName = [NSString stringWithFormat:kFunctionNameFormatUpdateStateMachine, number];
+	[self writeFunctionWithReturnType:@"void" name:functionName contents:^{
+		if (self.insertsProfilingCode) [self writeProfilingStateForStates:states withNumber:number];
+		[self writeLine:@"currentState%i = %@(%@);", number, kFunctionNameRunStateMachineTable, [arguments componentsJoinedByString:@", "]];
+	}];
+}
+
+- (void)writeTableWithType:(NSString *)type name:(NSString *)name values:(NSArray *)values
+{
+	if ([values count] == 0) values = @[ @"0" ]; // No empty arrays in C++
+	[self writeLine:@"const %@ %@[] PROGMEM = {", type, name];
+	[self doIndented:^{
+		for (NSUInteger i = 0; i < [values count]; i += kTableValuesPerLine) {
+			NSArray *lineValues = [values subarrayWithRange:NSMakeRange(i, MIN(kTableValuesPerLine, [values count] - i))];
+			[self writeLine:@"%@,", [lineValues componentsJoinedByString:@", "]];
+		}
+	}];
+	[self writeLine:@"};"];
+}
+
+- (NSArray *)transitionsInCheckingOrderForState:(MANode *)state
+{
+	// Conditional ones first, like writeTransitionsForState:withNumber:firstTransitionIndex:
+	NSMutableArray *transitions = [NSMutableArray array];
+	NSMutableArray *nothingTransitions = [NSMutableArray array];
+	for (MAArrow *transition in state.arrows) {
+		if (transition.sourceNode != state) continue;
+		[(transition.condition ? transitions : nothingTransitions) addObject:transition];
+	}
+	[transitions addObjectsFromArray:nothingTransitions];
+	return transitions;
+}
+
+- (NSArray *)tableConditions
+{
+	// Cached ones first, so the interpreter can tell them apart by index
+	if (!self.memoizesConditions) return self.conditions;
+	NSMutableArray *conditions = [NSMutableArray arrayWithArray:self.cachedConditions];
+	for (MACondition *condition in self.conditions) {
+		if (condition.isVolatile) [conditions addObject:condition];
+	}
+	return conditions;
+}
+
+- (NSDictionary *)tableIndexesForSymbolsOfObjects:(NSArray *)objects
+{
+	NSMutableDictionary *indexes = [NSMutableDictionary dictionaryWithCapacity:[objects count]];
+	[objects enumerateObjectsUsingBlock:^(id object, NSUInteger index, BOOL *stop) {
+		indexes[[self.symbols symbolNameForObject:object]] = @(index);
+	}];
+	return indexes;
+}
+
+- (NSString *)messageIDForObject:(id)object
+{
+	// Messages carry 16 bits of the id, the same bits the switch form's int arguments end up sending
+	return [NSString stringWithFormat:@"%llu", (unsigned long long)([self.symbols symbolIDForObject:object] & 0xFFFF)];
+}
+
+- (NSUInteger)largestTableIndex
+{
+	NSUInteger largestIndex = MAX([self.conditions count], [self.actions count]); // Condition indexes start at 1
+	for (NSArray *states in self.stateGroups) {
+		NSUInteger transitionCount = 0;
+		NSUInteger actionCount = 0;
+		for (MANode *state in states) {
+			for (MAArrow *transition in state.arrows) {
+				if (transition.sourceNode != state) continue;
+				transitionCount++;
+				actionCount += [transition.actions count];
+			}
+		}
+		largestIndex = MAX(largestIndex, MAX([states count], MAX(transitionCount, actionCount)));
+	}
+	return largestIndex;
+}
+
+#pragma mark Writing Condition Cache
+
+- (void)writeConditionCache
+{
+	// Two bitsets: whether each condition was checked since the last clear, and what it returned
+	[self writeLine:@"const int %@ = %lu;", kConstantNameCachedConditionCount, (unsigned long)[self.cachedConditions count]];
+	[self writeLine:@"byte %@[(%@+7)/8];", kVariableNameEvaluatedConditions, kConstantNameCachedConditionCount];
+	[self writeLine:@"byte %@[(%@+7)/8];", kVariableNameConditionResults, kConstantNameCachedConditionCount];
+	[self writeLine:@""];
+	[self writeFunctionWithReturnType:@"void" name:kFunctionNameClearConditionCache contents:^{
+		[self writeLine:@"memset(%@, 0, sizeof(%@));", kVariableNameEvaluatedConditions, kVariableNameEvaluatedConditions];
+	}];
+	[self writeLine:@""];
+	[self writeLine:@"boolean %@(int index, boolean (*condition)()) {", kFunctionNameCheckCondition];
+	[self doIndented:^{
+		[self writeLine:@"byte mask = 1 << (index & 7);"];
+		[self writeLine:@"if (!(%@[index >> 3] & mask)) {", kVariableNameEvaluatedConditions];
+		[self doIndented:^{
+			[self writeLine:@"%@[index >> 3] |= mask;", kVariableNameEvaluatedConditions];
+			if (self.insertsProfilingCode) [self writeLine:@"if (profileCondition(index, condition)) %@[index >> 3] |= mask;", kVariableNameConditionResults]; // Cache indexes are profile indexes
+			else [self writeLine:@"if (condition()) %@[index >> 3] |= mask;", kVariableNameConditionResults];
+			[self writeLine:@"else %@[index >> 3] &= ~mask;", kVariableNameConditionResults];
+		}];
+		[self writeLine:@"}"];
+		[self writeLine:@"return (%@[index >> 3] & mask) != 0;", kVariableNameConditionResults];
+	}];
+	[self writeLine:@"}"];
+}
+
+#pragma mark Writing Profiles
+
+- (void)writeProfiles
+{
+	// The symbol ids the summaries are sent with, and an accumulator for each
+	NSMutableArray *profileIDs = [NSMutableArray arrayWithCapacity:[self.profiledObjects count]];
+	for (id object in self.profiledObjects) {
+		[profileIDs addObject:[self messageIDForObject:object]];
+	}
+	[self writeLine:@"const int %@ = %lu;", kConstantNameProfileCount, (unsigned long)[self.profiledObjects count]];
+	[self writeTableWithType:@"SymbolID" name:kTableNameProfileIDs values:profileIDs];
+	[self writeLine:@"ProfileAccumulator %@[%lu];", kVariableNameProfiles, (unsigned long)MAX([self.profiledObjects count], 1)];
+}
+
+- (void)writeProfilingStateForStates:(NSArray *)states withNumber:(int)number
+{
+	NSString *profiledStateName = [NSString stringWithFormat:kVariableNameFormatProfiledState, number];
+	NSNumber *firstIndex = ([states count] > 0) ? [self.profileIndexes objectForKey:states[0]] : @0;
+	[self writeLine:@"profileState(&%@, currentState%i, %@);", profiledStateName, number, firstIndex];
+}
+
 #pragma mark Writing Utility
 
 - (NSRange)writeFunctionWithReturnType:(NSString *)returnType name:(NSString *)name contents:(void(^)())block
 {
-	NSUInteger startIndex = [[self code] length]+1;
+	NSUInteger startIndex = [self codeLength]+1;
 	[self writeLine:@"%@ %@() {", returnType, name];
 	[self doIndented:block];
 	[self writeLine:@"}"];
-	NSUInteger endIndex = [[self code] length];
+	NSUInteger endIndex = [self codeLength];
 	return NSMakeRange(startIndex, endIndex-startIndex);
 }
 
@@ -345,44 +893,152 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 	[self writeLine:@"// ---%@---", dashes];
 }
 
-#pragma mark - Preparation
+#pragma mark Fragment Reuse
 
-- (void)getStateGroups
+- (void)writeFragmentWithKey:(NSString *)key reusingTemplate:(MAStateMachineCodeTemplate *)oldTemplate contents:(void(^)())block
 {
-	NSMutableArray *stateGroups = [NSMutableArray array];
-	for (MANode *state in self.states) {
-		// Check if it's already in one of the state machines in the list
-		BOOL alreadyInList = NO;
-		for (NSArray *stateGroup in stateGroups) {
-			if ([stateGroup containsObject:state]) {
-				alreadyInList = YES;
-				break;
-			}
+	if ([self canReuseFragmentWithKey:key fromTemplate:oldTemplate] && [self appendFragmentWithKey:key fromTemplate:oldTemplate]) return;
+	[self fragment:block withKey:key];
+}
+
+- (BOOL)canReuseFragmentWithKey:(NSString *)key fromTemplate:(MAStateMachineCodeTemplate *)oldTemplate
+{
+	if (!oldTemplate) return NO;
+	NSArray *editableRangeKeys = [oldTemplate keysForEditableRangesInFragmentWithKey:key];
+	if (!editableRangeKeys) return NO; // No such fragment
+	// The editable code has to come out the same as well
+	for (id editableRangeKey in editableRangeKeys) {
+		NSString *code = self.codeForEditableRangesToWrite[editableRangeKey];
+		if (!code || ![code isEqualToString:[oldTemplate codeForEditableRangeWithKey:editableRangeKey]]) return NO;
+	}
+	return YES;
+}
+
+- (BOOL)canReuseStateGroupAtIndex:(NSUInteger)index fromTemplate:(MAStateMachineCodeTemplate *)oldTemplate affectedStates:(NSHashTable *)affectedStates
+{
+	if (!oldTemplate || index >= [oldTemplate.stateGroups count]) return NO;
+	NSArray *stateGroup = self.stateGroups[index];
+	NSArray *oldStateGroup = oldTemplate.stateGroups[index];
+	if ([stateGroup count] != [oldStateGroup count]) return NO;
+	for (NSUInteger i=0; i<[stateGroup count]; i++) {
+		MANode *state = stateGroup[i];
+		if (state != oldStateGroup[i] || [affectedStates containsObject:state]) return NO;
+	}
+	return YES;
+}
+
+- (NSHashTable *)statesAffectedByChanges:(NSArray *)changes sinceTemplate:(MAStateMachineCodeTemplate *)oldTemplate
+{
+	NSHashTable *affectedStates = [NSHashTable hashTableWithOptions:NSPointerFunctionsObjectPointerPersonality];
+	// Changed directly
+	for (MAGraphChange *change in changes) {
+		for (MANode *node in change.affectedNodes) {
+			[affectedStates addObject:node];
+		}
+	}
+	// Changed symbols (e.g. a name that got another suffix because some other symbol was renamed)
+	for (NSArray *stateGroup in self.stateGroups) {
+		for (MANode *state in stateGroup) {
+			if ([self symbolForObject:state differsFromTemplate:oldTemplate]) [affectedStates addObject:state];
 		}
-		// If not, add its state machine
-		if (!alreadyInList) {
-			NSArray *stateGroup = [state findConnectedNodes];
-			[stateGroups addObject:stateGroup];
+	}
+	NSHashTable *changedObjects = [NSHashTable hashTableWithOptions:NSPointerFunctionsObjectPointerPersonality];
+	for (MACondition *condition in self.conditions) {
+		if ([self symbolForObject:condition differsFromTemplate:oldTemplate]) [changedObjects addObject:condition];
+	}
+	for (MAAction *action in self.actions) {
+		if ([self symbolForObject:action differsFromTemplate:oldTemplate]) [changedObjects addObject:action];
+	}
+	for (MAArrow *transition in self.transitions) {
+		if (!transition.sourceNode) continue;
+		BOOL isChanged = [self symbolForObject:transition differsFromTemplate:oldTemplate];
+		if (transition.condition && [changedObjects containsObject:transition.condition]) isChanged = YES;
+		for (MAAction *action in transition.actions) {
+			if ([changedObjects containsObject:action]) isChanged = YES;
 		}
+		if (isChanged) [affectedStates addObject:transition.sourceNode];
 	}
-	self.stateGroups = stateGroups;
+	return affectedStates;
+}
+
+- (BOOL)symbolForObject:(id)object differsFromTemplate:(MAStateMachineCodeTemplate *)oldTemplate
+{
+	NSNumber *oldSymbolID = [oldTemplate.writtenSymbolIDs objectForKey:object];
+	if (!oldSymbolID) return YES; // New
+	if ([oldSymbolID unsignedLongLongValue] != [self.symbols symbolIDForObject:object]) return YES;
+	NSString *oldSymbolName = [oldTemplate.writtenSymbolNames objectForKey:object];
+	NSString *symbolName = [self.symbols symbolNameForObject:object];
+	return (oldSymbolName != symbolName && ![oldSymbolName isEqualToString:symbolName]);
+}
+
+- (void)recordWrittenSymbols
+{
+	NSPointerFunctionsOptions keyOptions = NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality;
+	self.writtenSymbolNames = [NSMapTable mapTableWithKeyOptions:keyOptions valueOptions:NSPointerFunctionsStrongMemory];
+	self.writtenSymbolIDs = [NSMapTable mapTableWithKeyOptions:keyOptions valueOptions:NSPointerFunctionsStrongMemory];
+	self.writtenSymbolIDWidth = [self.symbols symbolIDWidth];
+	void (^record)(id) = ^(id object) {
+		NSString *symbolName = [self.symbols symbolNameForObject:object];
+		if (symbolName) [self.writtenSymbolNames setObject:symbolName forKey:object];
+		[self.writtenSymbolIDs setObject:@([self.symbols symbolIDForObject:object]) forKey:object];
+	};
+	for (NSArray *stateGroup in self.stateGroups) {
+		for (MANode *state in stateGroup) record(state);
+	}
+	for (MAArrow *transition in self.transitions) record(transition);
+	for (MACondition *condition in self.conditions) record(condition);
+	for (MAAction *action in self.actions) record(action);
+}
+
+#pragma mark - Preparation
+
+- (void)getStateGroups
+{
+	self.graphAnalysis = [MAGraphAnalysis analysisWithNodes:self.states arrows:self.transitions];
+	self.stateGroups = [self.graphAnalysis components];
 }
 
 - (void)getActionsAndConditions
 {
-	NSMutableArray *conditions = [NSMutableArray array];
-	NSMutableArray *actions = [NSMutableArray array];
-	for (MAArrow *transition in self.transitions) {
-		// Conditions
-		MACondition *condition = transition.condition;
-		if (condition && ![conditions containsObject:condition]) [conditions addObject:condition];
-		// Actions
-		for (MAAction *action in transition.actions) {
-			if (![actions containsObject:action]) [actions addObject:action];
+	if (!self.graphAnalysis) self.graphAnalysis = [MAGraphAnalysis analysisWithNodes:self.states arrows:self.transitions];
+	self.conditions = [self.graphAnalysis conditions];
+	self.actions = [self.graphAnalysis actions];
+	[self getCachedConditions];
+	[self getProfileIndexes];
+}
+
+- (void)getCachedConditions
+{
+	NSMutableArray *cachedConditions = [NSMutableArray array];
+	NSMapTable *cacheIndexes = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	if (self.memoizesConditions) {
+		for (MACondition *condition in self.conditions) {
+			if (condition.isVolatile) continue;
+			[cacheIndexes setObject:@([cachedConditions count]) forKey:condition];
+			[cachedConditions addObject:condition];
 		}
 	}
-	self.conditions = conditions;
-	self.actions = actions;
+	self.cachedConditions = cachedConditions;
+	self.conditionCacheIndexes = cacheIndexes;
+}
+
+- (void)getProfileIndexes
+{
+	// Conditions in table order, so cache indexes are profile indexes too, and each state machine's states in a row
+	NSMutableArray *profiledObjects = [NSMutableArray array];
+	NSMapTable *profileIndexes = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	if (self.insertsProfilingCode) {
+		[profiledObjects addObjectsFromArray:[self tableConditions]];
+		[profiledObjects addObjectsFromArray:self.actions];
+		for (NSArray *states in self.stateGroups) {
+			[profiledObjects addObjectsFromArray:states];
+		}
+		[profiledObjects enumerateObjectsUsingBlock:^(id object, NSUInteger index, BOOL *stop) {
+			[profileIndexes setObject:@(index) forKey:object];
+		}];
+	}
+	self.profiledObjects = profiledObjects;
+	self.profileIndexes = profileIndexes;
 }
 
 - (void)assignNamesToSymbols
@@ -394,6 +1050,15 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 	for (int i=0; i<stateGroupCount; i++) {
 		NSString *functionName = [NSString stringWithFormat:kFunctionNameFormatUpdateStateMachine, i+1];
 		[symbols addReservedNames:@[ functionName ]];
+		if (self.writesTables) {
+			NSMutableArray *tableNames = [NSMutableArray array];
+			for (NSString *format in @[ kTableNameFormatOffsets, kTableNameFormatTransitions, kTableNameFormatActions, kTableNameFormatStateIDs, kTableNameFormatTransitionIDs, kTableNameFormatConditionIDs ]) {
+				[tableNames addObject:[NSString stringWithFormat:format, i+1]];
+			}
+			[symbols addReservedNames:tableNames];
+		}
+		if (self.logsChangesOnly) [symbols addReservedNames:@[ [NSString stringWithFormat:kVariableNameFormatLoggedState, i+1], [NSString stringWithFormat:kVariableNameFormatLoggedConditions, i+1] ]];
+		if (self.insertsProfilingCode) [symbols addReservedNames:@[ [NSString stringWithFormat:kVariableNameFormatProfiledState, i+1] ]];
 	}
 	// States
 	for (MANode *state in self.states) {
@@ -426,17 +1091,19 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 		}
 	}
 	// Remove unused symbols
+	NSMutableSet *usedObjects = [NSMutableSet setWithArray:self.states];
+	[usedObjects addObjectsFromArray:self.transitions];
+	[usedObjects addObjectsFromArray:self.conditions];
+	[usedObjects addObjectsFromArray:self.actions];
 	NSArray *allObjects = [symbols allObjects];
 	for (id object in allObjects) {
-		if ([object isKindOfClass:[MANode class]] && [self.states containsObject:object]) continue;
-		if ([object isKindOfClass:[MAArrow class]] && [self.transitions containsObject:object]) continue;
-		if ([object isKindOfClass:[MACondition class]] && [self.conditions containsObject:object]) continue;
-		if ([object isKindOfClass:[MAAction class]] && [self.actions containsObject:object]) continue;
+		if ([usedObjects containsObject:object]) continue;
 		// Not used anymore, delete
 		[symbols removeObject:object];
 	}
 	// Generate names
 	[symbols generateSymbolNames];
+	[self recordWrittenSymbols];
 }
 
 - (MASymbolManager *)createSymbolManager
@@ -444,13 +1111,15 @@ static NSString * const kRangeActionKeyFormat = @"Action$%@";
 	MASymbolManager *symbols = [[MASymbolManager alloc] init];
 	symbols.maximumSymbolID = UINT16_MAX;
 	// Add reserved names
-	NSString *path = [[NSBundle mainBundle] pathForResource:@"ReservedSymbolNames" ofType:@"txt"];
-	NSString *reversedNamesString = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:nil];
-	NSArray *reservedNames = [reversedNamesString componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-	reservedNames = [reservedNames arrayUsingBlock:^id(NSString *str) {
-		return ([str length] > 0) ? str : nil; // Returning nil will remove the element
-	}];
-	[symbols addReservedNames:reservedNames];
+	NSArray *reservedNames;
+	@synchronized([self class]) {
+		reservedNames = reservedSymbolNames;
+	}
+	if (reservedNames) {
+		[symbols addReservedNames:reservedNames];
+	} else {
+		symbols.reservesBuiltInNames = YES;
+	}
 	// Return
 	return symbols;
 }
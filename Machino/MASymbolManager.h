@@ -11,13 +11,22 @@
 
 #import <Foundation/Foundation.h>
 
+// Symbol ids are dense: objects get the last freed id, otherwise the next one up, and keep it (saved documents too)
+// until they're removed. So ids stay below the object count plus what was freed since, and map back through a flat array.
+// Names are given in the order the objects were added, so generating them again only redoes the ones from the first
+// object added, removed or renamed since.
 @interface MASymbolManager : NSObject <NSCoding>
 
 @property (nonatomic) UInt64 maximumSymbolID;
+@property (nonatomic) BOOL reservesBuiltInNames; // Keeps symbols off the names in MAReservedNames.h, as well as the added ones
+@property (nonatomic, readonly) NSUInteger symbolIDWidth; // Bits, 8, 16, 32 or 64: the fewest that fit every id in use
 
 // Core
 - (void)generateSymbolNames;
-- (void)regenerateSymbolIDs;
+- (void)regenerateSymbolIDs; // Renumbers from 0, in the order the objects were added
+// Saving without NSCoding, for documents that store the objects themselves (MADocumentArchive): objects go by their index
+- (NSData *)dataWithIndexForObject:(NSUInteger(^)(id object))indexForObject; // NSNotFound leaves the object out
+- (id)initWithData:(NSData *)data objectForIndex:(id(^)(NSUInteger index))objectForIndex; // nil if the data is malformed
 // Querying
 - (NSString *)symbolNameForObject:(id)object;
 - (UInt64)symbolIDForObject:(id)object;
@@ -10,6 +10,8 @@
 // NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #import "MASymbolManager.h"
+#import "MAReservedNames.h"
+#import "MADocumentFormat.h"
 
 static NSString * const kValidSymbolCharactersString = @"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
 // Coder keys
@@ -21,6 +23,8 @@ static NSString * const kCoderSymbolNameKey = @"symbolName";
 static NSString * const kCoderMaximumSymbolIDKey = @"maximumSymbolID";
 static NSString * const kCoderSymbolsKey = @"symbols";
 static NSString * const kCoderReservedNamesKey = @"reservedNames";
+static NSString * const kCoderReservesBuiltInNamesKey = @"reservesBuiltInNames";
+static NSString * const kCoderDenseSymbolIDsKey = @"denseSymbolIDs"; // Older documents have random ids
 
 #pragma mark - Private Class - MASymbol
 
@@ -31,11 +35,19 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
 @property (nonatomic, copy) NSString *objectName;
 @property (nonatomic, copy) NSString *nameFormat; // Format to apply on the object name before generating its symbol names
 @property (nonatomic, copy) NSString *symbolName;
+@property (nonatomic, copy) NSString *baseName; // The valid name from the object name & format, before making it unique
 
 @end
 
 @implementation MASymbol
 
+- (void)setObjectName:(NSString *)objectName
+{
+	if (objectName == _objectName || [objectName isEqualToString:_objectName]) return;
+	_objectName = [objectName copy];
+	_baseName = nil;
+}
+
 - (id)initWithCoder:(NSCoder *)coder
 {
     self = [super init];
@@ -69,8 +81,15 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
 
 @interface MASymbolManager ()
 
-@property (nonatomic, strong, readonly) NSMutableArray *symbols;
+@property (nonatomic, strong, readonly) NSMutableOrderedSet *symbols;
 @property (nonatomic, strong, readonly) NSMutableArray *reservedNames;
+@property (nonatomic, strong, readonly) NSMutableSet *reservedNameSet; // Same names, to check against
+@property (nonatomic) NSUInteger firstStaleSymbolIndex; // Symbols from here on need new names, NSNotFound if none do
+// Indexes into symbols, kept in sync by the editing methods
+@property (nonatomic, strong, readonly) NSMapTable *symbolsByObject; // Weak object (by pointer) -> MASymbol
+@property (nonatomic, strong, readonly) NSMutableArray *symbolsByID; // Indexed by id, NSNull where free, up to the highest id
+@property (nonatomic, strong, readonly) NSMutableArray *freeSymbolIDs; // Freed ids, reused last first
+@property (nonatomic, strong, readonly) NSMutableDictionary *symbolsByName;
 
 @end
 
@@ -78,15 +97,46 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
 
 - (NSCharacterSet *)validSymbolCharacters
 {
-	return [NSCharacterSet characterSetWithCharactersInString:kValidSymbolCharactersString];
+	static NSCharacterSet *validSymbolCharacters;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		validSymbolCharacters = [NSCharacterSet characterSetWithCharactersInString:kValidSymbolCharactersString];
+	});
+	return validSymbolCharacters;
+}
+
+- (NSCharacterSet *)invalidSymbolCharacters
+{
+	static NSCharacterSet *invalidSymbolCharacters;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		invalidSymbolCharacters = [[self validSymbolCharacters] invertedSet];
+	});
+	return invalidSymbolCharacters;
+}
+
+- (void)setReservesBuiltInNames:(BOOL)reservesBuiltInNames
+{
+	if (_reservesBuiltInNames == reservesBuiltInNames) return;
+	_reservesBuiltInNames = reservesBuiltInNames;
+	self.firstStaleSymbolIndex = 0;
 }
 
 - (void)setMaximumSymbolID:(UInt64)maximumSymbolID
 {
 	if (_maximumSymbolID == maximumSymbolID) return;
 	_maximumSymbolID = maximumSymbolID;
-	// Update
-	[self regenerateSymbolIDs];
+	// Update, only if ids would be out of range (so they stay the same otherwise)
+	if ([self.symbolsByID count] > 0 && [self.symbolsByID count] - 1 > maximumSymbolID) [self regenerateSymbolIDs];
+}
+
+- (NSUInteger)symbolIDWidth
+{
+	UInt64 count = [self.symbolsByID count];
+	if (count <= (1ULL << 8)) return 8;
+	if (count <= (1ULL << 16)) return 16;
+	if (count <= (1ULL << 32)) return 32;
+	return 64;
 }
 
 #pragma mark - Initialization
@@ -96,9 +146,11 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
     self = [super init];
     if (self) {
 		_maximumSymbolID = UINT64_MAX;
-		_symbols = [NSMutableArray array];
+		_symbols = [NSMutableOrderedSet orderedSet];
 		_reservedNames = [NSMutableArray array];
-		srandom((int)time(NULL));
+		_reservedNameSet = [NSMutableSet set];
+		_firstStaleSymbolIndex = 0;
+		[self createIndexes];
     }
     return self;
 }
@@ -108,43 +160,147 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
     self = [super init];
     if (self) {
 		_maximumSymbolID = [coder decodeInt64ForKey:kCoderMaximumSymbolIDKey];
-        _symbols = [coder decodeObjectForKey:kCoderSymbolsKey];
-		_reservedNames = [coder decodeObjectForKey:kCoderReservedNamesKey];
+		_symbols = [NSMutableOrderedSet orderedSetWithArray:[coder decodeObjectForKey:kCoderSymbolsKey]];
+		_reservedNames = [[coder decodeObjectForKey:kCoderReservedNamesKey] mutableCopy] ?: [NSMutableArray array];
+		_reservedNameSet = [NSMutableSet setWithArray:_reservedNames];
+		_reservesBuiltInNames = [coder decodeBoolForKey:kCoderReservesBuiltInNamesKey];
+		_firstStaleSymbolIndex = 0;
+		[self createIndexes];
+		if (![coder decodeBoolForKey:kCoderDenseSymbolIDsKey]) [self regenerateSymbolIDs]; // Once, they're kept from then on
     }
     return self;
 }
 
+- (id)initWithData:(NSData *)data objectForIndex:(id(^)(NSUInteger index))objectForIndex
+{
+	self = [super init];
+	if (self) {
+		MADocumentReader reader = MADocumentReaderMake(data);
+		_maximumSymbolID = MADocumentReadVarint(&reader);
+		_reservesBuiltInNames = (MADocumentReadVarint(&reader) != 0);
+		UInt64 reservedNameCount = MADocumentReadVarint(&reader);
+		_reservedNames = [NSMutableArray array];
+		for (UInt64 i = 0; i < reservedNameCount && !reader.failed; i++) {
+			NSString *name = MADocumentReadString(&reader);
+			if (name) [_reservedNames addObject:name];
+		}
+		_reservedNameSet = [NSMutableSet setWithArray:_reservedNames];
+		UInt64 symbolCount = MADocumentReadVarint(&reader);
+		_symbols = [NSMutableOrderedSet orderedSet];
+		for (UInt64 i = 0; i < symbolCount && !reader.failed; i++) {
+			UInt64 objectIndex = MADocumentReadVarint(&reader);
+			MASymbol *symbol = [[MASymbol alloc] init];
+			symbol.symbolID = MADocumentReadVarint(&reader);
+			symbol.objectName = MADocumentReadString(&reader);
+			symbol.nameFormat = MADocumentReadString(&reader);
+			symbol.symbolName = MADocumentReadString(&reader);
+			symbol.object = (objectIndex < NSNotFound) ? objectForIndex((NSUInteger)objectIndex) : nil;
+			if (symbol.object) [_symbols addObject:symbol];
+		}
+		if (!MADocumentReaderIsAtEnd(&reader)) return nil;
+		_firstStaleSymbolIndex = 0;
+		[self createIndexes];
+	}
+	return self;
+}
+
+- (NSData *)dataWithIndexForObject:(NSUInteger(^)(id object))indexForObject
+{
+	NSMutableData *data = [NSMutableData data];
+	MADocumentAppendVarint(data, self.maximumSymbolID);
+	MADocumentAppendVarint(data, self.reservesBuiltInNames);
+	MADocumentAppendVarint(data, [self.reservedNames count]);
+	for (NSString *name in self.reservedNames) {
+		MADocumentAppendString(data, name);
+	}
+	// Symbols whose object is gone or not in the document are left out, which frees their ids
+	NSMutableArray *symbols = [NSMutableArray arrayWithCapacity:[self.symbols count]];
+	NSMutableArray *objectIndexes = [NSMutableArray arrayWithCapacity:[self.symbols count]];
+	for (MASymbol *symbol in self.symbols) {
+		NSUInteger objectIndex = symbol.object ? indexForObject(symbol.object) : NSNotFound;
+		if (objectIndex == NSNotFound) continue;
+		[symbols addObject:symbol];
+		[objectIndexes addObject:@(objectIndex)];
+	}
+	MADocumentAppendVarint(data, [symbols count]);
+	[symbols enumerateObjectsUsingBlock:^(MASymbol *symbol, NSUInteger index, BOOL *stop) {
+		MADocumentAppendVarint(data, [objectIndexes[index] unsignedIntegerValue]);
+		MADocumentAppendVarint(data, symbol.symbolID);
+		MADocumentAppendString(data, symbol.objectName);
+		MADocumentAppendString(data, symbol.nameFormat);
+		MADocumentAppendString(data, symbol.symbolName);
+	}];
+	return data;
+}
+
 - (void)encodeWithCoder:(NSCoder *)coder
 {
 	[coder encodeInt64:self.maximumSymbolID forKey:kCoderMaximumSymbolIDKey];
-	[coder encodeObject:self.symbols forKey:kCoderSymbolsKey];
+	[coder encodeObject:[[self.symbols array] mutableCopy] forKey:kCoderSymbolsKey]; // Stays an array for older versions
 	[coder encodeObject:self.reservedNames forKey:kCoderReservedNamesKey];
+	[coder encodeBool:self.reservesBuiltInNames forKey:kCoderReservesBuiltInNamesKey];
+	[coder encodeBool:YES forKey:kCoderDenseSymbolIDsKey];
 }
 
 #pragma mark - Core
 
 - (void)generateSymbolNames
 {
-	NSMutableSet *names = [NSMutableSet setWithArray:self.reservedNames];
-	for (MASymbol *symbol in self.symbols) {
+	// Names only depend on the symbols before, so the ones before the first change keep theirs
+	NSUInteger symbolCount = [self.symbols count];
+	NSUInteger firstIndex = self.firstStaleSymbolIndex;
+	if (firstIndex >= symbolCount) {
+		self.firstStaleSymbolIndex = NSNotFound;
+		return;
+	}
+	NSMutableSet *names = [NSMutableSet setWithCapacity:symbolCount];
+	for (NSUInteger i = 0; i < firstIndex; i++) {
+		MASymbol *symbol = self.symbols[i];
+		if (symbol.objectName && symbol.symbolName) [names addObject:symbol.symbolName];
+	}
+	// Name the rest, taking names off the index as they go
+	NSMutableDictionary *nextSuffixes = [NSMutableDictionary dictionary]; // Base name -> first suffix digit not tried yet
+	for (NSUInteger i = firstIndex; i < symbolCount; i++) {
+		MASymbol *symbol = self.symbols[i];
 		if (!symbol.objectName) continue;
-		NSString *name = symbol.nameFormat ? [NSString stringWithFormat:symbol.nameFormat, symbol.objectName] : symbol.objectName;
-		name = [self validSymbolNameFromName:name];
-		name = [self makeName:name differentFromNamesInSet:names];
+		if (!symbol.baseName) {
+			NSString *name = symbol.nameFormat ? [NSString stringWithFormat:symbol.nameFormat, symbol.objectName] : symbol.objectName;
+			symbol.baseName = [self validSymbolNameFromName:name];
+		}
+		NSString *name = [self makeName:symbol.baseName differentFromNames:names nextSuffixes:nextSuffixes];
 		[names addObject:name];
+		[self removeSymbol:symbol fromIndexByKey:symbol.symbolName inDictionary:self.symbolsByName];
 		symbol.symbolName = name;
 	}
+	// Re-index
+	if (firstIndex == 0) [self.symbolsByName removeAllObjects];
+	for (NSUInteger i = firstIndex; i < symbolCount; i++) {
+		MASymbol *symbol = self.symbols[i];
+		[self indexSymbol:symbol byKey:symbol.symbolName inDictionary:self.symbolsByName];
+	}
+	self.firstStaleSymbolIndex = NSNotFound;
 }
 
 - (void)regenerateSymbolIDs
 {
+	// Densely from 0, in the order the objects were added
+	[self.symbolsByID removeAllObjects];
+	[self.freeSymbolIDs removeAllObjects];
+	for (MASymbol *symbol in self.symbols) {
+		symbol.symbolID = UINT64_MAX;
+	}
 	for (MASymbol *symbol in self.symbols) {
-		symbol.symbolID = [self generateUniqueSymbolID];
+		[self setSymbolID:[self takeFreeSymbolID] forSymbol:symbol];
 	}
 }
 
 - (NSString *)validSymbolNameFromName:(NSString *)name
 {
+	// Most names are valid already
+	if ([name length] > 0 && [name rangeOfCharacterFromSet:[self invalidSymbolCharacters]].location == NSNotFound) {
+		unichar first = [name characterAtIndex:0];
+		if (first < '0' || first > '9') return [name copy];
+	}
 	NSMutableString *str = [name mutableCopy];
 	// Replace special characters outside ascii (with substitution, e.g. é becomes e).
 	NSData *tmp = [str dataUsingEncoding:NSASCIIStringEncoding allowLossyConversion:YES];
@@ -181,19 +337,27 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
 	return [str copy];
 }
 
-- (NSString *)makeName:(NSString *)name differentFromNamesInSet:(NSSet *)set
+- (NSString *)makeName:(NSString *)name differentFromNames:(NSSet *)names nextSuffixes:(NSMutableDictionary *)nextSuffixes
 {
-	if (![set containsObject:name]) return name;
-	// Find a suffix digit that's unique
-	int suffixDigit = 2;
+	if (![self isName:name takenInNames:names]) return name;
+	// Find a suffix digit that's unique, carrying on from the last one for this name (names are only added, so the ones
+	// before stay taken)
+	int suffixDigit = [nextSuffixes[name] intValue] ?: 2;
 	NSString *newName = name;
 	do {
 		newName = [NSString stringWithFormat:@"%@%d", name, suffixDigit];
 		suffixDigit++;
-	} while ([set containsObject:newName]);
+	} while ([self isName:newName takenInNames:names]);
+	nextSuffixes[name] = @(suffixDigit);
 	return newName;
 }
 
+- (BOOL)isName:(NSString *)name takenInNames:(NSSet *)names
+{
+	if ([names containsObject:name] || [self.reservedNameSet containsObject:name]) return YES;
+	return (self.reservesBuiltInNames && MAIsBuiltInReservedName(name));
+}
+
 #pragma mark - Querying
 
 - (NSString *)symbolNameForObject:(id)object
@@ -208,18 +372,16 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
 
 - (id)objectForSymbolName:(NSString *)symbolName
 {
-	for (MASymbol *symbol in self.symbols) {
-		if ([symbol.symbolName isEqual:symbolName]) return symbol.object;
-	}
-	return nil;
+	if (!symbolName) return nil;
+	MASymbol *symbol = self.symbolsByName[symbolName];
+	return symbol.object;
 }
 
 - (id)objectForSymbolID:(UInt64)symbolID
 {
-	for (MASymbol *symbol in self.symbols) {
-		if (symbol.symbolID == symbolID) return symbol.object;
-	}
-	return nil;
+	if (symbolID >= [self.symbolsByID count]) return nil;
+	MASymbol *symbol = self.symbolsByID[(NSUInteger)symbolID];
+	return (symbol != (id)[NSNull null]) ? symbol.object : nil;
 }
 
 - (BOOL)containsObject:(id)object
@@ -229,10 +391,8 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
 
 - (MASymbol *)symbolForObject:(id)object
 {
-	for (MASymbol *symbol in self.symbols) {
-		if ([symbol.object isEqual:object]) return symbol;
-	}
-	return nil;
+	if (!object) return nil;
+	return [self.symbolsByObject objectForKey:object];
 }
 
 #pragma mark - Editing Objects
@@ -246,34 +406,55 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
 {
 	if (!object) return;
 	MASymbol *symbol = [[MASymbol alloc] init];
-	symbol.symbolID = [self generateUniqueSymbolID];
 	symbol.object = object;
 	symbol.objectName = name;
 	symbol.nameFormat = symbolNameFormat;
+	[self setSymbolID:[self takeFreeSymbolID] forSymbol:symbol];
 	[self.symbols addObject:symbol];
+	if (![self.symbolsByObject objectForKey:object]) [self.symbolsByObject setObject:symbol forKey:object];
+	[self markSymbolsStaleFromIndex:[self.symbols count] - 1];
 }
 
 - (void)removeObject:(id)object
 {
 	MASymbol *symbol = [self symbolForObject:object];
+	if (!symbol) return;
+	[self markSymbolsStaleFromIndex:[self.symbols indexOfObject:symbol]]; // The ones after may get its name
 	[self.symbols removeObject:symbol];
+	[self.symbolsByObject removeObjectForKey:object];
+	[self setSymbolID:UINT64_MAX forSymbol:symbol]; // Frees its id
+	[self removeSymbol:symbol fromIndexByKey:symbol.symbolName inDictionary:self.symbolsByName];
 }
 
 - (void)setName:(NSString *)name forObject:(id)object
 {
-	[self symbolForObject:object].objectName = name;
+	MASymbol *symbol = [self symbolForObject:object];
+	if (!symbol || name == symbol.objectName || [name isEqualToString:symbol.objectName]) return;
+	symbol.objectName = name;
+	[self markSymbolsStaleFromIndex:[self.symbols indexOfObject:symbol]];
 }
 
 #pragma mark - Editing Reserved Names
 
 - (void)addReservedNames:(NSArray *)names
 {
-	[self.reservedNames addObjectsFromArray:names];
+	// Only new ones, so adding the same names before every generation keeps the names
+	for (NSString *name in names) {
+		if ([self.reservedNameSet containsObject:name]) continue;
+		[self.reservedNames addObject:name];
+		[self.reservedNameSet addObject:name];
+		self.firstStaleSymbolIndex = 0;
+	}
 }
 
 - (void)removeReservedNames:(NSArray *)names
 {
-	[self.reservedNames removeObjectsInArray:names];
+	for (NSString *name in names) {
+		if (![self.reservedNameSet containsObject:name]) continue;
+		[self.reservedNames removeObject:name];
+		[self.reservedNameSet removeObject:name];
+		self.firstStaleSymbolIndex = 0;
+	}
 }
 
 #pragma mark - Enumerators
@@ -292,16 +473,83 @@ static NSString * const kCoderReservedNamesKey = @"reservedNames";
 	return [self.reservedNames objectEnumerator];
 }
 
+#pragma mark - Indexes
+
+- (void)createIndexes
+{
+	NSPointerFunctionsOptions keyOptions = NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality;
+	_symbolsByObject = [[NSMapTable alloc] initWithKeyOptions:keyOptions valueOptions:NSPointerFunctionsStrongMemory capacity:[self.symbols count]];
+	_symbolsByID = [NSMutableArray arrayWithCapacity:[self.symbols count]];
+	_freeSymbolIDs = [NSMutableArray array];
+	_symbolsByName = [NSMutableDictionary dictionaryWithCapacity:[self.symbols count]];
+	// First symbol wins, like the linear searches these replace
+	NSMutableArray *unnumberedSymbols = [NSMutableArray array];
+	for (MASymbol *symbol in self.symbols) {
+		if (symbol.object && ![self.symbolsByObject objectForKey:symbol.object]) {
+			[self.symbolsByObject setObject:symbol forKey:symbol.object];
+		}
+		UInt64 symbolID = symbol.symbolID;
+		BOOL isTaken = (symbolID < [self.symbolsByID count] && self.symbolsByID[(NSUInteger)symbolID] != (id)[NSNull null]);
+		if (symbolID > self.maximumSymbolID || symbolID > NSIntegerMax || isTaken) {
+			symbol.symbolID = UINT64_MAX;
+			[unnumberedSymbols addObject:symbol];
+		} else {
+			[self setSymbolID:symbolID forSymbol:symbol];
+		}
+		[self indexSymbol:symbol byKey:symbol.symbolName inDictionary:self.symbolsByName];
+	}
+	// The gaps are free, then the ones that clashed or were out of ids get new ones
+	[self.symbolsByID enumerateObjectsWithOptions:NSEnumerationReverse usingBlock:^(id symbol, NSUInteger index, BOOL *stop) {
+		if (symbol == [NSNull null]) [self.freeSymbolIDs addObject:@(index)];
+	}];
+	for (MASymbol *symbol in unnumberedSymbols) {
+		[self setSymbolID:[self takeFreeSymbolID] forSymbol:symbol];
+	}
+}
+
+- (void)setSymbolID:(UInt64)symbolID forSymbol:(MASymbol *)symbol
+{
+	// Free the old id, dropping free ids off the end so the highest id is always taken
+	UInt64 oldSymbolID = symbol.symbolID;
+	if (oldSymbolID < [self.symbolsByID count] && self.symbolsByID[(NSUInteger)oldSymbolID] == symbol) {
+		self.symbolsByID[(NSUInteger)oldSymbolID] = [NSNull null];
+		[self.freeSymbolIDs addObject:@(oldSymbolID)];
+		while ([self.symbolsByID lastObject] == [NSNull null]) [self.symbolsByID removeLastObject];
+	}
+	symbol.symbolID = symbolID;
+	if (symbolID == UINT64_MAX) return; // Means out of id's
+	while ([self.symbolsByID count] <= symbolID) [self.symbolsByID addObject:[NSNull null]];
+	self.symbolsByID[(NSUInteger)symbolID] = symbol;
+}
+
+- (void)indexSymbol:(MASymbol *)symbol byKey:(id)key inDictionary:(NSMutableDictionary *)index
+{
+	if (key && !index[key]) index[key] = symbol;
+}
+
+- (void)removeSymbol:(MASymbol *)symbol fromIndexByKey:(id)key inDictionary:(NSMutableDictionary *)index
+{
+	if (!key || index[key] != symbol) return;
+	[index removeObjectForKey:key];
+}
+
 #pragma mark - Utility
 
-- (UInt64)generateUniqueSymbolID
+- (void)markSymbolsStaleFromIndex:(NSUInteger)index
 {
-	if ([self.symbols count] >= self.maximumSymbolID+1) return UINT64_MAX;
-	UInt64 symbolID;
-	do {
-		symbolID = (random() % self.maximumSymbolID);
-	} while ([self objectForSymbolID:symbolID]);
-	return symbolID;
+	if (index < self.firstStaleSymbolIndex) self.firstStaleSymbolIndex = index;
+}
+
+- (UInt64)takeFreeSymbolID
+{
+	// The last freed id, skipping ones taken again or dropped off the end since, otherwise the next one up
+	while ([self.freeSymbolIDs count] > 0) {
+		UInt64 symbolID = [[self.freeSymbolIDs lastObject] unsignedLongLongValue];
+		[self.freeSymbolIDs removeLastObject];
+		if (symbolID < [self.symbolsByID count] && self.symbolsByID[(NSUInteger)symbolID] == (id)[NSNull null]) return symbolID;
+	}
+	UInt64 symbolID = [self.symbolsByID count];
+	return (symbolID <= self.maximumSymbolID) ? symbolID : UINT64_MAX;
 }
 
 - (NSString *)description
@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAPlatform.h"
+
+@class MANode;
+@class MAArrow;
+@class MACondition;
+
+// What changed in the graph view since the last frame, ending up the same as showing every event one after another:
+// the last state of each state machine, and the condition or action that was last active.
+@interface MATelemetryFrame : NSObject
+
+@property (nonatomic, copy, readonly) NSArray *states; // The state machines' latest states, the one noted last at the end
+@property (nonatomic, readonly) BOOL hasActivity; // Whether the three below are set, otherwise they're left as they were
+@property (nonatomic, strong, readonly) MACondition *activeCondition;
+@property (nonatomic, strong, readonly) MAArrow *activeArrow; // Of the action being performed, if any
+@property (nonatomic, readonly) NSUInteger activeActionIndex; // NSNotFound if none
+@property (nonatomic, strong, readonly) id executionItem; // The last condition or action, nil if none came in
+// Events that went into the frame
+@property (nonatomic, readonly) NSUInteger eventCount;
+@property (nonatomic, readonly) NSUInteger stateCount;
+@property (nonatomic, readonly) NSUInteger conditionCount;
+@property (nonatomic, readonly) NSUInteger actionCount;
+
+@end
+
+// Collects the states, conditions & actions a running sketch reports into one MATelemetryFrame per display refresh, so
+// the views update once per frame however many events come in. It doesn't schedule anything itself: the first event
+// after a frame was taken calls frameRequestHandler, and the owner takes the frame when the display is due. Not
+// thread-safe, use it from one queue.
+@interface MATelemetryCoalescer : NSObject
+
+@property (nonatomic, copy) void (^frameRequestHandler)(void);
+@property (nonatomic, readonly) BOOL hasPendingFrame;
+@property (nonatomic, readonly) NSUInteger receivedEventCount; // Since the last reset, checked by machino-gen --verify coalescing
+@property (nonatomic, readonly) NSUInteger renderedFrameCount;
+
+- (void)noteState:(MANode *)state;
+- (void)noteCondition:(MACondition *)condition arrow:(MAArrow *)arrow;
+- (void)noteActionAtIndex:(NSUInteger)index arrow:(MAArrow *)arrow;
+- (MATelemetryFrame *)takeFrame; // nil if nothing came in since the last one
+- (void)reset; // Drops the pending frame & the counters, and forgets which states form a state machine (after graph changes)
+
+@end
@@ -0,0 +1,174 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MATelemetryCoalescer.h"
+#import "Graph.h"
+
+#pragma mark - Private Interfaces
+
+@interface MATelemetryFrame ()
+
+@property (nonatomic, strong) NSMutableArray *stateMachines; // NSNumbers, in the order their states were last noted
+@property (nonatomic, strong) NSMutableDictionary *latestStates; // By state machine
+@property (nonatomic, readwrite) BOOL hasActivity;
+@property (nonatomic, strong, readwrite) MACondition *activeCondition;
+@property (nonatomic, strong, readwrite) MAArrow *activeArrow;
+@property (nonatomic, readwrite) NSUInteger activeActionIndex;
+@property (nonatomic, strong, readwrite) id executionItem;
+@property (nonatomic, readwrite) NSUInteger stateCount;
+@property (nonatomic, readwrite) NSUInteger conditionCount;
+@property (nonatomic, readwrite) NSUInteger actionCount;
+
+@end
+
+@interface MATelemetryCoalescer ()
+
+@property (nonatomic, strong) MATelemetryFrame *pendingFrame;
+@property (nonatomic, strong) NSMapTable *stateMachines; // MANode -> NSNumber, filled in as states come in
+@property (nonatomic) NSUInteger stateMachineCount;
+@property (nonatomic, readwrite) NSUInteger receivedEventCount;
+@property (nonatomic, readwrite) NSUInteger renderedFrameCount;
+
+@end
+
+#pragma mark - MATelemetryFrame
+
+@implementation MATelemetryFrame
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateMachines = [NSMutableArray array];
+		_latestStates = [NSMutableDictionary dictionary];
+		_activeActionIndex = NSNotFound;
+	}
+	return self;
+}
+
+- (NSArray *)states
+{
+	NSMutableArray *states = [NSMutableArray arrayWithCapacity:[self.stateMachines count]];
+	for (NSNumber *stateMachine in self.stateMachines) {
+		[states addObject:self.latestStates[stateMachine]];
+	}
+	return states;
+}
+
+- (NSUInteger)eventCount
+{
+	return self.stateCount + self.conditionCount + self.actionCount;
+}
+
+- (void)setState:(MANode *)state ofStateMachine:(NSNumber *)stateMachine
+{
+	// Like MAGraphView making it active: replaces the state machine's other state, and the arrow
+	if (self.latestStates[stateMachine]) [self.stateMachines removeObject:stateMachine];
+	[self.stateMachines addObject:stateMachine];
+	self.latestStates[stateMachine] = state;
+	self.activeArrow = nil;
+	self.activeActionIndex = NSNotFound;
+}
+
+@end
+
+#pragma mark - MATelemetryCoalescer
+
+@implementation MATelemetryCoalescer
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateMachines = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	}
+	return self;
+}
+
+- (BOOL)hasPendingFrame
+{
+	return (self.pendingFrame != nil);
+}
+
+- (NSNumber *)stateMachineForState:(MANode *)state
+{
+	// Connected states are one state machine, like the graph view deactivates them
+	NSNumber *stateMachine = [self.stateMachines objectForKey:state];
+	if (stateMachine) return stateMachine;
+	stateMachine = @(self.stateMachineCount++);
+	for (MANode *connectedState in [state findConnectedNodes]) {
+		[self.stateMachines setObject:stateMachine forKey:connectedState];
+	}
+	[self.stateMachines setObject:stateMachine forKey:state];
+	return stateMachine;
+}
+
+- (MATelemetryFrame *)frameForEvent
+{
+	self.receivedEventCount++;
+	if (!self.pendingFrame) {
+		self.pendingFrame = [[MATelemetryFrame alloc] init];
+		if (self.frameRequestHandler) self.frameRequestHandler();
+	}
+	return self.pendingFrame;
+}
+
+#pragma mark - Events
+
+- (void)noteState:(MANode *)state
+{
+	MATelemetryFrame *frame = [self frameForEvent];
+	frame.stateCount++;
+	[frame setState:state ofStateMachine:[self stateMachineForState:state]];
+}
+
+- (void)noteCondition:(MACondition *)condition arrow:(MAArrow *)arrow
+{
+	MATelemetryFrame *frame = [self frameForEvent];
+	frame.conditionCount++;
+	[frame setState:arrow.sourceNode ofStateMachine:[self stateMachineForState:arrow.sourceNode]];
+	frame.hasActivity = YES;
+	frame.activeCondition = condition;
+	frame.executionItem = condition;
+}
+
+- (void)noteActionAtIndex:(NSUInteger)index arrow:(MAArrow *)arrow
+{
+	MATelemetryFrame *frame = [self frameForEvent];
+	frame.actionCount++;
+	[frame setState:arrow.sourceNode ofStateMachine:[self stateMachineForState:arrow.sourceNode]];
+	frame.hasActivity = YES;
+	frame.activeCondition = nil;
+	frame.activeArrow = arrow;
+	frame.activeActionIndex = index;
+	frame.executionItem = arrow.actions[index];
+}
+
+#pragma mark - Frames
+
+- (MATelemetryFrame *)takeFrame
+{
+	MATelemetryFrame *frame = self.pendingFrame;
+	if (!frame) return nil;
+	self.pendingFrame = nil;
+	self.renderedFrameCount++;
+	return frame;
+}
+
+- (void)reset
+{
+	self.pendingFrame = nil;
+	[self.stateMachines removeAllObjects];
+	self.stateMachineCount = 0;
+	self.receivedEventCount = 0;
+	self.renderedFrameCount = 0;
+}
+
+@end
@@ -0,0 +1,41 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAPlatform.h"
+
+// Trace files (.matrace), written by MATraceRecorder and mapped by MATraceReader: a header, then fixed size records, all
+// little-endian. The first record of every block of kTraceIndexInterval records is an index record holding the host time
+// of the record after it, so a seek only touches one page per step of its binary search until it's down to one block.
+// Records are only ever appended, so a trace that was cut off mid-write loses at most its last partial record.
+
+static const char kTraceMagic[8] = "MATRACE";
+static const UInt32 kTraceVersion = 1;
+static const NSUInteger kTraceIndexInterval = 1024; // Records per block, the index record included
+static const UInt8 kTraceRecordTypeIndex = 0; // Message events use their MAMessageEventType, user serial MATraceEventUserSerial
+
+typedef struct {
+	char magic[8];
+	UInt32 version;
+	UInt32 recordSize;
+	UInt32 indexInterval;
+	UInt32 reserved;
+	UInt64 startTime; // Wall clock, nanoseconds since 1970
+} MATraceHeader;
+
+typedef struct {
+	UInt64 hostTime; // Nanoseconds since startTime, never decreasing
+	UInt32 deviceTime;
+	UInt8 type;
+	UInt8 length; // Of the user serial bytes
+	UInt8 payload[10]; // Event arguments as UInt16's, or user serial bytes
+} MATraceRecord;
+
+static const NSUInteger kTraceUserSerialBytesPerRecord = sizeof(((MATraceRecord *)0)->payload);
@@ -0,0 +1,38 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAPlatform.h"
+#import "MAArduinoController.h"
+
+@class MATraceReader;
+
+// Replays a trace through the same MAArduinoControllerDelegate calls MAArduinoController makes when it decodes the
+// events live: in real time, sped up, or as fast as the delegate takes them. Playing is driven by timers on the current
+// run loop, so it works headless too; playEventsUpToHostTime: plays synchronously instead.
+@interface MATracePlayer : NSObject
+
+@property (nonatomic, strong, readonly) MATraceReader *reader;
+@property (nonatomic, weak) id<MAArduinoControllerDelegate> delegate;
+@property (nonatomic, weak) MAArduinoController *arduino; // Handed to the delegate, may be nil
+@property (nonatomic) double speed; // 1 plays in real time (the default), 0 as fast as possible
+@property (nonatomic, readonly) NSUInteger eventIndex; // Of the next event
+@property (nonatomic, readonly) UInt64 hostTime; // Of the event being played, or the last one
+@property (nonatomic, readonly) BOOL isPlaying;
+@property (nonatomic, copy) void (^completionHandler)(void); // Called when playing reaches the end
+
+- (id)initWithReader:(MATraceReader *)reader;
+
+- (void)seekToHostTime:(UInt64)hostTime; // O(log n), to the first event at or after it
+- (void)play;
+- (void)pause;
+- (NSUInteger)playEventsUpToHostTime:(UInt64)hostTime; // Returns how many
+
+@end
@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MATracePlayer.h"
+#import "MATraceReader.h"
+
+static const NSUInteger kTracePlayerBatchCount = 4096; // Events per run loop pass when playing as fast as possible
+
+#pragma mark - Private Interface
+
+@interface MATracePlayer ()
+
+@property (nonatomic, strong, readwrite) MATraceReader *reader;
+@property (nonatomic, readwrite) NSUInteger eventIndex;
+@property (nonatomic, readwrite) UInt64 hostTime;
+@property (nonatomic, readwrite) BOOL isPlaying;
+@property (nonatomic, strong) NSTimer *timer;
+@property (nonatomic, strong, readonly) NSMutableData *userSerialData; // Collected like MAArduinoController does
+// Where playing (re)started, to keep the pace from drifting
+@property (nonatomic) NSTimeInterval startUptime;
+@property (nonatomic) UInt64 startHostTime;
+
+@end
+
+#pragma mark - MATracePlayer
+
+@implementation MATracePlayer
+
+- (id)initWithReader:(MATraceReader *)reader
+{
+	self = [super init];
+	if (self) {
+		_reader = reader;
+		_speed = 1;
+		_userSerialData = [NSMutableData data];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[_timer invalidate];
+}
+
+#pragma mark - Playing
+
+- (void)seekToHostTime:(UInt64)hostTime
+{
+	self.eventIndex = [self.reader indexOfFirstEventAtOrAfterHostTime:hostTime];
+	[self.userSerialData setLength:0];
+	if (self.isPlaying) {
+		[self restartClock];
+		[self scheduleTimerWithInterval:0];
+	}
+}
+
+- (void)play
+{
+	if (self.isPlaying) return;
+	self.isPlaying = YES;
+	[self restartClock];
+	[self scheduleTimerWithInterval:0];
+}
+
+- (void)pause
+{
+	[self.timer invalidate];
+	self.timer = nil;
+	self.isPlaying = NO;
+}
+
+- (void)restartClock
+{
+	self.startUptime = [[NSProcessInfo processInfo] systemUptime];
+	self.startHostTime = (self.eventIndex < self.reader.eventCount) ? [self.reader eventAtIndex:self.eventIndex].hostTime : 0;
+}
+
+- (void)scheduleTimerWithInterval:(NSTimeInterval)interval
+{
+	[self.timer invalidate];
+	self.timer = [NSTimer scheduledTimerWithTimeInterval:interval target:self selector:@selector(timerDidFire:) userInfo:nil repeats:NO];
+}
+
+- (void)timerDidFire:(NSTimer *)timer
+{
+	self.timer = nil;
+	if (self.speed <= 0) {
+		[self playEventsUpToHostTime:UINT64_MAX maximumCount:kTracePlayerBatchCount];
+	} else {
+		NSTimeInterval elapsed = [[NSProcessInfo processInfo] systemUptime] - self.startUptime;
+		UInt64 hostTime = self.startHostTime + (UInt64)(elapsed * self.speed * 1e9);
+		[self playEventsUpToHostTime:hostTime maximumCount:NSUIntegerMax];
+	}
+	if (!self.isPlaying) return; // Paused by the delegate
+	// Finished, or wait for the next event
+	if (self.eventIndex >= self.reader.eventCount) {
+		[self pause];
+		if (self.completionHandler) self.completionHandler();
+		return;
+	}
+	NSTimeInterval interval = 0;
+	if (self.speed > 0) {
+		UInt64 nextHostTime = [self.reader eventAtIndex:self.eventIndex].hostTime;
+		NSTimeInterval elapsed = [[NSProcessInfo processInfo] systemUptime] - self.startUptime;
+		interval = MAX((nextHostTime - self.startHostTime) * 1e-9 / self.speed - elapsed, 0);
+	}
+	[self scheduleTimerWithInterval:interval];
+}
+
+- (NSUInteger)playEventsUpToHostTime:(UInt64)hostTime
+{
+	return [self playEventsUpToHostTime:hostTime maximumCount:NSUIntegerMax];
+}
+
+- (NSUInteger)playEventsUpToHostTime:(UInt64)hostTime maximumCount:(NSUInteger)maximumCount
+{
+	MATraceReader *reader = self.reader;
+	NSUInteger eventCount = reader.eventCount;
+	NSUInteger count = 0;
+	while (self.eventIndex < eventCount && count < maximumCount) {
+		MATraceEvent event = [reader eventAtIndex:self.eventIndex];
+		if (event.hostTime > hostTime) break;
+		[self playEvent:&event];
+		self.eventIndex++;
+		count++;
+	}
+	[self sendUserSerialData];
+	return count;
+}
+
+- (void)playEvent:(const MATraceEvent *)event
+{
+	// The same calls as MAArduinoController, user serial output collected up to the next event
+	if (event->type == MATraceEventUserSerial) {
+		[self.userSerialData appendBytes:event->bytes length:event->length];
+		self.hostTime = event->hostTime;
+		return;
+	}
+	[self sendUserSerialData];
+	self.hostTime = event->hostTime;
+	id<MAArduinoControllerDelegate> delegate = self.delegate;
+	MAArduinoController *arduino = self.arduino;
+	const UInt16 *arguments = event->arguments;
+	switch (event->type) {
+		case MAMessageEventIterationStart: [delegate arduinoDidStartIteration:arduino]; break;
+		case MAMessageEventIterationEnd: [delegate arduinoDidEndIteration:arduino]; break;
+		case MAMessageEventCurrentState: [delegate arduino:arduino didSendCurrentStateID:arguments[0]]; break;
+		case MAMessageEventWillCheckCondition: [delegate arduino:arduino willCheckConditionWithID:arguments[1] forTransitionWithID:arguments[0]]; break;
+		case MAMessageEventWillPerformTransition: [delegate arduino:arduino willPerformTransitionWithID:arguments[0]]; break;
+		case MAMessageEventWillPerformAction: [delegate arduino:arduino willPerformActionAtIndex:arguments[1] forTransitionWithID:arguments[0]]; break;
+		case MAMessageEventDroppedMessages: [delegate arduino:arduino didDropMessages:arguments[0]]; break;
+	}
+}
+
+- (void)sendUserSerialData
+{
+	if ([self.userSerialData length] == 0) return;
+	[self.delegate arduino:self.arduino didReceiveUserSerialData:[self.userSerialData copy]];
+	[self.userSerialData setLength:0];
+}
+
+@end
@@ -0,0 +1,43 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAPlatform.h"
+#import "MAMessageDecoder.h"
+
+static const UInt8 MATraceEventUserSerial = 8; // Besides the MAMessageEventType's
+static const UInt32 MATraceNoDeviceTime = 0xFFFFFFFF;
+
+typedef struct {
+	UInt64 hostTime; // When it was received, in nanoseconds since the trace started
+	UInt32 deviceTime; // Milliseconds, or MATraceNoDeviceTime
+	UInt8 type; // An MAMessageEventType, or MATraceEventUserSerial
+	UInt16 arguments[2];
+	UInt8 length; // Of the user serial bytes
+	const Byte *bytes; // User serial bytes, only valid while the reader is
+} MATraceEvent;
+
+// Reads a trace MATraceRecorder wrote by mapping it, so opening even a trace of many GB costs nothing up front and only
+// the pages actually looked at are read. Finding the events at a time is a binary search over the index records and
+// then over one block. A trace that's still being recorded can be mapped again with reload.
+@interface MATraceReader : NSObject
+
+@property (nonatomic, copy, readonly) NSString *path;
+@property (nonatomic, strong, readonly) NSDate *startDate;
+@property (nonatomic, readonly) NSUInteger eventCount;
+@property (nonatomic, readonly) UInt64 duration; // Host time of the last event
+
++ (id)readerWithContentsOfFile:(NSString *)path error:(NSError **)error;
+
+- (MATraceEvent)eventAtIndex:(NSUInteger)index;
+- (NSUInteger)indexOfFirstEventAtOrAfterHostTime:(UInt64)hostTime; // eventCount if there is none
+- (BOOL)reload; // Maps what was appended since, NO if the file can't be read anymore
+
+@end
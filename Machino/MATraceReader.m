@@ -0,0 +1,173 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MATraceReader.h"
+#import "MATraceFormat.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <errno.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+
+static const NSUInteger kTraceEventsPerBlock = kTraceIndexInterval - 1;
+
+#pragma mark - Private Interface
+
+@interface MATraceReader () {
+	const Byte *_bytes; // The mapped file
+	size_t _length;
+}
+
+@property (nonatomic, copy, readwrite) NSString *path;
+@property (nonatomic, strong, readwrite) NSDate *startDate;
+@property (nonatomic, readwrite) NSUInteger eventCount;
+@property (nonatomic) NSUInteger recordCount; // Index records included
+
+@end
+
+#pragma mark - MATraceReader
+
+@implementation MATraceReader
+
++ (id)readerWithContentsOfFile:(NSString *)path error:(NSError **)error
+{
+	MATraceReader *reader = [[self alloc] init];
+	reader.path = path;
+	if (![reader mapWithError:error]) return nil;
+	// Header
+	MATraceHeader header;
+	memcpy(&header, reader->_bytes, sizeof(header));
+	if (memcmp(header.magic, kTraceMagic, sizeof(header.magic)) != 0 || NSSwapLittleIntToHost(header.version) != kTraceVersion
+		|| NSSwapLittleIntToHost(header.recordSize) != sizeof(MATraceRecord) || NSSwapLittleIntToHost(header.indexInterval) != kTraceIndexInterval) {
+		if (error) *error = [NSError errorWithDomain:@"" code:0 userInfo:@{ NSLocalizedDescriptionKey : @"Not a trace, or of another version" }];
+		return nil;
+	}
+	reader.startDate = [NSDate dateWithTimeIntervalSince1970:NSSwapLittleLongLongToHost(header.startTime) * 1e-9];
+	return reader;
+}
+
+- (void)dealloc
+{
+	[self unmap];
+}
+
+#pragma mark - Mapping
+
+- (BOOL)mapWithError:(NSError **)error
+{
+	int fileDescriptor = open([self.path fileSystemRepresentation], O_RDONLY);
+	struct stat status;
+	if (fileDescriptor < 0 || fstat(fileDescriptor, &status) != 0) {
+		if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+		if (fileDescriptor >= 0) close(fileDescriptor);
+		return NO;
+	}
+	if (status.st_size < (off_t)sizeof(MATraceHeader)) {
+		if (error) *error = [NSError errorWithDomain:@"" code:0 userInfo:@{ NSLocalizedDescriptionKey : @"Not a trace" }];
+		close(fileDescriptor);
+		return NO;
+	}
+	void *bytes = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	close(fileDescriptor); // The mapping stays
+	if (bytes == MAP_FAILED) {
+		if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+		return NO;
+	}
+	[self unmap];
+	_bytes = bytes;
+	_length = (size_t)status.st_size;
+	// Only whole records, a recording that was cut off ends in a partial one
+	self.recordCount = (_length - sizeof(MATraceHeader)) / sizeof(MATraceRecord);
+	NSUInteger blockCount = self.recordCount / kTraceIndexInterval;
+	NSUInteger remainder = self.recordCount % kTraceIndexInterval;
+	self.eventCount = blockCount * kTraceEventsPerBlock + (remainder > 0 ? remainder-1 : 0);
+	return YES;
+}
+
+- (void)unmap
+{
+	if (_bytes) munmap((void *)_bytes, _length);
+	_bytes = NULL;
+	_length = 0;
+}
+
+- (BOOL)reload
+{
+	return [self mapWithError:NULL];
+}
+
+#pragma mark - Reading
+
+- (const MATraceRecord *)recordAtIndex:(NSUInteger)index
+{
+	return (const MATraceRecord *)(_bytes + sizeof(MATraceHeader) + index * sizeof(MATraceRecord));
+}
+
+- (UInt64)hostTimeOfRecordAtIndex:(NSUInteger)index
+{
+	return NSSwapLittleLongLongToHost([self recordAtIndex:index]->hostTime);
+}
+
+- (NSUInteger)recordIndexForEventAtIndex:(NSUInteger)index
+{
+	return (index / kTraceEventsPerBlock) * kTraceIndexInterval + 1 + index % kTraceEventsPerBlock;
+}
+
+- (MATraceEvent)eventAtIndex:(NSUInteger)index
+{
+	const MATraceRecord *record = [self recordAtIndex:[self recordIndexForEventAtIndex:index]];
+	MATraceEvent event;
+	memset(&event, 0, sizeof(event));
+	event.hostTime = NSSwapLittleLongLongToHost(record->hostTime);
+	event.deviceTime = NSSwapLittleIntToHost(record->deviceTime);
+	event.type = record->type;
+	if (event.type == MATraceEventUserSerial) {
+		event.length = MIN(record->length, kTraceUserSerialBytesPerRecord);
+		event.bytes = record->payload;
+	} else {
+		for (NSUInteger i = 0; i < 2; i++) {
+			UInt16 argument;
+			memcpy(&argument, &record->payload[i*2], sizeof(argument));
+			event.arguments[i] = NSSwapLittleShortToHost(argument);
+		}
+	}
+	return event;
+}
+
+- (UInt64)duration
+{
+	if (self.eventCount == 0) return 0;
+	return [self hostTimeOfRecordAtIndex:[self recordIndexForEventAtIndex:self.eventCount-1]];
+}
+
+- (NSUInteger)indexOfFirstEventAtOrAfterHostTime:(UInt64)hostTime
+{
+	// The first block whose index record isn't earlier, touching one page per step
+	NSUInteger blockCount = (self.recordCount + kTraceIndexInterval - 1) / kTraceIndexInterval;
+	NSUInteger low = 0;
+	NSUInteger high = blockCount;
+	while (low < high) {
+		NSUInteger middle = low + (high - low) / 2;
+		if ([self hostTimeOfRecordAtIndex:middle * kTraceIndexInterval] < hostTime) low = middle + 1;
+		else high = middle;
+	}
+	// The event is in the block before it, or is that block's first
+	NSUInteger first = (low > 0) ? (low - 1) * kTraceEventsPerBlock : 0;
+	NSUInteger last = MIN(low * kTraceEventsPerBlock, self.eventCount);
+	while (first < last) {
+		NSUInteger middle = first + (last - first) / 2;
+		if ([self hostTimeOfRecordAtIndex:[self recordIndexForEventAtIndex:middle]] < hostTime) first = middle + 1;
+		else last = middle;
+	}
+	return first;
+}
+
+@end
@@ -0,0 +1,33 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAPlatform.h"
+#import "MAMessageDecoder.h"
+
+// Appends every event MAArduinoController decodes, and its user serial output, to a trace file (see MATraceFormat.h)
+// with the time it was received, for MATraceReader & MATracePlayer to go through later. Records are buffered and
+// written with plain write()s when the buffer fills up or on flush, so it works the same without AppKit.
+@interface MATraceRecorder : NSObject
+
+@property (nonatomic, copy, readonly) NSString *path;
+@property (nonatomic, readonly) NSUInteger eventCount; // User serial records included
+
++ (id)recorderWithPath:(NSString *)path error:(NSError **)error; // Replaces any file at path
+
+- (UInt64)currentHostTime; // Nanoseconds since the trace started
+- (void)recordEvents:(const MAMessageEvent *)events count:(NSUInteger)count; // Received now
+- (void)recordUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length;
+- (void)recordEvents:(const MAMessageEvent *)events count:(NSUInteger)count hostTime:(UInt64)hostTime deviceTime:(UInt32)deviceTime; // Times earlier than the last are recorded as the last
+- (void)recordUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length hostTime:(UInt64)hostTime deviceTime:(UInt32)deviceTime;
+- (BOOL)flush; // NO if writing failed
+- (void)close; // Flushes, later records are ignored
+
+@end
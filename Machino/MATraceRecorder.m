@@ -0,0 +1,184 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MATraceRecorder.h"
+#import "MATraceReader.h"
+#import "MATraceFormat.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <errno.h>
+
+static const NSUInteger kTraceBufferRecordCount = 2048; // 48 KB
+
+#pragma mark - Private Interface
+
+@interface MATraceRecorder () {
+	MATraceRecord _buffer[kTraceBufferRecordCount];
+}
+
+@property (nonatomic, copy, readwrite) NSString *path;
+@property (nonatomic, readwrite) NSUInteger eventCount;
+@property (nonatomic) int fileDescriptor; // -1 once closed
+@property (nonatomic) NSUInteger bufferCount;
+@property (nonatomic) NSUInteger recordCount; // Written or buffered, index records included
+@property (nonatomic) UInt64 lastHostTime;
+@property (nonatomic) NSTimeInterval startUptime;
+
+@end
+
+#pragma mark - MATraceRecorder
+
+@implementation MATraceRecorder
+
++ (id)recorderWithPath:(NSString *)path error:(NSError **)error
+{
+	int fileDescriptor = open([path fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (fileDescriptor < 0) {
+		if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+		return nil;
+	}
+	MATraceRecorder *recorder = [[self alloc] init];
+	recorder.path = path;
+	recorder.fileDescriptor = fileDescriptor;
+	recorder.startUptime = [[NSProcessInfo processInfo] systemUptime];
+	// Header
+	MATraceHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kTraceMagic, sizeof(header.magic));
+	header.version = NSSwapHostIntToLittle(kTraceVersion);
+	header.recordSize = NSSwapHostIntToLittle(sizeof(MATraceRecord));
+	header.indexInterval = NSSwapHostIntToLittle((UInt32)kTraceIndexInterval);
+	header.startTime = NSSwapHostLongLongToLittle((UInt64)([[NSDate date] timeIntervalSince1970] * 1e9));
+	if (![recorder writeBytes:&header length:sizeof(header)]) {
+		if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+		[recorder close];
+		return nil;
+	}
+	return recorder;
+}
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_fileDescriptor = -1;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[self close];
+}
+
+#pragma mark - Recording
+
+- (UInt64)currentHostTime
+{
+	return (UInt64)(([[NSProcessInfo processInfo] systemUptime] - self.startUptime) * 1e9);
+}
+
+- (void)recordEvents:(const MAMessageEvent *)events count:(NSUInteger)count
+{
+	[self recordEvents:events count:count hostTime:[self currentHostTime] deviceTime:MATraceNoDeviceTime];
+}
+
+- (void)recordUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length
+{
+	[self recordUserSerialBytes:bytes length:length hostTime:[self currentHostTime] deviceTime:MATraceNoDeviceTime];
+}
+
+- (void)recordEvents:(const MAMessageEvent *)events count:(NSUInteger)count hostTime:(UInt64)hostTime deviceTime:(UInt32)deviceTime
+{
+	for (NSUInteger i = 0; i < count; i++) {
+		MATraceRecord *record = [self appendRecordWithType:events[i].type hostTime:hostTime deviceTime:deviceTime];
+		if (!record) return;
+		for (NSUInteger j = 0; j < 2; j++) {
+			UInt16 argument = NSSwapHostShortToLittle(events[i].arguments[j]);
+			memcpy(&record->payload[j*2], &argument, sizeof(argument));
+		}
+	}
+}
+
+- (void)recordUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length hostTime:(UInt64)hostTime deviceTime:(UInt32)deviceTime
+{
+	for (NSUInteger offset = 0; offset < length; offset += kTraceUserSerialBytesPerRecord) {
+		MATraceRecord *record = [self appendRecordWithType:MATraceEventUserSerial hostTime:hostTime deviceTime:deviceTime];
+		if (!record) return;
+		record->length = (UInt8)MIN(length - offset, kTraceUserSerialBytesPerRecord);
+		memcpy(record->payload, &bytes[offset], record->length);
+	}
+}
+
+- (MATraceRecord *)appendRecordWithType:(UInt8)type hostTime:(UInt64)hostTime deviceTime:(UInt32)deviceTime
+{
+	if (self.fileDescriptor < 0) return NULL;
+	hostTime = MAX(hostTime, self.lastHostTime); // Keeps the trace sorted for seeking
+	self.lastHostTime = hostTime;
+	// Each block starts with an index record, with the time of the record after it
+	if (self.recordCount % kTraceIndexInterval == 0) {
+		[self bufferRecordWithType:kTraceRecordTypeIndex hostTime:hostTime deviceTime:MATraceNoDeviceTime];
+	}
+	self.eventCount++;
+	return [self bufferRecordWithType:type hostTime:hostTime deviceTime:deviceTime];
+}
+
+- (MATraceRecord *)bufferRecordWithType:(UInt8)type hostTime:(UInt64)hostTime deviceTime:(UInt32)deviceTime
+{
+	if (self.bufferCount == kTraceBufferRecordCount) [self flush];
+	MATraceRecord *record = &_buffer[self.bufferCount];
+	memset(record, 0, sizeof(MATraceRecord));
+	record->hostTime = NSSwapHostLongLongToLittle(hostTime);
+	record->deviceTime = NSSwapHostIntToLittle(deviceTime);
+	record->type = type;
+	self.bufferCount++;
+	self.recordCount++;
+	return record;
+}
+
+#pragma mark - Writing
+
+- (BOOL)flush
+{
+	if (self.bufferCount == 0) return YES;
+	BOOL success = [self writeBytes:_buffer length:self.bufferCount * sizeof(MATraceRecord)];
+	self.bufferCount = 0;
+	if (!success && self.fileDescriptor >= 0) {
+		// Stop, what made it to the file is still a valid trace (up to a partial record) but later blocks wouldn't line up
+		NSLog(@"Could not write trace %@: %s", self.path, strerror(errno));
+		close(self.fileDescriptor);
+		self.fileDescriptor = -1;
+	}
+	return success;
+}
+
+- (BOOL)writeBytes:(const void *)bytes length:(NSUInteger)length
+{
+	if (self.fileDescriptor < 0) return NO;
+	while (length > 0) {
+		ssize_t writtenLength = write(self.fileDescriptor, bytes, length);
+		if (writtenLength < 0 && errno == EINTR) continue;
+		if (writtenLength <= 0) return NO;
+		bytes = (const Byte *)bytes + writtenLength;
+		length -= writtenLength;
+	}
+	return YES;
+}
+
+- (void)close
+{
+	if (self.fileDescriptor < 0) return;
+	[self flush];
+	close(self.fileDescriptor);
+	self.fileDescriptor = -1;
+}
+
+@end
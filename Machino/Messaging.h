@@ -1,7 +1,53 @@
 #include "Arduino.h"
 
-static const int kMessageStartSequenceLength = 3;
-static const byte kMessageStartSequence[] = { 17, 31, 23 };
+// Protocol version 2. Events are packed into frames, one per loop() iteration where they fit: a frame type, the events
+// (a type byte and varint arguments each) and a CRC-16/CCITT, COBS-encoded and written between zero bytes. Frames are
+// queued in a ring buffer and each written whole once the serial transmit buffer has room for it, so sending never
+// blocks and plain Serial output always lands between frames. Frames that don't fit in the ring are dropped, and a
+// dropped messages event in a later frame reports how many events were lost. Output printed to MessagingSerial is framed
+// too. MESSAGING_FRAME_SIZE has to leave an encoded frame room in the transmit buffer.
+// Machino defines MESSAGING_BAUD_RATE when uploading and connects at that rate; MESSAGING_BUFFER_SIZE has to be a power
+// of two. Sketches written with change-only logging use the sendMessageIf* functions instead, and sketches
+// written for profiling define MESSAGING_PROFILING and send only the summaries of the profiling section at the end.
+// Symbol ids are dense, so Machino defines MESSAGING_SYMBOL_ID_TYPE as uint8_t when they all fit in a byte, which halves
+// the id tables in PROGMEM; on the wire they're varints either way.
+// Sketches built through the build cache define MESSAGING_BUILD_ID, sent in the hello frame, so Machino can tell the
+// board already runs the build and skip uploading it.
+
+#ifndef MESSAGING_BAUD_RATE
+#define MESSAGING_BAUD_RATE 1000000UL
+#endif
+#ifndef MESSAGING_BUFFER_SIZE
+#define MESSAGING_BUFFER_SIZE 128
+#endif
+#ifndef MESSAGING_FRAME_SIZE
+#define MESSAGING_FRAME_SIZE 48 // Before encoding, at most 254
+#endif
+#ifndef MESSAGING_KEYFRAME_INTERVAL
+#define MESSAGING_KEYFRAME_INTERVAL 250 // Milliseconds between change-only updates that log everything
+#endif
+#ifndef MESSAGING_PROFILE_INTERVAL
+#define MESSAGING_PROFILE_INTERVAL 1000 // Milliseconds between profile summaries
+#endif
+#if defined(SERIAL_TX_BUFFER_SIZE) && MESSAGING_FRAME_SIZE + 4 > SERIAL_TX_BUFFER_SIZE - 1
+#error "MESSAGING_FRAME_SIZE is too large for the serial transmit buffer, frames would never be sent"
+#endif
+#ifndef MESSAGING_SYMBOL_ID_TYPE
+#define MESSAGING_SYMBOL_ID_TYPE uint16_t
+#endif
+
+typedef MESSAGING_SYMBOL_ID_TYPE SymbolID;
+
+static const byte kMessagingProtocolVersion = 2;
+static const byte kMessageMaximumLength = 7; // Type and the largest arguments
+static const byte kFrameCRCLength = 2;
+
+typedef enum {
+	kFrameEvents = 1,
+	kFrameUserSerial = 2,
+	kFrameHello = 3,
+	kFrameProfile = 4
+} FrameType;
 
 typedef enum {
 	kMessageNone = 0,
@@ -10,74 +56,372 @@ typedef enum {
 	kMessageCurrentState = 3,
 	kMessageWillCheckCondition = 4,
 	kMessageWillPerformTransition = 5,
-	kMessageWillPerformAction = 6
+	kMessageWillPerformAction = 6,
+	kMessageDroppedMessages = 7
 } MessageType;
 
+byte messageBuffer[MESSAGING_BUFFER_SIZE];
+uint16_t messageBufferStart = 0;
+uint16_t messageBufferLength = 0;
+uint16_t droppedMessageCount = 0;
+byte messageFrame[MESSAGING_FRAME_SIZE];
+byte messageFrameLength = 0;
+byte messageFrameEventCount = 0;
+boolean messageFrameReportsDrops = false;
+unsigned long lastMessagingKeyframeTime = 0UL - MESSAGING_KEYFRAME_INTERVAL; // So the first update is one
+boolean isMessagingKeyframe = false;
+boolean isLoggedStateEntered = false;
+
+void sendMessageHello();
+
 // -------------
 // -- Utility --
 // -------------
 
 void setupMessaging() {
-	Serial.begin(9600);
+	Serial.begin(MESSAGING_BAUD_RATE);
+	sendMessageHello();
+}
+
+uint16_t bufferedFrameLength() {
+	// From the first frame's leading delimiter through its trailing one, frames are only buffered whole
+	uint16_t length = 1;
+	while (length < messageBufferLength && messageBuffer[(messageBufferStart + length) & (MESSAGING_BUFFER_SIZE - 1)] != 0) length++;
+	return length + 1;
+}
+
+void sendBufferedMessages() {
+	// Whole frames that the serial transmit buffer has room for, so this never blocks and nothing printed with plain
+	// Serial ends up inside a frame
+	while (messageBufferLength > 0) {
+		uint16_t frameLength = bufferedFrameLength();
+		if (Serial.availableForWrite() < (int)frameLength) break;
+		while (frameLength > 0) {
+			uint16_t length = MESSAGING_BUFFER_SIZE - messageBufferStart; // Up to the end of the ring
+			if (length > frameLength) length = frameLength;
+			Serial.write(&messageBuffer[messageBufferStart], length);
+			messageBufferStart = (messageBufferStart + length) & (MESSAGING_BUFFER_SIZE - 1);
+			messageBufferLength -= length;
+			frameLength -= length;
+		}
+	}
+}
+
+void bufferUInt8(uint8_t value) {
+	messageBuffer[(messageBufferStart + messageBufferLength) & (MESSAGING_BUFFER_SIZE - 1)] = value;
+	messageBufferLength++;
+}
+
+SymbolID readSymbolID(const SymbolID *address) {
+	if (sizeof(SymbolID) == 1) return pgm_read_byte(address);
+	return pgm_read_word(address);
+}
+
+uint16_t messageFrameCRC() {
+	uint16_t crc = 0xFFFF;
+	for (byte i = 0; i < messageFrameLength; i++) {
+		crc ^= (uint16_t)messageFrame[i] << 8;
+		for (byte bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+	}
+	return crc;
+}
+
+void bufferEncodedFrame() {
+	// COBS: every zero becomes the distance to the next one, so the frame has none
+	bufferUInt8(0);
+	uint16_t codeIndex = messageBufferLength;
+	byte code = 1;
+	bufferUInt8(0);
+	for (byte i = 0; i < messageFrameLength; i++) {
+		if (messageFrame[i] != 0) {
+			bufferUInt8(messageFrame[i]);
+			code++;
+		}
+		if (messageFrame[i] == 0 || code == 255) {
+			messageBuffer[(messageBufferStart + codeIndex) & (MESSAGING_BUFFER_SIZE - 1)] = code;
+			codeIndex = messageBufferLength;
+			code = 1;
+			bufferUInt8(0);
+		}
+	}
+	messageBuffer[(messageBufferStart + codeIndex) & (MESSAGING_BUFFER_SIZE - 1)] = code;
+	bufferUInt8(0);
+}
+
+void sendFrame() {
+	if (messageFrameLength == 0) return;
+	uint16_t crc = messageFrameCRC();
+	messageFrame[messageFrameLength++] = crc >> 8;
+	messageFrame[messageFrameLength++] = crc & 255;
+	// Both delimiters, the first code and one more per 254 bytes
+	uint16_t encodedLength = messageFrameLength + 4;
+	if (MESSAGING_BUFFER_SIZE - messageBufferLength < encodedLength) sendBufferedMessages();
+	if (MESSAGING_BUFFER_SIZE - messageBufferLength < encodedLength) {
+		uint16_t count = droppedMessageCount + messageFrameEventCount;
+		droppedMessageCount = (count < droppedMessageCount) ? 0xFFFF : count;
+	} else {
+		bufferEncodedFrame();
+		if (messageFrameReportsDrops) droppedMessageCount = 0;
+	}
+	messageFrameLength = 0;
+	messageFrameEventCount = 0;
+	messageFrameReportsDrops = false;
+	sendBufferedMessages();
+}
+
+void beginFrame(FrameType type) {
+	messageFrame[0] = type;
+	messageFrameLength = 1;
 }
 
 void writeUInt8(uint8_t value) {
-	Serial.write(value);
+	messageFrame[messageFrameLength++] = value;
 }
 
-void writeUInt16(uint16_t value) {
-	Serial.write((value >> 8) & 255);
-	Serial.write(value & 255);
+void writeVarint(uint16_t value) {
+	while (value >= 128) {
+		writeUInt8((value & 127) | 128);
+		value >>= 7;
+	}
+	writeUInt8(value);
 }
 
-void writeMessageHeader(MessageType type, uint16_t length) {
-	Serial.write(kMessageStartSequence, kMessageStartSequenceLength);
-	writeUInt8(type);
-	writeUInt16(length);
+void writeVarint32(uint32_t value) {
+	while (value >= 128) {
+		writeUInt8((value & 127) | 128);
+		value >>= 7;
+	}
+	writeUInt8(value);
 }
 
-void endMessage()
-{
-	Serial.flush();
+void beginMessage(MessageType type) {
+	if (messageFrameLength > 0 && (messageFrame[0] != kFrameEvents || messageFrameLength + kMessageMaximumLength + kFrameCRCLength > MESSAGING_FRAME_SIZE)) sendFrame();
+	if (messageFrameLength == 0) {
+		beginFrame(kFrameEvents);
+		if (droppedMessageCount > 0) {
+			writeUInt8(kMessageDroppedMessages);
+			writeVarint(droppedMessageCount);
+			messageFrameReportsDrops = true;
+		}
+	}
+	writeUInt8(type);
+	messageFrameEventCount++;
 }
 
+// ------------------------
+// -- Framed User Serial --
+// ------------------------
+
+class MessagingSerialClass : public Print {
+public:
+	size_t write(uint8_t value) {
+		if (messageFrameLength > 0 && (messageFrame[0] != kFrameUserSerial || messageFrameLength + kFrameCRCLength >= MESSAGING_FRAME_SIZE)) sendFrame();
+		if (messageFrameLength == 0) {
+			beginFrame(kFrameUserSerial);
+			messageFrameEventCount = 1;
+		}
+		writeUInt8(value);
+		return 1;
+	}
+	void flush() {
+		sendFrame();
+	}
+};
+
+MessagingSerialClass MessagingSerial;
+
 // --------------
 // -- Messages --
 // --------------
 
+void sendMessageHello() {
+	sendFrame();
+	beginFrame(kFrameHello);
+	writeUInt8(kMessagingProtocolVersion);
+	writeVarint((MESSAGING_BAUD_RATE / 100) & 0xFFFF);
+	writeVarint(MESSAGING_BUFFER_SIZE);
+#ifdef MESSAGING_BUILD_ID
+	writeVarint32(MESSAGING_BUILD_ID);
+#endif
+	sendFrame();
+}
+
 void sendMessageIterationStart() {
-	writeMessageHeader(kMessageIterationStart, 0);
-	endMessage();
+	beginMessage(kMessageIterationStart);
 }
 
 void sendMessageIterationEnd() {
-	writeMessageHeader(kMessageIterationEnd, 0);
-	endMessage();
+	beginMessage(kMessageIterationEnd);
+	sendFrame(); // One frame per iteration
 }
 
-void sendMessageCurrentState(int stateID) {
-	writeMessageHeader(kMessageCurrentState, 2);
-	writeUInt16(stateID);
-	endMessage();
+void sendMessageCurrentState(SymbolID stateID) {
+	beginMessage(kMessageCurrentState);
+	writeVarint(stateID);
 }
 
-boolean sendMessageWillCheckCondition(int transitionID, int conditionID) {
-	writeMessageHeader(kMessageWillCheckCondition, 4);
-	writeUInt16(transitionID);
-	writeUInt16(conditionID);
-	endMessage();
+boolean sendMessageWillCheckCondition(SymbolID transitionID, SymbolID conditionID) {
+	beginMessage(kMessageWillCheckCondition);
+	writeVarint(transitionID);
+	writeVarint(conditionID);
 	return true; // To allow message sending from within conditionals
 }
 
-void sendMessageWillPerformTransition(int transitionID) {
-	writeMessageHeader(kMessageWillPerformTransition, 2);
-	writeUInt16(transitionID);
-	endMessage();
+void sendMessageWillPerformTransition(SymbolID transitionID) {
+	beginMessage(kMessageWillPerformTransition);
+	writeVarint(transitionID);
+}
+
+void sendMessageWillPerformAction(SymbolID transitionID, int index) {
+	beginMessage(kMessageWillPerformAction);
+	writeVarint(transitionID);
+	writeVarint(index);
+}
+
+// --------------------------
+// -- Change-only Messages --
+// --------------------------
+
+// A state machine idling in one state would otherwise log the same state and conditions on every update. These log a
+// state only when it's entered and a condition only when it returned something else than the last time it was checked
+// (or its state was just entered). Keyframes log everything, so a host that connected late or lost messages catches up.
+
+void beginMessagingUpdate() {
+	unsigned long time = millis();
+	isMessagingKeyframe = (time - lastMessagingKeyframeTime >= MESSAGING_KEYFRAME_INTERVAL);
+	if (isMessagingKeyframe) lastMessagingKeyframeTime = time;
+}
+
+void endMessagingUpdate() {
+	sendFrame(); // Otherwise the last changes wait until the next ones fill up the frame
+}
+
+void sendMessageIfStateEntered(int *loggedState, int state, SymbolID stateID) {
+	isLoggedStateEntered = (*loggedState != state);
+	if (isLoggedStateEntered || isMessagingKeyframe) sendMessageCurrentState(stateID);
+	*loggedState = state;
+}
+
+boolean sendMessageIfConditionChanged(byte *loggedResults, int index, SymbolID transitionID, SymbolID conditionID, boolean result) {
+	// One bit per transition, the result it was last logged with
+	byte mask = 1 << (index & 7);
+	boolean loggedResult = (loggedResults[index >> 3] & mask) != 0;
+	if (result != loggedResult || isLoggedStateEntered || isMessagingKeyframe) sendMessageWillCheckCondition(transitionID, conditionID);
+	if (result) loggedResults[index >> 3] |= mask;
+	else loggedResults[index >> 3] &= ~mask;
+	return result;
+}
+
+// ---------------
+// -- Profiling --
+// ---------------
+
+// Sketches written for profiling time every loop(), condition and action call with micros(), and how long each state
+// machine stays in a state, into accumulators instead of sending events. Every MESSAGING_PROFILE_INTERVAL a summary
+// goes out: for each accumulator that got samples its count, total and maximum time, after which it starts over. The
+// summary is sent a frame per iteration, once the buffer has room for one, so it neither blocks nor gets dropped.
+
+#ifdef MESSAGING_PROFILING
+
+static const byte kProfileEntryMaximumLength = 19; // Kind, id, count, total & maximum
+
+typedef enum {
+	kProfileLoop = 1,
+	kProfileSymbol = 2 // A state, condition or action, by id
+} ProfileKind;
+
+typedef struct {
+	uint32_t count;
+	uint32_t total; // Microseconds
+	uint32_t maximum;
+} ProfileAccumulator;
+
+typedef struct {
+	int state; // -1 before the first update
+	unsigned long enteredTime;
+} ProfiledState;
+
+// Written by Machino: the conditions, actions and states of all state machines, in that order
+extern const int kProfileCount;
+extern const SymbolID profileIDs[] PROGMEM;
+extern ProfileAccumulator profiles[];
+
+ProfileAccumulator loopProfile;
+unsigned long profiledIterationStartTime = 0;
+unsigned long lastProfileTime = 0;
+int profileSendIndex = -2; // -1 is the loop, then the profiles, -2 while not sending
+
+void addProfileSample(ProfileAccumulator *profile, unsigned long time) {
+	// The count stops at its maximum, along with the total, so their ratio stays the mean
+	if (profile->count < 0xFFFFFFFFUL) {
+		profile->count++;
+		profile->total += time;
+	}
+	if (time > profile->maximum) profile->maximum = time;
+}
+
+boolean profileCondition(int index, boolean (*condition)()) {
+	unsigned long startTime = micros();
+	boolean result = condition();
+	addProfileSample(&profiles[index], micros() - startTime);
+	return result;
+}
+
+void profileAction(int index, void (*action)()) {
+	unsigned long startTime = micros();
+	action();
+	addProfileSample(&profiles[index], micros() - startTime);
+}
+
+void profileState(ProfiledState *profiledState, int state, int firstIndex) {
+	// Counts a visit when the state is left
+	if (profiledState->state == state) return;
+	unsigned long time = micros();
+	if (profiledState->state >= 0) addProfileSample(&profiles[firstIndex + profiledState->state], time - profiledState->enteredTime);
+	profiledState->state = state;
+	profiledState->enteredTime = time;
+}
+
+void sendProfileFrame() {
+	sendFrame(); // Framed user serial, if any
+	if (MESSAGING_BUFFER_SIZE - messageBufferLength < MESSAGING_FRAME_SIZE + 4) return; // Next iteration
+	beginFrame(kFrameProfile);
+	while (profileSendIndex < kProfileCount && messageFrameLength + kProfileEntryMaximumLength + kFrameCRCLength <= MESSAGING_FRAME_SIZE) {
+		ProfileAccumulator *profile = (profileSendIndex < 0) ? &loopProfile : &profiles[profileSendIndex];
+		if (profile->count > 0) {
+			if (profileSendIndex < 0) {
+				writeUInt8(kProfileLoop);
+			} else {
+				writeUInt8(kProfileSymbol);
+				writeVarint(readSymbolID(&profileIDs[profileSendIndex]));
+			}
+			writeVarint32(profile->count);
+			writeVarint32(profile->total);
+			writeVarint32(profile->maximum);
+			messageFrameEventCount++;
+			memset(profile, 0, sizeof(ProfileAccumulator));
+		}
+		profileSendIndex++;
+	}
+	if (profileSendIndex == kProfileCount) profileSendIndex = -2;
+	if (messageFrameEventCount > 0) sendFrame();
+	else messageFrameLength = 0;
+}
+
+void beginProfiledIteration() {
+	profiledIterationStartTime = micros();
+}
+
+void endProfiledIteration() {
+	addProfileSample(&loopProfile, micros() - profiledIterationStartTime);
+	unsigned long time = millis();
+	if (profileSendIndex == -2 && time - lastProfileTime >= MESSAGING_PROFILE_INTERVAL) {
+		lastProfileTime = time;
+		profileSendIndex = -1;
+	}
+	if (profileSendIndex != -2) sendProfileFrame();
+	else sendFrame();
+	sendBufferedMessages();
 }
 
-void sendMessageWillPerformAction(int transitionID, int index) {
-	writeMessageHeader(kMessageWillPerformAction, 4);
-	writeUInt16(transitionID);
-	writeUInt16(index);
-	endMessage();
-}
\ No newline at end of file
+#endif
\ No newline at end of file
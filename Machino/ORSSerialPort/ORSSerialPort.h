@@ -25,7 +25,11 @@
 //	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #import <Foundation/Foundation.h>
+#ifdef __APPLE__
 #import <IOKit/IOTypes.h>
+#else
+typedef unsigned int io_object_t; // No I/O Registry, ports are only known by their path
+#endif
 #import <termios.h>
 
 //#define LOG_SERIAL_PORT_ERRORS 
@@ -48,23 +52,36 @@ enum {
 - (void)serialPort:(ORSSerialPort *)serialPort didEncounterError:(NSError *)error;
 - (void)serialPortWasOpened:(ORSSerialPort *)serialPort;
 - (void)serialPortWasClosed:(ORSSerialPort *)serialPort;
+- (void)serialPort:(ORSSerialPort *)serialPort writeQueueDidFillToLength:(NSUInteger)length; // Reached writeQueueHighWatermark
+- (void)serialPort:(ORSSerialPort *)serialPort writeQueueDidDrainToLength:(NSUInteger)length; // Back down to writeQueueLowWatermark
 
 @end
 
 @interface ORSSerialPort : NSObject
 
-+ (ORSSerialPort *)serialPortWithPath:(NSString *)devicePath;
-+ (ORSSerialPort *)serialPortWithDevice:(io_object_t)device;
-
++ (ORSSerialPort *)serialPortWithPath:(NSString *)devicePath; // Also takes devices outside the I/O Registry, like pseudo-terminals
 - (id)initWithPath:(NSString *)devicePath;
+#ifdef __APPLE__
++ (ORSSerialPort *)serialPortWithDevice:(io_object_t)device;
 - (id)initWithDevice:(io_object_t)device;
+#endif
 
 - (void)open;
 - (BOOL)close;
 - (void)cleanup;
 - (BOOL)sendData:(NSData *)data;
+// Queues data for a writer of its own and returns right away. The completion is called on the delegate queue once all of
+// it went to the driver, or with NO if the port closed or failed first.
+- (BOOL)sendData:(NSData *)data completion:(void(^)(BOOL sent))completion;
 
 @property (nonatomic, unsafe_unretained) id<ORSSerialPortDelegate> delegate;
+// Received data, errors, removal & pin changes are delivered on this serial queue (default: main). Reads that come in
+// while a delivery is still queued are batched into it.
+#if OS_OBJECT_HAVE_OBJC_SUPPORT
+@property (nonatomic, strong) dispatch_queue_t delegateQueue;
+#else
+@property (nonatomic) dispatch_queue_t delegateQueue;
+#endif
 
 // Port settings
 @property (readonly, getter = isOpen) BOOL open;
@@ -78,8 +95,16 @@ enum {
 @property (nonatomic) BOOL usesRTSCTSFlowControl;
 @property (nonatomic) BOOL usesDTRDSRFlowControl;
 @property (nonatomic) BOOL usesDCDOutputFlowControl;
+@property (nonatomic) BOOL usesLowLatency; // Reads return without waiting between bytes, and the driver is asked not to hold data back
+
+// Write queue
+@property (readonly) NSUInteger queuedWriteLength; // Bytes sent but not yet taken by the driver
+@property (readonly, getter = isWriteQueueFull) BOOL writeQueueFull; // From reaching the high watermark until draining to the low one
+@property (nonatomic) NSUInteger writeQueueHighWatermark; // Default: 64 KB
+@property (nonatomic) NSUInteger writeQueueLowWatermark; // Default: 16 KB
 
 // Port pins
+@property (nonatomic) BOOL pollsPins; // CTS, DSR & DCD are only kept up to date when set (default: NO)
 @property (nonatomic) BOOL RTS;
 @property (nonatomic) BOOL DTR;
 @property (nonatomic, readonly) BOOL CTS;
@@ -25,11 +25,20 @@
 //	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #import "ORSSerialPort.h"
+#ifdef __APPLE__
 #import <IOKit/serial/IOSerialKeys.h>
 #import <IOKit/serial/ioss.h>
-#import <sys/param.h>
 #import <sys/filio.h>
+#endif
+#ifdef __linux__
+#import <sys/epoll.h>
+#import <sys/eventfd.h>
+#import <linux/serial.h>
+#endif
+#import <sys/param.h>
 #import <sys/ioctl.h>
+#import <sys/stat.h>
+#import <sys/uio.h>
 
 #if !__has_feature(objc_arc)
 	#error ORSSerialPort.m must be compiled with ARC. Either turn on ARC for the project or set the -fobjc-arc flag for ORSSerialPort.m in the Build Phases for this target
@@ -49,20 +58,66 @@
 #define LOG_SERIAL_PORT_ERROR(fmt, ...) 
 #endif
 
+// Linux has no DTR/DSR or DCD flow control
+#ifndef CDTR_IFLOW
+#define CDTR_IFLOW 0
+#define CDSR_OFLOW 0
+#endif
+#ifndef CCAR_OFLOW
+#define CCAR_OFLOW 0
+#endif
+
+static const size_t kReadBufferSize = 65536;
+static const int kMaximumWriteVectors = 64; // Queued buffers handed to one writev()
+
 static __strong NSMutableArray *allSerialPorts;
 
+// A -sendData: that is (partly) still waiting in the write queue
+@interface ORSSerialPortWrite : NSObject
+
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic) NSUInteger offset; // Bytes already written
+@property (nonatomic, copy) void (^completion)(BOOL sent);
+
+@end
+
+@implementation ORSSerialPortWrite
+@end
+
 @interface ORSSerialPort ()
 {	
 	struct termios originalPortAttributes;
+	uint8_t *readBuffer; // Reused for every read
+	NSMutableData *receivedData; // Read but not yet delivered, guarded by @synchronized(self)
+	BOOL deliveryPending;
+	dispatch_group_t writeSources; // Entered for each write source, left by its cancel handler once it's done with the descriptor
+#ifdef __linux__
+	int wakeDescriptor; // Interrupts the reader's epoll_wait() on close
+	dispatch_semaphore_t readerExited; // Signaled once the reader is done with the descriptor
+#endif
 }
 
 + (void)addSerialPort:(ORSSerialPort *)port;
 + (void)removeSerialPort:(ORSSerialPort *)port;
 + (ORSSerialPort *)existingPortWithPath:(NSString *)path;
 
+- (id)initWithPath:(NSString *)devicePath device:(io_object_t)device name:(NSString *)name;
+
 - (void)receiveData:(NSData *)data;
+- (BOOL)readFromDescriptor:(int)descriptor;
+- (void)deliverBytes:(const void *)bytes length:(size_t)length;
+- (void)handleHangup;
+- (void)writePendingData;
+- (void)didWriteLength:(NSUInteger)length;
+- (void)dequeueWriteLength:(NSUInteger)length;
+- (void)finishWrite:(ORSSerialPortWrite *)write sent:(BOOL)sent;
+- (void)failPendingWrites;
+- (void)startPinPolling;
+- (void)stopPinPolling;
 
 - (void)setPortOptions;
+- (void)setLowLatencyOptions;
+#ifdef __APPLE__
 + (io_object_t)deviceFromBSDPath:(NSString *)bsdPath;
 + (NSString *)stringPropertyOf:(io_object_t)aDevice forIOSerialKey:(NSString *)key;
 + (NSString *)bsdCalloutPathFromDevice:(io_object_t)aDevice;
@@ -71,6 +126,7 @@ static __strong NSMutableArray *allSerialPorts;
 + (NSString *)serviceTypeFromDevice:(io_object_t)aDevice;
 + (NSString *)modemNameFromDevice:(io_object_t)aDevice;
 + (NSString *)suffixFromDevice:(io_object_t)aDevice;
+#endif
 
 - (void)notifyDelegateOfPosixError;
 
@@ -78,7 +134,7 @@ static __strong NSMutableArray *allSerialPorts;
 @property (readwrite) io_object_t IOKitDevice;
 @property (copy, readwrite) NSString *name;
 
-@property (strong) NSMutableData *writeBuffer;
+@property (strong) NSMutableArray *pendingWrites; // Of ORSSerialPortWrite, only touched on writeQueue
 @property int fileDescriptor;
 
 @property (nonatomic, readwrite) BOOL CTS;
@@ -87,8 +143,12 @@ static __strong NSMutableArray *allSerialPorts;
 
 #if OS_OBJECT_HAVE_OBJC_SUPPORT
 @property (nonatomic, strong) dispatch_source_t pinPollTimer;
+@property (nonatomic, strong) dispatch_queue_t writeQueue;
+@property (nonatomic, strong) dispatch_source_t writeSource; // While waiting for the port to take more
 #else
 @property (nonatomic) dispatch_source_t pinPollTimer;
+@property (nonatomic) dispatch_queue_t writeQueue;
+@property (nonatomic) dispatch_source_t writeSource; // While waiting for the port to take more
 #endif
 
 @end
@@ -140,28 +200,40 @@ static __strong NSMutableArray *allSerialPorts;
  	return [[self alloc] initWithPath:devicePath];
 }
 
-+ (ORSSerialPort *)serialPortWithDevice:(io_object_t)device;
+- (id)initWithPath:(NSString *)devicePath
 {
-	return [[self alloc] initWithDevice:device];
+#ifdef __APPLE__
+ 	io_object_t device = [[self class] deviceFromBSDPath:devicePath];
+ 	if (device != 0) return [self initWithDevice:device];
+#endif
+	
+	// Not in the I/O Registry (Linux, pseudo-terminals), so only known by its path
+	struct stat deviceInfo;
+	if ([devicePath length] < 1 || stat([devicePath fileSystemRepresentation], &deviceInfo) != 0 || !S_ISCHR(deviceInfo.st_mode))
+	{
+		self = nil;
+		return self;
+	}
+	
+	return [self initWithPath:devicePath device:0 name:[devicePath lastPathComponent]];
 }
 
-- (id)initWithPath:(NSString *)devicePath
+#ifdef __APPLE__
++ (ORSSerialPort *)serialPortWithDevice:(io_object_t)device;
 {
- 	io_object_t device = [[self class] deviceFromBSDPath:devicePath];
- 	if (device == 0) 
- 	{
- 		self = nil;
- 		return self;
- 	}
- 	
- 	return [self initWithDevice:device];
+	return [[self alloc] initWithDevice:device];
 }
 
 - (id)initWithDevice:(io_object_t)device;
 {
 	NSAssert(device != 0, @"%s requires non-zero device argument.", __PRETTY_FUNCTION__);
 	
-	NSString *bsdPath = [[self class] bsdCalloutPathFromDevice:device];
+	return [self initWithPath:[[self class] bsdCalloutPathFromDevice:device] device:device name:[[self class] modemNameFromDevice:device]];
+}
+#endif
+
+- (id)initWithPath:(NSString *)bsdPath device:(io_object_t)device name:(NSString *)name
+{
 	ORSSerialPort *existingPort = [[self class] existingPortWithPath:bsdPath];
 	
 	if (existingPort != nil)
@@ -176,8 +248,15 @@ static __strong NSMutableArray *allSerialPorts;
 	{
 		self.ioKitDevice = device;
 		self.path = bsdPath;
-		self.name = [[self class] modemNameFromDevice:device];
-		self.writeBuffer = [NSMutableData data];
+		self.name = name;
+		self.pendingWrites = [NSMutableArray array];
+		self.writeQueueHighWatermark = 65536;
+		self.writeQueueLowWatermark = 16384;
+		self.delegateQueue = dispatch_get_main_queue();
+		writeSources = dispatch_group_create();
+#ifdef __linux__
+		wakeDescriptor = -1;
+#endif
 		self.baudRate = @B19200;
 		self.numberOfStopBits = 1;
 		self.parity = ORSSerialPortParityNone;
@@ -209,6 +288,10 @@ static __strong NSMutableArray *allSerialPorts;
 		dispatch_source_cancel(_pinPollTimer);
 		ORS_GCD_RELEASE(_pinPollTimer);
 	}
+	if (_delegateQueue) { ORS_GCD_RELEASE(_delegateQueue); }
+	if (_writeQueue) { ORS_GCD_RELEASE(_writeQueue); }
+	if (writeSources) { ORS_GCD_RELEASE(writeSources); }
+	free(readBuffer);
 }
 
 - (NSString *)description
@@ -237,26 +320,37 @@ static __strong NSMutableArray *allSerialPorts;
 {
 	if (self.isOpen) return;
 	
-	dispatch_queue_t mainQueue = dispatch_get_main_queue();
+	dispatch_queue_t delegateQueue = self.delegateQueue;
 	
 	int descriptor=0;
+#ifdef O_EXLOCK
 	descriptor = open([self.path cStringUsingEncoding:NSASCIIStringEncoding], O_RDWR | O_NOCTTY | O_EXLOCK | O_NONBLOCK);
+#else
+	descriptor = open([self.path cStringUsingEncoding:NSASCIIStringEncoding], O_RDWR | O_NOCTTY | O_NONBLOCK);
+	// No O_EXLOCK, so keep others out by making the tty exclusive instead
+	if (descriptor > 0 && ioctl(descriptor, TIOCEXCL) == -1)
+	{
+		LOG_SERIAL_PORT_ERROR(@"Error setting TIOCEXCL on %@ - %s(%d).\n", self.path, strerror(errno), errno);
+	}
+#endif
 	if (descriptor < 1) 
 	{
 		// Error			
-		dispatch_async(mainQueue,  ^{ [self notifyDelegateOfPosixError]; });
+		dispatch_async(delegateQueue,  ^{ [self notifyDelegateOfPosixError]; });
 		return;
 	}
 	
-	// Now that the device is open, clear the O_NONBLOCK flag so subsequent I/O will block.
-	// See fcntl(2) ("man 2 fcntl") for details.
+	// The port stays non-blocking: the reader only reads once select()/epoll says there's data, and the writer
+	// waits on a dispatch source when the driver won't take more
 	
-	if (fcntl(descriptor, F_SETFL, 0) == -1)
+	self.fileDescriptor = descriptor;
+	if (self.writeQueue == nil)
 	{
-		LOG_SERIAL_PORT_ERROR(@"Error clearing O_NONBLOCK %@ - %s(%d).\n", self.path, strerror(errno), errno);
+		dispatch_queue_t writeQueue = dispatch_queue_create("com.openreelsoftware.ORSSerialPort.write", DISPATCH_QUEUE_SERIAL);
+		self.writeQueue = writeQueue;
+		ORS_GCD_RELEASE(writeQueue);
 	}
-	
-	self.fileDescriptor = descriptor;
+	if (readBuffer == NULL) readBuffer = malloc(kReadBufferSize);
 	
 	// Port opened successfully, set options
 	tcgetattr(descriptor, &originalPortAttributes); // Get original options so they can be reset later
@@ -264,10 +358,10 @@ static __strong NSMutableArray *allSerialPorts;
 	
 	// Get status of RTS and DTR lines
 	int modemLines=0;
-	if (ioctl(self.fileDescriptor, TIOCMGET, &modemLines) < 0)
+	if (ioctl(self.fileDescriptor, TIOCMGET, &modemLines) < 0 && errno != ENOTTY) // Linux pseudo-terminals have no modem lines
 	{
 		LOG_SERIAL_PORT_ERROR(@"Error reading modem lines status");
-		dispatch_async(mainQueue, ^{[self notifyDelegateOfPosixError];});
+		dispatch_async(delegateQueue, ^{[self notifyDelegateOfPosixError];});
 	}
 	
 	BOOL desiredRTS = self.RTS;
@@ -277,13 +371,68 @@ static __strong NSMutableArray *allSerialPorts;
 	self.RTS = desiredRTS;
 	self.DTR = desiredDTR;
 	
-	dispatch_async(mainQueue, ^{
+	dispatch_async(delegateQueue, ^{
 		if ([(id)self.delegate respondsToSelector:@selector(serialPortWasOpened:)])
 		{
 			[self.delegate serialPortWasOpened:self];
 		}
 	});
 	
+#ifdef __linux__
+	// Start a reader in the background, sleeping in epoll_wait() until there's data or the port is closed
+	int epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+	int localWakeDescriptor = eventfd(0, EFD_CLOEXEC);
+	struct epoll_event portEvent = { .events = EPOLLIN, .data.fd = descriptor };
+	struct epoll_event wakeEvent = { .events = EPOLLIN, .data.fd = localWakeDescriptor };
+	if (epollDescriptor < 0 || localWakeDescriptor < 0 ||
+		epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &portEvent) < 0 ||
+		epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, localWakeDescriptor, &wakeEvent) < 0)
+	{
+		LOG_SERIAL_PORT_ERROR(@"Error setting up epoll for %@ - %s(%d).\n", self.path, strerror(errno), errno);
+		dispatch_async(delegateQueue, ^{[self notifyDelegateOfPosixError];});
+		if (epollDescriptor >= 0) close(epollDescriptor);
+		if (localWakeDescriptor >= 0) close(localWakeDescriptor);
+		[self close];
+		return;
+	}
+	wakeDescriptor = localWakeDescriptor;
+	dispatch_semaphore_t localReaderExited = dispatch_semaphore_create(0);
+	readerExited = localReaderExited;
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+		
+		struct epoll_event events[2];
+		BOOL woken = NO;
+		
+		while (!woken)
+		{
+			int count = epoll_wait(epollDescriptor, events, 2, -1);
+			if (count < 0)
+			{
+				if (errno == EINTR) continue;
+				dispatch_async(delegateQueue, ^{[self notifyDelegateOfPosixError];});
+				break;
+			}
+			
+			for (int i = 0; i < count; i++)
+			{
+				if (events[i].data.fd == localWakeDescriptor)
+				{
+					woken = YES;
+				}
+				else if (!woken && ![self readFromDescriptor:descriptor])
+				{
+					// Hung up, wait for the close
+					epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, descriptor, NULL);
+				}
+			}
+		}
+		
+		// The eventfd is left to close(), which still writes to it
+		close(epollDescriptor);
+		dispatch_semaphore_signal(localReaderExited);
+	});
+#else
 	// Start a read poller in the background
 	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
 		
@@ -304,63 +453,26 @@ static __strong NSMutableArray *allSerialPorts;
 			if (!self.isOpen) break; // Port closed while select call was waiting
 			if (result < 0) 
 			{
-				dispatch_sync(mainQueue, ^{[self notifyDelegateOfPosixError];});
+				dispatch_sync(delegateQueue, ^{[self notifyDelegateOfPosixError];});
 				continue;
 			}
 			
 			if (result == 0 || !FD_ISSET(localPortFD, &localReadFDSet)) continue;
 			
 			// Data is available
-			char buf[1024];
-			long lengthRead = read(localPortFD, buf, sizeof(buf));
-			if (lengthRead>0)
-			{
-				NSData *readData = [NSData dataWithBytes:buf length:lengthRead];
-				if (readData != nil) dispatch_async(dispatch_get_main_queue(), ^{
-					[self receiveData:readData];
-				});
-			}
+			if (![self readFromDescriptor:localPortFD]) break;
 		}
 	});
+#endif
 	
-	// Start another poller to check status of CTS and DSR
-	dispatch_queue_t pollQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
-	dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, pollQueue);
-	dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, 0), 10*NSEC_PER_MSEC, 5*NSEC_PER_MSEC);
-	dispatch_source_set_event_handler(timer, ^{
-		if (!self.isOpen) {
-			dispatch_async(pollQueue, ^{ dispatch_source_cancel(timer); });
-			return;
-		}
-		
-		int32_t modemLines=0;
-		if (ioctl(self.fileDescriptor, TIOCMGET, &modemLines) < 0)
-		{
-			dispatch_sync(mainQueue, ^{[self notifyDelegateOfPosixError];});
-			return;
-		}
-		
-		BOOL CTSPin = (modemLines & TIOCM_CTS) != 0;
-		BOOL DSRPin = (modemLines & TIOCM_DSR) != 0;
-		BOOL DCDPin = (modemLines & TIOCM_CAR) != 0;
-		
-		if (CTSPin != self.CTS) 
-			dispatch_sync(mainQueue, ^{self.CTS = CTSPin;});
-		if (DSRPin != self.DSR) 
-			dispatch_sync(mainQueue, ^{self.DSR = DSRPin;});
-		if (DCDPin != self.DCD) 
-			dispatch_sync(mainQueue, ^{self.DCD = DCDPin;});
-	});
-	self.pinPollTimer = timer;
-	dispatch_resume(self.pinPollTimer);
-	ORS_GCD_RELEASE(timer);
+	if (self.pollsPins) [self startPinPolling];
 }
 
 - (BOOL)close;
 {
 	if (!self.isOpen) return YES;
 	
-	[self.writeBuffer replaceBytesInRange:NSMakeRange(0, [self.writeBuffer length]) withBytes:NULL length:0];
+	[self stopPinPolling];
 	
 	// The next tcsetattr() call can fail if the port is waiting to send data. This is likely to happen
 	// e.g. if flow control is on and the CTS line is low. So, turn off flow control before proceeding
@@ -377,6 +489,25 @@ static __strong NSMutableArray *allSerialPorts;
 	int localFD = self.fileDescriptor;
 	self.fileDescriptor = 0; // So other threads know that the port should be closed and can stop I/O operations
 	
+	// Stop the writer before the descriptor goes away, failing what it hasn't written, and wait for the cancel handlers
+	// of its write sources, GCD can use the descriptor until they've run
+	dispatch_sync(self.writeQueue, ^{ [self failPendingWrites]; });
+	dispatch_group_wait(writeSources, DISPATCH_TIME_FOREVER);
+	
+#ifdef __linux__
+	// Stop the reader before the descriptor goes away too, its number could be reused for another file right after
+	if (wakeDescriptor >= 0)
+	{
+		uint64_t wake = 1;
+		if (write(wakeDescriptor, &wake, sizeof(wake)) < 0) LOG_SERIAL_PORT_ERROR(@"Error waking serial port reader:%d", errno);
+		else dispatch_semaphore_wait(readerExited, DISPATCH_TIME_FOREVER);
+		close(wakeDescriptor);
+		wakeDescriptor = -1;
+		ORS_GCD_RELEASE(readerExited);
+		readerExited = NULL;
+	}
+#endif
+	
 	if (close(localFD))
 	{
 		self.fileDescriptor = localFD;
@@ -401,21 +532,48 @@ static __strong NSMutableArray *allSerialPorts;
 }
 
 - (BOOL)sendData:(NSData *)data;
+{
+	return [self sendData:data completion:nil];
+}
+
+- (BOOL)sendData:(NSData *)data completion:(void(^)(BOOL sent))completion;
 {
 	if (!self.isOpen) return NO;
 	
-	[self.writeBuffer appendData:data];
+	ORSSerialPortWrite *write = [[ORSSerialPortWrite alloc] init];
+	write.data = [data copy];
+	write.completion = completion;
 	
-	if ([self.writeBuffer length] < 1) return YES;
-	
-	long numBytesWritten = write(self.fileDescriptor, [self.writeBuffer bytes], [self.writeBuffer length]);
-	if (numBytesWritten < 0)
+	// Counted right away, so a sender checking writeQueueFull in a loop sees it fill up
+	BOOL didFill = NO;
+	NSUInteger queuedLength = 0;
+	@synchronized(self)
 	{
-		LOG_SERIAL_PORT_ERROR(@"Error writing to serial port:%d", errno);
-		[self notifyDelegateOfPosixError];
-		return NO;
+		_queuedWriteLength += [write.data length];
+		queuedLength = _queuedWriteLength;
+		if (!_writeQueueFull && queuedLength >= self.writeQueueHighWatermark)
+		{
+			_writeQueueFull = YES;
+			didFill = YES;
+		}
 	}
-	if (numBytesWritten > 0) [self.writeBuffer replaceBytesInRange:NSMakeRange(0, numBytesWritten) withBytes:NULL length:0];
+	if (didFill) dispatch_async(self.delegateQueue, ^{
+		if ([(id)self.delegate respondsToSelector:@selector(serialPort:writeQueueDidFillToLength:)])
+		{
+			[self.delegate serialPort:self writeQueueDidFillToLength:queuedLength];
+		}
+	});
+	
+	dispatch_async(self.writeQueue, ^{
+		if (!self.isOpen)
+		{
+			[self dequeueWriteLength:[write.data length]];
+			[self finishWrite:write sent:NO];
+			return;
+		}
+		[self.pendingWrites addObject:write];
+		if (self.writeSource == nil) [self writePendingData]; // Otherwise already waiting for the port
+	});
 	
 	return YES;
 }
@@ -432,6 +590,226 @@ static __strong NSMutableArray *allSerialPorts;
 	}
 }
 
+- (BOOL)readFromDescriptor:(int)descriptor;
+{
+	long lengthRead = read(descriptor, readBuffer, kReadBufferSize);
+	if (lengthRead > 0)
+	{
+		[self deliverBytes:readBuffer length:lengthRead];
+		return YES;
+	}
+	if (lengthRead < 0 && (errno == EINTR || errno == EAGAIN)) return YES;
+	
+	// End of file or EIO: the device is gone, or the other end of a pseudo-terminal closed
+	if (self.isOpen) dispatch_async(self.delegateQueue, ^{ [self handleHangup]; });
+	return NO;
+}
+
+- (void)deliverBytes:(const void *)bytes length:(size_t)length;
+{
+	// Reads that come in while a delivery is still queued join it, so a busy delegate queue gets fewer, bigger batches
+	BOOL needsDelivery = NO;
+	@synchronized(self)
+	{
+		if (receivedData == nil) receivedData = [NSMutableData dataWithCapacity:length];
+		[receivedData appendBytes:bytes length:length];
+		needsDelivery = !deliveryPending;
+		deliveryPending = YES;
+	}
+	if (!needsDelivery) return;
+	
+	dispatch_async(self.delegateQueue, ^{
+		NSData *data = nil;
+		@synchronized(self)
+		{
+			data = receivedData;
+			receivedData = nil;
+			deliveryPending = NO;
+		}
+		[self receiveData:data];
+	});
+}
+
+- (void)handleHangup;
+{
+	if (!self.isOpen) return;
+	[self cleanup];
+}
+
+- (void)writePendingData;
+{
+	int descriptor = self.fileDescriptor;
+	if (descriptor == 0)
+	{
+		[self failPendingWrites];
+		return;
+	}
+	
+	while ([self.pendingWrites count] > 0)
+	{
+		// Gather as many queued buffers as one writev() takes
+		struct iovec vectors[kMaximumWriteVectors];
+		int vectorCount = 0;
+		for (ORSSerialPortWrite *write in self.pendingWrites)
+		{
+			if (vectorCount == kMaximumWriteVectors) break;
+			vectors[vectorCount].iov_base = (uint8_t *)[write.data bytes] + write.offset;
+			vectors[vectorCount].iov_len = [write.data length] - write.offset;
+			vectorCount++;
+		}
+		
+		long lengthWritten = writev(descriptor, vectors, vectorCount);
+		if (lengthWritten < 0 && errno == EINTR) continue;
+		if (lengthWritten < 0 && errno != EAGAIN)
+		{
+			int error = errno;
+			LOG_SERIAL_PORT_ERROR(@"Error writing to serial port:%d", error);
+			dispatch_async(self.delegateQueue, ^{
+				errno = error;
+				[self notifyDelegateOfPosixError];
+			});
+			[self failPendingWrites];
+			return;
+		}
+		NSUInteger pendingCount = [self.pendingWrites count];
+		if (lengthWritten > 0 || vectors[0].iov_len == 0) [self didWriteLength:MAX(lengthWritten, 0)];
+		if (lengthWritten > 0 || [self.pendingWrites count] < pendingCount) continue;
+		
+		// The driver is full, carry on when it takes more
+		if (self.writeSource == nil)
+		{
+			dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_WRITE, descriptor, 0, self.writeQueue);
+			dispatch_source_set_event_handler(source, ^{
+				[self writePendingData];
+			});
+			dispatch_group_t group = writeSources;
+			dispatch_group_enter(group);
+			dispatch_source_set_cancel_handler(source, ^{
+				dispatch_group_leave(group);
+			});
+			self.writeSource = source;
+			dispatch_resume(self.writeSource);
+			ORS_GCD_RELEASE(source);
+		}
+		return;
+	}
+	
+	if (self.writeSource)
+	{
+		dispatch_source_cancel(self.writeSource);
+		self.writeSource = nil;
+	}
+}
+
+- (void)didWriteLength:(NSUInteger)length;
+{
+	NSUInteger remainingLength = length;
+	while ([self.pendingWrites count] > 0)
+	{
+		ORSSerialPortWrite *write = self.pendingWrites[0];
+		NSUInteger unwrittenLength = [write.data length] - write.offset;
+		if (remainingLength < unwrittenLength)
+		{
+			write.offset += remainingLength;
+			break;
+		}
+		remainingLength -= unwrittenLength;
+		[self.pendingWrites removeObjectAtIndex:0];
+		[self finishWrite:write sent:YES];
+	}
+	[self dequeueWriteLength:length];
+}
+
+- (void)dequeueWriteLength:(NSUInteger)length;
+{
+	BOOL didDrain = NO;
+	NSUInteger queuedLength = 0;
+	@synchronized(self)
+	{
+		_queuedWriteLength -= length;
+		queuedLength = _queuedWriteLength;
+		if (_writeQueueFull && queuedLength <= self.writeQueueLowWatermark)
+		{
+			_writeQueueFull = NO;
+			didDrain = YES;
+		}
+	}
+	if (didDrain) dispatch_async(self.delegateQueue, ^{
+		if ([(id)self.delegate respondsToSelector:@selector(serialPort:writeQueueDidDrainToLength:)])
+		{
+			[self.delegate serialPort:self writeQueueDidDrainToLength:queuedLength];
+		}
+	});
+}
+
+- (void)finishWrite:(ORSSerialPortWrite *)write sent:(BOOL)sent;
+{
+	if (write.completion == nil) return;
+	void (^completion)(BOOL sent) = write.completion;
+	dispatch_async(self.delegateQueue, ^{ completion(sent); });
+}
+
+- (void)failPendingWrites;
+{
+	if (self.writeSource)
+	{
+		dispatch_source_cancel(self.writeSource);
+		self.writeSource = nil;
+	}
+	
+	NSUInteger unwrittenLength = 0;
+	for (ORSSerialPortWrite *write in self.pendingWrites)
+	{
+		unwrittenLength += [write.data length] - write.offset;
+		[self finishWrite:write sent:NO];
+	}
+	[self.pendingWrites removeAllObjects];
+	[self dequeueWriteLength:unwrittenLength];
+}
+
+#pragma mark Port Pins
+
+- (void)startPinPolling;
+{
+	if (self.pinPollTimer) return;
+	
+	// Check the status of CTS, DSR & DCD
+	dispatch_queue_t pollQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, pollQueue);
+	dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, 0), 10*NSEC_PER_MSEC, 5*NSEC_PER_MSEC);
+	dispatch_source_set_event_handler(timer, ^{
+		if (!self.isOpen) return;
+		
+		int32_t modemLines=0;
+		if (ioctl(self.fileDescriptor, TIOCMGET, &modemLines) < 0)
+		{
+			if (errno != ENOTTY) dispatch_async(self.delegateQueue, ^{[self notifyDelegateOfPosixError];});
+			return;
+		}
+		
+		BOOL CTSPin = (modemLines & TIOCM_CTS) != 0;
+		BOOL DSRPin = (modemLines & TIOCM_DSR) != 0;
+		BOOL DCDPin = (modemLines & TIOCM_CAR) != 0;
+		
+		if (CTSPin != self.CTS) 
+			dispatch_async(self.delegateQueue, ^{self.CTS = CTSPin;});
+		if (DSRPin != self.DSR) 
+			dispatch_async(self.delegateQueue, ^{self.DSR = DSRPin;});
+		if (DCDPin != self.DCD) 
+			dispatch_async(self.delegateQueue, ^{self.DCD = DCDPin;});
+	});
+	self.pinPollTimer = timer;
+	dispatch_resume(self.pinPollTimer);
+	ORS_GCD_RELEASE(timer);
+}
+
+- (void)stopPinPolling;
+{
+	if (!self.pinPollTimer) return;
+	dispatch_source_cancel(self.pinPollTimer);
+	self.pinPollTimer = nil;
+}
+
 #pragma mark Port Propeties Methods
 
 - (void)setPortOptions;
@@ -444,7 +822,7 @@ static __strong NSMutableArray *allSerialPorts;
 	
 	cfmakeraw(&options);
 	options.c_cc[VMIN] = 1; // Wait for at least 1 character before returning
-	options.c_cc[VTIME] = 2; // Wait 200 milliseconds between bytes before returning from read
+	options.c_cc[VTIME] = self.usesLowLatency ? 0 : 2; // Wait 200 milliseconds between bytes before returning from read
 	
 	// Set 8 data bits
 	options.c_cflag &= ~CSIZE;
@@ -484,8 +862,35 @@ static __strong NSMutableArray *allSerialPorts;
 	// TODO: Call delegate error handling method if this fails
 	int result = tcsetattr(self.fileDescriptor, TCSANOW, &options);
 	if (result != 0) NSLog(@"Unable to set options on %@: %i", self, result);
+	
+	[self setLowLatencyOptions];
+}
+
+- (void)setLowLatencyOptions;
+{
+#ifdef __linux__
+	// Only UARTs & some USB adapters have these, pseudo-terminals don't
+	struct serial_struct serialInfo;
+	if (ioctl(self.fileDescriptor, TIOCGSERIAL, &serialInfo) < 0) return;
+	int flags = self.usesLowLatency ? (serialInfo.flags | ASYNC_LOW_LATENCY) : (serialInfo.flags & ~ASYNC_LOW_LATENCY);
+	if (flags == serialInfo.flags) return;
+	serialInfo.flags = flags;
+	if (ioctl(self.fileDescriptor, TIOCSSERIAL, &serialInfo) < 0)
+	{
+		LOG_SERIAL_PORT_ERROR(@"Error setting ASYNC_LOW_LATENCY on %@ - %s(%d).\n", self.path, strerror(errno), errno);
+	}
+#elif defined(IOSSDATALAT)
+	if (!self.usesLowLatency) return;
+	unsigned long latency = 1; // Microseconds the driver may hold received data back
+	if (ioctl(self.fileDescriptor, IOSSDATALAT, &latency) < 0)
+	{
+		LOG_SERIAL_PORT_ERROR(@"Error setting IOSSDATALAT on %@ - %s(%d).\n", self.path, strerror(errno), errno);
+	}
+#endif
 }
 
+#ifdef __APPLE__
+
 + (io_object_t)deviceFromBSDPath:(NSString *)bsdPath;
 {
 	if ([bsdPath length] < 1) return 0;
@@ -560,6 +965,8 @@ static __strong NSMutableArray *allSerialPorts;
 	return [self stringPropertyOf:aDevice forIOSerialKey:(NSString*)CFSTR(kIOTTYSuffixKey)];
 }
 
+#endif
+
 #pragma mark Helper Methods
 
 - (void)notifyDelegateOfPosixError;
@@ -589,6 +996,18 @@ static __strong NSMutableArray *allSerialPorts;
 
 @synthesize delegate = _delegate;
 
+@synthesize delegateQueue = _delegateQueue;
+- (void)setDelegateQueue:(dispatch_queue_t)queue
+{
+	if (queue == nil) queue = dispatch_get_main_queue();
+	if (queue != _delegateQueue)
+	{
+		ORS_GCD_RETAIN(queue);
+		if (_delegateQueue) ORS_GCD_RELEASE(_delegateQueue);
+		_delegateQueue = queue;
+	}
+}
+
 #pragma mark Port Properties
 
 - (BOOL)isOpen { return self.fileDescriptor != 0; }
@@ -599,9 +1018,13 @@ static __strong NSMutableArray *allSerialPorts;
 - (void)setIoKitDevice:(io_object_t)device
 {
 	if (device != _IOKitDevice) {
+#ifdef __APPLE__
 		if (_IOKitDevice) IOObjectRelease(_IOKitDevice);
 		_IOKitDevice = device;
 		if (_IOKitDevice) IOObjectRetain(_IOKitDevice);
+#else
+		_IOKitDevice = device;
+#endif
 	}
 }
 
@@ -705,6 +1128,16 @@ static __strong NSMutableArray *allSerialPorts;
 	}
 }
 
+@synthesize usesLowLatency = _usesLowLatency;
+- (void)setUsesLowLatency:(BOOL)flag
+{
+	if (flag != _usesLowLatency)
+	{
+		_usesLowLatency = flag;
+		[self setPortOptions];
+	}
+}
+
 @synthesize RTS = _RTS;
 - (void)setRTS:(BOOL)flag
 {
@@ -720,7 +1153,7 @@ static __strong NSMutableArray *allSerialPorts;
 		if (ioctl( self.fileDescriptor, TIOCMSET, &bits ) < 0)
 		{
 			LOG_SERIAL_PORT_ERROR(@"Error in %s", __PRETTY_FUNCTION__);
-			dispatch_async(dispatch_get_main_queue(), ^{[self notifyDelegateOfPosixError];});
+			dispatch_async(self.delegateQueue, ^{[self notifyDelegateOfPosixError];});
 		}
 	}
 }
@@ -740,7 +1173,7 @@ static __strong NSMutableArray *allSerialPorts;
 		if (ioctl( self.fileDescriptor, TIOCMSET, &bits ) < 0)
 		{
 			LOG_SERIAL_PORT_ERROR(@"Error in %s", __PRETTY_FUNCTION__);
-			dispatch_async(dispatch_get_main_queue(), ^{[self notifyDelegateOfPosixError];});
+			dispatch_async(self.delegateQueue, ^{[self notifyDelegateOfPosixError];});
 		}
 	}
 }
@@ -749,9 +1182,37 @@ static __strong NSMutableArray *allSerialPorts;
 @synthesize DSR = _DSR;
 @synthesize DCD = _DCD;
 
+@synthesize queuedWriteLength = _queuedWriteLength;
+- (NSUInteger)queuedWriteLength
+{
+	@synchronized(self) { return _queuedWriteLength; }
+}
+
+@synthesize writeQueueFull = _writeQueueFull;
+- (BOOL)isWriteQueueFull
+{
+	@synchronized(self) { return _writeQueueFull; }
+}
+
+@synthesize writeQueueHighWatermark = _writeQueueHighWatermark;
+@synthesize writeQueueLowWatermark = _writeQueueLowWatermark;
+
+@synthesize pollsPins = _pollsPins;
+- (void)setPollsPins:(BOOL)flag
+{
+	if (flag != _pollsPins)
+	{
+		_pollsPins = flag;
+		
+		if (![self isOpen]) return;
+		if (flag) [self startPinPolling];
+		else [self stopPinPolling];
+	}
+}
+
 #pragma mark Private Properties
 
-@synthesize writeBuffer = _writeBuffer;
+@synthesize pendingWrites = _pendingWrites;
 @synthesize fileDescriptor = _fileDescriptor;
 @synthesize pinPollTimer = _pinPollTimer;
 - (void)setPinPollTimer:(dispatch_source_t)timer
@@ -760,9 +1221,33 @@ static __strong NSMutableArray *allSerialPorts;
 	{
 		if (_pinPollTimer) { ORS_GCD_RELEASE(_pinPollTimer); }
 		
-		ORS_GCD_RETAIN(timer);
+		if (timer) { ORS_GCD_RETAIN(timer); }
 		_pinPollTimer = timer;
 	}
 }
 
+@synthesize writeQueue = _writeQueue;
+- (void)setWriteQueue:(dispatch_queue_t)queue
+{
+	if (queue != _writeQueue)
+	{
+		if (_writeQueue) { ORS_GCD_RELEASE(_writeQueue); }
+		
+		if (queue) { ORS_GCD_RETAIN(queue); }
+		_writeQueue = queue;
+	}
+}
+
+@synthesize writeSource = _writeSource;
+- (void)setWriteSource:(dispatch_source_t)source
+{
+	if (source != _writeSource)
+	{
+		if (_writeSource) { ORS_GCD_RELEASE(_writeSource); }
+		
+		if (source) { ORS_GCD_RETAIN(source); }
+		_writeSource = source;
+	}
+}
+
 @end
@@ -31,8 +31,10 @@
 #import "ORSSerialPortManager.h"
 #import "ORSSerialPort.h"
 
+#ifdef __APPLE__
 #import <IOKit/IOKitLib.h>
 #import <IOKit/serial/IOSerialKeys.h>
+#endif
 
 #ifdef LOG_SERIAL_PORT_ERRORS
 	#define LOG_SERIAL_PORT_ERROR(fmt, ...) NSLog(fmt, ##__VA_ARGS__)
@@ -46,20 +48,29 @@ NSString * const ORSSerialPortsWereDisconnectedNotification = @"ORSSerialPortWas
 NSString * const ORSConnectedSerialPortsKey = @"ORSConnectedSerialPortsKey";
 NSString * const ORSDisconnectedSerialPortsKey = @"ORSDisconnectedSerialPortsKey";
 
+#ifdef __APPLE__
 void ORSSerialPortManagerPortsPublishedNotificationCallback(void *refCon, io_iterator_t iterator);
 void ORSSerialPortManagerPortsTerminatedNotificationCallback(void *refCon, io_iterator_t iterator);
+#else
+static void (^ORSSerialPortManagerTerminationBlock)(void);
+static void ORSSerialPortManagerTerminate(void) { ORSSerialPortManagerTerminationBlock(); }
+#endif
 
 @interface ORSSerialPortManager ()
 
+#ifdef __APPLE__
 - (void)serialPortsWerePublished:(io_iterator_t)iterator;
 - (void)serialPortsWereTerminated:(io_iterator_t)iterator;
+#endif
 - (void)getAvailablePortsAndRegisterForChangeNotifications;
 
 @property (nonatomic, copy, readwrite) NSArray *availablePorts;
 @property (nonatomic, strong) NSMutableArray *portsToReopenAfterSleep;
 
+#ifdef __APPLE__
 @property (nonatomic) io_iterator_t portPublishedNotificationIterator;
 @property (nonatomic) io_iterator_t portTerminatedNotificationIterator;
+#endif
 
 @end
 
@@ -112,11 +123,13 @@ static ORSSerialPortManager *sharedInstance = nil;
 	NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
 	[nc removeObserver:self];
 	
+#ifdef __APPLE__
 	// Stop IOKit notifications for ports being added/removed
 	IOObjectRelease(_portPublishedNotificationIterator);
 	_portPublishedNotificationIterator = 0;
 	IOObjectRelease(_portTerminatedNotificationIterator);
 	_portTerminatedNotificationIterator = 0;
+#endif
 }
 
 - (void)registerForNotifications
@@ -140,11 +153,16 @@ static ORSSerialPortManager *sharedInstance = nil;
 	
 	[nc addObserver:self selector:@selector(systemWillSleep:) name:NSWorkspaceWillSleepNotification object:NULL];
 	[nc addObserver:self selector:@selector(systemDidWake:) name:NSWorkspaceDidWakeNotification object:NULL];
-#else
+#elif defined(__APPLE__)
 	// If AppKit isn't available, as in a Foundation command-line tool, cleanup upon exit. Sleep/wake
 	// notifications don't seem to be available without NSWorkspace.
 	int result = atexit_b(terminationBlock);
 	if (result) NSLog(@"ORSSerialPort was unable to register its termination handler for serial port cleanup: %i", errno);
+#else
+	// No atexit_b() outside of Apple's libc
+	ORSSerialPortManagerTerminationBlock = terminationBlock;
+	int result = atexit(ORSSerialPortManagerTerminate);
+	if (result) NSLog(@"ORSSerialPort was unable to register its termination handler for serial port cleanup: %i", errno);
 #endif
 }
 
@@ -177,6 +195,8 @@ static ORSSerialPortManager *sharedInstance = nil;
 
 #pragma mark - Private Methods
 
+#ifdef __APPLE__
+
 - (void)serialPortsWerePublished:(io_iterator_t)iterator;
 {
 	NSMutableArray *newlyConnectedPorts = [[NSMutableArray alloc] init];
@@ -284,6 +304,28 @@ static ORSSerialPortManager *sharedInstance = nil;
 	while (IOIteratorNext(self.portTerminatedNotificationIterator)) {}; // Run out the iterator or notifications won't start
 }
 
+#else
+
+- (void)getAvailablePortsAndRegisterForChangeNotifications;
+{
+	// Without IOKit there are no notifications, so these are the ports present at launch: the ttys with a device behind
+	// them (leaving out virtual consoles & pseudo-terminals)
+	NSFileManager *fileManager = [NSFileManager defaultManager];
+	NSArray *names = [[fileManager contentsOfDirectoryAtPath:@"/sys/class/tty" error:NULL] sortedArrayUsingSelector:@selector(compare:)];
+	NSMutableArray *ports = [NSMutableArray array];
+	for (NSString *name in names)
+	{
+		NSString *devicePath = [[@"/sys/class/tty" stringByAppendingPathComponent:name] stringByAppendingPathComponent:@"device"];
+		if (![fileManager fileExistsAtPath:devicePath]) continue;
+		ORSSerialPort *port = [ORSSerialPort serialPortWithPath:[@"/dev" stringByAppendingPathComponent:name]];
+		if (port) [ports addObject:port];
+	}
+	
+	self.availablePorts = ports;
+}
+
+#endif
+
 #pragma mark - Properties
 
 @synthesize availablePorts = _availablePorts;
@@ -305,6 +347,8 @@ static ORSSerialPortManager *sharedInstance = nil;
 
 @synthesize portsToReopenAfterSleep = _portsToReopenAfterSleep;
 
+#ifdef __APPLE__
+
 @synthesize portPublishedNotificationIterator = _portPublishedNotificationIterator;
 - (void)setPortPublishedNotificationIterator:(io_iterator_t)iterator
 {
@@ -329,8 +373,12 @@ static ORSSerialPortManager *sharedInstance = nil;
 	}
 }
 
+#endif
+
 @end
 
+#ifdef __APPLE__
+
 void ORSSerialPortManagerPortsPublishedNotificationCallback(void *refCon, io_iterator_t iterator)
 {
 	ORSSerialPortManager *manager = (__bridge ORSSerialPortManager *)refCon;
@@ -351,4 +399,6 @@ void ORSSerialPortManagerPortsTerminatedNotificationCallback(void *refCon, io_it
 		return;
 	}
 	[manager serialPortsWereTerminated:iterator];
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,487 @@
+// The Arduino core, simulated on the host, so sketches Machino writes run without a board (see MASimulator). It's
+// copied next to the sketch as Arduino.h. Time is virtual: every loop() takes SIMULATED_LOOP_MICROS (or --loop-time),
+// delay() skips ahead, and Serial has a 64 byte transmit buffer emptying at the baud rate passed to begin(), blocking
+// by moving time on. The main runs as fast as it can, or --speed times real time, and connects Serial to a
+// pseudo-terminal (printing "serial <path>" first) that Machino opens like a board's serial port, or to a file with
+// --serial-output. Inputs come from a --script of "<milliseconds> <pin> <value>" lines (pins like 2 or A0, values HIGH,
+// LOW or 0-1023, digitalRead() being HIGH above 0), outputs that change are printed as "<milliseconds> <pin> <value>"
+// with --pins, and --duration stops the sketch after that many milliseconds.
+
+#ifndef SIMULATED_ARDUINO_H
+#define SIMULATED_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef unsigned int word;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LED_BUILTIN 13
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+#define SIMULATED_PIN_COUNT 70
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define PROGMEM
+#define F(string) (string)
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(value, low, high) ((value) < (low) ? (low) : ((value) > (high) ? (high) : (value)))
+#define bitRead(value, bit) (((value) >> (bit)) & 1)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+
+class Print {
+public:
+	virtual size_t write(uint8_t value) = 0;
+	virtual size_t write(const uint8_t *bytes, size_t length) {
+		for (size_t i = 0; i < length; i++) write(bytes[i]);
+		return length;
+	}
+	size_t write(const char *string) {
+		return write((const uint8_t *)string, strlen(string));
+	}
+	size_t print(const char *string) {
+		return write(string);
+	}
+	size_t print(char value) {
+		return write((uint8_t)value);
+	}
+	size_t print(long value, int base = DEC) {
+		if (value < 0 && base == DEC) return print('-') + print((unsigned long)-value, base);
+		return print((unsigned long)value, base);
+	}
+	size_t print(unsigned long value, int base = DEC) {
+		char digits[33];
+		int length = 0;
+		do {
+			int digit = value % base;
+			digits[length++] = (digit < 10) ? '0' + digit : 'A' + digit - 10;
+			value /= base;
+		} while (value > 0);
+		for (int i = length - 1; i >= 0; i--) write((uint8_t)digits[i]);
+		return length;
+	}
+	size_t print(int value, int base = DEC) {
+		return print((long)value, base);
+	}
+	size_t print(unsigned int value, int base = DEC) {
+		return print((unsigned long)value, base);
+	}
+	size_t print(double value, int decimals = 2) {
+		char string[40];
+		snprintf(string, sizeof(string), "%.*f", decimals, value);
+		return print(string);
+	}
+	size_t println() {
+		return print("\r\n");
+	}
+	template <typename T> size_t println(T value) {
+		return print(value) + println();
+	}
+	template <typename T> size_t println(T value, int format) {
+		return print(value, format) + println();
+	}
+	virtual void flush() {}
+};
+
+class SimulatedSerial : public Print {
+public:
+	void begin(unsigned long speed);
+	void end() {}
+	int available();
+	int read();
+	int peek();
+	int availableForWrite();
+	size_t write(uint8_t value);
+	using Print::write;
+	void flush();
+	operator bool() { return true; }
+};
+
+extern SimulatedSerial Serial;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long milliseconds);
+void delayMicroseconds(unsigned int microseconds);
+long random(long maximum);
+long random(long minimum, long maximum);
+void randomSeed(unsigned long seed);
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh);
+
+#ifdef SIMULATED_ARDUINO_MAIN
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SIMULATED_LOOP_MICROS
+#define SIMULATED_LOOP_MICROS 50 // Roughly what an update with logging takes on a 16 MHz AVR
+#endif
+
+void setup();
+void loop();
+
+struct SimulatedInput {
+	unsigned long time;
+	uint8_t pin;
+	int value;
+};
+
+SimulatedSerial Serial;
+static uint64_t simulatedTime = 0; // Microseconds
+static unsigned long simulatedLoopTime = SIMULATED_LOOP_MICROS;
+static uint8_t simulatedPinModes[SIMULATED_PIN_COUNT];
+static int simulatedPinValues[SIMULATED_PIN_COUNT]; // Written by the sketch for outputs, by the script for inputs, -1 if neither
+static SimulatedInput *simulatedInputs = NULL;
+static size_t simulatedInputCount = 0;
+static size_t simulatedNextInput = 0;
+static bool simulatedLogsPins = false;
+static int simulatedSerialFile = -1; // Pseudo-terminal master
+static FILE *simulatedSerialOutput = NULL; // Or the output file
+static bool simulatedSerialIsTerminal = false;
+static bool simulatedSerialStalled = false; // Nobody reading the pseudo-terminal, writes are dropped until it drains
+static unsigned long simulatedSerialBaudRate = 9600;
+static double simulatedSerialPending = 0; // Bytes in the transmit buffer
+static uint64_t simulatedSerialTime = 0;
+static const int kSimulatedSerialBufferSize = 64;
+static uint8_t simulatedReceiveBuffer[kSimulatedSerialBufferSize];
+static int simulatedReceiveStart = 0;
+static int simulatedReceiveLength = 0;
+static uint32_t simulatedRandomState = 1;
+
+static double simulatedRealTime() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// ------------
+// -- Serial --
+// ------------
+
+static void simulatedSerialDrain() {
+	simulatedSerialPending -= (simulatedTime - simulatedSerialTime) * 1e-6 * (simulatedSerialBaudRate / 10.0); // 8N1
+	if (simulatedSerialPending < 0) simulatedSerialPending = 0;
+	simulatedSerialTime = simulatedTime;
+}
+
+static void simulatedSerialSend(uint8_t value) {
+	if (simulatedSerialOutput) {
+		fputc(value, simulatedSerialOutput);
+		return;
+	}
+	if (simulatedSerialFile < 0) return;
+	// Wait a little for a reader to make room, like the board would keep sending into the void without one
+	while (write(simulatedSerialFile, &value, 1) < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) return;
+		struct pollfd descriptor = { simulatedSerialFile, POLLOUT, 0 };
+		if (simulatedSerialStalled || poll(&descriptor, 1, 100) <= 0) {
+			simulatedSerialStalled = true;
+			return;
+		}
+	}
+	simulatedSerialStalled = false;
+}
+
+void SimulatedSerial::begin(unsigned long speed) {
+	simulatedSerialBaudRate = speed;
+}
+
+int SimulatedSerial::available() {
+	if (simulatedSerialIsTerminal && simulatedReceiveLength < kSimulatedSerialBufferSize) {
+		int end = (simulatedReceiveStart + simulatedReceiveLength) % kSimulatedSerialBufferSize;
+		int length = (end >= simulatedReceiveStart) ? kSimulatedSerialBufferSize - end : simulatedReceiveStart - end;
+		ssize_t count = ::read(simulatedSerialFile, &simulatedReceiveBuffer[end], length);
+		if (count > 0) simulatedReceiveLength += count;
+	}
+	return simulatedReceiveLength;
+}
+
+int SimulatedSerial::read() {
+	if (available() == 0) return -1;
+	uint8_t value = simulatedReceiveBuffer[simulatedReceiveStart];
+	simulatedReceiveStart = (simulatedReceiveStart + 1) % kSimulatedSerialBufferSize;
+	simulatedReceiveLength--;
+	return value;
+}
+
+int SimulatedSerial::peek() {
+	if (available() == 0) return -1;
+	return simulatedReceiveBuffer[simulatedReceiveStart];
+}
+
+int SimulatedSerial::availableForWrite() {
+	simulatedSerialDrain();
+	return kSimulatedSerialBufferSize - (int)(simulatedSerialPending + 0.999);
+}
+
+size_t SimulatedSerial::write(uint8_t value) {
+	// A full transmit buffer blocks until a byte went out
+	while (availableForWrite() <= 0) {
+		simulatedTime += (uint64_t)(10e6 / simulatedSerialBaudRate) + 1;
+	}
+	simulatedSerialPending += 1;
+	simulatedSerialSend(value);
+	return 1;
+}
+
+void SimulatedSerial::flush() {
+	while (availableForWrite() < kSimulatedSerialBufferSize) {
+		simulatedTime += (uint64_t)(10e6 / simulatedSerialBaudRate) + 1;
+	}
+}
+
+// ---------
+// -- I/O --
+// ---------
+
+static int simulatedPinIndex(uint8_t pin) {
+	return (pin < SIMULATED_PIN_COUNT) ? pin : -1;
+}
+
+static void simulatedSetOutput(uint8_t pin, int value) {
+	int index = simulatedPinIndex(pin);
+	if (index < 0) return;
+	if (simulatedLogsPins && simulatedPinValues[index] != value) printf("%lu %d %d\n", millis(), pin, value);
+	simulatedPinValues[index] = value;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+	int index = simulatedPinIndex(pin);
+	if (index < 0) return;
+	simulatedPinModes[index] = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+	simulatedSetOutput(pin, (value == LOW) ? LOW : HIGH);
+}
+
+int digitalRead(uint8_t pin) {
+	int index = simulatedPinIndex(pin);
+	if (index < 0) return LOW;
+	if (simulatedPinValues[index] < 0) return (simulatedPinModes[index] == INPUT_PULLUP) ? HIGH : LOW; // Not set by the script
+	return (simulatedPinValues[index] > 0) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+	int index = simulatedPinIndex((pin < A0) ? pin + A0 : pin);
+	if (index < 0 || simulatedPinValues[index] < 0) return 0;
+	return simulatedPinValues[index];
+}
+
+void analogWrite(uint8_t pin, int value) {
+	simulatedSetOutput(pin, constrain(value, 0, 255));
+}
+
+// ----------
+// -- Time --
+// ----------
+
+unsigned long millis() {
+	return (unsigned long)(uint32_t)(simulatedTime / 1000);
+}
+
+unsigned long micros() {
+	return (unsigned long)(uint32_t)simulatedTime;
+}
+
+void delay(unsigned long milliseconds) {
+	simulatedTime += (uint64_t)milliseconds * 1000;
+}
+
+void delayMicroseconds(unsigned int microseconds) {
+	simulatedTime += microseconds;
+}
+
+// ----------
+// -- Math --
+// ----------
+
+long random(long maximum) {
+	if (maximum <= 0) return 0;
+	simulatedRandomState ^= simulatedRandomState << 13;
+	simulatedRandomState ^= simulatedRandomState >> 17;
+	simulatedRandomState ^= simulatedRandomState << 5;
+	return simulatedRandomState % maximum;
+}
+
+long random(long minimum, long maximum) {
+	if (minimum >= maximum) return minimum;
+	return minimum + random(maximum - minimum);
+}
+
+void randomSeed(unsigned long seed) {
+	if (seed != 0) simulatedRandomState = (uint32_t)seed;
+}
+
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh) {
+	return (value - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
+}
+
+// ------------
+// -- Script --
+// ------------
+
+static bool simulatedReadScript(const char *path) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		fprintf(stderr, "could not open %s\n", path);
+		return false;
+	}
+	char line[256];
+	size_t capacity = 0;
+	int lineNumber = 0;
+	while (fgets(line, sizeof(line), file)) {
+		lineNumber++;
+		char pinName[16], valueName[16];
+		unsigned long time;
+		int fieldCount = sscanf(line, " %lu %15s %15s", &time, pinName, valueName);
+		if (fieldCount <= 0 || line[strspn(line, " \t")] == '#') continue;
+		int pin = (pinName[0] == 'A') ? A0 + atoi(pinName + 1) : atoi(pinName);
+		int value = !strcmp(valueName, "HIGH") ? 1023 : (!strcmp(valueName, "LOW") ? 0 : atoi(valueName));
+		if (fieldCount != 3 || simulatedPinIndex(pin) < 0 || value < 0 || value > 1023) {
+			fprintf(stderr, "%s:%d: expected <milliseconds> <pin> <value>\n", path, lineNumber);
+			fclose(file);
+			return false;
+		}
+		if (simulatedInputCount == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			simulatedInputs = (SimulatedInput *)realloc(simulatedInputs, capacity * sizeof(SimulatedInput));
+		}
+		SimulatedInput input = { time, (uint8_t)pin, value };
+		size_t index = simulatedInputCount++;
+		while (index > 0 && simulatedInputs[index - 1].time > time) { // Keeps lines of the same time in order
+			simulatedInputs[index] = simulatedInputs[index - 1];
+			index--;
+		}
+		simulatedInputs[index] = input;
+	}
+	fclose(file);
+	return true;
+}
+
+static void simulatedApplyInputs() {
+	unsigned long time = millis();
+	while (simulatedNextInput < simulatedInputCount && simulatedInputs[simulatedNextInput].time <= time) {
+		simulatedPinValues[simulatedInputs[simulatedNextInput].pin] = simulatedInputs[simulatedNextInput].value;
+		simulatedNextInput++;
+	}
+}
+
+// ----------
+// -- Main --
+// ----------
+
+static bool simulatedOpenTerminal(const char *linkPath) {
+	simulatedSerialFile = posix_openpt(O_RDWR | O_NOCTTY);
+	if (simulatedSerialFile < 0 || grantpt(simulatedSerialFile) != 0 || unlockpt(simulatedSerialFile) != 0) return false;
+	const char *path = ptsname(simulatedSerialFile);
+	// Raw, and kept open so writes don't fail before Machino connects
+	int terminal = open(path, O_RDWR | O_NOCTTY);
+	if (terminal < 0) return false;
+	struct termios settings;
+	tcgetattr(terminal, &settings);
+	cfmakeraw(&settings);
+	tcsetattr(terminal, TCSANOW, &settings);
+	fcntl(simulatedSerialFile, F_SETFL, fcntl(simulatedSerialFile, F_GETFL) | O_NONBLOCK);
+	simulatedSerialIsTerminal = true;
+	if (linkPath) {
+		unlink(linkPath);
+		if (symlink(path, linkPath) != 0) return false;
+		path = linkPath;
+	}
+	printf("serial %s\n", path);
+	fflush(stdout);
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	double speed = 0;
+	unsigned long duration = 0;
+	const char *serialOutputPath = NULL;
+	const char *linkPath = NULL;
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = (i + 1 < argc);
+		if (!strcmp(argv[i], "--pins")) simulatedLogsPins = true;
+		else if (!strcmp(argv[i], "--speed") && hasValue) speed = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--duration") && hasValue) duration = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--loop-time") && hasValue) simulatedLoopTime = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--serial-output") && hasValue) serialOutputPath = argv[++i];
+		else if (!strcmp(argv[i], "--link") && hasValue) linkPath = argv[++i];
+		else if (!strcmp(argv[i], "--script") && hasValue) {
+			if (!simulatedReadScript(argv[++i])) return 2;
+		} else {
+			fprintf(stderr, "usage: %s [--script <file>] [--speed <x>] [--duration <ms>] [--loop-time <us>] [--serial-output <file> | --link <path>] [--pins]\n", argv[0]);
+			return 2;
+		}
+	}
+	for (int i = 0; i < SIMULATED_PIN_COUNT; i++) {
+		simulatedPinValues[i] = -1;
+	}
+	// Serial
+	if (serialOutputPath) {
+		simulatedSerialOutput = fopen(serialOutputPath, "wb");
+		if (!simulatedSerialOutput) {
+			fprintf(stderr, "could not open %s\n", serialOutputPath);
+			return 1;
+		}
+	} else if (!simulatedOpenTerminal(linkPath)) {
+		fprintf(stderr, "could not open a pseudo-terminal: %s\n", strerror(errno));
+		return 1;
+	}
+	// Run, sleeping whenever virtual time gets ahead of real time at the given speed
+	double startTime = simulatedRealTime();
+	simulatedApplyInputs();
+	setup();
+	while (duration == 0 || simulatedTime < (uint64_t)duration * 1000) {
+		simulatedApplyInputs();
+		loop();
+		simulatedTime += simulatedLoopTime;
+		if (speed > 0) {
+			double ahead = simulatedTime * 1e-6 / speed - (simulatedRealTime() - startTime);
+			if (ahead > 1e-3) usleep((useconds_t)(ahead * 1e6));
+		}
+	}
+	Serial.flush();
+	if (simulatedSerialOutput) fclose(simulatedSerialOutput);
+	fflush(stdout);
+	return 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,120 @@
+#include "Arduino.h"
+
+// Runs the table-driven state machines Machino writes. Each state machine has, in PROGMEM, the transitions of every
+// state (from offsets[state] up to offsets[state+1], in the order they're checked) and the action lists they point into.
+// The condition and action functions are shared by all state machines. With STATE_MACHINE_TABLE_LOGGING defined (and
+// Messaging.h included first) it sends the same messages as the switch form, and with STATE_MACHINE_TABLE_CHANGE_ONLY_LOGGING
+// as well only the changes, taking the state machine's logged state and one logged condition bit per transition. With
+// STATE_MACHINE_CACHED_CONDITION_COUNT defined, the conditions below that index go through the sketch's checkCondition cache.
+// With STATE_MACHINE_TABLE_PROFILING defined (and Messaging.h included first, with MESSAGING_PROFILING) the conditions and
+// actions are timed into Messaging.h's profiles, which hold the conditions first and the actions from
+// STATE_MACHINE_FIRST_ACTION_PROFILE on.
+
+#ifndef STATE_MACHINE_INDEX_TYPE
+#define STATE_MACHINE_INDEX_TYPE uint8_t
+#endif
+
+typedef STATE_MACHINE_INDEX_TYPE StateMachineIndex;
+typedef boolean (*StateMachineCondition)();
+typedef void (*StateMachineAction)();
+
+typedef struct {
+	StateMachineIndex condition; // Index+1 in stateMachineConditions, 0 if there is none
+	StateMachineIndex firstAction; // In the state machine's actions
+	StateMachineIndex actionCount;
+	StateMachineIndex target;
+} StateMachineTransition;
+
+extern const StateMachineCondition stateMachineConditions[] PROGMEM;
+extern const StateMachineAction stateMachineActions[] PROGMEM;
+
+// -------------
+// -- Utility --
+// -------------
+
+StateMachineIndex readStateMachineIndex(const StateMachineIndex *address) {
+	if (sizeof(StateMachineIndex) == 1) return pgm_read_byte(address);
+	return pgm_read_word(address);
+}
+
+StateMachineCondition readStateMachineCondition(StateMachineIndex index) {
+#if defined(__AVR__)
+	return (StateMachineCondition)pgm_read_word(&stateMachineConditions[index]);
+#else
+	return stateMachineConditions[index];
+#endif
+}
+
+StateMachineAction readStateMachineAction(StateMachineIndex index) {
+#if defined(__AVR__)
+	return (StateMachineAction)pgm_read_word(&stateMachineActions[index]);
+#else
+	return stateMachineActions[index];
+#endif
+}
+
+// -----------------
+// -- Interpreter --
+// -----------------
+
+#if defined(STATE_MACHINE_TABLE_LOGGING) && defined(STATE_MACHINE_TABLE_CHANGE_ONLY_LOGGING)
+int runStateMachineTable(int currentState, const StateMachineIndex *offsets, const StateMachineTransition *transitions, const StateMachineIndex *actions,
+	const SymbolID *stateIDs, const SymbolID *transitionIDs, const SymbolID *conditionIDs, int *loggedState, byte *loggedConditions) {
+	sendMessageIfStateEntered(loggedState, currentState, readSymbolID(&stateIDs[currentState]));
+#elif defined(STATE_MACHINE_TABLE_LOGGING)
+int runStateMachineTable(int currentState, const StateMachineIndex *offsets, const StateMachineTransition *transitions, const StateMachineIndex *actions,
+	const SymbolID *stateIDs, const SymbolID *transitionIDs, const SymbolID *conditionIDs) {
+	sendMessageCurrentState(readSymbolID(&stateIDs[currentState]));
+#else
+int runStateMachineTable(int currentState, const StateMachineIndex *offsets, const StateMachineTransition *transitions, const StateMachineIndex *actions) {
+#endif
+	StateMachineIndex end = readStateMachineIndex(&offsets[currentState+1]);
+	for (StateMachineIndex i = readStateMachineIndex(&offsets[currentState]); i < end; i++) {
+		const StateMachineTransition *transition = &transitions[i];
+#ifdef STATE_MACHINE_TABLE_LOGGING
+		SymbolID transitionID = readSymbolID(&transitionIDs[i]);
+#endif
+		// Check condition
+		StateMachineIndex condition = readStateMachineIndex(&transition->condition);
+		if (condition) {
+#if defined(STATE_MACHINE_TABLE_LOGGING) && !defined(STATE_MACHINE_TABLE_CHANGE_ONLY_LOGGING)
+			sendMessageWillCheckCondition(transitionID, readSymbolID(&conditionIDs[i]));
+#endif
+			boolean result;
+#ifdef STATE_MACHINE_CACHED_CONDITION_COUNT
+			if (condition <= STATE_MACHINE_CACHED_CONDITION_COUNT) result = checkCondition(condition-1, readStateMachineCondition(condition-1));
+			else
+#endif
+#ifdef STATE_MACHINE_TABLE_PROFILING
+			result = profileCondition(condition-1, readStateMachineCondition(condition-1));
+#else
+			result = readStateMachineCondition(condition-1)();
+#endif
+#if defined(STATE_MACHINE_TABLE_LOGGING) && defined(STATE_MACHINE_TABLE_CHANGE_ONLY_LOGGING)
+			sendMessageIfConditionChanged(loggedConditions, i, transitionID, readSymbolID(&conditionIDs[i]), result);
+#endif
+			if (!result) continue;
+		}
+		// Perform actions
+#ifdef STATE_MACHINE_TABLE_LOGGING
+		sendMessageWillPerformTransition(transitionID);
+#endif
+		StateMachineIndex firstAction = readStateMachineIndex(&transition->firstAction);
+		StateMachineIndex actionCount = readStateMachineIndex(&transition->actionCount);
+		for (StateMachineIndex j = 0; j < actionCount; j++) {
+#ifdef STATE_MACHINE_TABLE_LOGGING
+			sendMessageWillPerformAction(transitionID, j);
+#endif
+			StateMachineIndex action = readStateMachineIndex(&actions[firstAction+j]);
+#ifdef STATE_MACHINE_TABLE_PROFILING
+			profileAction(STATE_MACHINE_FIRST_ACTION_PROFILE + action, readStateMachineAction(action));
+#else
+			readStateMachineAction(action)();
+#endif
+		}
+		// Move to the target, self-transitions go on checking
+		StateMachineIndex target = readStateMachineIndex(&transition->target);
+		if (target != currentState) return target;
+	}
+	return currentState;
+}
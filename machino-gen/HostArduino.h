@@ -0,0 +1,172 @@
+// Just enough of Arduino.h to build generated sketches on the host, used by machino-gen --compare-tables and
+// the telemetry benchmarks. PROGMEM is plain memory here, Serial folds everything written into a checksum, and the
+// conditions & actions the comparisons write call hostCondition/hostAction, so two builds of the same graph can be
+// checked for the same behaviour. Serial takes everything at once, unless HOST_SERIAL_BAUD_RATE is defined when
+// building the main: then it has a 64 byte transmit buffer that empties at that rate, and blocks like the real one.
+// millis() goes up by one every loop() call, so sketches that keep time behave the same in every build and run;
+// micros() is the real time, for profiling, and HOST_SLOW_CONDITION makes that condition take 100 microseconds.
+// The main takes the number of loop() calls and optionally a file to record the serial output in.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+
+class Print {
+public:
+	virtual size_t write(uint8_t value) = 0;
+	size_t print(const char *string) {
+		size_t length = 0;
+		while (string[length]) write(string[length++]);
+		return length;
+	}
+	size_t println(const char *string) {
+		return print(string) + print("\r\n");
+	}
+};
+
+class HostSerial {
+public:
+	void begin(unsigned long speed) {}
+	int availableForWrite();
+	size_t write(uint8_t value);
+	size_t write(const uint8_t *bytes, size_t length);
+	void flush();
+};
+
+extern HostSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+boolean hostCondition(int number);
+void hostAction(int number);
+
+#ifdef HOST_ARDUINO_MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+void setup();
+void loop();
+
+HostSerial Serial;
+static uint32_t hostChecksum = 2166136261u;
+static uint32_t hostRandomState = 2463534242u;
+static unsigned long long hostSerialByteCount = 0;
+static FILE *hostSerialOutput = NULL;
+static unsigned long hostMillis = 0;
+static double hostStartTime = 0;
+
+static void hostMix(uint32_t value) {
+	hostChecksum = (hostChecksum ^ value) * 16777619u; // FNV-1a
+}
+
+static double hostTime() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+#ifdef HOST_SERIAL_BAUD_RATE
+static const int kHostSerialBufferSize = 64;
+static double hostSerialPending = 0; // Bytes in the transmit buffer
+static double hostSerialTime = 0;
+
+static void hostSerialDrain() {
+	double time = hostTime();
+	hostSerialPending -= (time - hostSerialTime) * (HOST_SERIAL_BAUD_RATE / 10.0); // 8N1
+	if (hostSerialPending < 0) hostSerialPending = 0;
+	hostSerialTime = time;
+}
+
+int HostSerial::availableForWrite() {
+	hostSerialDrain();
+	return kHostSerialBufferSize - (int)(hostSerialPending + 0.999);
+}
+
+void HostSerial::flush() {
+	while (hostSerialPending > 0) hostSerialDrain();
+}
+
+static void hostSerialWait() {
+	while (HostSerial().availableForWrite() <= 0) {}
+	hostSerialPending += 1;
+}
+#else
+int HostSerial::availableForWrite() {
+	return 1 << 30;
+}
+
+void HostSerial::flush() {}
+
+static void hostSerialWait() {}
+#endif
+
+size_t HostSerial::write(uint8_t value) {
+	hostSerialWait();
+	hostMix(value);
+	hostSerialByteCount++;
+	if (hostSerialOutput) fputc(value, hostSerialOutput);
+	return 1;
+}
+
+size_t HostSerial::write(const uint8_t *bytes, size_t length) {
+	for (size_t i = 0; i < length; i++) write(bytes[i]);
+	return length;
+}
+
+unsigned long millis() {
+	return hostMillis;
+}
+
+unsigned long micros() {
+	return (unsigned long)((hostTime() - hostStartTime) * 1e6);
+}
+
+boolean hostCondition(int number) {
+	hostRandomState ^= hostRandomState << 13;
+	hostRandomState ^= hostRandomState >> 17;
+	hostRandomState ^= hostRandomState << 5;
+	hostMix(0x10000 + number);
+#ifdef HOST_SLOW_CONDITION
+	if (number == HOST_SLOW_CONDITION) {
+		double end = hostTime() + 100e-6;
+		while (hostTime() < end) {}
+	}
+#endif
+	return (hostRandomState & 3) == 0;
+}
+
+void hostAction(int number) {
+	hostMix(0x20000 + number);
+}
+
+int main(int argc, char *argv[]) {
+	long iterations = (argc > 1) ? atol(argv[1]) : 100000;
+	if (argc > 2) hostSerialOutput = fopen(argv[2], "wb");
+	hostStartTime = hostTime();
+	setup();
+	double start = hostTime();
+	for (long i = 0; i < iterations; i++) {
+		loop();
+		hostMillis++;
+	}
+	double end = hostTime();
+	if (hostSerialOutput) fclose(hostSerialOutput);
+	printf("%.3f %08x %llu\n", (end - start) * 1e9 / iterations, hostChecksum, hostSerialByteCount);
+	return 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,26 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Times each code generation phase on synthetic graphs and reports the memory high-water mark after it
+@interface MABenchmark : NSObject
+
+@property (nonatomic, copy) NSArray *stateCounts; // NSNumbers
+@property (nonatomic, copy) NSArray *densities; // NSNumbers holding MASyntheticGraphDensity
+@property (nonatomic) NSUInteger machineSize;
+@property (nonatomic) UInt32 seed;
+@property (nonatomic) BOOL insertLoggingCode;
+@property (nonatomic, copy) NSArray *writerCounts; // NSNumbers, if set also times writing the code with this many threads (checking it comes out the same as with one)
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output; // NO if some code written side by side differed
+
+@end
@@ -0,0 +1,211 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MABenchmark.h"
+#import "MASyntheticGraph.h"
+#import "MAStateMachineCodeTemplate.h"
+#import "MASymbolManager.h"
+#import "MANode.h"
+#import <sys/resource.h>
+#import <unistd.h>
+#if defined(__APPLE__)
+#import <mach/mach.h>
+#endif
+
+static NSString * const kBenchmarkIndentString = @"  ";
+static const NSUInteger kSymbolLookupCount = 1000000;
+
+#pragma mark - Memory
+
+static double MAPeakResidentMegabytes(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+	return usage.ru_maxrss / (1024.0 * 1024.0); // Bytes
+#else
+	return usage.ru_maxrss / 1024.0; // Kilobytes
+#endif
+}
+
+static double MAResidentMegabytes(void)
+{
+#if defined(__APPLE__)
+	struct mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+	return info.resident_size / (1024.0 * 1024.0);
+#else
+	long pages = 0, residentPages = 0;
+	FILE *file = fopen("/proc/self/statm", "r");
+	if (!file) return 0;
+	if (fscanf(file, "%ld %ld", &pages, &residentPages) != 2) residentPages = 0;
+	fclose(file);
+	return residentPages * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+#endif
+}
+
+@implementation MABenchmark
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateCounts = @[@1000, @5000, @10000, @50000];
+		_densities = @[@(MASyntheticGraphSparse), @(MASyntheticGraphDense)];
+		_machineSize = 100;
+		_seed = 1;
+	}
+	return self;
+}
+
++ (NSString *)nameForPhase:(MAGenerationPhase)phase
+{
+	switch (phase) {
+		case MAGenerationPhaseStateGroups: return @"state groups";
+		case MAGenerationPhaseActionsAndConditions: return @"actions/conditions";
+		case MAGenerationPhaseSymbolNames: return @"symbol names";
+		case MAGenerationPhaseWriteCode: return @"write code";
+	}
+	return nil;
+}
+
+#pragma mark - Running
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output
+{
+	output([NSString stringWithFormat:@"%-8@ %-7@ %-8@ %-8@ %-19@ %10@ %10@ %10@", @"states", @"density", @"arrows", @"symbols", @"phase", @"time (ms)", @"rss (MB)", @"peak (MB)"]);
+	BOOL passed = YES;
+	for (NSNumber *stateCount in self.stateCounts) {
+		for (NSNumber *density in self.densities) {
+			@autoreleasepool {
+				if (![self runCaseWithStateCount:[stateCount unsignedIntegerValue] density:[density unsignedIntegerValue] output:output]) passed = NO;
+			}
+		}
+	}
+	return passed;
+}
+
+- (BOOL)runCaseWithStateCount:(NSUInteger)stateCount density:(MASyntheticGraphDensity)density output:(void(^)(NSString *line))output
+{
+	// Graph
+	NSDate *start = [NSDate date];
+	MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:stateCount machineSize:self.machineSize density:density seed:self.seed];
+	NSString *densityName = [MASyntheticGraph nameForDensity:density];
+	NSUInteger arrowCount = [graph.transitions count];
+	__block NSUInteger symbolCount = 0;
+	void (^report)(NSString *, NSTimeInterval) = ^(NSString *phaseName, NSTimeInterval time) {
+		output([NSString stringWithFormat:@"%-8lu %-7@ %-8lu %-8lu %-19@ %10.1f %10.1f %10.1f", (unsigned long)stateCount, densityName,
+				(unsigned long)arrowCount, (unsigned long)symbolCount, phaseName, time * 1000.0, MAResidentMegabytes(), MAPeakResidentMegabytes()]);
+	};
+	report(@"build graph", -[start timeIntervalSinceNow]);
+	// Generate
+	MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+	template.states = graph.states;
+	template.transitions = graph.transitions;
+	template.options = self.insertLoggingCode ? MAInsertLoggingCode : 0;
+	template.indentString = kBenchmarkIndentString;
+	NSDate *generationStart = [NSDate date];
+	__block NSDate *phaseStart = generationStart;
+	[template generateWithPhaseHandler:^(MAGenerationPhase phase) {
+		if (phase == MAGenerationPhaseSymbolNames) symbolCount = [[template.symbols allObjects] count];
+		report([[self class] nameForPhase:phase], -[phaseStart timeIntervalSinceNow]);
+		phaseStart = [NSDate date];
+	}];
+	report(@"total", -[generationStart timeIntervalSinceNow]);
+	// Merge (what every regeneration in the editor does on top of generating)
+	NSDate *mergeStart = [NSDate date];
+	MAStateMachineCodeTemplate *regenerated = [[MAStateMachineCodeTemplate alloc] init];
+	regenerated.states = graph.states;
+	regenerated.transitions = graph.transitions;
+	regenerated.options = template.options;
+	regenerated.indentString = kBenchmarkIndentString;
+	regenerated.symbols = template.symbols;
+	[regenerated generate];
+	[regenerated mergeCodeFromTemplate:template];
+	report(@"regenerate + merge", -[mergeStart timeIntervalSinceNow]);
+	// Renaming one state halfway (only the names from there on are made again)
+	if ([graph.states count] > 0) {
+		MANode *renamedState = graph.states[[graph.states count] / 2];
+		NSDate *renameStart = [NSDate date];
+		[regenerated.symbols setName:[renamedState.name stringByAppendingString:@" renamed"] forObject:renamedState];
+		[regenerated.symbols generateSymbolNames];
+		report(@"rename + names", -[renameStart timeIntervalSinceNow]);
+	}
+	// Symbol lookups (what the telemetry does for every message received while running)
+	[self benchmarkSymbolLookupsInTemplate:regenerated report:report];
+	// Writing the state machines side by side
+	return [self benchmarkWritersWithGraph:graph symbols:template.symbols options:template.options report:report output:output];
+}
+
+- (BOOL)benchmarkWritersWithGraph:(MASyntheticGraph *)graph symbols:(MASymbolManager *)symbols options:(MAStateMachineCodeTemplateOptions)options
+						   report:(void(^)(NSString *, NSTimeInterval))report output:(void(^)(NSString *line))output
+{
+	if ([self.writerCounts count] == 0) return YES;
+	// One thread first, which the others should match
+	NSMutableOrderedSet *writerCounts = [NSMutableOrderedSet orderedSetWithObject:@1];
+	[writerCounts addObjectsFromArray:self.writerCounts];
+	BOOL passed = YES;
+	NSString *sequentialCode = nil;
+	NSTimeInterval sequentialTime = 0;
+	for (NSNumber *writerCount in writerCounts) {
+		MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+		template.states = graph.states;
+		template.transitions = graph.transitions;
+		template.options = options;
+		template.indentString = kBenchmarkIndentString;
+		template.symbols = symbols;
+		template.writerCount = [writerCount unsignedIntegerValue];
+		__block NSDate *writeStart = nil;
+		__block NSTimeInterval writeTime = 0;
+		[template generateWithPhaseHandler:^(MAGenerationPhase phase) {
+			if (phase == MAGenerationPhaseSymbolNames) writeStart = [NSDate date];
+			if (phase == MAGenerationPhaseWriteCode) writeTime = -[writeStart timeIntervalSinceNow];
+		}];
+		unsigned long count = [writerCount unsignedLongValue];
+		report([NSString stringWithFormat:@"write (%lu thread%@)", count, (count == 1) ? @"" : @"s"], writeTime);
+		if (!sequentialCode) {
+			sequentialCode = [template code];
+			sequentialTime = writeTime;
+			continue;
+		}
+		output([NSString stringWithFormat:@"  %lu threads: %.2fx", count, (writeTime > 0) ? sequentialTime / writeTime : 0.0]);
+		if (![[template code] isEqualToString:sequentialCode]) {
+			output([NSString stringWithFormat:@"  FAIL: the code written by %lu threads differs from the code written by one", count]);
+			passed = NO;
+		}
+	}
+	return passed;
+}
+
+- (void)benchmarkSymbolLookupsInTemplate:(MAStateMachineCodeTemplate *)template report:(void(^)(NSString *, NSTimeInterval))report
+{
+	NSArray *objects = [template.symbols allObjects];
+	NSUInteger objectCount = [objects count];
+	if (objectCount == 0) return;
+	UInt64 *symbolIDs = malloc(objectCount * sizeof(UInt64));
+	for (NSUInteger i = 0; i < objectCount; i++) {
+		symbolIDs[i] = [template.symbols symbolIDForObject:objects[i]];
+	}
+	NSDate *start = [NSDate date];
+	for (NSUInteger i = 0; i < kSymbolLookupCount; i++) {
+		[template objectForSymbolWithID:symbolIDs[i % objectCount]];
+	}
+	report([NSString stringWithFormat:@"%luk id lookups", (unsigned long)kSymbolLookupCount / 1000], -[start timeIntervalSinceNow]);
+	start = [NSDate date];
+	for (NSUInteger i = 0; i < kSymbolLookupCount; i++) {
+		[template.symbols symbolNameForObject:objects[i % objectCount]];
+	}
+	report([NSString stringWithFormat:@"%luk name lookups", (unsigned long)kSymbolLookupCount / 1000], -[start timeIntervalSinceNow]);
+	free(symbolIDs);
+}
+
+@end
@@ -0,0 +1,22 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAVerifier.h"
+
+// Checks MATelemetryCoalescer headlessly. Random streams of states, conditions & actions on a synthetic graph go to a
+// model of what the graph & code views show (made active one event at a time, like they used to be) and through the
+// coalescer, taking frames at random points. After every frame both models have to show the same, and the frames have
+// to account for every event. Also times how many events per second the coalescer takes.
+@interface MACoalescingVerifier : MAVerifier
+
+@property (nonatomic) NSUInteger stateCount;
+@property (nonatomic) NSUInteger machineSize;
+
+@end
@@ -0,0 +1,205 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MACoalescingVerifier.h"
+#import "MARandom.h"
+#import "MASyntheticGraph.h"
+#import "MATelemetryCoalescer.h"
+#import "Graph.h"
+
+static const NSUInteger kMaximumEventsPerStream = 5000;
+static const NSUInteger kMaximumEventsPerFrame = 200;
+static const NSUInteger kTimedEventCount = 1000000;
+
+#pragma mark - MAViewModel
+
+// What MAGraphView & MACodeController show while running, changed the same way
+@interface MAViewModel : NSObject
+
+@property (nonatomic, strong) NSMutableArray *activatedNodes;
+@property (nonatomic, strong) MANode *activeNode;
+@property (nonatomic, strong) MAArrow *activeArrow;
+@property (nonatomic, strong) MACondition *activeCondition;
+@property (nonatomic) NSUInteger activeActionIndex;
+@property (nonatomic, strong) id executionItem;
+
+@end
+
+@implementation MAViewModel
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_activatedNodes = [NSMutableArray array];
+		_activeActionIndex = NSNotFound;
+	}
+	return self;
+}
+
+- (void)makeNodeActive:(MANode *)node
+{
+	self.activeNode = node;
+	if (![self.activatedNodes containsObject:node]) [self.activatedNodes addObject:node];
+	NSArray *connectedNodes = [node findConnectedNodes];
+	for (MANode *otherNode in [self.activatedNodes copy]) {
+		if (otherNode != node && [connectedNodes containsObject:otherNode]) [self.activatedNodes removeObject:otherNode];
+	}
+	self.activeArrow = nil;
+	self.activeActionIndex = NSNotFound;
+}
+
+- (void)makeConditionActive:(MACondition *)condition arrow:(MAArrow *)arrow
+{
+	[self makeNodeActive:arrow.sourceNode];
+	self.activeCondition = condition;
+	self.executionItem = condition;
+}
+
+- (void)makeActionAtIndexActive:(NSUInteger)index arrow:(MAArrow *)arrow
+{
+	[self makeNodeActive:arrow.sourceNode];
+	self.activeArrow = arrow;
+	self.activeCondition = nil;
+	self.activeActionIndex = index;
+	self.executionItem = arrow.actions[index];
+}
+
+- (void)showTelemetryFrame:(MATelemetryFrame *)frame
+{
+	// Like MAController & MAGraphView do
+	for (MANode *node in frame.states) {
+		[self makeNodeActive:node];
+	}
+	if (frame.hasActivity) {
+		self.activeCondition = frame.activeCondition;
+		self.activeArrow = frame.activeArrow;
+		self.activeActionIndex = frame.activeActionIndex;
+	}
+	if (frame.executionItem) self.executionItem = frame.executionItem;
+}
+
+- (NSString *)mismatchWithModel:(MAViewModel *)model
+{
+	if (![[NSSet setWithArray:self.activatedNodes] isEqualToSet:[NSSet setWithArray:model.activatedNodes]]) return @"activated states differ";
+	if (self.activeNode != model.activeNode) return @"active state differs";
+	if (self.activeArrow != model.activeArrow || self.activeActionIndex != model.activeActionIndex) return @"active action differs";
+	if (self.activeCondition != model.activeCondition) return @"active condition differs";
+	if (self.executionItem != model.executionItem) return @"execution item differs";
+	return nil;
+}
+
+@end
+
+#pragma mark - Private Interface
+
+@interface MACoalescingVerifier ()
+
+@property (nonatomic, strong) NSArray *states;
+@property (nonatomic, strong) NSMapTable *outgoingTransitions; // MANode -> NSArray of MAArrow
+
+@end
+
+#pragma mark - MACoalescingVerifier
+
+@implementation MACoalescingVerifier
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateCount = 200;
+		_machineSize = 10;
+		self.iterationCount = 100;
+	}
+	return self;
+}
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:self.stateCount machineSize:self.machineSize density:MASyntheticGraphSparse seed:self.seed];
+	self.states = graph.states;
+	self.outgoingTransitions = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	for (MAArrow *transition in graph.transitions) {
+		NSArray *transitions = [self.outgoingTransitions objectForKey:transition.sourceNode] ?: @[];
+		[self.outgoingTransitions setObject:[transitions arrayByAddingObject:transition] forKey:transition.sourceNode];
+	}
+	// Random streams, frames taken at random points
+	NSUInteger totalEventCount = 0;
+	NSUInteger totalFrameCount = 0;
+	for (NSUInteger iteration = 0; iteration < self.iterationCount; iteration++) {
+		@autoreleasepool {
+			MAViewModel *eventModel = [[MAViewModel alloc] init];
+			MAViewModel *frameModel = [[MAViewModel alloc] init];
+			MATelemetryCoalescer *coalescer = [[MATelemetryCoalescer alloc] init];
+			__block NSUInteger requestCount = 0;
+			coalescer.frameRequestHandler = ^{
+				requestCount++;
+			};
+			NSUInteger eventCount = 1 + [self.random randomBelow:kMaximumEventsPerStream];
+			NSUInteger framedEventCount = 0;
+			NSUInteger nextFrame = [self.random randomBelow:kMaximumEventsPerFrame];
+			for (NSUInteger i = 0; i < eventCount; i++) {
+				[self sendRandomEventToModel:eventModel coalescer:coalescer];
+				if (i < nextFrame && i + 1 < eventCount) continue;
+				nextFrame = i + 1 + [self.random randomBelow:kMaximumEventsPerFrame];
+				MATelemetryFrame *frame = [coalescer takeFrame];
+				[frameModel showTelemetryFrame:frame];
+				framedEventCount += frame.eventCount;
+				NSString *mismatch = [frameModel mismatchWithModel:eventModel];
+				if (mismatch) {
+					output([NSString stringWithFormat:@"iteration %lu (seed %u), after event %lu: %@", (unsigned long)iteration, (unsigned int)self.seed, (unsigned long)i, mismatch]);
+					return NO;
+				}
+			}
+			if ([coalescer takeFrame] || framedEventCount != eventCount || coalescer.receivedEventCount != eventCount || requestCount != coalescer.renderedFrameCount) {
+				output([NSString stringWithFormat:@"iteration %lu (seed %u): %lu events received, %lu in frames, %lu frames requested, %lu taken", (unsigned long)iteration, (unsigned int)self.seed,
+					(unsigned long)coalescer.receivedEventCount, (unsigned long)framedEventCount, (unsigned long)requestCount, (unsigned long)coalescer.renderedFrameCount]);
+				return NO;
+			}
+			totalEventCount += eventCount;
+			totalFrameCount += coalescer.renderedFrameCount;
+		}
+	}
+	output([NSString stringWithFormat:@"%lu streams ok, %lu events in %lu frames", (unsigned long)self.iterationCount, (unsigned long)totalEventCount, (unsigned long)totalFrameCount]);
+	// Time the coalescer on its own, taking a frame every 1000 events
+	MATelemetryCoalescer *coalescer = [[MATelemetryCoalescer alloc] init];
+	NSDate *start = [NSDate date];
+	@autoreleasepool {
+		for (NSUInteger i = 0; i < kTimedEventCount; i++) {
+			[self sendRandomEventToModel:nil coalescer:coalescer];
+			if (i % 1000 == 999) [coalescer takeFrame];
+		}
+	}
+	double seconds = -[start timeIntervalSinceNow];
+	output([NSString stringWithFormat:@"%.0f events/s coalesced (including generating them)", kTimedEventCount / MAX(seconds, 1e-9)]);
+	return YES;
+}
+
+- (void)sendRandomEventToModel:(MAViewModel *)model coalescer:(MATelemetryCoalescer *)coalescer
+{
+	MANode *state = self.states[[self.random randomBelow:[self.states count]]];
+	NSArray *transitions = [self.outgoingTransitions objectForKey:state];
+	MAArrow *transition = [transitions count] ? transitions[[self.random randomBelow:[transitions count]]] : nil;
+	NSUInteger kind = [self.random randomBelow:3];
+	if (kind == 1 && transition.condition) {
+		[model makeConditionActive:transition.condition arrow:transition];
+		[coalescer noteCondition:transition.condition arrow:transition];
+	} else if (kind == 2 && [transition.actions count] > 0) {
+		NSUInteger index = [self.random randomBelow:[transition.actions count]];
+		[model makeActionAtIndexActive:index arrow:transition];
+		[coalescer noteActionAtIndex:index arrow:transition];
+	} else {
+		[model makeNodeActive:state];
+		[coalescer noteState:state];
+	}
+}
+
+@end
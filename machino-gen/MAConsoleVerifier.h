@@ -0,0 +1,22 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAVerifier.h"
+
+// Checks MAConsoleBuffer headlessly. Random streams of text, with short, empty & overlong lines, go through a console
+// with a small line capacity, taking updates at random points and applying them to a string the way MAController
+// applies them to the text view. After every update the string has to be the tail of the stream the console keeps, no
+// more than lineCapacity lines long, and the line index has to match it. At the end of each stream the saved full log
+// has to be the whole stream, and searching it has to find the same lines as searching the stream. Also times appends.
+@interface MAConsoleVerifier : MAVerifier
+
+@property (nonatomic) NSUInteger lineCapacity;
+
+@end
@@ -0,0 +1,181 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAConsoleVerifier.h"
+#import "MARandom.h"
+#import "MAConsoleBuffer.h"
+#import <unistd.h>
+
+static const NSUInteger kMaximumAppendsPerStream = 2000;
+static const NSUInteger kMaximumAppendsPerUpdate = 50;
+static const NSUInteger kTimedLineCount = 1000000;
+static NSString * const kSearchString = @"ab";
+
+#pragma mark - Private Interface
+
+@interface MAConsoleVerifier ()
+
+
+@end
+
+#pragma mark - MAConsoleVerifier
+
+@implementation MAConsoleVerifier
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_lineCapacity = 50;
+		self.iterationCount = 50;
+	}
+	return self;
+}
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	NSString *logPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"machino-console-%d.txt", (int)getpid()]];
+	// Random streams, updates taken at random points
+	unsigned long long totalLength = 0;
+	NSUInteger totalUpdateCount = 0;
+	for (NSUInteger iteration = 0; iteration < self.iterationCount; iteration++) {
+		@autoreleasepool {
+			MAConsoleBuffer *console = [[MAConsoleBuffer alloc] initWithLineCapacity:self.lineCapacity];
+			__block NSUInteger requestCount = 0;
+			console.updateRequestHandler = ^{
+				requestCount++;
+			};
+			NSMutableString *stream = [NSMutableString string];
+			NSMutableString *view = [NSMutableString string];
+			NSUInteger updateCount = 0;
+			NSUInteger appendCount = 1 + [self.random randomBelow:kMaximumAppendsPerStream];
+			NSUInteger nextUpdate = [self.random randomBelow:kMaximumAppendsPerUpdate];
+			for (NSUInteger i = 0; i < appendCount; i++) {
+				NSString *string = [self randomString];
+				[stream appendString:string];
+				[console appendString:string attributes:nil];
+				if (i < nextUpdate && i + 1 < appendCount) continue;
+				nextUpdate = i + 1 + [self.random randomBelow:kMaximumAppendsPerUpdate];
+				// Like MAController's text views
+				MAConsoleUpdate *update = [console takeUpdate];
+				if (update) updateCount++;
+				[view deleteCharactersInRange:NSMakeRange(0, MIN(update.removedLength, [view length]))];
+				if (update.appendedText) [view appendString:[update.appendedText string]];
+				NSString *mismatch = [self mismatchOfView:view withConsole:console stream:stream];
+				if (mismatch) {
+					output([NSString stringWithFormat:@"iteration %lu (seed %u), after append %lu: %@", (unsigned long)iteration, (unsigned int)self.seed, (unsigned long)i, mismatch]);
+					return NO;
+				}
+			}
+			if ([console takeUpdate] || requestCount != updateCount) {
+				output([NSString stringWithFormat:@"iteration %lu (seed %u): %lu updates requested, %lu taken", (unsigned long)iteration, (unsigned int)self.seed, (unsigned long)requestCount, (unsigned long)updateCount]);
+				return NO;
+			}
+			// Full log & search, from the spill file
+			NSError *error = nil;
+			if (![console writeFullLogToPath:logPath error:&error]) {
+				output([NSString stringWithFormat:@"Couldn't save the log: %@", [error localizedDescription]]);
+				return NO;
+			}
+			NSString *log = [NSString stringWithContentsOfFile:logPath encoding:NSUTF8StringEncoding error:NULL];
+			if (![log isEqualToString:stream]) {
+				output([NSString stringWithFormat:@"iteration %lu (seed %u): saved log is %lu long, stream %lu", (unsigned long)iteration, (unsigned int)self.seed, (unsigned long)[log length], (unsigned long)[stream length]]);
+				return NO;
+			}
+			NSString *searchMismatch = [self mismatchOfSearchInConsole:console stream:stream];
+			if (searchMismatch) {
+				output([NSString stringWithFormat:@"iteration %lu (seed %u): %@", (unsigned long)iteration, (unsigned int)self.seed, searchMismatch]);
+				return NO;
+			}
+			// Clearing
+			[console clear];
+			[console appendString:@"x" attributes:nil];
+			[console writeFullLogToPath:logPath error:NULL];
+			if (![[NSString stringWithContentsOfFile:logPath encoding:NSUTF8StringEncoding error:NULL] isEqualToString:@"x"] || ![[[console takeUpdate].appendedText string] isEqualToString:@"x"]) {
+				output([NSString stringWithFormat:@"iteration %lu (seed %u): clearing left text behind", (unsigned long)iteration, (unsigned int)self.seed]);
+				return NO;
+			}
+			totalLength += [stream length];
+			totalUpdateCount += updateCount;
+		}
+	}
+	unlink([logPath fileSystemRepresentation]);
+	output([NSString stringWithFormat:@"%lu streams ok, %llu characters in %lu updates", (unsigned long)self.iterationCount, totalLength, (unsigned long)totalUpdateCount]);
+	// Time appends of sensor-like lines, taking an update every 100
+	NSMutableArray *lines = [NSMutableArray arrayWithCapacity:1000];
+	for (NSUInteger i = 0; i < 1000; i++) {
+		[lines addObject:[NSString stringWithFormat:@"sensor %lu: %lu\n", (unsigned long)[self.random randomBelow:8], (unsigned long)[self.random randomBelow:1024]]];
+	}
+	MAConsoleBuffer *console = [[MAConsoleBuffer alloc] initWithLineCapacity:10000];
+	NSDate *start = [NSDate date];
+	@autoreleasepool {
+		for (NSUInteger i = 0; i < kTimedLineCount; i++) {
+			[console appendString:lines[i % 1000] attributes:nil];
+			if (i % 100 == 99) [console takeUpdate];
+		}
+	}
+	double seconds = -[start timeIntervalSinceNow];
+	output([NSString stringWithFormat:@"%.0f lines/s appended, %lu characters kept of %llu", kTimedLineCount / MAX(seconds, 1e-9), (unsigned long)console.length, console.totalLength]);
+	return YES;
+}
+
+- (NSString *)mismatchOfView:(NSString *)view withConsole:(MAConsoleBuffer *)console stream:(NSString *)stream
+{
+	if ([view length] != console.length || [view length] > [stream length]) return [NSString stringWithFormat:@"view is %lu long, console keeps %lu", (unsigned long)[view length], (unsigned long)console.length];
+	if (![stream hasSuffix:view]) return @"view isn't the end of the stream";
+	if (console.lineCount > console.lineCapacity) return [NSString stringWithFormat:@"%lu lines kept", (unsigned long)console.lineCount];
+	// Line index covers the view, lines ending in newlines or overlong
+	NSUInteger end = 0;
+	for (NSUInteger i = 0; i < console.lineCount; i++) {
+		NSRange range = [console rangeOfLineAtIndex:i];
+		if (range.location != end) return [NSString stringWithFormat:@"line %lu starts at %lu, not %lu", (unsigned long)i, (unsigned long)range.location, (unsigned long)end];
+		if (range.length > kConsoleMaximumLineLength + 2) return [NSString stringWithFormat:@"line %lu is %lu long", (unsigned long)i, (unsigned long)range.length];
+		NSRange newline = [view rangeOfString:@"\n" options:0 range:range];
+		if (newline.location != NSNotFound && NSMaxRange(newline) != NSMaxRange(range)) return [NSString stringWithFormat:@"line %lu has a newline inside", (unsigned long)i];
+		if (i + 1 < console.lineCount && newline.location == NSNotFound && range.length < kConsoleMaximumLineLength) return [NSString stringWithFormat:@"line %lu ends early", (unsigned long)i];
+		end = NSMaxRange(range);
+	}
+	if (end != [view length]) return @"lines don't reach the end of the view";
+	return nil;
+}
+
+- (NSString *)mismatchOfSearchInConsole:(MAConsoleBuffer *)console stream:(NSString *)stream
+{
+	NSMutableArray *expected = [NSMutableArray array];
+	unsigned long long lineNumber = 0;
+	for (NSString *line in [stream componentsSeparatedByString:@"\n"]) {
+		lineNumber++;
+		if ([line rangeOfString:kSearchString].location != NSNotFound) [expected addObject:@[@(lineNumber), line]];
+	}
+	NSMutableArray *found = [NSMutableArray array];
+	BOOL success = [console enumerateLinesContainingString:kSearchString options:0 usingBlock:^(unsigned long long number, NSString *line, BOOL *stop) {
+		[found addObject:@[@(number), line]];
+	}];
+	if (!success) return @"couldn't search the log";
+	if (![found isEqualToArray:expected]) return [NSString stringWithFormat:@"search found %lu lines, not %lu", (unsigned long)[found count], (unsigned long)[expected count]];
+	return nil;
+}
+
+- (NSString *)randomString
+{
+	// Mostly short lines, sometimes empty ones, a line split over appends, or one longer than the maximum
+	NSUInteger kind = [self.random randomBelow:20];
+	NSUInteger length = (kind == 0) ? kConsoleMaximumLineLength + [self.random randomBelow:2 * kConsoleMaximumLineLength] : [self.random randomBelow:40];
+	NSMutableString *string = [NSMutableString stringWithCapacity:length];
+	static NSString * const characters[] = {@"a", @"b", @"c", @" ", @"\n", @"é", @"😀"};
+	for (NSUInteger i = 0; i < length; i++) {
+		NSUInteger index = [self.random randomBelow:7];
+		if (kind == 0 && index == 4) index = 0; // Overlong, without newlines
+		[string appendString:characters[index]];
+	}
+	return string;
+}
+
+@end
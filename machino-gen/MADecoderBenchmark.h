@@ -0,0 +1,24 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Times MAMessageDecoder on recorded serial streams, read in pieces the size serial ports hand over: a synthetic
+// MAMessageRecording for each protocol version, or a recording of a real sketch. Reports MB/s and events/s.
+@interface MADecoderBenchmark : NSObject
+
+@property (nonatomic) NSUInteger iterationCount; // loop() iterations in the synthetic recordings
+@property (nonatomic) UInt32 seed;
+@property (nonatomic, copy) NSString *recordingPath; // Benchmarked instead of the synthetic recordings if set
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output; // NO if the recording couldn't be read
+
+@end
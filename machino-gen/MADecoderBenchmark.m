@@ -0,0 +1,94 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MADecoderBenchmark.h"
+#import "MAMessageRecording.h"
+#import "MAMessageDecoder.h"
+
+static const NSUInteger kReadLength = 4096;
+static const NSUInteger kRunCount = 5; // Best of
+
+#pragma mark - Private Interface
+
+@interface MADecoderBenchmark () <MAMessageDecoderDelegate>
+
+@property (nonatomic) NSUInteger eventCount; // Of the current run
+
+@end
+
+#pragma mark - MADecoderBenchmark
+
+@implementation MADecoderBenchmark
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_iterationCount = 200000;
+		_seed = 1;
+	}
+	return self;
+}
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output
+{
+	output([NSString stringWithFormat:@"%-24@ %10@ %9@ %10@ %12@", @"recording", @"size (MB)", @"MB/s", @"events", @"Mevents/s"]);
+	if (self.recordingPath) {
+		NSData *bytes = [NSData dataWithContentsOfFile:self.recordingPath];
+		if (!bytes) {
+			output([NSString stringWithFormat:@"could not read %@", self.recordingPath]);
+			return NO;
+		}
+		[self benchmarkBytes:bytes name:[self.recordingPath lastPathComponent] output:output];
+		return YES;
+	}
+	for (NSNumber *version in @[ @(MAMessageProtocolVersion1), @(MAMessageProtocolVersion2) ]) {
+		@autoreleasepool {
+			MAMessageRecording *recording = [MAMessageRecording recordingWithProtocolVersion:[version unsignedIntegerValue] iterationCount:self.iterationCount seed:self.seed];
+			[self benchmarkBytes:recording.bytes name:[NSString stringWithFormat:@"synthetic v%@", version] output:output];
+		}
+	}
+	return YES;
+}
+
+- (void)benchmarkBytes:(NSData *)data name:(NSString *)name output:(void(^)(NSString *line))output
+{
+	const Byte *bytes = [data bytes];
+	NSUInteger length = [data length];
+	NSTimeInterval bestDuration = DBL_MAX;
+	for (NSUInteger run = 0; run < kRunCount; run++) {
+		MAMessageDecoder *decoder = [[MAMessageDecoder alloc] init];
+		decoder.delegate = self;
+		self.eventCount = 0;
+		NSDate *start = [NSDate date];
+		for (NSUInteger index = 0; index < length; index += kReadLength) {
+			[decoder decodeBytes:&bytes[index] length:MIN(kReadLength, length - index)];
+		}
+		bestDuration = MIN(bestDuration, -[start timeIntervalSinceNow]);
+	}
+	double megabytes = length / 1e6;
+	bestDuration = MAX(bestDuration, 1e-9);
+	output([NSString stringWithFormat:@"%-24@ %10.2f %9.1f %10lu %12.2f", name, megabytes, megabytes / bestDuration, (unsigned long)self.eventCount, self.eventCount / bestDuration / 1e6]);
+}
+
+#pragma mark - Message Decoder Delegate
+
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeEvents:(const MAMessageEvent *)events count:(NSUInteger)count
+{
+	self.eventCount += count;
+}
+
+// Not counted:
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length { }
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveHelloWithBaudRate:(unsigned long)baudRate { }
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count { }
+
+@end
@@ -0,0 +1,231 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MADecoderFuzzer.h"
+#import "MARandom.h"
+#import "MAMessageRecording.h"
+#import "MAMessageDecoder.h"
+
+static const NSUInteger kMaximumRecordingIterations = 200;
+static const NSUInteger kMaximumMutations = 60;
+static const NSUInteger kMaximumRandomLength = 5000;
+static const NSUInteger kMaximumReadLength = 300;
+
+typedef NS_ENUM(NSUInteger, MAReadPattern) {
+	MAReadAll,
+	MAReadRandomPieces,
+	MAReadBytes
+};
+
+#pragma mark - Private Class - MADecoderCapture
+
+// Everything a decoder hands over
+@interface MADecoderCapture : NSObject <MAMessageDecoderDelegate>
+
+@property (nonatomic) MAMessageProtocolVersion protocolVersion;
+@property (nonatomic, strong, readonly) NSMutableData *events;
+@property (nonatomic, strong, readonly) NSMutableData *userSerialBytes;
+@property (nonatomic, strong, readonly) NSMutableArray *baudRates;
+
+@end
+
+@implementation MADecoderCapture
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_events = [NSMutableData data];
+		_userSerialBytes = [NSMutableData data];
+		_baudRates = [NSMutableArray array];
+	}
+	return self;
+}
+
+- (BOOL)isEqual:(MADecoderCapture *)capture
+{
+	return ([capture isKindOfClass:[MADecoderCapture class]] && capture.protocolVersion == self.protocolVersion && [capture.events isEqualToData:self.events]
+		&& [capture.userSerialBytes isEqualToData:self.userSerialBytes] && [capture.baudRates isEqualToArray:self.baudRates]);
+}
+
+- (NSUInteger)hash
+{
+	return [self.events hash];
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"protocol %lu, %lu events, %lu user serial bytes, %lu hellos", (unsigned long)self.protocolVersion,
+		(unsigned long)([self.events length] / sizeof(MAMessageEvent)), (unsigned long)[self.userSerialBytes length], (unsigned long)[self.baudRates count]];
+}
+
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeEvents:(const MAMessageEvent *)events count:(NSUInteger)count
+{
+	for (NSUInteger i = 0; i < count; i++) {
+		[MAMessageRecording appendEvent:&events[i] toData:self.events];
+	}
+}
+
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length
+{
+	[self.userSerialBytes appendBytes:bytes length:length];
+}
+
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveHelloWithBaudRate:(unsigned long)baudRate
+{
+	[self.baudRates addObject:@(baudRate)];
+}
+
+// Recordings have no profile summaries
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count { }
+
+@end
+
+#pragma mark - Private Interface
+
+@interface MADecoderFuzzer ()
+
+
+@end
+
+#pragma mark - MADecoderFuzzer
+
+@implementation MADecoderFuzzer
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		self.iterationCount = 1000;
+	}
+	return self;
+}
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	unsigned long long byteCount = 0;
+	for (NSUInteger iteration = 0; iteration < self.iterationCount; iteration++) {
+		@autoreleasepool {
+			NSString *mismatch = nil;
+			// A clean recording decodes to what's in it
+			MAMessageProtocolVersion version = ([self.random randomBelow:2] == 0) ? MAMessageProtocolVersion1 : MAMessageProtocolVersion2;
+			NSUInteger recordingIterations = 1 + [self.random randomBelow:kMaximumRecordingIterations];
+			MAMessageRecording *recording = [MAMessageRecording recordingWithProtocolVersion:version iterationCount:recordingIterations seed:(UInt32)[self.random randomBelow:UINT32_MAX] + 1];
+			MADecoderCapture *expected = [[MADecoderCapture alloc] init];
+			expected.protocolVersion = version;
+			[expected.events appendData:recording.events];
+			[expected.userSerialBytes appendData:recording.userSerialBytes];
+			[expected.baudRates addObject:@(recording.baudRate)];
+			MADecoderCapture *capture = [self captureDecoding:recording.bytes pattern:MAReadRandomPieces];
+			if (![capture isEqual:expected]) mismatch = [NSString stringWithFormat:@"version %lu recording decoded to %@ instead of %@", (unsigned long)version, capture, expected];
+			// Mutated & random bytes decode the same however they're read
+			NSData *mutatedBytes = [self mutatedData:recording.bytes];
+			NSData *randomBytes = [self randomDataOfLength:1 + [self.random randomBelow:kMaximumRandomLength]];
+			if (!mismatch) mismatch = [self mismatchBetweenReadPatternsForData:mutatedBytes name:@"mutated recording"];
+			if (!mismatch) mismatch = [self mismatchBetweenReadPatternsForData:randomBytes name:@"random bytes"];
+			if (mismatch) {
+				output([NSString stringWithFormat:@"iteration %lu (seed %u): %@", (unsigned long)iteration, (unsigned int)self.seed, mismatch]);
+				return NO;
+			}
+			byteCount += [recording.bytes length] + [mutatedBytes length] + [randomBytes length];
+		}
+	}
+	output([NSString stringWithFormat:@"%lu iterations ok, %llu bytes decoded", (unsigned long)self.iterationCount, byteCount]);
+	return YES;
+}
+
+- (NSString *)mismatchBetweenReadPatternsForData:(NSData *)data name:(NSString *)name
+{
+	MADecoderCapture *allCapture = [self captureDecoding:data pattern:MAReadAll];
+	MADecoderCapture *piecesCapture = [self captureDecoding:data pattern:MAReadRandomPieces];
+	MADecoderCapture *bytesCapture = [self captureDecoding:data pattern:MAReadBytes];
+	if (![piecesCapture isEqual:allCapture]) return [NSString stringWithFormat:@"%@ read in pieces decoded to %@ instead of %@", name, piecesCapture, allCapture];
+	if (![bytesCapture isEqual:allCapture]) return [NSString stringWithFormat:@"%@ read bytewise decoded to %@ instead of %@", name, bytesCapture, allCapture];
+	return nil;
+}
+
+- (MADecoderCapture *)captureDecoding:(NSData *)data pattern:(MAReadPattern)pattern
+{
+	MADecoderCapture *capture = [[MADecoderCapture alloc] init];
+	MAMessageDecoder *decoder = [[MAMessageDecoder alloc] init];
+	decoder.delegate = capture;
+	const Byte *bytes = [data bytes];
+	NSUInteger length = [data length];
+	NSUInteger index = 0;
+	while (index < length) {
+		NSUInteger readLength = length - index;
+		if (pattern == MAReadRandomPieces) readLength = MIN(readLength, 1 + [self.random randomBelow:kMaximumReadLength]);
+		else if (pattern == MAReadBytes) readLength = 1;
+		[decoder decodeBytes:&bytes[index] length:readLength];
+		index += readLength;
+	}
+	capture.protocolVersion = decoder.protocolVersion;
+	return capture;
+}
+
+#pragma mark - Mutation
+
+- (NSData *)mutatedData:(NSData *)data
+{
+	// Bytes changed, inserted (delimiters, start sequences, headers & runs) & deleted
+	NSMutableData *mutatedData = [data mutableCopy];
+	NSUInteger mutationCount = [self.random randomBelow:kMaximumMutations + 1];
+	for (NSUInteger i = 0; i < mutationCount; i++) {
+		NSUInteger location = [self.random randomBelow:[mutatedData length] + 1];
+		switch ([self.random randomBelow:3]) {
+			case 0: {
+				if (location == [mutatedData length]) break;
+				Byte byte = [self.random randomBelow:256];
+				[mutatedData replaceBytesInRange:NSMakeRange(location, 1) withBytes:&byte];
+				break;
+			}
+			case 1: {
+				NSData *insertion = [self randomInsertion];
+				[mutatedData replaceBytesInRange:NSMakeRange(location, 0) withBytes:[insertion bytes] length:[insertion length]];
+				break;
+			}
+			default: {
+				NSUInteger length = MIN([self.random randomBelow:20], [mutatedData length] - location);
+				[mutatedData replaceBytesInRange:NSMakeRange(location, length) withBytes:NULL length:0];
+				break;
+			}
+		}
+	}
+	return mutatedData;
+}
+
+- (NSData *)randomInsertion
+{
+	switch ([self.random randomBelow:4]) {
+		case 0: return [NSData dataWithBytes:(Byte[]){ 0 } length:1];
+		case 1: return [NSData dataWithBytes:(Byte[]){ 17, 31, 23 } length:3];
+		case 2: return [NSData dataWithBytes:(Byte[]){ 17, 31, 23, [self.random randomBelow:9], 0, [self.random randomBelow:8] } length:6];
+		default: {
+			NSMutableData *run = [NSMutableData dataWithLength:[self.random randomBelow:300]];
+			memset([run mutableBytes], 0xFF, [run length]);
+			return run;
+		}
+	}
+}
+
+#pragma mark - Random
+
+- (NSData *)randomDataOfLength:(NSUInteger)length
+{
+	NSMutableData *data = [NSMutableData dataWithLength:length];
+	Byte *bytes = [data mutableBytes];
+	for (NSUInteger i = 0; i < length; i++) {
+		bytes[i] = [self.random randomBelow:256];
+	}
+	return data;
+}
+
+@end
@@ -0,0 +1,22 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAVerifier.h"
+
+// Checks MADocumentArchive's chunked format headlessly. Random edits of a synthetic document (moves, renames, user code,
+// added states & removed arrows), each autosaved by appending the changed chunks, after which reading the file back and
+// generating its code again has to give the same code & layout; the file cut off anywhere in the last save has to read
+// as it was before that save. Also checks keyed archives still import, and times saving & opening stateCount states
+// both ways, and an autosave after editing one piece of code.
+@interface MADocumentFormatVerifier : MAVerifier
+
+@property (nonatomic) NSUInteger stateCount; // For the timing
+
+@end
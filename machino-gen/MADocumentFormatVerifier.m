@@ -0,0 +1,245 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MADocumentFormatVerifier.h"
+#import "MARandom.h"
+#import "MADocumentArchive.h"
+#import "MAStateMachineCodeTemplate.h"
+#import "MASyntheticGraph.h"
+#import "Graph.h"
+
+static const NSUInteger kInitialStateCount = 30;
+static const NSUInteger kMachineSize = 10;
+static NSString * const kIndentString = @"  ";
+
+#pragma mark - Private Interface
+
+@interface MADocumentFormatVerifier ()
+
+
+@end
+
+#pragma mark - MADocumentFormatVerifier
+
+@implementation MADocumentFormatVerifier
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		self.iterationCount = 200;
+		_stateCount = 10000;
+	}
+	return self;
+}
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"machino-document-%d.machino", [[NSProcessInfo processInfo] processIdentifier]]];
+	BOOL passed = [self verifyEditsWithPath:path output:output] && [self timeWithPath:path output:output];
+	[[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+	return passed;
+}
+
+- (BOOL)verifyEditsWithPath:(NSString *)path output:(void(^)(NSString *line))output
+{
+	MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:kInitialStateCount machineSize:kMachineSize density:MASyntheticGraphSparse seed:self.seed];
+	NSMutableArray *nodes = [graph.states mutableCopy];
+	NSMutableArray *arrows = [graph.transitions mutableCopy];
+	MAStateMachineCodeTemplate *codeTemplate = [self templateForNodes:nodes arrows:arrows mergingCodeFromTemplate:nil];
+	MADocumentArchive *archive = [[MADocumentArchive alloc] initWithNodes:nodes arrows:arrows codeTemplate:codeTemplate];
+	NSError *error = nil;
+	if (![archive writeToFile:path error:&error]) {
+		output([NSString stringWithFormat:@"%@: %@", path, [error localizedDescription]]);
+		return NO;
+	}
+	NSString *signature = [self signatureForNodes:nodes arrows:arrows codeTemplate:codeTemplate];
+	NSData *fileData = [NSData dataWithContentsOfFile:path];
+	NSUInteger appendCount = 0;
+	NSUInteger rewriteCount = 0;
+	for (NSUInteger i = 0; i < self.iterationCount; i++) {
+		@autoreleasepool {
+			// Edit, and generate again like the code controller does
+			NSString *edit = [self editNodes:nodes arrows:arrows codeTemplate:codeTemplate];
+			codeTemplate = [self templateForNodes:nodes arrows:arrows mergingCodeFromTemplate:codeTemplate];
+			archive.codeTemplate = codeTemplate;
+			if (![archive writeChangesToFile:path error:&error]) {
+				output([NSString stringWithFormat:@"iteration %lu (%@): %@", (unsigned long)i, edit, [error localizedDescription]]);
+				return NO;
+			}
+			// Read back
+			NSString *previousSignature = signature;
+			NSData *previousFileData = fileData;
+			signature = [self signatureForNodes:nodes arrows:arrows codeTemplate:codeTemplate];
+			fileData = [NSData dataWithContentsOfFile:path];
+			NSString *readSignature = [self signatureForArchiveData:fileData];
+			if (![readSignature isEqualToString:signature]) {
+				output([NSString stringWithFormat:@"iteration %lu (seed %u, %@): document reads back different", (unsigned long)i, (unsigned int)self.seed, edit]);
+				return NO;
+			}
+			// Cut off during the save, it has to read as before
+			BOOL appended = ([fileData length] > [previousFileData length] && [[fileData subdataWithRange:NSMakeRange(0, [previousFileData length])] isEqualToData:previousFileData]);
+			if (!appended) {
+				if (![fileData isEqualToData:previousFileData]) rewriteCount++;
+				continue;
+			}
+			appendCount++;
+			NSUInteger cutLength = [previousFileData length] + [self.random randomBelow:[fileData length] - [previousFileData length]];
+			readSignature = [self signatureForArchiveData:[fileData subdataWithRange:NSMakeRange(0, cutLength)]];
+			if (![readSignature isEqualToString:previousSignature]) {
+				output([NSString stringWithFormat:@"iteration %lu (seed %u, %@): cut off at %lu of %lu bytes, document doesn't read as before", (unsigned long)i, (unsigned int)self.seed, edit, (unsigned long)cutLength, (unsigned long)[fileData length]]);
+				return NO;
+			}
+		}
+	}
+	output([NSString stringWithFormat:@"%lu edits ok, %lu saves appended, %lu rewritten, %lu states & %lu bytes now", (unsigned long)self.iterationCount, (unsigned long)appendCount, (unsigned long)rewriteCount, (unsigned long)[nodes count], (unsigned long)[fileData length]]);
+	// Keyed archives from before version 2 still open
+	NSString *readSignature = [self signatureForArchiveData:[archive keyedArchiveData]];
+	if (![readSignature isEqualToString:signature]) {
+		output(@"keyed archive reads back different");
+		return NO;
+	}
+	output(@"keyed archive import ok");
+	return YES;
+}
+
+- (BOOL)timeWithPath:(NSString *)path output:(void(^)(NSString *line))output
+{
+	if (self.stateCount == 0) return YES;
+	MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:self.stateCount machineSize:100 density:MASyntheticGraphSparse seed:self.seed];
+	NSMutableArray *nodes = [graph.states mutableCopy];
+	NSMutableArray *arrows = [graph.transitions mutableCopy];
+	MAStateMachineCodeTemplate *codeTemplate = [self templateForNodes:nodes arrows:arrows mergingCodeFromTemplate:nil];
+	MADocumentArchive *archive = [[MADocumentArchive alloc] initWithNodes:nodes arrows:arrows codeTemplate:codeTemplate];
+	// Save & open, both ways
+	NSDate *start = [NSDate date];
+	NSData *keyedData = [archive keyedArchiveData];
+	double keyedSaveSeconds = -[start timeIntervalSinceNow];
+	start = [NSDate date];
+	[MADocumentArchive archiveWithData:keyedData error:nil];
+	double keyedOpenSeconds = -[start timeIntervalSinceNow];
+	start = [NSDate date];
+	NSData *data = [archive data];
+	double saveSeconds = -[start timeIntervalSinceNow];
+	start = [NSDate date];
+	MADocumentArchive *readArchive = [MADocumentArchive archiveWithData:data error:nil];
+	double openSeconds = -[start timeIntervalSinceNow];
+	if (!readArchive) {
+		output(@"timed document doesn't read back");
+		return NO;
+	}
+	// Autosave after editing one piece of code
+	NSError *error = nil;
+	if (![archive writeToFile:path error:&error]) {
+		output([NSString stringWithFormat:@"%@: %@", path, [error localizedDescription]]);
+		return NO;
+	}
+	NSArray *keys = [codeTemplate keysForEditableRangesInOrder];
+	[codeTemplate setCode:@"\n  digitalWrite(13, HIGH);\n" forEditableRangeWithKey:keys[[keys count] / 2]];
+	start = [NSDate date];
+	BOOL isWritten = [archive writeChangesToFile:path error:&error];
+	double autosaveSeconds = -[start timeIntervalSinceNow];
+	if (!isWritten) {
+		output([NSString stringWithFormat:@"%@: %@", path, [error localizedDescription]]);
+		return NO;
+	}
+	unsigned long long fileLength = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize];
+	output([NSString stringWithFormat:@"%lu states: keyed archive %.1f MB, saved in %.1f ms, opened in %.1f ms; chunked %.1f MB, saved in %.1f ms, opened in %.1f ms; autosave of one edit %.2f ms (+%llu bytes)",
+		(unsigned long)self.stateCount, [keyedData length] / 1e6, keyedSaveSeconds * 1000, keyedOpenSeconds * 1000, [data length] / 1e6, saveSeconds * 1000, openSeconds * 1000,
+		autosaveSeconds * 1000, fileLength - (unsigned long long)[data length]]);
+	return YES;
+}
+
+#pragma mark - Documents
+
+- (MAStateMachineCodeTemplate *)templateForNodes:(NSArray *)nodes arrows:(NSArray *)arrows mergingCodeFromTemplate:(MAStateMachineCodeTemplate *)oldTemplate
+{
+	MAStateMachineCodeTemplate *codeTemplate = [[MAStateMachineCodeTemplate alloc] init];
+	codeTemplate.states = nodes;
+	codeTemplate.transitions = arrows;
+	codeTemplate.indentString = kIndentString;
+	codeTemplate.symbols = oldTemplate.symbols; // Reuse symbols to persist id's
+	[codeTemplate generateMergingCodeFromTemplate:oldTemplate];
+	return codeTemplate;
+}
+
+- (NSString *)signatureForArchiveData:(NSData *)data
+{
+	NSError *error = nil;
+	MADocumentArchive *archive = [MADocumentArchive archiveWithData:data error:&error];
+	if (!archive) return [error localizedDescription];
+	// The code is generated again after opening
+	MAStateMachineCodeTemplate *codeTemplate = [self templateForNodes:archive.nodes arrows:archive.arrows mergingCodeFromTemplate:archive.codeTemplate];
+	return [self signatureForNodes:archive.nodes arrows:archive.arrows codeTemplate:codeTemplate];
+}
+
+- (NSString *)signatureForNodes:(NSArray *)nodes arrows:(NSArray *)arrows codeTemplate:(MAStateMachineCodeTemplate *)codeTemplate
+{
+	// Layout & each state's arrows in order (neither shows in the code), then the code
+	NSMutableString *signature = [NSMutableString string];
+	for (MANode *node in nodes) {
+		[signature appendFormat:@"%@ %g,%g:", node.name, node.position.x, node.position.y];
+		for (MAArrow *arrow in node.arrows) {
+			[signature appendFormat:@" %lu", (unsigned long)[arrows indexOfObjectIdenticalTo:arrow]];
+		}
+		[signature appendString:@"\n"];
+	}
+	for (MAArrow *arrow in arrows) {
+		[signature appendFormat:@"%g,%g %g,%g %g %g\n", arrow.sourcePoint.x, arrow.sourcePoint.y, arrow.targetPoint.x, arrow.targetPoint.y, arrow.sourceAngle, arrow.targetAngle];
+	}
+	[signature appendString:[codeTemplate code]];
+	return signature;
+}
+
+- (NSString *)editNodes:(NSMutableArray *)nodes arrows:(NSMutableArray *)arrows codeTemplate:(MAStateMachineCodeTemplate *)codeTemplate
+{
+	NSUInteger choice = [self.random randomBelow:10];
+	MANode *node = nodes[[self.random randomBelow:[nodes count]]];
+	if (choice < 3) {
+		node.position = CGPointMake(node.position.x + [self.random randomBelow:100] - 50.0, node.position.y + [self.random randomBelow:100] / 4.0);
+		return [NSString stringWithFormat:@"move %@", node.name];
+	} else if (choice < 5) {
+		NSArray *keys = [codeTemplate keysForEditableRangesInOrder];
+		id key = keys[[self.random randomBelow:[keys count]]];
+		[codeTemplate setCode:[NSString stringWithFormat:@"\n  // Edit %u, ünïcode\n  counter += %u;\n", (unsigned int)[self.random randomBelow:1000], (unsigned int)[self.random randomBelow:10]] forEditableRangeWithKey:key];
+		return [NSString stringWithFormat:@"code in %@", key];
+	} else if (choice < 7) {
+		NSString *name = [NSString stringWithFormat:@"Renamed %u", (unsigned int)[self.random randomBelow:50]];
+		NSString *edit = [NSString stringWithFormat:@"rename %@ to %@", node.name, name];
+		node.name = name;
+		return edit;
+	} else if (choice < 9 || [arrows count] < 2) {
+		MANode *newNode = [[MANode alloc] init];
+		newNode.name = [NSString stringWithFormat:@"Added %lu", (unsigned long)[nodes count]];
+		newNode.position = CGPointMake([self.random randomBelow:1000], [self.random randomBelow:1000]);
+		MAArrow *arrow = [[MAArrow alloc] init];
+		arrow.sourceNode = node;
+		arrow.targetNode = newNode;
+		arrow.sourcePoint = node.position;
+		arrow.targetPoint = newNode.position;
+		arrow.sourceAngle = [self.random randomBelow:628] / 100.0;
+		arrow.condition = ([self.random randomBelow:2] == 0) ? ((MAArrow *)arrows[[self.random randomBelow:[arrows count]]]).condition : [MACondition conditionWithName:[NSString stringWithFormat:@"is ready %u", (unsigned int)[self.random randomBelow:20]]];
+		arrow.actions = @[ [MAAction actionWithName:[NSString stringWithFormat:@"blink %u", (unsigned int)[self.random randomBelow:20]]] ];
+		[nodes addObject:newNode];
+		[arrows addObject:arrow];
+		return [NSString stringWithFormat:@"add %@", newNode.name];
+	} else {
+		NSUInteger index = [self.random randomBelow:[arrows count]];
+		MAArrow *arrow = arrows[index];
+		arrow.sourceNode = nil;
+		arrow.targetNode = nil;
+		[arrows removeObjectAtIndex:index];
+		return [NSString stringWithFormat:@"remove arrow %lu", (unsigned long)index];
+	}
+}
+
+#pragma mark - Utility
+
+@end
@@ -0,0 +1,43 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+@class MAStateMachineCodeTemplate;
+
+// The result of running a sketch built by MAHostSketchBuilder
+@interface MAHostSketchRun : NSObject
+
+@property (nonatomic) NSUInteger textSize; // Of the sketch's object file
+@property (nonatomic) double nanosecondsPerUpdate;
+@property (nonatomic, copy) NSString *checksum; // Of the serial output and the conditions & actions called, in order
+@property (nonatomic) double serialBytesPerUpdate;
+
+@end
+
+// Builds generated sketches for the host against HostArduino.h (standing in for Arduino.h) and runs them, for the
+// comparisons in machino-gen. The headers a sketch includes are copied into a temporary build directory first.
+@interface MAHostSketchBuilder : NSObject
+
+@property (nonatomic, copy) NSString *compiler; // Defaults to $CXX, or c++
+@property (nonatomic, copy) NSString *hostHeaderPath; // HostArduino.h
+@property (nonatomic, copy) NSString *messagingHeaderPath;
+@property (nonatomic, copy) NSString *tableHeaderPath; // StateMachineTable.h
+@property (nonatomic) NSUInteger iterationCount; // Calls of loop() timed
+@property (nonatomic, copy) NSString *serialOutputPath; // Where runs record what the sketch wrote to Serial, if set
+
++ (void)writeHostHooksIntoTemplate:(MAStateMachineCodeTemplate *)template; // Conditions & actions call hostCondition/hostAction with their index
+
+- (BOOL)prepareWithOutput:(void(^)(NSString *line))output;
+- (MAHostSketchRun *)runCode:(NSString *)code name:(NSString *)name definitions:(NSArray *)definitions output:(void(^)(NSString *line))output; // Definitions (NAME=VALUE) apply to the sketch & the host main, nil if a step failed
+- (void)cleanUp;
+
+@end
@@ -0,0 +1,168 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAHostSketch.h"
+#import "MAStateMachineCodeTemplate.h"
+#import "MAGraphAnalysis.h"
+#import "MASimulator.h"
+#import "Graph.h"
+
+static NSString * const kHostMainSource = @"#define HOST_ARDUINO_MAIN\n#include \"Arduino.h\"\n";
+
+#pragma mark - MAHostSketchRun
+
+@implementation MAHostSketchRun
+
+@end
+
+#pragma mark - Private Interface
+
+@interface MAHostSketchBuilder ()
+
+@property (nonatomic, copy) NSString *buildDirectory;
+
+@end
+
+#pragma mark - MAHostSketchBuilder
+
+@implementation MAHostSketchBuilder
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_compiler = [[NSProcessInfo processInfo] environment][@"CXX"] ?: @"c++";
+		_iterationCount = 100000;
+	}
+	return self;
+}
+
+#pragma mark - Hooks
+
++ (void)writeHostHooksIntoTemplate:(MAStateMachineCodeTemplate *)template
+{
+	MAGraphAnalysis *analysis = [MAGraphAnalysis analysisWithNodes:template.states arrows:template.transitions];
+	[[analysis conditions] enumerateObjectsUsingBlock:^(MACondition *condition, NSUInteger index, BOOL *stop) {
+		NSString *code = [NSString stringWithFormat:@"return hostCondition(%lu);", (unsigned long)index];
+		[self setCode:code inFunctionWithRange:[template rangeForCondition:condition] ofTemplate:template];
+	}];
+	[[analysis actions] enumerateObjectsUsingBlock:^(MAAction *action, NSUInteger index, BOOL *stop) {
+		NSString *code = [NSString stringWithFormat:@"hostAction(%lu);", (unsigned long)index];
+		[self setCode:code inFunctionWithRange:[template rangeForAction:action] ofTemplate:template];
+	}];
+}
+
++ (void)setCode:(NSString *)code inFunctionWithRange:(NSRange)functionRange ofTemplate:(MAStateMachineCodeTemplate *)template
+{
+	// The one editable range inside the function, keeping its newline & indent
+	for (id key in [template keysForEditableRangesTouchingRange:functionRange]) {
+		NSRange range = [template editableRangeForKey:key];
+		if (range.location <= functionRange.location || NSMaxRange(range) >= NSMaxRange(functionRange)) continue;
+		NSString *oldCode = [template codeForEditableRangeWithKey:key];
+		NSRange textRange = [oldCode rangeOfCharacterFromSet:[[NSCharacterSet whitespaceAndNewlineCharacterSet] invertedSet]];
+		NSString *prefix = (textRange.location != NSNotFound) ? [oldCode substringToIndex:textRange.location] : oldCode;
+		[template setCode:[prefix stringByAppendingString:code] forEditableRangeWithKey:key];
+		return;
+	}
+}
+
+#pragma mark - Building
+
+- (BOOL)prepareWithOutput:(void(^)(NSString *line))output
+{
+	NSDictionary *headers = @{ @"Arduino.h" : self.hostHeaderPath ?: @"", @"Messaging.h" : self.messagingHeaderPath ?: @"", @"StateMachineTable.h" : self.tableHeaderPath ?: @"" };
+	NSString *name = [NSString stringWithFormat:@"machino-host-%d", [[NSProcessInfo processInfo] processIdentifier]];
+	self.buildDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	[fileManager removeItemAtPath:self.buildDirectory error:nil];
+	if (![fileManager createDirectoryAtPath:self.buildDirectory withIntermediateDirectories:YES attributes:nil error:nil]) {
+		output([NSString stringWithFormat:@"could not create %@", self.buildDirectory]);
+		return NO;
+	}
+	for (NSString *headerName in headers) {
+		NSString *path = headers[headerName];
+		if (![fileManager copyItemAtPath:path toPath:[self.buildDirectory stringByAppendingPathComponent:headerName] error:nil]) {
+			output([NSString stringWithFormat:@"%@ not found (%@)", headerName, [path length] ? path : @"no path"]);
+			return NO;
+		}
+	}
+	NSString *mainPath = [self.buildDirectory stringByAppendingPathComponent:@"main.cpp"];
+	return [kHostMainSource writeToFile:mainPath atomically:YES encoding:NSUTF8StringEncoding error:nil];
+}
+
+- (void)cleanUp
+{
+	if (self.buildDirectory) [[NSFileManager defaultManager] removeItemAtPath:self.buildDirectory error:nil];
+	self.buildDirectory = nil;
+}
+
+- (MAHostSketchRun *)runCode:(NSString *)code name:(NSString *)name definitions:(NSArray *)definitions output:(void(^)(NSString *line))output
+{
+	NSString *sourcePath = [self.buildDirectory stringByAppendingPathComponent:[name stringByAppendingPathExtension:@"cpp"]];
+	NSString *objectPath = [self.buildDirectory stringByAppendingPathComponent:[name stringByAppendingPathExtension:@"o"]];
+	NSString *mainPath = [self.buildDirectory stringByAppendingPathComponent:@"main.cpp"];
+	NSString *mainObjectPath = [self.buildDirectory stringByAppendingPathComponent:[name stringByAppendingString:@"-main.o"]];
+	NSString *executablePath = [self.buildDirectory stringByAppendingPathComponent:name];
+	[[MASimulator hostSourceForCode:code] writeToFile:sourcePath atomically:YES encoding:NSUTF8StringEncoding error:nil];
+	NSMutableArray *flags = [NSMutableArray array];
+	for (NSString *definition in definitions) {
+		[flags addObject:[@"-D" stringByAppendingString:definition]];
+	}
+	// Compile, measure & link
+	if (![self compileArguments:[flags arrayByAddingObjectsFromArray:@[ @"-c", sourcePath, @"-o", objectPath ]] output:output]) return nil;
+	if (![self compileArguments:[flags arrayByAddingObjectsFromArray:@[ @"-c", mainPath, @"-o", mainObjectPath ]] output:output]) return nil;
+	if (![self compileArguments:@[ objectPath, mainObjectPath, @"-o", executablePath ] output:output]) return nil;
+	MAHostSketchRun *run = [[MAHostSketchRun alloc] init];
+	NSArray *sizeLines = [[self outputOfTool:@"size" arguments:@[ objectPath ] status:NULL] componentsSeparatedByString:@"\n"];
+	run.textSize = ([sizeLines count] > 1) ? [sizeLines[1] integerValue] : 0; // Text column
+	// Run
+	int status = 0;
+	NSArray *runArguments = @[ [NSString stringWithFormat:@"%lu", (unsigned long)self.iterationCount] ];
+	if (self.serialOutputPath) runArguments = [runArguments arrayByAddingObject:self.serialOutputPath];
+	NSString *runOutput = [self outputOfTool:executablePath arguments:runArguments status:&status];
+	NSArray *values = [[runOutput stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] componentsSeparatedByString:@" "];
+	if (status != 0 || [values count] != 3) {
+		output([NSString stringWithFormat:@"running %@ failed: %@", name, runOutput]);
+		return nil;
+	}
+	run.nanosecondsPerUpdate = [values[0] doubleValue];
+	run.checksum = values[1];
+	run.serialBytesPerUpdate = [values[2] doubleValue] / MAX(self.iterationCount, 1);
+	return run;
+}
+
+- (BOOL)compileArguments:(NSArray *)arguments output:(void(^)(NSString *line))output
+{
+	NSArray *flags = @[ @"-O2", @"-w", @"-I", self.buildDirectory ];
+	int status = 0;
+	NSString *compilerOutput = [self outputOfTool:self.compiler arguments:[flags arrayByAddingObjectsFromArray:arguments] status:&status];
+	if (status == 0) return YES;
+	output([NSString stringWithFormat:@"%@ failed:\n%@", self.compiler, compilerOutput]);
+	return NO;
+}
+
+- (NSString *)outputOfTool:(NSString *)tool arguments:(NSArray *)arguments status:(int *)status
+{
+	// Through env, so tools are looked up in PATH
+	NSTask *task = [[NSTask alloc] init];
+	[task setLaunchPath:@"/usr/bin/env"];
+	[task setArguments:[@[ tool ] arrayByAddingObjectsFromArray:arguments]];
+	NSPipe *pipe = [NSPipe pipe];
+	[task setStandardOutput:pipe];
+	[task setStandardError:pipe];
+	[task launch];
+	NSData *data = [[pipe fileHandleForReading] readDataToEndOfFile];
+	[task waitUntilExit];
+	if (status) *status = [task terminationStatus];
+	return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+}
+
+@end
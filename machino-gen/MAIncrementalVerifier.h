@@ -0,0 +1,26 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAVerifier.h"
+
+// Checks incremental code generation against full regeneration. Every iteration makes random edits to the graph (recorded
+// as MAGraphChange's the way the graph view does) and to the editable code, then requires the incrementally generated
+// template to equal a regenerated & merged one: code, editable ranges, extra ranges, and the text edits between them.
+// In the background, the edits are requested from an MACodeGenerator with short pauses (so some requests are debounced,
+// cancelled or delivered late, and code edits make it generate again), and the code is flushed & compared now and then.
+@interface MAIncrementalVerifier : MAVerifier
+
+@property (nonatomic) NSUInteger stateCount;
+@property (nonatomic) NSUInteger machineSize;
+@property (nonatomic) BOOL insertLoggingCode;
+@property (nonatomic) BOOL generatesInBackground;
+
+@end
@@ -0,0 +1,385 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAIncrementalVerifier.h"
+#import "MARandom.h"
+#import "MASyntheticGraph.h"
+#import "MAStateMachineCodeTemplate.h"
+#import "MACodeGenerator.h"
+#import "Graph.h"
+#import <unistd.h>
+
+static NSString * const kIndentString = @"  ";
+static const NSUInteger kMaximumGraphEditsPerIteration = 3;
+static const NSUInteger kMaximumCodeEditsPerIteration = 2;
+static const NSTimeInterval kBackgroundDebounceInterval = 0.002;
+static const NSUInteger kMaximumBackgroundPause = 3; // Milliseconds between iterations
+static const NSUInteger kBackgroundFlushInterval = 20; // Iterations between flushes, on average
+
+#pragma mark - Private Interface
+
+@interface MAIncrementalVerifier ()
+
+@property (nonatomic, strong) NSMutableArray *states;
+@property (nonatomic, strong) NSMutableArray *transitions;
+@property (nonatomic, strong) NSMutableDictionary *conditionsByName; // Shared by name, like the graph view does
+@property (nonatomic, strong) NSMutableDictionary *actionsByName;
+@property (nonatomic, strong) NSMutableArray *changes;
+
+@end
+
+#pragma mark - Implementation
+
+@implementation MAIncrementalVerifier
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateCount = 200;
+		_machineSize = 10;
+		self.iterationCount = 1000;
+	}
+	return self;
+}
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	[self createGraph];
+	if (self.generatesInBackground) return [self runInBackgroundWithOutput:output];
+	// Start from a full generation
+	MAStateMachineCodeTemplate *template = [self templateReusingSymbolsOfTemplate:nil];
+	[template generate];
+	unsigned long long replacedLength = 0;
+	unsigned long long totalLength = 0;
+	for (NSUInteger iteration = 0; iteration < self.iterationCount; iteration++) {
+		// Edit
+		NSUInteger codeEditCount = [self.random randomBelow:kMaximumCodeEditsPerIteration + 1];
+		for (NSUInteger i = 0; i < codeEditCount; i++) {
+			[self editCodeOfTemplate:template iteration:iteration];
+		}
+		self.changes = [NSMutableArray array];
+		NSUInteger graphEditCount = 1 + [self.random randomBelow:kMaximumGraphEditsPerIteration];
+		for (NSUInteger i = 0; i < graphEditCount; i++) {
+			[self editGraph];
+		}
+		// Generate both ways (the full generation first, it leaves the shared symbols as the incremental one would)
+		MAStateMachineCodeTemplate *fullTemplate = [self templateReusingSymbolsOfTemplate:template];
+		[fullTemplate generate];
+		[fullTemplate mergeCodeFromTemplate:template];
+		MAStateMachineCodeTemplate *incrementalTemplate = [self templateReusingSymbolsOfTemplate:template];
+		[incrementalTemplate generateFromTemplate:template changes:self.changes];
+		// Compare
+		NSString *mismatch = [self mismatchBetweenTemplate:incrementalTemplate andTemplate:fullTemplate];
+		if (!mismatch) mismatch = [self mismatchOfEditsFromTemplate:template toTemplate:incrementalTemplate replacedLength:&replacedLength];
+		if (mismatch) {
+			output([NSString stringWithFormat:@"iteration %lu (seed %u): %@", (unsigned long)iteration, (unsigned int)self.seed, mismatch]);
+			output([NSString stringWithFormat:@"changes: %@", self.changes]);
+			return NO;
+		}
+		totalLength += [incrementalTemplate codeLength];
+		template = incrementalTemplate;
+	}
+	double replacedPercentage = (totalLength > 0) ? 100.0 * replacedLength / totalLength : 0;
+	output([NSString stringWithFormat:@"%lu iterations ok, %lu states at the end, edits replaced %.2f%% of the code on average",
+		(unsigned long)self.iterationCount, (unsigned long)[self.states count], replacedPercentage]);
+	return YES;
+}
+
+- (BOOL)runInBackgroundWithOutput:(void(^)(NSString *line))output
+{
+	// A serial queue stands in for the main queue: requests, deliveries & edits all happen on it
+	dispatch_queue_t queue = dispatch_queue_create("machino-gen.verify.incremental", DISPATCH_QUEUE_SERIAL);
+	MACodeGenerator *generator = [[MACodeGenerator alloc] init];
+	generator.completionQueue = queue;
+	generator.debounceInterval = kBackgroundDebounceInterval;
+	generator.indentString = kIndentString;
+	MAStateMachineCodeTemplateOptions options = self.insertLoggingCode ? MAInsertLoggingCode : 0;
+	// Shown the way MACodeController does, applying the edits to a copy of the text when it's in sync
+	NSMutableString *text = [NSMutableString string];
+	__block NSUInteger deliveryCount = 0;
+	__block NSTimeInterval deliveryTime = 0;
+	__block NSTimeInterval maximumDeliveryTime = 0;
+	void (^show)(MAStateMachineCodeTemplate *) = ^(MAStateMachineCodeTemplate *codeTemplate) {
+		NSDate *start = [NSDate date];
+		MACodeTemplate *oldTemplate = generator.codeTemplate;
+		if (oldTemplate && [text length] == [oldTemplate codeLength]) {
+			for (MACodeEdit *edit in [[codeTemplate editsFromTemplate:oldTemplate] reverseObjectEnumerator]) {
+				[text replaceCharactersInRange:edit.replacedRange withString:[codeTemplate codeInRange:edit.range]];
+			}
+		} else {
+			[text setString:[codeTemplate code]];
+		}
+		generator.codeTemplate = codeTemplate;
+		NSTimeInterval time = -[start timeIntervalSinceNow];
+		deliveryTime += time;
+		maximumDeliveryTime = MAX(maximumDeliveryTime, time);
+		deliveryCount++;
+	};
+	dispatch_sync(queue, ^{
+		show([generator codeForStates:self.states transitions:self.transitions options:options]);
+	});
+	NSTimeInterval requestTime = 0;
+	NSTimeInterval maximumRequestTime = 0;
+	NSUInteger flushCount = 0;
+	for (NSUInteger iteration = 0; iteration < self.iterationCount; iteration++) {
+		__block NSString *mismatch = nil;
+		__block NSTimeInterval time = 0;
+		BOOL flushes = ([self.random randomBelow:kBackgroundFlushInterval] == 0 || iteration+1 == self.iterationCount);
+		dispatch_sync(queue, ^{
+			// Edit, as typed into the text view
+			NSUInteger codeEditCount = [self.random randomBelow:kMaximumCodeEditsPerIteration + 1];
+			for (NSUInteger i = 0; i < codeEditCount; i++) {
+				[self editCodeOfTemplate:generator.codeTemplate iteration:iteration];
+			}
+			if (codeEditCount > 0) [text setString:[generator.codeTemplate code]];
+			self.changes = [NSMutableArray array];
+			NSUInteger graphEditCount = 1 + [self.random randomBelow:kMaximumGraphEditsPerIteration];
+			for (NSUInteger i = 0; i < graphEditCount; i++) {
+				[self editGraph];
+			}
+			// Request
+			NSDate *start = [NSDate date];
+			[generator requestCodeForStates:self.states transitions:self.transitions changes:self.changes options:options completion:show];
+			time = -[start timeIntervalSinceNow];
+			// Now and then take the latest code right away (as before a run), it has to be what a full generation gives
+			if (flushes) {
+				MAStateMachineCodeTemplate *editedTemplate = generator.codeTemplate;
+				[generator flushRequests];
+				MAStateMachineCodeTemplate *fullTemplate = [self templateReusingSymbolsOfTemplate:generator.codeTemplate];
+				[fullTemplate generate];
+				[fullTemplate mergeCodeFromTemplate:editedTemplate];
+				mismatch = [self mismatchBetweenTemplate:generator.codeTemplate andTemplate:fullTemplate];
+				if (!mismatch && ![text isEqualToString:[generator.codeTemplate code]]) mismatch = @"applying the edits doesn't give the new code";
+			}
+		});
+		if (mismatch) {
+			output([NSString stringWithFormat:@"iteration %lu (seed %u): %@", (unsigned long)iteration, (unsigned int)self.seed, mismatch]);
+			return NO;
+		}
+		requestTime += time;
+		maximumRequestTime = MAX(maximumRequestTime, time);
+		if (flushes) flushCount++;
+		// Some requests finish in the pause, others are debounced or cancelled by the next one
+		usleep((useconds_t)[self.random randomBelow:kMaximumBackgroundPause + 1] * 1000);
+	}
+	dispatch_sync(queue, ^{}); // Deliveries still queued
+	double averageRequestTime = (self.iterationCount > 0) ? 1000 * requestTime / self.iterationCount : 0;
+	double averageDeliveryTime = (deliveryCount > 0) ? 1000 * deliveryTime / deliveryCount : 0;
+	output([NSString stringWithFormat:@"%lu iterations ok (%lu flushes), %lu states at the end, %lu of the requests delivered",
+		(unsigned long)self.iterationCount, (unsigned long)flushCount, (unsigned long)[self.states count], (unsigned long)deliveryCount]);
+	output([NSString stringWithFormat:@"on the main queue: %.3f ms per request (at most %.3f ms), %.3f ms per delivery (at most %.3f ms)",
+		averageRequestTime, 1000 * maximumRequestTime, averageDeliveryTime, 1000 * maximumDeliveryTime]);
+	return YES;
+}
+
+- (void)createGraph
+{
+	MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:self.stateCount machineSize:self.machineSize density:MASyntheticGraphSparse seed:self.seed];
+	self.states = [graph.states mutableCopy];
+	self.transitions = [graph.transitions mutableCopy];
+	self.conditionsByName = [NSMutableDictionary dictionary];
+	self.actionsByName = [NSMutableDictionary dictionary];
+	for (MAArrow *transition in self.transitions) {
+		if (transition.condition) self.conditionsByName[transition.condition.name] = transition.condition;
+		for (MAAction *action in transition.actions) {
+			self.actionsByName[action.name] = action;
+		}
+	}
+}
+
+- (MAStateMachineCodeTemplate *)templateReusingSymbolsOfTemplate:(MAStateMachineCodeTemplate *)oldTemplate
+{
+	MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+	template.states = self.states;
+	template.transitions = self.transitions;
+	template.options = self.insertLoggingCode ? MAInsertLoggingCode : 0;
+	template.indentString = kIndentString;
+	template.symbols = oldTemplate.symbols;
+	return template;
+}
+
+#pragma mark - Comparing
+
+- (NSString *)mismatchBetweenTemplate:(MACodeTemplate *)template andTemplate:(MACodeTemplate *)expectedTemplate
+{
+	NSString *code = [template code];
+	NSString *expectedCode = [expectedTemplate code];
+	if (![code isEqualToString:expectedCode]) {
+		NSUInteger index = 0;
+		NSUInteger length = MIN([code length], [expectedCode length]);
+		while (index < length && [code characterAtIndex:index] == [expectedCode characterAtIndex:index]) index++;
+		NSRange lineRange = [expectedCode lineRangeForRange:NSMakeRange(MIN(index, [expectedCode length]), 0)];
+		return [NSString stringWithFormat:@"code differs at %lu, expected line: %@", (unsigned long)index, [expectedCode substringWithRange:lineRange]];
+	}
+	if (![[template editableRanges] isEqualToDictionary:[expectedTemplate editableRanges]]) return @"editable ranges differ";
+	if (![[template extraRanges] isEqualToDictionary:[expectedTemplate extraRanges]]) return @"extra ranges differ";
+	return nil;
+}
+
+- (NSString *)mismatchOfEditsFromTemplate:(MACodeTemplate *)oldTemplate toTemplate:(MACodeTemplate *)template replacedLength:(unsigned long long *)replacedLength
+{
+	NSMutableString *code = [[oldTemplate code] mutableCopy];
+	for (MACodeEdit *edit in [[template editsFromTemplate:oldTemplate] reverseObjectEnumerator]) {
+		[code replaceCharactersInRange:edit.replacedRange withString:[template codeInRange:edit.range]];
+		*replacedLength += edit.range.length;
+	}
+	return [code isEqualToString:[template code]] ? nil : @"applying the edits doesn't give the new code";
+}
+
+#pragma mark - Code Edits
+
+- (void)editCodeOfTemplate:(MACodeTemplate *)template iteration:(NSUInteger)iteration
+{
+	NSArray *keys = [[[template editableRanges] allKeys] sortedArrayUsingSelector:@selector(compare:)];
+	if ([keys count] == 0) return;
+	id key = keys[[self.random randomBelow:[keys count]]];
+	NSString *code = [template codeForEditableRangeWithKey:key];
+	switch ([self.random randomBelow:4]) {
+		case 0: code = @""; break; // Cleared
+		case 1: code = @"\n  "; break; // Only whitespace, dropped when the range goes away
+		case 2: code = [code stringByAppendingFormat:@"\n  counter += %lu;", (unsigned long)iteration]; break;
+		default: code = [NSString stringWithFormat:@"\n  // Edit %lu", (unsigned long)iteration]; break;
+	}
+	[template setCode:code forEditableRangeWithKey:key];
+}
+
+#pragma mark - Graph Edits
+
+- (void)editGraph
+{
+	if ([self.states count] < 2) {
+		[self addState];
+		return;
+	}
+	switch ([self.random randomBelow:9]) {
+		case 0: [self addState]; break;
+		case 1: [self removeState:[self randomState]]; break;
+		case 2: [self renameState:[self randomState]]; break;
+		case 3: [self toggleInitialStateOfState:[self randomState]]; break;
+		case 4: [self addTransitionFromState:[self randomState] toState:[self randomState]]; break;
+		case 5: [self removeTransition:[self randomTransition]]; break;
+		case 6: [self moveEndOfTransition:[self randomTransition]]; break;
+		case 7: [self setRandomConditionForTransition:[self randomTransition]]; break;
+		default: [self setRandomActionsForTransition:[self randomTransition]]; break;
+	}
+}
+
+- (void)addState
+{
+	MANode *state = [[MANode alloc] init];
+	state.name = [self randomName];
+	state.position = NSMakePoint([self.random randomBelow:1000], [self.random randomBelow:1000]);
+	[self.states addObject:state];
+	[self.changes addObject:[MAGraphChange changeWithType:MAGraphChangeNodeAdded node:state]];
+	if ([self.states count] > 1 && [self.random randomBelow:2] == 0) [self addTransitionFromState:[self randomState] toState:state];
+}
+
+- (void)removeState:(MANode *)state
+{
+	[self.states removeObject:state];
+	[self.changes addObject:[MAGraphChange changeWithType:MAGraphChangeNodeRemoved node:state]];
+	while ([state.arrows count] > 0) {
+		[self removeTransition:state.arrows[0]];
+	}
+}
+
+- (void)renameState:(MANode *)state
+{
+	state.name = [self randomName];
+	[self.changes addObject:[MAGraphChange changeWithType:MAGraphChangeNodeRenamed node:state]];
+}
+
+- (void)toggleInitialStateOfState:(MANode *)state
+{
+	state.isInitialState = !state.isInitialState;
+	[self.changes addObject:[MAGraphChange changeWithType:MAGraphChangeNodeInitialStateChanged node:state]];
+}
+
+- (void)addTransitionFromState:(MANode *)sourceState toState:(MANode *)targetState
+{
+	MAArrow *transition = [[MAArrow alloc] init];
+	transition.sourceNode = sourceState;
+	transition.targetNode = targetState;
+	[self.transitions addObject:transition];
+	[self.changes addObject:[MAGraphChange changeWithType:MAGraphChangeArrowAdded arrow:transition]];
+	[self setRandomConditionForTransition:transition];
+	[self setRandomActionsForTransition:transition];
+}
+
+- (void)removeTransition:(MAArrow *)transition
+{
+	if (!transition) return;
+	[self.transitions removeObject:transition];
+	[self.changes addObject:[MAGraphChange changeWithType:MAGraphChangeArrowRemoved arrow:transition]];
+	transition.sourceNode = nil;
+	transition.targetNode = nil;
+}
+
+- (void)moveEndOfTransition:(MAArrow *)transition
+{
+	if (!transition) return;
+	MAArrowEnd end = ([self.random randomBelow:2] == 0) ? MAArrowTail : MAArrowHead;
+	MANode *previousSourceNode = transition.sourceNode;
+	[transition setNode:[self randomState] forEnd:end];
+	[self.changes addObject:[MAGraphChange changeWithType:MAGraphChangeArrowNodeChanged arrow:transition previousSourceNode:previousSourceNode]];
+}
+
+- (void)setRandomConditionForTransition:(MAArrow *)transition
+{
+	if (!transition) return;
+	NSString *name = [self randomName];
+	if ([self.random randomBelow:4] == 0) {
+		transition.condition = nil;
+	} else {
+		if (!self.conditionsByName[name]) self.conditionsByName[name] = [MACondition conditionWithName:name];
+		transition.condition = self.conditionsByName[name];
+	}
+	[self.changes addObject:[MAGraphChange changeWithType:MAGraphChangeArrowConditionChanged arrow:transition]];
+}
+
+- (void)setRandomActionsForTransition:(MAArrow *)transition
+{
+	if (!transition) return;
+	NSUInteger actionCount = [self.random randomBelow:3];
+	NSMutableArray *actions = [NSMutableArray arrayWithCapacity:actionCount];
+	for (NSUInteger i = 0; i < actionCount; i++) {
+		NSString *name = [self randomName];
+		if (!self.actionsByName[name]) self.actionsByName[name] = [MAAction actionWithName:name];
+		[actions addObject:self.actionsByName[name]];
+	}
+	transition.actions = actions;
+	[self.changes addObject:[MAGraphChange changeWithType:MAGraphChangeArrowActionsChanged arrow:transition]];
+}
+
+#pragma mark - Random
+
+- (MANode *)randomState
+{
+	return self.states[[self.random randomBelow:[self.states count]]];
+}
+
+- (MAArrow *)randomTransition
+{
+	if ([self.transitions count] == 0) return nil;
+	return self.transitions[[self.random randomBelow:[self.transitions count]]];
+}
+
+- (NSString *)randomName
+{
+	// Few distinct names, so symbol names collide, get suffixes and shift around
+	NSArray *names = @[ @"idle", @"Idle", @"state 1", @"condition 2", @"action 3", @"loop", @"updateStateMachine1", @"go", @"2go", @"stop!" ];
+	NSUInteger index = [self.random randomBelow:[names count] + 2];
+	if (index >= [names count]) return [NSString stringWithFormat:@"name %lu", (unsigned long)[self.random randomBelow:50]];
+	return names[index];
+}
+
+@end
@@ -0,0 +1,29 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+#import "MAMessageDecoder.h"
+
+// A synthetic serial recording of a logging sketch, encoded the way Messaging.h (or MessagingV1.h) sends it: random
+// loop() iterations of events, the hello, some dropped messages, and user serial output in between. Keeps the events &
+// user serial output in it, for checking and timing MAMessageDecoder in machino-gen.
+@interface MAMessageRecording : NSObject
+
+@property (nonatomic, readonly) MAMessageProtocolVersion protocolVersion;
+@property (nonatomic, readonly) unsigned long baudRate; // In the hello
+@property (nonatomic, copy, readonly) NSData *bytes; // As sent over serial
+@property (nonatomic, copy, readonly) NSData *events; // MAMessageEvents, see +appendEvent:toData:
+@property (nonatomic, copy, readonly) NSData *userSerialBytes;
+
++ (instancetype)recordingWithProtocolVersion:(MAMessageProtocolVersion)version iterationCount:(NSUInteger)iterationCount seed:(UInt32)seed;
++ (void)appendEvent:(const MAMessageEvent *)event toData:(NSMutableData *)data; // Without padding garbage, so event data compares with -isEqual:
+
+@end
@@ -0,0 +1,216 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAMessageRecording.h"
+#import "MARandom.h"
+
+static const unsigned long kRecordingBaudRate = 115200;
+static const NSUInteger kMaximumConditionsPerIteration = 3;
+static const NSUInteger kMaximumActionsPerTransition = 2;
+static NSString * const kUserSerialFormat = @"sensor %u\r\n";
+
+#pragma mark - Private Interface
+
+@interface MAMessageRecording ()
+
+@property (nonatomic, readwrite) MAMessageProtocolVersion protocolVersion;
+@property (nonatomic, strong) NSMutableData *mutableBytes;
+@property (nonatomic, strong) NSMutableData *mutableEvents;
+@property (nonatomic, strong) NSMutableData *mutableUserSerialBytes;
+@property (nonatomic, strong) NSMutableData *frame; // Version 2, before encoding
+@property (nonatomic, strong) MARandom *random;
+
+@end
+
+#pragma mark - Implementation
+
+@implementation MAMessageRecording
+
++ (instancetype)recordingWithProtocolVersion:(MAMessageProtocolVersion)version iterationCount:(NSUInteger)iterationCount seed:(UInt32)seed
+{
+	MAMessageRecording *recording = [[self alloc] init];
+	recording.protocolVersion = version;
+	recording.random = [[MARandom alloc] initWithSeed:seed];
+	[recording recordIterations:iterationCount];
+	return recording;
+}
+
++ (void)appendEvent:(const MAMessageEvent *)event toData:(NSMutableData *)data
+{
+	MAMessageEvent copy;
+	memset(&copy, 0, sizeof(copy));
+	copy.type = event->type;
+	copy.arguments[0] = event->arguments[0];
+	copy.arguments[1] = event->arguments[1];
+	[data appendBytes:&copy length:sizeof(copy)];
+}
+
+- (NSData *)bytes
+{
+	return self.mutableBytes;
+}
+
+- (NSData *)events
+{
+	return self.mutableEvents;
+}
+
+- (NSData *)userSerialBytes
+{
+	return self.mutableUserSerialBytes;
+}
+
+- (unsigned long)baudRate
+{
+	return kRecordingBaudRate;
+}
+
+#pragma mark - Recording
+
+- (void)recordIterations:(NSUInteger)iterationCount
+{
+	self.mutableBytes = [NSMutableData data];
+	self.mutableEvents = [NSMutableData data];
+	self.mutableUserSerialBytes = [NSMutableData data];
+	self.frame = [NSMutableData data];
+	[self recordHello];
+	for (NSUInteger iteration = 0; iteration < iterationCount; iteration++) {
+		// Like the generated updateStateMachines(), with the odd drop & print in between
+		if ([self.random randomBelow:64] == 0) [self recordEventWithType:MAMessageEventDroppedMessages argument:1 + [self.random randomBelow:100] argument:0];
+		[self recordEventWithType:MAMessageEventIterationStart argument:0 argument:0];
+		[self recordEventWithType:MAMessageEventCurrentState argument:[self randomID] argument:0];
+		UInt16 transitionID = [self randomID];
+		NSUInteger conditionCount = [self.random randomBelow:kMaximumConditionsPerIteration + 1];
+		for (NSUInteger i = 0; i < conditionCount; i++) {
+			[self recordEventWithType:MAMessageEventWillCheckCondition argument:transitionID argument:[self randomID]];
+		}
+		if ([self.random randomBelow:2] == 0) {
+			[self recordEventWithType:MAMessageEventWillPerformTransition argument:transitionID argument:0];
+			NSUInteger actionCount = [self.random randomBelow:kMaximumActionsPerTransition + 1];
+			for (NSUInteger i = 0; i < actionCount; i++) {
+				[self recordEventWithType:MAMessageEventWillPerformAction argument:transitionID argument:i];
+			}
+		}
+		[self recordEventWithType:MAMessageEventIterationEnd argument:0 argument:0];
+		[self endFrame];
+		if ([self.random randomBelow:8] == 0) [self recordUserSerial];
+	}
+}
+
+- (void)recordHello
+{
+	if (self.protocolVersion == MAMessageProtocolVersion1) {
+		[self appendVersion1MessageWithType:8 arguments:(UInt16[]){ kRecordingBaudRate >> 16, kRecordingBaudRate & 0xFFFF } count:2];
+	} else {
+		[self.frame appendBytes:(Byte[]){ 3, 2 } length:2]; // Hello frame, protocol version
+		[self appendVarint:kRecordingBaudRate / 100];
+		[self appendVarint:128]; // Buffer size
+		[self endFrame];
+	}
+}
+
+- (void)recordEventWithType:(MAMessageEventType)type argument:(UInt16)argument0 argument:(UInt16)argument1
+{
+	MAMessageEvent event = { type, { argument0, argument1 } };
+	[[self class] appendEvent:&event toData:self.mutableEvents];
+	NSUInteger argumentCount = (type == MAMessageEventWillCheckCondition || type == MAMessageEventWillPerformAction) ? 2 : (type >= MAMessageEventCurrentState) ? 1 : 0;
+	if (self.protocolVersion == MAMessageProtocolVersion1) {
+		[self appendVersion1MessageWithType:type arguments:event.arguments count:argumentCount];
+	} else {
+		if ([self.frame length] == 0) [self.frame appendBytes:(Byte[]){ 1 } length:1]; // Events frame
+		Byte typeByte = type;
+		[self.frame appendBytes:&typeByte length:1];
+		for (NSUInteger i = 0; i < argumentCount; i++) {
+			[self appendVarint:event.arguments[i]];
+		}
+	}
+}
+
+- (void)recordUserSerial
+{
+	NSData *text = [[NSString stringWithFormat:kUserSerialFormat, (unsigned int)[self.random randomBelow:100000]] dataUsingEncoding:NSUTF8StringEncoding];
+	[self.mutableUserSerialBytes appendData:text];
+	if (self.protocolVersion == MAMessageProtocolVersion2 && [self.random randomBelow:2] == 0) {
+		// Through MessagingSerial
+		[self.frame appendBytes:(Byte[]){ 2 } length:1];
+		[self.frame appendData:text];
+		[self endFrame];
+	} else {
+		[self.mutableBytes appendData:text];
+	}
+}
+
+#pragma mark Encoding
+
+- (void)appendVersion1MessageWithType:(Byte)type arguments:(const UInt16 *)arguments count:(NSUInteger)count
+{
+	Byte header[] = { 17, 31, 23, type, 0, count * 2 };
+	[self.mutableBytes appendBytes:header length:sizeof(header)];
+	for (NSUInteger i = 0; i < count; i++) {
+		Byte argument[] = { arguments[i] >> 8, arguments[i] & 255 };
+		[self.mutableBytes appendBytes:argument length:2];
+	}
+}
+
+- (void)appendVarint:(NSUInteger)value
+{
+	while (value >= 128) {
+		Byte byte = (value & 127) | 128;
+		[self.frame appendBytes:&byte length:1];
+		value >>= 7;
+	}
+	Byte byte = value;
+	[self.frame appendBytes:&byte length:1];
+}
+
+- (void)endFrame
+{
+	// CRC-16/CCITT-FALSE, COBS (frames are shorter than 254 bytes) & the delimiters
+	if ([self.frame length] == 0) return;
+	const Byte *bytes = [self.frame bytes];
+	UInt16 crc = 0xFFFF;
+	for (NSUInteger i = 0; i < [self.frame length]; i++) {
+		crc ^= (UInt16)bytes[i] << 8;
+		for (int bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (UInt16)((crc << 1) ^ 0x1021) : (UInt16)(crc << 1);
+	}
+	[self.frame appendBytes:(Byte[]){ crc >> 8, crc & 255 } length:2];
+	bytes = [self.frame bytes];
+	NSUInteger length = [self.frame length];
+	Byte encoded[length + 3];
+	NSUInteger encodedLength = 0;
+	encoded[encodedLength++] = 0;
+	NSUInteger codeIndex = encodedLength++;
+	Byte code = 1;
+	for (NSUInteger i = 0; i < length; i++) {
+		if (bytes[i] != 0) {
+			encoded[encodedLength++] = bytes[i];
+			code++;
+		} else {
+			encoded[codeIndex] = code;
+			codeIndex = encodedLength++;
+			code = 1;
+		}
+	}
+	encoded[codeIndex] = code;
+	encoded[encodedLength++] = 0;
+	[self.mutableBytes appendBytes:encoded length:encodedLength];
+	[self.frame setLength:0];
+}
+
+#pragma mark Random
+
+- (UInt16)randomID
+{
+	// Mostly small like the symbol manager's, some of every varint length
+	return (UInt16)[self.random randomBelow:[self.random randomBelow:4] == 0 ? 65536 : 512];
+}
+
+@end
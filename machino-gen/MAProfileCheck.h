@@ -0,0 +1,27 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAVerifier.h"
+
+// Checks the profiling code (see MAProfiling) finds a slow condition: builds profiling sketches of a synthetic graph in
+// the switch, memoized & table forms for the host (see MAHostSketchBuilder), with HostArduino.h making one condition
+// take 100 microseconds, runs iterationCount loop()s of each, decodes what they send into an MAProfile like Machino
+// does, and checks that condition comes out slowest and every summary names a symbol of the sketch.
+@interface MAProfileCheck : MAVerifier
+
+@property (nonatomic) NSUInteger stateCount;
+@property (nonatomic) NSUInteger machineSize;
+@property (nonatomic) NSUInteger slowConditionIndex; // In the order of MAGraphAnalysis (default: 0), the first if out of range
+@property (nonatomic, copy) NSString *compiler; // Defaults to $CXX, or c++
+@property (nonatomic, copy) NSString *hostHeaderPath; // HostArduino.h
+@property (nonatomic, copy) NSString *messagingHeaderPath;
+@property (nonatomic, copy) NSString *tableHeaderPath; // StateMachineTable.h
+
+@end
@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAProfileCheck.h"
+#import "MAHostSketch.h"
+#import "MASyntheticGraph.h"
+#import "MAStateMachineCodeTemplate.h"
+#import "MAMessageDecoder.h"
+#import "MAProfile.h"
+#import "Graph.h"
+
+static NSString * const kProfileCheckIndentString = @"  ";
+
+#pragma mark - Private Interface
+
+@interface MAProfileCheck () <MAMessageDecoderDelegate>
+
+@property (nonatomic, strong) MAProfile *profile; // Of the recording being decoded
+
+@end
+
+#pragma mark - MAProfileCheck
+
+@implementation MAProfileCheck
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateCount = 50;
+		_machineSize = 10;
+		self.iterationCount = 20000;
+		_compiler = [[NSProcessInfo processInfo] environment][@"CXX"] ?: @"c++";
+	}
+	return self;
+}
+
+#pragma mark - Running
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:self.stateCount machineSize:self.machineSize density:MASyntheticGraphSparse seed:self.seed];
+	NSArray *conditions = [[MAGraphAnalysis analysisWithNodes:graph.states arrows:graph.transitions] conditions];
+	if ([conditions count] == 0) {
+		output(@"the graph has no conditions");
+		return NO;
+	}
+	NSUInteger slowConditionIndex = (self.slowConditionIndex < [conditions count]) ? self.slowConditionIndex : 0;
+	MACondition *slowCondition = conditions[slowConditionIndex];
+	output([NSString stringWithFormat:@"%lu states, condition %@ takes 100 us", (unsigned long)self.stateCount, slowCondition.name]);
+	// Build & run each form
+	MAHostSketchBuilder *builder = [[MAHostSketchBuilder alloc] init];
+	builder.compiler = self.compiler;
+	builder.hostHeaderPath = self.hostHeaderPath;
+	builder.messagingHeaderPath = self.messagingHeaderPath;
+	builder.tableHeaderPath = self.tableHeaderPath;
+	builder.iterationCount = self.iterationCount;
+	builder.serialOutputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"machino-serial-%d", [[NSProcessInfo processInfo] processIdentifier]]];
+	if (![builder prepareWithOutput:output]) return NO;
+	NSArray *formOptions = @[ @0, @(MAMemoizeConditions), @(MATableDrivenStateMachines) ];
+	NSArray *formNames = @[ @"switch", @"memoized", @"table" ];
+	NSArray *definitions = @[ [NSString stringWithFormat:@"HOST_SLOW_CONDITION=%lu", (unsigned long)slowConditionIndex] ];
+	BOOL passed = YES;
+	for (NSUInteger formIndex = 0; formIndex < [formOptions count]; formIndex++) {
+		@autoreleasepool {
+			MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+			template.states = graph.states;
+			template.transitions = graph.transitions;
+			template.options = MAInsertLoggingCode | MAProfiling | [formOptions[formIndex] unsignedIntegerValue];
+			template.indentString = kProfileCheckIndentString;
+			[template generate];
+			[MAHostSketchBuilder writeHostHooksIntoTemplate:template];
+			if (![builder runCode:[template code] name:@"profiling" definitions:definitions output:output]) {
+				passed = NO;
+				continue;
+			}
+			// Decode the summaries
+			MAMessageDecoder *decoder = [[MAMessageDecoder alloc] init];
+			decoder.delegate = self;
+			self.profile = [[MAProfile alloc] init];
+			[decoder decodeData:[NSData dataWithContentsOfFile:builder.serialOutputPath]];
+			if (![self checkProfile:self.profile ofTemplate:template slowCondition:slowCondition formName:formNames[formIndex] output:output]) passed = NO;
+		}
+	}
+	self.profile = nil;
+	[builder cleanUp];
+	[[NSFileManager defaultManager] removeItemAtPath:builder.serialOutputPath error:nil];
+	return passed;
+}
+
+- (BOOL)checkProfile:(MAProfile *)profile ofTemplate:(MAStateMachineCodeTemplate *)template slowCondition:(MACondition *)slowCondition formName:(NSString *)formName output:(void(^)(NSString *line))output
+{
+	if (!profile.loopEntry) {
+		output([NSString stringWithFormat:@"%@: no summaries came in", formName]);
+		return NO;
+	}
+	// Every summary names a symbol, and the slowest condition per call is the slow one
+	BOOL passed = YES;
+	MAProfileEntry *slowestEntry = nil;
+	for (MAProfileEntry *entry in profile.entries) {
+		id object = [template objectForSymbolWithID:entry.symbolID];
+		if (!object) {
+			output([NSString stringWithFormat:@"%@: summary for unknown symbol %u", formName, (unsigned)entry.symbolID]);
+			passed = NO;
+		} else if ([object isKindOfClass:[MACondition class]] && (!slowestEntry || entry.meanTime > slowestEntry.meanTime)) {
+			slowestEntry = entry;
+		}
+	}
+	MACondition *slowestCondition = slowestEntry ? [template objectForSymbolWithID:slowestEntry.symbolID] : nil;
+	if (slowestCondition != slowCondition) passed = NO;
+	output([NSString stringWithFormat:@"%-8@ loop %9.1f us, %6llu calls, slowest condition %@ %9.1f us %@", formName, profile.loopEntry.meanTime,
+		profile.loopEntry.count, slowestCondition.name ?: @"-", slowestEntry.meanTime, passed ? @"ok" : @"WRONG"]);
+	return passed;
+}
+
+#pragma mark - Message Decoder Delegate
+
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count
+{
+	[self.profile addSamples:samples count:count];
+}
+
+// Not used:
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeEvents:(const MAMessageEvent *)events count:(NSUInteger)count { }
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length { }
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveHelloWithBaudRate:(unsigned long)baudRate { }
+
+@end
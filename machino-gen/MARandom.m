@@ -0,0 +1,40 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MARandom.h"
+
+@interface MARandom ()
+
+@property (nonatomic) UInt32 state;
+
+@end
+
+@implementation MARandom
+
+- (id)initWithSeed:(UInt32)seed
+{
+	self = [super init];
+	if (self) {
+		_state = seed ?: 1;
+	}
+	return self;
+}
+
+- (NSUInteger)randomBelow:(NSUInteger)bound
+{
+	UInt32 x = self.state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	self.state = x;
+	return x % bound;
+}
+
+@end
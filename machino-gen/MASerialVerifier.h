@@ -0,0 +1,23 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAVerifier.h"
+
+// Checks ORSSerialPort against a pseudo-terminal pair: the port opens the slave end like a board, the master end plays
+// the board. A random byte stream written in iterationCount random chunks has to arrive complete & in order (with a delegate queue that
+// is sometimes busy, so reads get batched), single bytes are timed from write to delivery with & without low latency
+// options, a stream sent faster than the other end reads has to come out complete with every send completed in order
+// & the write queue's watermarks reported, and hanging up has to be reported as removal.
+@interface MASerialVerifier : MAVerifier
+
+@property (nonatomic) NSUInteger roundTripCount; // Per latency setting
+@property (nonatomic) NSUInteger baudRate;
+
+@end
@@ -0,0 +1,303 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MASerialVerifier.h"
+#import "MARandom.h"
+#import "ORSSerialPort.h"
+#import <termios.h>
+#import <poll.h>
+
+static const NSUInteger kMaximumChunkLength = 4096;
+static const NSUInteger kBusyDeliveryInterval = 8; // Every so many deliveries the delegate queue stalls for a bit
+static const NSUInteger kWriteQueueHighWatermark = 16384;
+static const NSUInteger kWriteQueueLowWatermark = 4096;
+static const NSTimeInterval kTimeout = 10;
+
+@interface MASerialVerifier () <ORSSerialPortDelegate>
+
+@property (nonatomic, strong) NSMutableData *receivedData; // Only touched on the delegate queue
+@property (nonatomic) NSUInteger expectedLength;
+@property (nonatomic) NSUInteger deliveryCount;
+@property (nonatomic) BOOL simulatesBusyQueue;
+@property (nonatomic) BOOL wasOpened;
+@property (nonatomic) BOOL wasRemoved;
+@property (nonatomic) BOOL writeQueueDidFill;
+@property (nonatomic) BOOL writeQueueDidDrain;
+@property (nonatomic, strong) dispatch_semaphore_t semaphore; // Signalled on open, removal & once expectedLength is in
+
+@end
+
+@implementation MASerialVerifier
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		self.iterationCount = 2000;
+		_roundTripCount = 200;
+		_baudRate = 1000000;
+	}
+	return self;
+}
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	self.receivedData = [NSMutableData data];
+	self.semaphore = dispatch_semaphore_create(0);
+	// Pseudo-terminal pair
+	int masterDescriptor = posix_openpt(O_RDWR | O_NOCTTY);
+	if (masterDescriptor < 0 || grantpt(masterDescriptor) != 0 || unlockpt(masterDescriptor) != 0) {
+		output([NSString stringWithFormat:@"could not open a pseudo-terminal: %s", strerror(errno)]);
+		if (masterDescriptor >= 0) close(masterDescriptor);
+		return NO;
+	}
+	struct termios options;
+	tcgetattr(masterDescriptor, &options);
+	cfmakeraw(&options);
+	tcsetattr(masterDescriptor, TCSANOW, &options);
+	NSString *slavePath = @(ptsname(masterDescriptor));
+	// Open like a board
+	ORSSerialPort *port = [ORSSerialPort serialPortWithPath:slavePath];
+	if (!port) {
+		output([NSString stringWithFormat:@"%@: not taken as a serial port", slavePath]);
+		close(masterDescriptor);
+		return NO;
+	}
+	port.delegate = self;
+	port.delegateQueue = dispatch_queue_create("machino-gen.verify.serial", DISPATCH_QUEUE_SERIAL);
+	port.baudRate = @(self.baudRate);
+	[port open];
+	BOOL passed = [self waitFor:@"open" output:output] && self.wasOpened
+		&& [self checkStreamOnPort:port masterDescriptor:masterDescriptor output:output]
+		&& [self checkLatencyOnPort:port masterDescriptor:masterDescriptor output:output]
+		&& [self checkWriteQueueOnPort:port masterDescriptor:masterDescriptor output:output];
+	// Hanging up the board's end
+	close(masterDescriptor);
+	if (passed) {
+		passed = [self waitFor:@"removal after hang-up" output:output] && self.wasRemoved && !port.open;
+		if (passed) output(@"hang-up: reported as removal");
+	}
+	if (port.open) [port close];
+	port.delegate = nil;
+	return passed;
+}
+
+- (BOOL)waitFor:(NSString *)what output:(void(^)(NSString *line))output
+{
+	if (dispatch_semaphore_wait(self.semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kTimeout * NSEC_PER_SEC))) == 0) return YES;
+	output([NSString stringWithFormat:@"timed out waiting for %@", what]);
+	return NO;
+}
+
+#pragma mark - Checks
+
+- (BOOL)checkStreamOnPort:(ORSSerialPort *)port masterDescriptor:(int)masterDescriptor output:(void(^)(NSString *line))output
+{
+	NSMutableArray *chunkLengths = [NSMutableArray array];
+	NSData *stream = [self randomStreamWithChunkLengths:chunkLengths];
+	self.expectedLength = [stream length];
+	self.simulatesBusyQueue = YES;
+	// Written from the board's end while the port delivers
+	NSDate *start = [NSDate date];
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		const UInt8 *bytes = [stream bytes];
+		for (NSNumber *length in chunkLengths) {
+			[self writeBytes:bytes length:[length unsignedIntegerValue] toDescriptor:masterDescriptor];
+			bytes += [length unsignedIntegerValue];
+		}
+	});
+	if (self.expectedLength > 0 && ![self waitFor:@"the byte stream" output:output]) return NO;
+	NSTimeInterval time = -[start timeIntervalSinceNow];
+	__block NSData *received = nil;
+	__block NSUInteger deliveryCount = 0;
+	dispatch_sync(port.delegateQueue, ^{
+		received = [self.receivedData copy];
+		deliveryCount = self.deliveryCount;
+		self.simulatesBusyQueue = NO;
+	});
+	if (![received isEqualToData:stream]) {
+		const UInt8 *expectedBytes = [stream bytes];
+		const UInt8 *receivedBytes = [received bytes];
+		NSUInteger offset = 0;
+		while (offset < MIN([stream length], [received length]) && expectedBytes[offset] == receivedBytes[offset]) offset++;
+		output([NSString stringWithFormat:@"stream (seed %u): %lu bytes received of %lu, first difference at %lu", (unsigned int)self.seed,
+			(unsigned long)[received length], (unsigned long)[stream length], (unsigned long)offset]);
+		return NO;
+	}
+	output([NSString stringWithFormat:@"stream: %lu bytes in %lu chunks, %lu deliveries (%.0f bytes each), %.1f MB/s", (unsigned long)[stream length],
+		(unsigned long)self.iterationCount, (unsigned long)deliveryCount, (double)[stream length] / MAX(deliveryCount, 1), [stream length] / time / 1e6]);
+	return YES;
+}
+
+- (BOOL)checkLatencyOnPort:(ORSSerialPort *)port masterDescriptor:(int)masterDescriptor output:(void(^)(NSString *line))output
+{
+	for (NSNumber *lowLatency in @[ @NO, @YES ]) {
+		port.usesLowLatency = [lowLatency boolValue];
+		NSTimeInterval totalTime = 0;
+		NSTimeInterval maximumTime = 0;
+		for (NSUInteger i = 0; i < self.roundTripCount; i++) {
+			dispatch_sync(port.delegateQueue, ^{
+				self.expectedLength = [self.receivedData length] + 1;
+			});
+			UInt8 byte = [self.random randomBelow:256];
+			NSDate *start = [NSDate date];
+			[self writeBytes:&byte length:1 toDescriptor:masterDescriptor];
+			if (![self waitFor:@"a single byte" output:output]) return NO;
+			NSTimeInterval time = -[start timeIntervalSinceNow];
+			totalTime += time;
+			maximumTime = MAX(maximumTime, time);
+		}
+		output([NSString stringWithFormat:@"latency%@: %.0f us mean, %.0f us max over %lu bytes", [lowLatency boolValue] ? @" (low latency)" : @"",
+			totalTime / MAX(self.roundTripCount, 1) * 1e6, maximumTime * 1e6, (unsigned long)self.roundTripCount]);
+	}
+	port.usesLowLatency = NO;
+	return YES;
+}
+
+- (BOOL)checkWriteQueueOnPort:(ORSSerialPort *)port masterDescriptor:(int)masterDescriptor output:(void(^)(NSString *line))output
+{
+	// Sent as fast as it goes while the board's end doesn't read, so the queue fills up
+	NSMutableArray *chunkLengths = [NSMutableArray array];
+	NSData *stream = [self randomStreamWithChunkLengths:chunkLengths];
+	port.writeQueueHighWatermark = kWriteQueueHighWatermark;
+	port.writeQueueLowWatermark = kWriteQueueLowWatermark;
+	NSMutableArray *completions = [NSMutableArray array]; // Only touched on the delegate queue
+	NSTimeInterval maximumSendTime = 0;
+	NSUInteger offset = 0;
+	for (NSUInteger i = 0; i < [chunkLengths count]; i++) {
+		NSData *chunk = [stream subdataWithRange:NSMakeRange(offset, [chunkLengths[i] unsignedIntegerValue])];
+		offset += [chunk length];
+		BOOL isLast = (i + 1 == [chunkLengths count]);
+		NSDate *start = [NSDate date];
+		BOOL queued = [port sendData:chunk completion:^(BOOL sent) {
+			[completions addObject:@[ @(i), @(sent) ]];
+			if (isLast) dispatch_semaphore_signal(self.semaphore);
+		}];
+		maximumSendTime = MAX(maximumSendTime, -[start timeIntervalSinceNow]);
+		if (!queued) {
+			output([NSString stringWithFormat:@"write queue: chunk %lu not taken", (unsigned long)i]);
+			return NO;
+		}
+	}
+	NSUInteger peakLength = port.queuedWriteLength;
+	// Everything has to come out the other end, in order
+	NSMutableData *received = [NSMutableData data];
+	NSDate *start = [NSDate date];
+	while ([received length] < [stream length]) {
+		struct pollfd descriptor = { .fd = masterDescriptor, .events = POLLIN };
+		if (poll(&descriptor, 1, (int)(kTimeout * 1000)) <= 0) break;
+		UInt8 buffer[16384];
+		ssize_t length = read(masterDescriptor, buffer, sizeof(buffer));
+		if (length <= 0) break;
+		[received appendBytes:buffer length:length];
+	}
+	NSTimeInterval time = -[start timeIntervalSinceNow];
+	if (![received isEqualToData:stream]) {
+		output([NSString stringWithFormat:@"write queue (seed %u): %lu bytes came out of %lu", (unsigned int)self.seed, (unsigned long)[received length], (unsigned long)[stream length]]);
+		return NO;
+	}
+	if ([chunkLengths count] > 0 && ![self waitFor:@"the last send completion" output:output]) return NO;
+	__block NSArray *completed = nil;
+	__block BOOL didFill = NO;
+	__block BOOL didDrain = NO;
+	dispatch_sync(port.delegateQueue, ^{
+		completed = [completions copy];
+		didFill = self.writeQueueDidFill;
+		didDrain = self.writeQueueDidDrain;
+	});
+	for (NSUInteger i = 0; i < [completed count]; i++) {
+		if ([completed[i][0] unsignedIntegerValue] != i || ![completed[i][1] boolValue]) {
+			output([NSString stringWithFormat:@"write queue: completion %lu is for send %@ (sent: %@)", (unsigned long)i, completed[i][0], completed[i][1]]);
+			return NO;
+		}
+	}
+	if ([completed count] != [chunkLengths count] || port.queuedWriteLength != 0 || port.writeQueueFull) {
+		output([NSString stringWithFormat:@"write queue: %lu of %lu sends completed, %lu bytes still queued", (unsigned long)[completed count],
+			(unsigned long)[chunkLengths count], (unsigned long)port.queuedWriteLength]);
+		return NO;
+	}
+	if ([stream length] > kWriteQueueHighWatermark + kMaximumChunkLength && !(didFill && didDrain)) {
+		output([NSString stringWithFormat:@"write queue: watermarks not reported (filled: %@, drained: %@)", didFill ? @"yes" : @"no", didDrain ? @"yes" : @"no"]);
+		return NO;
+	}
+	output([NSString stringWithFormat:@"write queue: %lu bytes in %lu sends, %lu queued at most, longest send call %.0f us, %.1f MB/s", (unsigned long)[stream length],
+		(unsigned long)[chunkLengths count], (unsigned long)peakLength, maximumSendTime * 1e6, [stream length] / time / 1e6]);
+	return YES;
+}
+
+#pragma mark - Serial Port Delegate
+
+- (void)serialPortWasOpened:(ORSSerialPort *)serialPort
+{
+	self.wasOpened = YES;
+	dispatch_semaphore_signal(self.semaphore);
+}
+
+- (void)serialPort:(ORSSerialPort *)serialPort didReceiveData:(NSData *)data
+{
+	NSUInteger previousLength = [self.receivedData length];
+	[self.receivedData appendData:data];
+	self.deliveryCount++;
+	if (previousLength < self.expectedLength && [self.receivedData length] >= self.expectedLength) dispatch_semaphore_signal(self.semaphore);
+	if (self.simulatesBusyQueue && self.deliveryCount % kBusyDeliveryInterval == 0) usleep(1000);
+}
+
+- (void)serialPort:(ORSSerialPort *)serialPort writeQueueDidFillToLength:(NSUInteger)length
+{
+	self.writeQueueDidFill = YES;
+}
+
+- (void)serialPort:(ORSSerialPort *)serialPort writeQueueDidDrainToLength:(NSUInteger)length
+{
+	self.writeQueueDidDrain = YES;
+}
+
+- (void)serialPortWasRemovedFromSystem:(ORSSerialPort *)serialPort
+{
+	self.wasRemoved = YES;
+	dispatch_semaphore_signal(self.semaphore);
+}
+
+- (void)serialPort:(ORSSerialPort *)serialPort didEncounterError:(NSError *)error
+{
+	NSLog(@"%@: %@", serialPort.path, [error localizedDescription]);
+}
+
+#pragma mark - Utility
+
+- (NSData *)randomStreamWithChunkLengths:(NSMutableArray *)chunkLengths
+{
+	// Random bytes in iterationCount random chunks
+	NSMutableData *stream = [NSMutableData data];
+	for (NSUInteger i = 0; i < self.iterationCount; i++) {
+		NSUInteger length = 1 + [self.random randomBelow:kMaximumChunkLength];
+		for (NSUInteger j = 0; j < length; j++) {
+			UInt8 byte = [self.random randomBelow:256];
+			[stream appendBytes:&byte length:1];
+		}
+		[chunkLengths addObject:@(length)];
+	}
+	return stream;
+}
+
+- (void)writeBytes:(const UInt8 *)bytes length:(NSUInteger)length toDescriptor:(int)descriptor
+{
+	while (length > 0) {
+		ssize_t written = write(descriptor, bytes, length);
+		if (written < 0) {
+			if (errno == EINTR || errno == EAGAIN) continue;
+			return;
+		}
+		bytes += written;
+		length -= written;
+	}
+}
+
+@end
@@ -0,0 +1,25 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAVerifier.h"
+
+// Checks simulated runs reach Machino like a board's: builds logging sketches of iterationCount synthetic graphs in
+// MASimulator, connects to each one's pseudo-terminal once it has started, the way MAArduinoController does, and checks
+// the hello comes in with the baud rate the sketch was built for, followed by states of the sketch.
+@interface MASimulationVerifier : MAVerifier
+
+@property (nonatomic) NSUInteger stateCount;
+@property (nonatomic) NSUInteger machineSize;
+@property (nonatomic) unsigned long baudRate; // Default: 1000000, like Machino's
+@property (nonatomic, copy) NSString *arduinoHeaderPath; // SimulatedArduino.h
+@property (nonatomic, copy) NSString *messagingHeaderPath;
+@property (nonatomic, copy) NSString *tableHeaderPath; // StateMachineTable.h
+
+@end
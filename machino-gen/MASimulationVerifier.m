@@ -0,0 +1,164 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MASimulationVerifier.h"
+#import "MASimulator.h"
+#import "MASyntheticGraph.h"
+#import "MAStateMachineCodeTemplate.h"
+#import "MAMessageDecoder.h"
+#import "MARandom.h"
+#import "Graph.h"
+#import <termios.h>
+#import <poll.h>
+
+static NSString * const kSimulationIndentString = @"  ";
+static const NSTimeInterval kTimeout = 10; // For the hello & states, once started
+static const NSUInteger kStateEventCount = 100; // Received before a run passes
+
+#pragma mark - Private Interface
+
+@interface MASimulationVerifier () <MAMessageDecoderDelegate>
+
+@property (nonatomic, strong) MAStateMachineCodeTemplate *template; // Of the run
+@property (nonatomic) unsigned long helloBaudRate; // 0 until the hello came in
+@property (nonatomic) NSUInteger stateEventCount;
+@property (nonatomic) NSUInteger unknownStateCount;
+
+@end
+
+#pragma mark - MASimulationVerifier
+
+@implementation MASimulationVerifier
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateCount = 20;
+		_machineSize = 5;
+		_baudRate = 1000000;
+		self.iterationCount = 3;
+	}
+	return self;
+}
+
+#pragma mark - Running
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	for (NSUInteger i = 0; i < self.iterationCount; i++) {
+		@autoreleasepool {
+			UInt32 graphSeed = (UInt32)[self.random randomBelow:UINT32_MAX];
+			if (![self runGraphWithSeed:graphSeed output:output]) return NO;
+		}
+	}
+	self.template = nil;
+	return YES;
+}
+
+- (BOOL)runGraphWithSeed:(UInt32)graphSeed output:(void(^)(NSString *line))output
+{
+	MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:self.stateCount machineSize:self.machineSize density:MASyntheticGraphSparse seed:graphSeed];
+	MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+	template.states = graph.states;
+	template.transitions = graph.transitions;
+	template.options = MAInsertLoggingCode;
+	template.indentString = kSimulationIndentString;
+	[template generate];
+	self.template = template;
+	// Built & started, then connected to
+	MASimulator *simulator = [[MASimulator alloc] init];
+	simulator.arduinoHeaderPath = self.arduinoHeaderPath;
+	simulator.messagingHeaderPath = self.messagingHeaderPath;
+	simulator.tableHeaderPath = self.tableHeaderPath;
+	simulator.baudRate = self.baudRate;
+	NSString *buildOutput = nil;
+	NSError *error = nil;
+	if (![simulator buildCode:[template code] output:&buildOutput]) {
+		output([NSString stringWithFormat:@"graph %u: the sketch didn't build\n%@", (unsigned int)graphSeed, buildOutput ?: @""]);
+		[simulator terminate];
+		return NO;
+	}
+	if (![simulator startWithError:&error]) {
+		output([NSString stringWithFormat:@"graph %u: the simulator didn't start: %@", (unsigned int)graphSeed, [error localizedDescription]]);
+		[simulator terminate];
+		return NO;
+	}
+	NSDate *start = [NSDate date];
+	BOOL passed = [self receiveFromPortAtPath:simulator.serialPortPath graphSeed:graphSeed output:output];
+	[simulator terminate];
+	if (passed) {
+		output([NSString stringWithFormat:@"graph %u: hello at %lu baud, %lu states in %.2f s", (unsigned int)graphSeed, self.helloBaudRate,
+			(unsigned long)self.stateEventCount, -[start timeIntervalSinceNow]]);
+	}
+	return passed;
+}
+
+- (BOOL)receiveFromPortAtPath:(NSString *)path graphSeed:(UInt32)graphSeed output:(void(^)(NSString *line))output
+{
+	int descriptor = open([path fileSystemRepresentation], O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (descriptor < 0) {
+		output([NSString stringWithFormat:@"graph %u: could not open %@: %s", (unsigned int)graphSeed, path, strerror(errno)]);
+		return NO;
+	}
+	struct termios options;
+	tcgetattr(descriptor, &options);
+	cfmakeraw(&options);
+	tcsetattr(descriptor, TCSANOW, &options);
+	// Decoded as it comes in, until the hello & enough states are in
+	MAMessageDecoder *decoder = [[MAMessageDecoder alloc] init];
+	decoder.delegate = self;
+	self.helloBaudRate = 0;
+	self.stateEventCount = 0;
+	self.unknownStateCount = 0;
+	NSDate *start = [NSDate date];
+	while ((self.helloBaudRate == 0 || self.stateEventCount < kStateEventCount) && -[start timeIntervalSinceNow] < kTimeout) {
+		struct pollfd pollDescriptor = { .fd = descriptor, .events = POLLIN };
+		if (poll(&pollDescriptor, 1, 100) <= 0) continue;
+		Byte buffer[4096];
+		ssize_t length = read(descriptor, buffer, sizeof(buffer));
+		if (length <= 0) break;
+		[decoder decodeBytes:buffer length:length];
+	}
+	close(descriptor);
+	if (self.helloBaudRate != self.baudRate) {
+		NSString *hello = self.helloBaudRate ? [NSString stringWithFormat:@"at %lu baud", self.helloBaudRate] : @"never came in";
+		output([NSString stringWithFormat:@"graph %u: the hello %@ (built for %lu)", (unsigned int)graphSeed, hello, self.baudRate]);
+		return NO;
+	}
+	if (self.stateEventCount < kStateEventCount || self.unknownStateCount > 0) {
+		output([NSString stringWithFormat:@"graph %u: %lu states came in, %lu of them unknown", (unsigned int)graphSeed,
+			(unsigned long)self.stateEventCount, (unsigned long)self.unknownStateCount]);
+		return NO;
+	}
+	return YES;
+}
+
+#pragma mark - Message Decoder Delegate
+
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveHelloWithBaudRate:(unsigned long)baudRate
+{
+	self.helloBaudRate = baudRate;
+}
+
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeEvents:(const MAMessageEvent *)events count:(NSUInteger)count
+{
+	for (NSUInteger i = 0; i < count; i++) {
+		if (events[i].type != MAMessageEventCurrentState) continue;
+		self.stateEventCount++;
+		if (![[self.template objectForSymbolWithID:events[i].arguments[0]] isKindOfClass:[MANode class]]) self.unknownStateCount++;
+	}
+}
+
+// Not used:
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length { }
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count { }
+
+@end
@@ -0,0 +1,38 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+#import "MAStateMachineCodeTemplate.h"
+
+@class MADocumentArchive;
+@class MACodeSink;
+
+// Turns .machino documents into Arduino sketches (<name>/<name>.ino), generating several documents at once
+@interface MASketchBatch : NSObject
+
+@property (nonatomic, copy) NSString *outputDirectory; // Defaults to the folder of each document
+@property (nonatomic, copy) NSString *indentString;
+@property (nonatomic) BOOL insertLoggingCode;
+@property (nonatomic) BOOL writesTables; // Table-driven state machines
+@property (nonatomic) BOOL memoizesConditions;
+@property (nonatomic) BOOL logsChangesOnly; // With insertLoggingCode
+@property (nonatomic) BOOL profiles; // With insertLoggingCode, sends timing summaries instead of events
+@property (nonatomic, copy) NSString *messagingHeaderPath; // Copied next to each sketch when inserting logging code
+@property (nonatomic, copy) NSString *tableHeaderPath; // Copied next to each sketch when writing tables
+@property (nonatomic) NSUInteger maximumConcurrentJobs; // Defaults to the number of active processors
+
++ (NSString *)codeForArchive:(MADocumentArchive *)archive options:(MAStateMachineCodeTemplateOptions)options indentString:(NSString *)indentString;
++ (void)writeCodeForArchive:(MADocumentArchive *)archive toSink:(MACodeSink *)sink options:(MAStateMachineCodeTemplateOptions)options indentString:(NSString *)indentString;
+
+// The handler is called once per document (one at a time, in completion order), returns the number of failures
+- (NSUInteger)generateSketchesForDocuments:(NSArray *)documentPaths completionHandler:(void(^)(NSString *documentPath, NSString *sketchPath, NSError *error))handler;
+
+@end
@@ -0,0 +1,113 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MASketchBatch.h"
+#import "MACodeSink.h"
+#import "MADocumentArchive.h"
+#import "MAStateMachineCodeTemplate.h"
+
+static NSString * const kDefaultIndentString = @"  ";
+static NSString * const kSketchExtension = @"ino";
+
+@implementation MASketchBatch
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_indentString = kDefaultIndentString;
+		_maximumConcurrentJobs = [[NSProcessInfo processInfo] activeProcessorCount];
+	}
+	return self;
+}
+
+#pragma mark - Generation
+
++ (NSString *)codeForArchive:(MADocumentArchive *)archive options:(MAStateMachineCodeTemplateOptions)options indentString:(NSString *)indentString
+{
+	MACodeSink *sink = [[MACodeSink alloc] init];
+	[self writeCodeForArchive:archive toSink:sink options:options indentString:indentString];
+	return [sink string];
+}
+
++ (void)writeCodeForArchive:(MADocumentArchive *)archive toSink:(MACodeSink *)sink options:(MAStateMachineCodeTemplateOptions)options indentString:(NSString *)indentString
+{
+	// Same result as the code controller gets after opening a document
+	MAStateMachineCodeTemplate *oldTemplate = archive.codeTemplate;
+	MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+	template.states = archive.nodes;
+	template.transitions = archive.arrows;
+	template.options = options;
+	template.indentString = indentString;
+	template.symbols = oldTemplate.symbols; // Reuse symbols to persist id's
+	template.sink = sink;
+	[template generateMergingCodeFromTemplate:oldTemplate];
+}
+
+- (NSString *)sketchPathForDocument:(NSString *)documentPath
+{
+	NSString *name = [[documentPath lastPathComponent] stringByDeletingPathExtension];
+	NSString *directory = self.outputDirectory ?: [documentPath stringByDeletingLastPathComponent];
+	NSString *sketchFolder = [directory stringByAppendingPathComponent:name];
+	return [sketchFolder stringByAppendingPathComponent:[name stringByAppendingPathExtension:kSketchExtension]];
+}
+
+- (NSString *)generateSketchForDocument:(NSString *)documentPath error:(NSError **)error
+{
+	// Load
+	MADocumentArchive *archive = [MADocumentArchive archiveWithContentsOfFile:documentPath error:error];
+	if (!archive) return nil;
+	// Generate straight into UTF-8
+	MAStateMachineCodeTemplateOptions options = (self.insertLoggingCode ? MAInsertLoggingCode : 0) | (self.writesTables ? MATableDrivenStateMachines : 0);
+	if (self.memoizesConditions) options |= MAMemoizeConditions;
+	if (self.logsChangesOnly) options |= MAChangeOnlyLogging;
+	if (self.profiles) options |= MAProfiling;
+	MACodeSink *sink = [[MACodeSink alloc] init];
+	[[self class] writeCodeForArchive:archive toSink:sink options:options indentString:self.indentString];
+	// Write
+	NSString *sketchPath = [self sketchPathForDocument:documentPath];
+	NSString *sketchFolder = [sketchPath stringByDeletingLastPathComponent];
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	if (![fileManager createDirectoryAtPath:sketchFolder withIntermediateDirectories:YES attributes:nil error:error]) return nil;
+	if (![sink writeToFile:sketchPath error:error]) return nil;
+	NSMutableArray *headerPaths = [NSMutableArray array];
+	if (self.insertLoggingCode && self.messagingHeaderPath) [headerPaths addObject:self.messagingHeaderPath];
+	if (self.writesTables && self.tableHeaderPath) [headerPaths addObject:self.tableHeaderPath];
+	for (NSString *sourcePath in headerPaths) {
+		NSString *headerPath = [sketchFolder stringByAppendingPathComponent:[sourcePath lastPathComponent]];
+		[fileManager removeItemAtPath:headerPath error:nil];
+		if (![fileManager copyItemAtPath:sourcePath toPath:headerPath error:error]) return nil;
+	}
+	return sketchPath;
+}
+
+- (NSUInteger)generateSketchesForDocuments:(NSArray *)documentPaths completionHandler:(void(^)(NSString *documentPath, NSString *sketchPath, NSError *error))handler
+{
+	__block NSUInteger failureCount = 0;
+	NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+	[queue setMaxConcurrentOperationCount:MAX(self.maximumConcurrentJobs, 1)];
+	for (NSString *documentPath in documentPaths) {
+		[queue addOperationWithBlock:^{
+			@autoreleasepool {
+				NSError *error = nil;
+				NSString *sketchPath = [self generateSketchForDocument:documentPath error:&error];
+				@synchronized(self) {
+					if (!sketchPath) failureCount++;
+					if (handler) handler(documentPath, sketchPath, error);
+				}
+			}
+		}];
+	}
+	[queue waitUntilAllOperationsAreFinished];
+	return failureCount;
+}
+
+@end
@@ -0,0 +1,138 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MASymbolIDVerifier.h"
+#import "MARandom.h"
+#import "MASymbolManager.h"
+
+static const NSUInteger kMaximumObjectCount = 600; // Crosses the 8-bit width both ways
+static const NSUInteger kArchiveInterval = 5000;
+static const NSUInteger kTimedOperationCount = 1000000;
+
+#pragma mark - Private Interface
+
+@interface MASymbolIDVerifier ()
+
+
+@end
+
+#pragma mark - MASymbolIDVerifier
+
+@implementation MASymbolIDVerifier
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		self.iterationCount = 100000;
+	}
+	return self;
+}
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	MASymbolManager *symbols = [[MASymbolManager alloc] init];
+	symbols.maximumSymbolID = UINT16_MAX;
+	NSMutableArray *objects = [NSMutableArray array];
+	NSMutableArray *symbolIDs = [NSMutableArray array]; // Of objects, as they were handed out
+	NSUInteger peakCount = 0;
+	NSUInteger objectNumber = 0;
+	for (NSUInteger i = 0; i < self.iterationCount; i++) {
+		@autoreleasepool {
+			// Grow towards the maximum and shrink back, in long runs
+			BOOL isGrowing = ((i / 2000) % 2 == 0);
+			BOOL adds = ([objects count] == 0 || ([objects count] < kMaximumObjectCount && [self.random randomBelow:10] < (isGrowing ? 7 : 3)));
+			if (adds) {
+				NSString *object = [NSString stringWithFormat:@"object%lu", (unsigned long)objectNumber++];
+				[symbols addObject:object withName:object];
+				[objects addObject:object];
+				[symbolIDs addObject:@([symbols symbolIDForObject:object])];
+				peakCount = MAX(peakCount, [objects count]);
+			} else {
+				NSUInteger index = [self.random randomBelow:[objects count]];
+				[symbols removeObject:objects[index]];
+				[objects removeObjectAtIndex:index];
+				[symbolIDs removeObjectAtIndex:index];
+			}
+			NSString *mismatch = [self mismatchOfSymbols:symbols withObjects:objects symbolIDs:symbolIDs peakCount:peakCount];
+			if (!mismatch && i % kArchiveInterval == kArchiveInterval - 1) mismatch = [self mismatchAfterArchivingSymbols:symbols objects:objects symbolIDs:symbolIDs];
+			if (mismatch) {
+				output([NSString stringWithFormat:@"operation %lu (seed %u): %@", (unsigned long)i, (unsigned int)self.seed, mismatch]);
+				return NO;
+			}
+		}
+	}
+	output([NSString stringWithFormat:@"%lu operations ok, at most %lu objects, %lu now with %lu-bit ids", (unsigned long)self.iterationCount, (unsigned long)peakCount, (unsigned long)[objects count], (unsigned long)[symbols symbolIDWidth]]);
+	// Time adding & removing, then mapping ids back
+	MASymbolManager *timedSymbols = [[MASymbolManager alloc] init];
+	timedSymbols.maximumSymbolID = UINT16_MAX;
+	NSMutableArray *timedObjects = [NSMutableArray arrayWithCapacity:1000];
+	for (NSUInteger i = 0; i < 1000; i++) {
+		[timedObjects addObject:[NSString stringWithFormat:@"object%lu", (unsigned long)i]];
+		[timedSymbols addObject:timedObjects[i] withName:timedObjects[i]];
+	}
+	NSDate *start = [NSDate date];
+	@autoreleasepool {
+		for (NSUInteger i = 0; i < kTimedOperationCount / 2; i++) {
+			id object = timedObjects[[self.random randomBelow:1000]];
+			[timedSymbols removeObject:object];
+			[timedSymbols addObject:object withName:object];
+		}
+	}
+	double seconds = -[start timeIntervalSinceNow];
+	output([NSString stringWithFormat:@"%.0f adds & removes/s with 1000 objects", kTimedOperationCount / MAX(seconds, 1e-9)]);
+	start = [NSDate date];
+	NSUInteger foundCount = 0;
+	for (NSUInteger i = 0; i < kTimedOperationCount; i++) {
+		if ([timedSymbols objectForSymbolID:[self.random randomBelow:1000]]) foundCount++;
+	}
+	seconds = -[start timeIntervalSinceNow];
+	output([NSString stringWithFormat:@"%.0f id lookups/s (%lu found)", kTimedOperationCount / MAX(seconds, 1e-9), (unsigned long)foundCount]);
+	return YES;
+}
+
+- (NSString *)mismatchOfSymbols:(MASymbolManager *)symbols withObjects:(NSArray *)objects symbolIDs:(NSArray *)symbolIDs peakCount:(NSUInteger)peakCount
+{
+	UInt64 highestSymbolID = 0;
+	for (NSUInteger i = 0; i < [objects count]; i++) {
+		UInt64 symbolID = [symbols symbolIDForObject:objects[i]];
+		if (symbolID != [symbolIDs[i] unsignedLongLongValue]) return [NSString stringWithFormat:@"%@ changed id from %@ to %llu", objects[i], symbolIDs[i], symbolID];
+		if (symbolID >= peakCount) return [NSString stringWithFormat:@"%@ has id %llu with at most %lu objects", objects[i], symbolID, (unsigned long)peakCount];
+		if ([symbols objectForSymbolID:symbolID] != objects[i]) return [NSString stringWithFormat:@"id %llu maps to %@, not %@", symbolID, [symbols objectForSymbolID:symbolID], objects[i]];
+		highestSymbolID = MAX(highestSymbolID, symbolID);
+	}
+	NSUInteger width = (highestSymbolID < 256) ? 8 : 16;
+	if ([objects count] > 0 && [symbols symbolIDWidth] != width) return [NSString stringWithFormat:@"%lu-bit ids for ids up to %llu", (unsigned long)[symbols symbolIDWidth], highestSymbolID];
+	return nil;
+}
+
+- (NSString *)mismatchAfterArchivingSymbols:(MASymbolManager *)symbols objects:(NSArray *)objects symbolIDs:(NSArray *)symbolIDs
+{
+	// The objects go in the archive too, so the symbols still point at them
+	NSData *data = [NSKeyedArchiver archivedDataWithRootObject:@[objects, symbols]];
+	NSArray *root = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+	NSArray *decodedObjects = root[0];
+	MASymbolManager *decodedSymbols = root[1];
+	for (NSUInteger i = 0; i < [decodedObjects count]; i++) {
+		UInt64 symbolID = [decodedSymbols symbolIDForObject:decodedObjects[i]];
+		if (symbolID != [symbolIDs[i] unsignedLongLongValue]) return [NSString stringWithFormat:@"%@ has id %llu after archiving, not %@", decodedObjects[i], symbolID, symbolIDs[i]];
+	}
+	// A new object gets the lowest gap, if there is one
+	NSMutableIndexSet *usedSymbolIDs = [NSMutableIndexSet indexSet];
+	for (NSNumber *symbolID in symbolIDs) [usedSymbolIDs addIndex:[symbolID unsignedIntegerValue]];
+	NSUInteger lowestFreeSymbolID = 0;
+	while ([usedSymbolIDs containsIndex:lowestFreeSymbolID]) lowestFreeSymbolID++;
+	NSString *object = @"new";
+	[decodedSymbols addObject:object withName:object];
+	if ([decodedSymbols symbolIDForObject:object] != lowestFreeSymbolID) return [NSString stringWithFormat:@"new object after archiving got id %llu, not %lu", [decodedSymbols symbolIDForObject:object], (unsigned long)lowestFreeSymbolID];
+	return nil;
+}
+
+@end
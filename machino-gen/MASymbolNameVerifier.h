@@ -0,0 +1,22 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MAVerifier.h"
+
+// Checks MASymbolManager's incremental naming headlessly. Random adds, removes & renames of objects with awkward names
+// (non-ascii, leading digits, reserved words, names that look like another's suffixed one), after each of which every
+// symbol name has to match what naming all objects from scratch the original way gives. Also checks the built-in
+// reserved name table against the names it was made from, and times naming, from scratch & after one rename, for
+// symbolCount objects.
+@interface MASymbolNameVerifier : MAVerifier
+
+@property (nonatomic) NSUInteger symbolCount; // For the timing
+
+@end
@@ -0,0 +1,238 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#import "MASymbolNameVerifier.h"
+#import "MARandom.h"
+#import "MASymbolManager.h"
+#import "MAReservedNames.h"
+
+static const NSUInteger kMaximumObjectCount = 150;
+static NSString * const kExtraReservedName = @"idle"; // Added & removed on the way, like the template's function names
+
+#pragma mark - Reference Naming
+
+// The way names were given before they were cached & kept, every name from scratch
+static NSString *MAReferenceValidSymbolName(NSString *name)
+{
+	NSMutableString *str = [name mutableCopy];
+	NSData *tmp = [str dataUsingEncoding:NSASCIIStringEncoding allowLossyConversion:YES];
+	str = [[NSMutableString alloc] initWithData:tmp encoding:NSASCIIStringEncoding];
+	NSCharacterSet *validSymbolCharacters = [NSCharacterSet characterSetWithCharactersInString:@"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_"];
+	NSCharacterSet *whitespaceCharacterSet = [NSCharacterSet whitespaceCharacterSet];
+	for (int i=0; i<[str length]; i++) {
+		unichar c = [str characterAtIndex:i];
+		if (![validSymbolCharacters characterIsMember:c] && ![whitespaceCharacterSet characterIsMember:c]) {
+			[str replaceCharactersInRange:NSMakeRange(i, 1) withString:@" "];
+		}
+	}
+	NSArray *parts = [str componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+	str = [NSMutableString string];
+	for (NSString *part in parts) {
+		if ([part length] == 0) continue;
+		if ([str length] > 0) {
+			[str appendString:[[part substringToIndex:1] uppercaseString]];
+			[str appendString:[part substringFromIndex:1]];
+		} else {
+			[str appendString:part];
+		}
+	}
+	if ([str length] == 0) [str appendString:@"_"];
+	if ([[NSCharacterSet decimalDigitCharacterSet] characterIsMember:[str characterAtIndex:0]]) {
+		[str insertString:@"_" atIndex:0];
+	}
+	return [str copy];
+}
+
+static NSArray *MAReferenceSymbolNames(NSArray *names, NSArray *nameFormats, NSArray *reservedNames)
+{
+	NSMutableSet *takenNames = [NSMutableSet setWithArray:reservedNames];
+	NSMutableArray *symbolNames = [NSMutableArray arrayWithCapacity:[names count]];
+	for (NSUInteger i = 0; i < [names count]; i++) {
+		NSString *name = (nameFormats[i] != [NSNull null]) ? [NSString stringWithFormat:nameFormats[i], names[i]] : names[i];
+		name = MAReferenceValidSymbolName(name);
+		if ([takenNames containsObject:name]) {
+			int suffixDigit = 2;
+			NSString *newName = name;
+			do {
+				newName = [NSString stringWithFormat:@"%@%d", name, suffixDigit];
+				suffixDigit++;
+			} while ([takenNames containsObject:newName]);
+			name = newName;
+		}
+		[takenNames addObject:name];
+		[symbolNames addObject:name];
+	}
+	return symbolNames;
+}
+
+#pragma mark - Private Interface
+
+@interface MASymbolNameVerifier ()
+
+
+@end
+
+#pragma mark - MASymbolNameVerifier
+
+@implementation MASymbolNameVerifier
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		self.iterationCount = 5000;
+		_symbolCount = 10000;
+	}
+	return self;
+}
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	// The table has to find every name it was made from, and only those
+	NSArray *builtInNames = MABuiltInReservedNames();
+	NSSet *builtInNameSet = [NSSet setWithArray:builtInNames];
+	for (NSString *name in builtInNames) {
+		if (!MAIsBuiltInReservedName(name)) {
+			output([NSString stringWithFormat:@"reserved name %@ not in the table", name]);
+			return NO;
+		}
+	}
+	for (NSUInteger i = 0; i < 10000; i++) {
+		NSString *name = [self randomName];
+		NSString *symbolName = MAReferenceValidSymbolName(name);
+		for (NSString *candidate in @[ name, symbolName, [symbolName stringByAppendingString:@"2"] ]) {
+			if (MAIsBuiltInReservedName(candidate) != [builtInNameSet containsObject:candidate]) {
+				output([NSString stringWithFormat:@"table says %@ is%@ reserved", candidate, MAIsBuiltInReservedName(candidate) ? @"" : @" not"]);
+				return NO;
+			}
+		}
+	}
+	output([NSString stringWithFormat:@"reserved name table ok, %lu names", (unsigned long)[builtInNames count]]);
+	// Random edits, naming incrementally after each
+	MASymbolManager *symbols = [[MASymbolManager alloc] init];
+	symbols.reservesBuiltInNames = YES;
+	NSMutableArray *objects = [NSMutableArray array];
+	NSMutableArray *names = [NSMutableArray array];
+	NSMutableArray *nameFormats = [NSMutableArray array];
+	NSMutableArray *reservedNames = [builtInNames mutableCopy];
+	NSUInteger objectNumber = 0;
+	for (NSUInteger i = 0; i < self.iterationCount; i++) {
+		@autoreleasepool {
+			NSUInteger choice = [self.random randomBelow:20];
+			if ([objects count] == 0 || ([objects count] < kMaximumObjectCount && choice < 9)) {
+				NSString *object = [NSString stringWithFormat:@"object%lu", (unsigned long)objectNumber++];
+				NSString *name = [self randomName];
+				NSString *nameFormat = @[ @"state %@", @"%@Check", @"" ][[self.random randomBelow:3]];
+				if ([nameFormat length] == 0) nameFormat = nil;
+				[symbols addObject:object withName:name symbolNameFormat:nameFormat];
+				[objects addObject:object];
+				[names addObject:name];
+				[nameFormats addObject:nameFormat ?: (id)[NSNull null]];
+			} else if (choice < 13) {
+				NSUInteger index = [self.random randomBelow:[objects count]];
+				[symbols removeObject:objects[index]];
+				[objects removeObjectAtIndex:index];
+				[names removeObjectAtIndex:index];
+				[nameFormats removeObjectAtIndex:index];
+			} else if (choice < 19) {
+				NSUInteger index = [self.random randomBelow:[objects count]];
+				NSString *name = ([self.random randomBelow:4] == 0) ? [names[index] copy] : [self randomName]; // Sometimes the same
+				[symbols setName:name forObject:objects[index]];
+				names[index] = name;
+			} else if ([reservedNames containsObject:kExtraReservedName]) {
+				[symbols removeReservedNames:@[ kExtraReservedName ]];
+				[reservedNames removeObject:kExtraReservedName];
+			} else {
+				[symbols addReservedNames:@[ kExtraReservedName ]];
+				[reservedNames addObject:kExtraReservedName];
+			}
+			[symbols generateSymbolNames];
+			NSArray *expectedNames = MAReferenceSymbolNames(names, nameFormats, reservedNames);
+			for (NSUInteger j = 0; j < [objects count]; j++) {
+				NSString *symbolName = [symbols symbolNameForObject:objects[j]];
+				BOOL mismatches = ![symbolName isEqualToString:expectedNames[j]] || [symbols objectForSymbolName:expectedNames[j]] != objects[j];
+				if (mismatches) {
+					output([NSString stringWithFormat:@"operation %lu (seed %u): %@ (\"%@\") is named %@, not %@", (unsigned long)i, (unsigned int)self.seed, objects[j], names[j], symbolName, expectedNames[j]]);
+					return NO;
+				}
+			}
+		}
+	}
+	output([NSString stringWithFormat:@"%lu operations ok, %lu objects now", (unsigned long)self.iterationCount, (unsigned long)[objects count]]);
+	return [self timeNamingWithOutput:output];
+}
+
+- (BOOL)timeNamingWithOutput:(void(^)(NSString *line))output
+{
+	// Named like states, with a share of duplicates to make unique
+	NSUInteger count = self.symbolCount;
+	NSMutableArray *objects = [NSMutableArray arrayWithCapacity:count];
+	NSMutableArray *names = [NSMutableArray arrayWithCapacity:count];
+	NSMutableArray *nameFormats = [NSMutableArray arrayWithCapacity:count];
+	for (NSUInteger i = 0; i < count; i++) {
+		[objects addObject:[NSString stringWithFormat:@"object%lu", (unsigned long)i]];
+		[names addObject:[NSString stringWithFormat:@"Step %lu", (unsigned long)[self.random randomBelow:MAX(count * 9 / 10, 1)]]];
+		[nameFormats addObject:@"state %@"];
+	}
+	NSDate *start = [NSDate date];
+	NSArray *expectedNames = MAReferenceSymbolNames(names, nameFormats, MABuiltInReservedNames());
+	double referenceSeconds = -[start timeIntervalSinceNow];
+	MASymbolManager *symbols = [[MASymbolManager alloc] init];
+	symbols.reservesBuiltInNames = YES;
+	for (NSUInteger i = 0; i < count; i++) {
+		[symbols addObject:objects[i] withName:names[i] symbolNameFormat:nameFormats[i]];
+	}
+	start = [NSDate date];
+	[symbols generateSymbolNames];
+	double fullSeconds = -[start timeIntervalSinceNow];
+	start = [NSDate date];
+	[symbols generateSymbolNames];
+	double unchangedSeconds = -[start timeIntervalSinceNow];
+	// Renaming one in the middle redoes half, one at the end only itself
+	double renameSeconds[2];
+	NSUInteger renamedIndexes[2] = { count / 2, count - 1 };
+	for (NSUInteger i = 0; i < 2 && count > 0; i++) {
+		names[renamedIndexes[i]] = [NSString stringWithFormat:@"Renamed %lu", (unsigned long)i];
+		[symbols setName:names[renamedIndexes[i]] forObject:objects[renamedIndexes[i]]];
+		start = [NSDate date];
+		[symbols generateSymbolNames];
+		renameSeconds[i] = -[start timeIntervalSinceNow];
+	}
+	expectedNames = MAReferenceSymbolNames(names, nameFormats, MABuiltInReservedNames());
+	for (NSUInteger i = 0; i < count; i++) {
+		if (![[symbols symbolNameForObject:objects[i]] isEqualToString:expectedNames[i]]) {
+			output([NSString stringWithFormat:@"%@ is named %@ after renaming, not %@", objects[i], [symbols symbolNameForObject:objects[i]], expectedNames[i]]);
+			return NO;
+		}
+	}
+	if (count == 0) return YES;
+	output([NSString stringWithFormat:@"%lu objects: from scratch %.1f ms (%.1f ms before), unchanged %.2f ms, one renamed in the middle %.1f ms, at the end %.2f ms",
+		(unsigned long)count, fullSeconds * 1000, referenceSeconds * 1000, unchangedSeconds * 1000, renameSeconds[0] * 1000, renameSeconds[1] * 1000]);
+	return YES;
+}
+
+#pragma mark - Utility
+
+- (NSString *)randomName
+{
+	// Pieces that trip up naming: unicode, digits, separators, reserved words, and names that look suffixed already
+	static NSArray *pieces;
+	if (!pieces) pieces = @[ @"state", @"State", @"idle", @"loop", @"setup", @"if", @"a", @"a2", @"2", @"2nd", @"", @" ", @"x-y",
+		@"café", @"naïve", @"日本", @"_", @"tab\tname", @"millis", @"updateStateMachine1", @"b_c", @"ÄÖ", @"go!", @"Check" ];
+	NSMutableString *name = [NSMutableString stringWithString:pieces[[self.random randomBelow:[pieces count]]]];
+	NSUInteger extraCount = [self.random randomBelow:3];
+	for (NSUInteger i = 0; i < extraCount; i++) {
+		if ([self.random randomBelow:2] == 0) [name appendString:@" "];
+		[name appendString:pieces[[self.random randomBelow:[pieces count]]]];
+	}
+	return name;
+}
+
+@end
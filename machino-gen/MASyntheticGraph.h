@@ -0,0 +1,34 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSUInteger, MASyntheticGraphDensity) {
+	MASyntheticGraphSparse, // Every state has ~2 outgoing arrows
+	MASyntheticGraphDense // Every state has ~8 outgoing arrows
+};
+
+// Builds reproducible state/arrow graphs for benchmarking code generation. States are split into machines of
+// machineSize states, each a connected chain with extra random arrows, and conditions/actions are drawn from shared pools
+// the same way the graph view shares them by name.
+@interface MASyntheticGraph : NSObject
+
+@property (nonatomic, readonly) NSUInteger stateCount;
+@property (nonatomic, readonly) NSUInteger machineSize;
+@property (nonatomic, readonly) MASyntheticGraphDensity density;
+@property (nonatomic, strong, readonly) NSArray *states;
+@property (nonatomic, strong, readonly) NSArray *transitions;
+
++ (id)graphWithStateCount:(NSUInteger)stateCount machineSize:(NSUInteger)machineSize density:(MASyntheticGraphDensity)density seed:(UInt32)seed;
+
++ (NSString *)nameForDensity:(MASyntheticGraphDensity)density;
+
+@end
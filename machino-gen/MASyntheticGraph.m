@@ -0,0 +1,98 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MASyntheticGraph.h"
+#import "MARandom.h"
+#import "Graph.h"
+
+static const NSUInteger kSparseArrowsPerState = 2;
+static const NSUInteger kDenseArrowsPerState = 8;
+static const NSUInteger kStatesPerCondition = 4;
+static const NSUInteger kStatesPerAction = 4;
+static const NSUInteger kMaximumActionsPerArrow = 2;
+
+@interface MASyntheticGraph ()
+
+@property (nonatomic, strong) MARandom *random;
+
+@end
+
+@implementation MASyntheticGraph
+
++ (id)graphWithStateCount:(NSUInteger)stateCount machineSize:(NSUInteger)machineSize density:(MASyntheticGraphDensity)density seed:(UInt32)seed
+{
+	MASyntheticGraph *graph = [[self alloc] init];
+	graph->_stateCount = stateCount;
+	graph->_machineSize = MAX(machineSize, 1);
+	graph->_density = density;
+	graph.random = [[MARandom alloc] initWithSeed:seed];
+	[graph build];
+	return graph;
+}
+
++ (NSString *)nameForDensity:(MASyntheticGraphDensity)density
+{
+	return (density == MASyntheticGraphDense) ? @"dense" : @"sparse";
+}
+
+#pragma mark - Building
+
+- (void)build
+{
+	// Pools
+	NSUInteger conditionCount = MAX(self.stateCount / kStatesPerCondition, 1);
+	NSUInteger actionCount = MAX(self.stateCount / kStatesPerAction, 1);
+	NSMutableArray *conditions = [NSMutableArray arrayWithCapacity:conditionCount];
+	NSMutableArray *actions = [NSMutableArray arrayWithCapacity:actionCount];
+	for (NSUInteger i = 0; i < conditionCount; i++) {
+		[conditions addObject:[MACondition conditionWithName:[NSString stringWithFormat:@"condition %lu", (unsigned long)i]]];
+	}
+	for (NSUInteger i = 0; i < actionCount; i++) {
+		[actions addObject:[MAAction actionWithName:[NSString stringWithFormat:@"action %lu", (unsigned long)i]]];
+	}
+	// States
+	NSMutableArray *states = [NSMutableArray arrayWithCapacity:self.stateCount];
+	for (NSUInteger i = 0; i < self.stateCount; i++) {
+		MANode *state = [[MANode alloc] init];
+		state.name = [NSString stringWithFormat:@"state %lu", (unsigned long)i];
+		state.position = NSMakePoint((i % 100) * 150.0, (i / 100) * 100.0);
+		state.isInitialState = (i % self.machineSize == 0);
+		[states addObject:state];
+	}
+	// Transitions
+	NSUInteger arrowsPerState = (self.density == MASyntheticGraphDense) ? kDenseArrowsPerState : kSparseArrowsPerState;
+	NSMutableArray *transitions = [NSMutableArray arrayWithCapacity:self.stateCount * arrowsPerState];
+	for (NSUInteger i = 0; i < self.stateCount; i++) {
+		NSUInteger machineStart = i - (i % self.machineSize);
+		NSUInteger machineLength = MIN(self.machineSize, self.stateCount - machineStart);
+		for (NSUInteger j = 0; j < arrowsPerState; j++) {
+			// The first arrow chains the machine together so it's a single connected component
+			NSUInteger target;
+			if (j == 0) target = machineStart + ((i - machineStart + 1) % machineLength);
+			else target = machineStart + [self.random randomBelow:machineLength];
+			MAArrow *arrow = [[MAArrow alloc] init];
+			arrow.sourceNode = states[i];
+			arrow.targetNode = states[target];
+			arrow.condition = conditions[[self.random randomBelow:conditionCount]];
+			NSUInteger arrowActionCount = [self.random randomBelow:kMaximumActionsPerArrow + 1];
+			NSMutableArray *arrowActions = [NSMutableArray arrayWithCapacity:arrowActionCount];
+			for (NSUInteger k = 0; k < arrowActionCount; k++) {
+				[arrowActions addObject:actions[[self.random randomBelow:actionCount]]];
+			}
+			arrow.actions = arrowActions;
+			[transitions addObject:arrow];
+		}
+	}
+	_states = states;
+	_transitions = transitions;
+}
+
+@end
@@ -0,0 +1,35 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Compares table-driven state machines with the switch form on synthetic graphs. Both forms get the same condition and
+// action code (calling into HostArduino.h, which stands in for Arduino.h), are built for the host, and are run for a
+// number of updates. Reports the text size of each sketch and the time per update, and checks that both forms call
+// the same conditions & actions and send the same messages in the same order.
+@interface MATableComparison : NSObject
+
+@property (nonatomic, copy) NSArray *stateCounts; // NSNumbers
+@property (nonatomic, copy) NSArray *densities; // NSNumbers holding MASyntheticGraphDensity
+@property (nonatomic) NSUInteger machineSize;
+@property (nonatomic) UInt32 seed;
+@property (nonatomic) NSUInteger iterationCount; // Updates of all state machines
+@property (nonatomic) BOOL insertLoggingCode;
+@property (nonatomic) BOOL memoizesConditions; // In both forms
+@property (nonatomic) BOOL logsChangesOnly; // With insertLoggingCode
+@property (nonatomic, copy) NSString *compiler; // Defaults to $CXX, or c++
+@property (nonatomic, copy) NSString *hostHeaderPath; // HostArduino.h
+@property (nonatomic, copy) NSString *messagingHeaderPath;
+@property (nonatomic, copy) NSString *tableHeaderPath; // StateMachineTable.h
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output; // NO if a build failed or the forms behaved differently
+
+@end
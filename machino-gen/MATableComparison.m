@@ -0,0 +1,94 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MATableComparison.h"
+#import "MAHostSketch.h"
+#import "MASyntheticGraph.h"
+#import "MAStateMachineCodeTemplate.h"
+
+static NSString * const kComparisonIndentString = @"  ";
+
+@implementation MATableComparison
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateCounts = @[@100, @1000];
+		_densities = @[@(MASyntheticGraphSparse), @(MASyntheticGraphDense)];
+		_machineSize = 50;
+		_seed = 1;
+		_iterationCount = 100000;
+		_compiler = [[NSProcessInfo processInfo] environment][@"CXX"] ?: @"c++";
+	}
+	return self;
+}
+
+#pragma mark - Running
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output
+{
+	MAHostSketchBuilder *builder = [[MAHostSketchBuilder alloc] init];
+	builder.compiler = self.compiler;
+	builder.hostHeaderPath = self.hostHeaderPath;
+	builder.messagingHeaderPath = self.messagingHeaderPath;
+	builder.tableHeaderPath = self.tableHeaderPath;
+	builder.iterationCount = self.iterationCount;
+	if (![builder prepareWithOutput:output]) return NO;
+	output([NSString stringWithFormat:@"%-8@ %-7@ %-8@ %-7@ %10@ %12@  %@", @"states", @"density", @"arrows", @"form", @"text (B)", @"update (ns)", @"behaviour"]);
+	BOOL passed = YES;
+	for (NSNumber *stateCount in self.stateCounts) {
+		for (NSNumber *density in self.densities) {
+			@autoreleasepool {
+				passed = [self runCaseWithStateCount:[stateCount unsignedIntegerValue] density:[density unsignedIntegerValue] builder:builder output:output] && passed;
+			}
+		}
+	}
+	[builder cleanUp];
+	return passed;
+}
+
+- (BOOL)runCaseWithStateCount:(NSUInteger)stateCount density:(MASyntheticGraphDensity)density builder:(MAHostSketchBuilder *)builder output:(void(^)(NSString *line))output
+{
+	MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:stateCount machineSize:self.machineSize density:density seed:self.seed];
+	NSString *caseName = [NSString stringWithFormat:@"%-8lu %-7@ %-8lu", (unsigned long)stateCount, [MASyntheticGraph nameForDensity:density], (unsigned long)[graph.transitions count]];
+	// Switch form with the host hooks, then the table form merging the hooks in
+	MAStateMachineCodeTemplate *switchTemplate = [self templateForGraph:graph options:0];
+	[switchTemplate generate];
+	[MAHostSketchBuilder writeHostHooksIntoTemplate:switchTemplate];
+	MAStateMachineCodeTemplate *tableTemplate = [self templateForGraph:graph options:MATableDrivenStateMachines];
+	tableTemplate.symbols = switchTemplate.symbols;
+	[tableTemplate generateMergingCodeFromTemplate:switchTemplate];
+	// Build & run
+	MAHostSketchRun *switchRun = [builder runCode:[switchTemplate code] name:@"switch" definitions:nil output:output];
+	if (!switchRun) return NO;
+	MAHostSketchRun *tableRun = [builder runCode:[tableTemplate code] name:@"tables" definitions:nil output:output];
+	if (!tableRun) return NO;
+	// Report
+	BOOL isSame = [switchRun.checksum isEqual:tableRun.checksum];
+	output([NSString stringWithFormat:@"%@ %-7@ %10lu %12.1f", caseName, @"switch", (unsigned long)switchRun.textSize, switchRun.nanosecondsPerUpdate]);
+	output([NSString stringWithFormat:@"%@ %-7@ %10lu %12.1f  %@ (%+.0f%% size, %+.0f%% time)", caseName, @"tables", (unsigned long)tableRun.textSize, tableRun.nanosecondsPerUpdate,
+		isSame ? @"same" : @"DIFFERENT", 100.0 * ((double)tableRun.textSize / MAX(switchRun.textSize, 1) - 1), 100.0 * (tableRun.nanosecondsPerUpdate / MAX(switchRun.nanosecondsPerUpdate, 0.001) - 1)]);
+	return isSame;
+}
+
+- (MAStateMachineCodeTemplate *)templateForGraph:(MASyntheticGraph *)graph options:(MAStateMachineCodeTemplateOptions)options
+{
+	MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+	template.states = graph.states;
+	template.transitions = graph.transitions;
+	template.options = options | (self.insertLoggingCode ? MAInsertLoggingCode : 0) | (self.memoizesConditions ? MAMemoizeConditions : 0);
+	if (self.logsChangesOnly) template.options |= MAChangeOnlyLogging;
+	template.indentString = kComparisonIndentString;
+	return template;
+}
+
+@end
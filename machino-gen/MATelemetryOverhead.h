@@ -0,0 +1,31 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Measures what the logging code costs per loop() on synthetic graphs: builds each sketch without and with logging for
+// the host (see MAHostSketchBuilder), with the serial port emptying at each baud rate, and reports the time per update
+// and the serial bytes sent per update.
+@interface MATelemetryOverhead : NSObject
+
+@property (nonatomic, copy) NSArray *stateCounts; // NSNumbers
+@property (nonatomic, copy) NSArray *densities; // NSNumbers holding MASyntheticGraphDensity
+@property (nonatomic, copy) NSArray *baudRates; // NSNumbers
+@property (nonatomic) NSUInteger machineSize;
+@property (nonatomic) UInt32 seed;
+@property (nonatomic) NSUInteger iterationCount;
+@property (nonatomic, copy) NSString *compiler; // Defaults to $CXX, or c++
+@property (nonatomic, copy) NSString *hostHeaderPath; // HostArduino.h
+@property (nonatomic, copy) NSString *messagingHeaderPath;
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output; // NO if a build failed
+
+@end
@@ -0,0 +1,94 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MATelemetryOverhead.h"
+#import "MAHostSketch.h"
+#import "MASyntheticGraph.h"
+#import "MAStateMachineCodeTemplate.h"
+
+static NSString * const kOverheadIndentString = @"  ";
+
+@implementation MATelemetryOverhead
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateCounts = @[@10, @100];
+		_densities = @[@(MASyntheticGraphSparse), @(MASyntheticGraphDense)];
+		_baudRates = @[@9600, @115200, @1000000];
+		_machineSize = 10;
+		_seed = 1;
+		_iterationCount = 20000;
+		_compiler = [[NSProcessInfo processInfo] environment][@"CXX"] ?: @"c++";
+	}
+	return self;
+}
+
+#pragma mark - Running
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output
+{
+	MAHostSketchBuilder *builder = [[MAHostSketchBuilder alloc] init];
+	builder.compiler = self.compiler;
+	builder.hostHeaderPath = self.hostHeaderPath;
+	builder.messagingHeaderPath = self.messagingHeaderPath;
+	builder.iterationCount = self.iterationCount;
+	if (![builder prepareWithOutput:output]) return NO;
+	output([NSString stringWithFormat:@"%-8@ %-7@ %-9@ %12@ %10@ %12@", @"states", @"density", @"baud", @"update (ns)", @"overhead", @"serial (B)"]);
+	BOOL passed = YES;
+	for (NSNumber *stateCount in self.stateCounts) {
+		for (NSNumber *density in self.densities) {
+			@autoreleasepool {
+				passed = [self runCaseWithStateCount:[stateCount unsignedIntegerValue] density:[density unsignedIntegerValue] builder:builder output:output] && passed;
+			}
+		}
+	}
+	[builder cleanUp];
+	return passed;
+}
+
+- (BOOL)runCaseWithStateCount:(NSUInteger)stateCount density:(MASyntheticGraphDensity)density builder:(MAHostSketchBuilder *)builder output:(void(^)(NSString *line))output
+{
+	MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:stateCount machineSize:self.machineSize density:density seed:self.seed];
+	NSString *caseName = [NSString stringWithFormat:@"%-8lu %-7@", (unsigned long)stateCount, [MASyntheticGraph nameForDensity:density]];
+	// Without logging, then with it, keeping the host hooks
+	MAStateMachineCodeTemplate *plainTemplate = [self templateForGraph:graph options:0];
+	[plainTemplate generate];
+	[MAHostSketchBuilder writeHostHooksIntoTemplate:plainTemplate];
+	MAStateMachineCodeTemplate *loggingTemplate = [self templateForGraph:graph options:MAInsertLoggingCode];
+	loggingTemplate.symbols = plainTemplate.symbols;
+	[loggingTemplate generateMergingCodeFromTemplate:plainTemplate];
+	// Build & run
+	MAHostSketchRun *plainRun = [builder runCode:[plainTemplate code] name:@"plain" definitions:nil output:output];
+	if (!plainRun) return NO;
+	output([NSString stringWithFormat:@"%@ %-9@ %12.1f %10@ %12.1f", caseName, @"-", plainRun.nanosecondsPerUpdate, @"-", plainRun.serialBytesPerUpdate]);
+	for (NSNumber *baudRate in self.baudRates) {
+		NSArray *definitions = @[ [NSString stringWithFormat:@"HOST_SERIAL_BAUD_RATE=%@", baudRate], [NSString stringWithFormat:@"MESSAGING_BAUD_RATE=%@UL", baudRate] ];
+		MAHostSketchRun *loggingRun = [builder runCode:[loggingTemplate code] name:@"logging" definitions:definitions output:output];
+		if (!loggingRun) return NO;
+		double overhead = loggingRun.nanosecondsPerUpdate / MAX(plainRun.nanosecondsPerUpdate, 0.001);
+		output([NSString stringWithFormat:@"%@ %-9@ %12.1f %9.1fx %12.1f", caseName, baudRate, loggingRun.nanosecondsPerUpdate, overhead, loggingRun.serialBytesPerUpdate]);
+	}
+	return YES;
+}
+
+- (MAStateMachineCodeTemplate *)templateForGraph:(MASyntheticGraph *)graph options:(MAStateMachineCodeTemplateOptions)options
+{
+	MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+	template.states = graph.states;
+	template.transitions = graph.transitions;
+	template.options = options;
+	template.indentString = kOverheadIndentString;
+	return template;
+}
+
+@end
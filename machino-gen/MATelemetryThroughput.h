@@ -0,0 +1,34 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Measures how many logging events get through the serial port per second at a fixed baud rate, for each version of
+// the messaging protocol: builds the same logging sketches against MessagingV1.h and Messaging.h for the host (see
+// MAHostSketchBuilder), records what they write to Serial and decodes it with MAMessageDecoder like Machino does. The
+// last run uses change-only logging, and whenever nothing got dropped it checks the states the graph view would have
+// shown match the ones from version 1 (which blocks instead).
+@interface MATelemetryThroughput : NSObject
+
+@property (nonatomic, copy) NSArray *stateCounts; // NSNumbers
+@property (nonatomic, copy) NSArray *densities; // NSNumbers holding MASyntheticGraphDensity
+@property (nonatomic) unsigned long baudRate;
+@property (nonatomic) NSUInteger machineSize;
+@property (nonatomic) UInt32 seed;
+@property (nonatomic) NSUInteger iterationCount;
+@property (nonatomic, copy) NSString *compiler; // Defaults to $CXX, or c++
+@property (nonatomic, copy) NSString *hostHeaderPath; // HostArduino.h
+@property (nonatomic, copy) NSString *messagingHeaderPath;
+@property (nonatomic, copy) NSString *version1MessagingHeaderPath; // MessagingV1.h
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output; // NO if a build failed or a recording didn't decode
+
+@end
@@ -0,0 +1,207 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MATelemetryThroughput.h"
+#import "MAHostSketch.h"
+#import "MASyntheticGraph.h"
+#import "MAStateMachineCodeTemplate.h"
+#import "MAMessageDecoder.h"
+#import "Graph.h"
+
+static NSString * const kThroughputIndentString = @"  ";
+
+#pragma mark - Private Interface
+
+@interface MATelemetryThroughput () <MAMessageDecoderDelegate>
+
+@property (nonatomic) NSUInteger eventCount; // Of the recording being decoded
+@property (nonatomic) NSUInteger droppedEventCount;
+// What the graph view would show while decoding: the states each state machine went through, found the way Machino does
+@property (nonatomic, strong) MAStateMachineCodeTemplate *template;
+@property (nonatomic, strong) NSMapTable *stateMachineIndexes; // MANode -> NSNumber
+@property (nonatomic, strong) NSMutableArray *shownStates; // Per state machine, without repeats
+
+@end
+
+#pragma mark - MATelemetryThroughput
+
+@implementation MATelemetryThroughput
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_stateCounts = @[@10, @100];
+		_densities = @[@(MASyntheticGraphSparse), @(MASyntheticGraphDense)];
+		_baudRate = 115200;
+		_machineSize = 10;
+		_seed = 1;
+		_iterationCount = 20000;
+		_compiler = [[NSProcessInfo processInfo] environment][@"CXX"] ?: @"c++";
+	}
+	return self;
+}
+
+#pragma mark - Running
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output
+{
+	// The same sketches for every version, and with change-only logging for the last
+	NSMutableArray *caseNames = [NSMutableArray array];
+	NSMutableArray *templates = [NSMutableArray array];
+	NSMutableArray *changeOnlyTemplates = [NSMutableArray array];
+	NSMutableArray *stateMachineIndexes = [NSMutableArray array];
+	for (NSNumber *stateCount in self.stateCounts) {
+		for (NSNumber *density in self.densities) {
+			@autoreleasepool {
+				MASyntheticGraph *graph = [MASyntheticGraph graphWithStateCount:[stateCount unsignedIntegerValue] machineSize:self.machineSize density:[density unsignedIntegerValue] seed:self.seed];
+				[templates addObject:[self templateForGraph:graph options:MAInsertLoggingCode]];
+				[changeOnlyTemplates addObject:[self templateForGraph:graph options:(MAInsertLoggingCode | MAChangeOnlyLogging)]];
+				[stateMachineIndexes addObject:[self stateMachineIndexesForStates:graph.states]];
+				[caseNames addObject:[NSString stringWithFormat:@"%-8@ %-7@", stateCount, [MASyntheticGraph nameForDensity:[density unsignedIntegerValue]]]];
+			}
+		}
+	}
+	// Build & run against each version
+	output([NSString stringWithFormat:@"%lu baud", self.baudRate]);
+	output([NSString stringWithFormat:@"%-8@ %-8@ %-7@ %12@ %10@ %9@ %12@ %10@ %7@", @"protocol", @"states", @"density", @"update (ns)", @"B/event", @"events/s", @"events", @"dropped", @"view"]);
+	NSArray *versions = @[ @(MAMessageProtocolVersion1), @(MAMessageProtocolVersion2), @(MAMessageProtocolVersion2) ];
+	NSArray *versionNames = @[ @"v1", @"v2", @"v2 chg" ];
+	NSArray *headerPaths = @[ self.version1MessagingHeaderPath ?: @"", self.messagingHeaderPath ?: @"", self.messagingHeaderPath ?: @"" ];
+	NSArray *versionTemplates = @[ templates, templates, changeOnlyTemplates ];
+	NSMutableArray *referenceShownStates = [NSMutableArray array]; // Version 1 blocks instead of dropping messages
+	NSString *serialOutputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"machino-serial-%d", [[NSProcessInfo processInfo] processIdentifier]]];
+	NSArray *definitions = @[ [NSString stringWithFormat:@"HOST_SERIAL_BAUD_RATE=%lu", self.baudRate], [NSString stringWithFormat:@"MESSAGING_BAUD_RATE=%luUL", self.baudRate] ];
+	BOOL passed = YES;
+	for (NSUInteger versionIndex = 0; versionIndex < [versions count]; versionIndex++) {
+		MAHostSketchBuilder *builder = [[MAHostSketchBuilder alloc] init];
+		builder.compiler = self.compiler;
+		builder.hostHeaderPath = self.hostHeaderPath;
+		builder.messagingHeaderPath = headerPaths[versionIndex];
+		builder.iterationCount = self.iterationCount;
+		builder.serialOutputPath = serialOutputPath;
+		if (![builder prepareWithOutput:output]) return NO;
+		for (NSUInteger caseIndex = 0; caseIndex < [caseNames count]; caseIndex++) {
+			@autoreleasepool {
+				MAStateMachineCodeTemplate *template = versionTemplates[versionIndex][caseIndex];
+				MAHostSketchRun *run = [builder runCode:[template code] name:@"logging" definitions:definitions output:output];
+				if (!run) {
+					passed = NO;
+					continue;
+				}
+				// Decode the recording
+				MAMessageDecoder *decoder = [[MAMessageDecoder alloc] init];
+				decoder.delegate = self;
+				self.eventCount = 0;
+				self.droppedEventCount = 0;
+				self.template = template;
+				self.stateMachineIndexes = stateMachineIndexes[caseIndex];
+				self.shownStates = [NSMutableArray array];
+				[decoder decodeData:[NSData dataWithContentsOfFile:serialOutputPath]];
+				MAMessageProtocolVersion version = [versions[versionIndex] unsignedIntegerValue];
+				if (decoder.protocolVersion != version) {
+					output([NSString stringWithFormat:@"%@: decoded as protocol %lu instead of %lu", caseNames[caseIndex], (unsigned long)decoder.protocolVersion, (unsigned long)version]);
+					passed = NO;
+					continue;
+				}
+				// Compare what the graph view would have shown, unless messages got lost
+				NSString *view = @"-";
+				if (versionIndex == 0) {
+					[referenceShownStates addObject:self.shownStates];
+					view = @"ref";
+				} else if (self.droppedEventCount == 0 && caseIndex < [referenceShownStates count]) {
+					BOOL isSame = [self shownStates:self.shownStates matchShownStates:referenceShownStates[caseIndex]];
+					if (!isSame) passed = NO;
+					view = isSame ? @"same" : @"differs";
+				}
+				double seconds = run.nanosecondsPerUpdate * self.iterationCount * 1e-9;
+				double bytesPerEvent = run.serialBytesPerUpdate * self.iterationCount / MAX(self.eventCount, 1);
+				output([NSString stringWithFormat:@"%-8@ %@ %12.1f %10.2f %9.0f %12lu %10lu %7@", versionNames[versionIndex], caseNames[caseIndex], run.nanosecondsPerUpdate,
+					bytesPerEvent, self.eventCount / MAX(seconds, 1e-9), (unsigned long)self.eventCount, (unsigned long)self.droppedEventCount, view]);
+			}
+		}
+		[builder cleanUp];
+	}
+	self.template = nil;
+	self.shownStates = nil;
+	[[NSFileManager defaultManager] removeItemAtPath:serialOutputPath error:nil];
+	return passed;
+}
+
+- (MAStateMachineCodeTemplate *)templateForGraph:(MASyntheticGraph *)graph options:(MAStateMachineCodeTemplateOptions)options
+{
+	MAStateMachineCodeTemplate *template = [[MAStateMachineCodeTemplate alloc] init];
+	template.states = graph.states;
+	template.transitions = graph.transitions;
+	template.options = options;
+	template.indentString = kThroughputIndentString;
+	[template generate];
+	[MAHostSketchBuilder writeHostHooksIntoTemplate:template];
+	return template;
+}
+
+- (NSMapTable *)stateMachineIndexesForStates:(NSArray *)states
+{
+	// Connected states are one state machine, like the graph view deactivates them
+	NSMapTable *indexes = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+	NSUInteger count = 0;
+	for (MANode *state in states) {
+		if ([indexes objectForKey:state]) continue;
+		for (MANode *connectedState in [state findConnectedNodes]) {
+			[indexes setObject:@(count) forKey:connectedState];
+		}
+		[indexes setObject:@(count) forKey:state];
+		count++;
+	}
+	return indexes;
+}
+
+- (BOOL)shownStates:(NSArray *)shownStates matchShownStates:(NSArray *)otherShownStates
+{
+	// Either run can stop with a few messages still buffered, so one only has to lead up to the other
+	for (NSUInteger i = 0; i < MAX([shownStates count], [otherShownStates count]); i++) {
+		NSArray *states = (i < [shownStates count]) ? shownStates[i] : @[];
+		NSArray *otherStates = (i < [otherShownStates count]) ? otherShownStates[i] : @[];
+		NSUInteger length = MIN([states count], [otherStates count]);
+		if (![[states subarrayWithRange:NSMakeRange(0, length)] isEqualToArray:[otherStates subarrayWithRange:NSMakeRange(0, length)]]) return NO;
+	}
+	return YES;
+}
+
+#pragma mark - Message Decoder Delegate
+
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeEvents:(const MAMessageEvent *)events count:(NSUInteger)count
+{
+	for (NSUInteger i = 0; i < count; i++) {
+		if (events[i].type == MAMessageEventDroppedMessages) self.droppedEventCount += events[i].arguments[0];
+		else self.eventCount++;
+		if (events[i].type == MAMessageEventCurrentState) [self showStateWithID:events[i].arguments[0]];
+	}
+}
+
+- (void)showStateWithID:(UInt16)stateID
+{
+	MANode *state = [self.template objectForSymbolWithID:stateID];
+	NSNumber *index = state ? [self.stateMachineIndexes objectForKey:state] : nil;
+	if (!index) return;
+	while ([self.shownStates count] <= [index unsignedIntegerValue]) {
+		[self.shownStates addObject:[NSMutableArray array]];
+	}
+	NSMutableArray *states = self.shownStates[[index unsignedIntegerValue]];
+	if ([states lastObject] != state) [states addObject:state];
+}
+
+// Not counted:
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length { }
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveHelloWithBaudRate:(unsigned long)baudRate { }
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count { }
+
+@end
@@ -0,0 +1,24 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Records what a logging sketch sends into a trace (see MATraceRecorder), from a recording of its serial output or live
+// from the serial device itself (set up with stty first): reads until the end of the input or an interrupt, decoding
+// and timestamping every read the way MAArduinoController does when the TraceDirectory default is set.
+@interface MATraceCapture : NSObject
+
+@property (nonatomic, copy) NSString *inputPath;
+@property (nonatomic, copy) NSString *tracePath;
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output; // NO if the input or the trace couldn't be opened
+
+@end
@@ -0,0 +1,93 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MATraceCapture.h"
+#import "MAMessageDecoder.h"
+#import "MATraceRecorder.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <errno.h>
+
+static const NSUInteger kCaptureReadLength = 4096;
+
+#pragma mark - Private Interface
+
+@interface MATraceCapture () <MAMessageDecoderDelegate>
+
+@property (nonatomic, strong) MATraceRecorder *recorder;
+@property (nonatomic) NSUInteger userSerialByteCount;
+@property (nonatomic, copy) void (^output)(NSString *line);
+
+@end
+
+#pragma mark - MATraceCapture
+
+@implementation MATraceCapture
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output
+{
+	int fileDescriptor = open([self.inputPath fileSystemRepresentation], O_RDONLY);
+	if (fileDescriptor < 0) {
+		output([NSString stringWithFormat:@"could not open %@: %s", self.inputPath, strerror(errno)]);
+		return NO;
+	}
+	NSError *error = nil;
+	self.recorder = [MATraceRecorder recorderWithPath:self.tracePath error:&error];
+	if (!self.recorder) {
+		output([NSString stringWithFormat:@"could not create %@: %@", self.tracePath, [error localizedDescription]]);
+		close(fileDescriptor);
+		return NO;
+	}
+	self.output = output;
+	// Read & record, flushing every read so an interrupt loses nothing
+	MAMessageDecoder *decoder = [[MAMessageDecoder alloc] init];
+	decoder.delegate = self;
+	Byte buffer[kCaptureReadLength];
+	unsigned long long byteCount = 0;
+	while (YES) {
+		ssize_t length = read(fileDescriptor, buffer, sizeof(buffer));
+		if (length < 0 && errno == EINTR) continue;
+		if (length <= 0) break;
+		[decoder decodeBytes:buffer length:length];
+		[self.recorder flush];
+		byteCount += length;
+	}
+	close(fileDescriptor);
+	[self.recorder close];
+	output([NSString stringWithFormat:@"%llu bytes, protocol %lu: %lu records (%lu user serial bytes) in %.1f s -> %@", byteCount, (unsigned long)decoder.protocolVersion,
+		(unsigned long)self.recorder.eventCount, (unsigned long)self.userSerialByteCount, [self.recorder currentHostTime] * 1e-9, self.tracePath]);
+	self.recorder = nil;
+	self.output = nil;
+	return YES;
+}
+
+#pragma mark - Message Decoder Delegate
+
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeEvents:(const MAMessageEvent *)events count:(NSUInteger)count
+{
+	[self.recorder recordEvents:events count:count];
+}
+
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveUserSerialBytes:(const Byte *)bytes length:(NSUInteger)length
+{
+	[self.recorder recordUserSerialBytes:bytes length:length];
+	self.userSerialByteCount += length;
+}
+
+- (void)decoder:(MAMessageDecoder *)decoder didReceiveHelloWithBaudRate:(unsigned long)baudRate
+{
+	self.output([NSString stringWithFormat:@"hello, sketch uses %lu baud", baudRate]);
+}
+
+// Traces don't keep profile summaries
+- (void)decoder:(MAMessageDecoder *)decoder didDecodeProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count { }
+
+@end
@@ -0,0 +1,24 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Plays a trace with MATracePlayer and prints every MAArduinoControllerDelegate call it makes, with the time the event
+// was received: in real time, sped up, or all at once. Seeking to the start time doesn't read the trace before it.
+@interface MATraceReplay : NSObject
+
+@property (nonatomic, copy) NSString *tracePath;
+@property (nonatomic) double speed; // 1 is real time, 0 as fast as possible
+@property (nonatomic) NSTimeInterval startTime; // Seconds into the trace
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output; // NO if the trace couldn't be read
+
+@end
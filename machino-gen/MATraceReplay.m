@@ -0,0 +1,118 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MATraceReplay.h"
+#import "MATraceReader.h"
+#import "MATracePlayer.h"
+
+#pragma mark - Private Interface
+
+@interface MATraceReplay () <MAArduinoControllerDelegate>
+
+@property (nonatomic, strong) MATracePlayer *player;
+@property (nonatomic, copy) void (^output)(NSString *line);
+
+@end
+
+#pragma mark - MATraceReplay
+
+@implementation MATraceReplay
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_speed = 1;
+	}
+	return self;
+}
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output
+{
+	NSDate *openStart = [NSDate date];
+	NSError *error = nil;
+	MATraceReader *reader = [MATraceReader readerWithContentsOfFile:self.tracePath error:&error];
+	if (!reader) {
+		output([NSString stringWithFormat:@"could not read %@: %@", self.tracePath, [error localizedDescription]]);
+		return NO;
+	}
+	self.player = [[MATracePlayer alloc] initWithReader:reader];
+	self.player.delegate = self;
+	self.player.speed = self.speed;
+	[self.player seekToHostTime:(UInt64)(MAX(self.startTime, 0) * 1e9)];
+	output([NSString stringWithFormat:@"%@: %lu records over %.3f s, recorded %@, opened & seeked in %.3f ms", self.tracePath, (unsigned long)reader.eventCount,
+		reader.duration * 1e-9, reader.startDate, -[openStart timeIntervalSinceNow] * 1e3]);
+	// Play on this run loop until the end
+	self.output = output;
+	[self.player play];
+	while (self.player.isPlaying && [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]]) { }
+	self.player = nil;
+	self.output = nil;
+	return YES;
+}
+
+- (void)printWithFormat:(NSString *)format, ...
+{
+	va_list arguments;
+	va_start(arguments, format);
+	NSString *string = [[NSString alloc] initWithFormat:format arguments:arguments];
+	va_end(arguments);
+	self.output([NSString stringWithFormat:@"%12.6f  %@", self.player.hostTime * 1e-9, string]);
+}
+
+#pragma mark - Arduino Controller Delegate
+
+- (void)arduinoDidStartIteration:(MAArduinoController *)arduino
+{
+	[self printWithFormat:@"iteration start"];
+}
+
+- (void)arduinoDidEndIteration:(MAArduinoController *)arduino
+{
+	[self printWithFormat:@"iteration end"];
+}
+
+- (void)arduino:(MAArduinoController *)arduino didSendCurrentStateID:(UInt16)stateID
+{
+	[self printWithFormat:@"state %u", stateID];
+}
+
+- (void)arduino:(MAArduinoController *)arduino willCheckConditionWithID:(UInt16)conditionID forTransitionWithID:(UInt16)transitionID
+{
+	[self printWithFormat:@"condition %u of transition %u", conditionID, transitionID];
+}
+
+- (void)arduino:(MAArduinoController *)arduino willPerformTransitionWithID:(UInt16)transitionID
+{
+	[self printWithFormat:@"transition %u", transitionID];
+}
+
+- (void)arduino:(MAArduinoController *)arduino willPerformActionAtIndex:(UInt16)index forTransitionWithID:(UInt16)transitionID
+{
+	[self printWithFormat:@"action %u of transition %u", index, transitionID];
+}
+
+- (void)arduino:(MAArduinoController *)arduino didReceiveUserSerialData:(NSData *)data
+{
+	NSString *string = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] ?: [data description];
+	string = [[string stringByReplacingOccurrencesOfString:@"\r" withString:@"\\r"] stringByReplacingOccurrencesOfString:@"\n" withString:@"\\n"];
+	[self printWithFormat:@"serial \"%@\"", string];
+}
+
+- (void)arduino:(MAArduinoController *)arduino didDropMessages:(UInt16)count
+{
+	[self printWithFormat:@"dropped %u messages", count];
+}
+
+// Traces don't keep profile summaries
+- (void)arduino:(MAArduinoController *)arduino didSendProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count { }
+
+@end
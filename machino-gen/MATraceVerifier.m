@@ -0,0 +1,258 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MATraceVerifier.h"
+#import "MARandom.h"
+#import "MATraceRecorder.h"
+#import "MATraceReader.h"
+#import "MATraceFormat.h"
+#import "MATracePlayer.h"
+#import "MAMessageRecording.h"
+#import <unistd.h>
+
+static const NSUInteger kMaximumRecordingIterations = 20000;
+static const NSUInteger kMaximumEventsPerRead = 40;
+static const NSUInteger kMaximumUserSerialBytesPerRead = 40;
+static const UInt64 kMaximumReadInterval = 2000000; // 2 ms
+static const NSUInteger kSeekCount = 200;
+
+typedef struct {
+	UInt64 hostTime;
+	UInt8 type;
+	UInt16 arguments[2];
+	UInt8 length;
+	Byte bytes[16];
+} MAExpectedTraceEvent;
+
+#pragma mark - Private Class - MAArduinoCallbackLog
+
+// Everything a player hands over, as the events & user serial output MAMessageRecording keeps
+@interface MAArduinoCallbackLog : NSObject <MAArduinoControllerDelegate>
+
+@property (nonatomic, strong, readonly) NSMutableData *events;
+@property (nonatomic, strong, readonly) NSMutableData *userSerialBytes;
+
+@end
+
+@implementation MAArduinoCallbackLog
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		_events = [NSMutableData data];
+		_userSerialBytes = [NSMutableData data];
+	}
+	return self;
+}
+
+- (void)appendEventWithType:(MAMessageEventType)type argument:(UInt16)argument argument:(UInt16)otherArgument
+{
+	MAMessageEvent event = { type, { argument, otherArgument } };
+	[MAMessageRecording appendEvent:&event toData:self.events];
+}
+
+- (void)arduinoDidStartIteration:(MAArduinoController *)arduino
+{
+	[self appendEventWithType:MAMessageEventIterationStart argument:0 argument:0];
+}
+
+- (void)arduinoDidEndIteration:(MAArduinoController *)arduino
+{
+	[self appendEventWithType:MAMessageEventIterationEnd argument:0 argument:0];
+}
+
+- (void)arduino:(MAArduinoController *)arduino didSendCurrentStateID:(UInt16)stateID
+{
+	[self appendEventWithType:MAMessageEventCurrentState argument:stateID argument:0];
+}
+
+- (void)arduino:(MAArduinoController *)arduino willCheckConditionWithID:(UInt16)conditionID forTransitionWithID:(UInt16)transitionID
+{
+	[self appendEventWithType:MAMessageEventWillCheckCondition argument:transitionID argument:conditionID];
+}
+
+- (void)arduino:(MAArduinoController *)arduino willPerformTransitionWithID:(UInt16)transitionID
+{
+	[self appendEventWithType:MAMessageEventWillPerformTransition argument:transitionID argument:0];
+}
+
+- (void)arduino:(MAArduinoController *)arduino willPerformActionAtIndex:(UInt16)index forTransitionWithID:(UInt16)transitionID
+{
+	[self appendEventWithType:MAMessageEventWillPerformAction argument:transitionID argument:index];
+}
+
+- (void)arduino:(MAArduinoController *)arduino didReceiveUserSerialData:(NSData *)data
+{
+	[self.userSerialBytes appendData:data];
+}
+
+- (void)arduino:(MAArduinoController *)arduino didDropMessages:(UInt16)count
+{
+	[self appendEventWithType:MAMessageEventDroppedMessages argument:count argument:0];
+}
+
+// Traces don't keep profile summaries
+- (void)arduino:(MAArduinoController *)arduino didSendProfileSamples:(const MAProfileSample *)samples count:(NSUInteger)count { }
+
+@end
+
+#pragma mark - Private Interface
+
+@interface MATraceVerifier ()
+
+
+@end
+
+#pragma mark - MATraceVerifier
+
+@implementation MATraceVerifier
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		self.iterationCount = 20;
+	}
+	return self;
+}
+
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output
+{
+	NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"machino-trace-%d.matrace", [[NSProcessInfo processInfo] processIdentifier]]];
+	NSUInteger recordCount = 0;
+	NSString *mismatch = nil;
+	for (NSUInteger iteration = 0; iteration < self.iterationCount && !mismatch; iteration++) {
+		@autoreleasepool {
+			MAMessageRecording *recording = [MAMessageRecording recordingWithProtocolVersion:MAMessageProtocolVersion2
+				iterationCount:1 + [self.random randomBelow:kMaximumRecordingIterations] seed:(UInt32)[self.random randomBelow:UINT32_MAX] + 1];
+			NSMutableData *expectedEvents = [NSMutableData data];
+			mismatch = [self recordRecording:recording toPath:path expectedEvents:expectedEvents];
+			if (!mismatch) mismatch = [self checkTraceAtPath:path againstEvents:expectedEvents recording:recording];
+			if (mismatch) mismatch = [NSString stringWithFormat:@"iteration %lu: %@", (unsigned long)iteration, mismatch];
+			recordCount += [expectedEvents length] / sizeof(MAExpectedTraceEvent);
+		}
+	}
+	unlink([path fileSystemRepresentation]);
+	if (mismatch) {
+		output(mismatch);
+		return NO;
+	}
+	output([NSString stringWithFormat:@"%lu traces, %lu records, %lu seeks: all read, seeked & replayed correctly", (unsigned long)self.iterationCount,
+		(unsigned long)recordCount, (unsigned long)(self.iterationCount * kSeekCount)]);
+	return YES;
+}
+
+#pragma mark - Recording
+
+- (NSString *)recordRecording:(MAMessageRecording *)recording toPath:(NSString *)path expectedEvents:(NSMutableData *)expectedEvents
+{
+	NSError *error = nil;
+	MATraceRecorder *recorder = [MATraceRecorder recorderWithPath:path error:&error];
+	if (!recorder) return [NSString stringWithFormat:@"could not create %@: %@", path, [error localizedDescription]];
+	// Reads of a few events or user serial bytes, at times that mostly go up
+	const MAMessageEvent *events = [recording.events bytes];
+	NSUInteger eventCount = [recording.events length] / sizeof(MAMessageEvent);
+	const Byte *userSerialBytes = [recording.userSerialBytes bytes];
+	NSUInteger userSerialLength = [recording.userSerialBytes length];
+	NSUInteger eventIndex = 0;
+	NSUInteger userSerialIndex = 0;
+	UInt64 hostTime = 0;
+	UInt64 lastHostTime = 0;
+	while (eventIndex < eventCount || userSerialIndex < userSerialLength) {
+		hostTime += [self.random randomBelow:kMaximumReadInterval];
+		if ([self.random randomBelow:50] == 0) hostTime -= MIN(hostTime, [self.random randomBelow:kMaximumReadInterval]); // Recorded as the last time
+		UInt64 expectedHostTime = MAX(hostTime, lastHostTime);
+		lastHostTime = expectedHostTime;
+		UInt32 deviceTime = ([self.random randomBelow:2] == 0) ? MATraceNoDeviceTime : (UInt32)(hostTime / 1000000);
+		if (userSerialIndex >= userSerialLength || (eventIndex < eventCount && [self.random randomBelow:4] != 0)) {
+			NSUInteger count = MIN(1 + [self.random randomBelow:kMaximumEventsPerRead], eventCount - eventIndex);
+			[recorder recordEvents:&events[eventIndex] count:count hostTime:hostTime deviceTime:deviceTime];
+			for (NSUInteger i = 0; i < count; i++) {
+				MAExpectedTraceEvent expectedEvent = { expectedHostTime, events[eventIndex+i].type, { events[eventIndex+i].arguments[0], events[eventIndex+i].arguments[1] }, 0, { 0 } };
+				[expectedEvents appendBytes:&expectedEvent length:sizeof(expectedEvent)];
+			}
+			eventIndex += count;
+		} else {
+			NSUInteger length = MIN(1 + [self.random randomBelow:kMaximumUserSerialBytesPerRead], userSerialLength - userSerialIndex);
+			[recorder recordUserSerialBytes:&userSerialBytes[userSerialIndex] length:length hostTime:hostTime deviceTime:deviceTime];
+			for (NSUInteger offset = 0; offset < length; offset += 10) {
+				MAExpectedTraceEvent expectedEvent = { expectedHostTime, MATraceEventUserSerial, { 0, 0 }, (UInt8)MIN(length - offset, 10), { 0 } };
+				memcpy(expectedEvent.bytes, &userSerialBytes[userSerialIndex + offset], expectedEvent.length);
+				[expectedEvents appendBytes:&expectedEvent length:sizeof(expectedEvent)];
+			}
+			userSerialIndex += length;
+		}
+	}
+	if (![recorder flush]) return @"could not write the trace";
+	[recorder close];
+	return nil;
+}
+
+#pragma mark - Checking
+
+- (NSString *)checkTraceAtPath:(NSString *)path againstEvents:(NSData *)expectedEventData recording:(MAMessageRecording *)recording
+{
+	const MAExpectedTraceEvent *expectedEvents = [expectedEventData bytes];
+	NSUInteger expectedCount = [expectedEventData length] / sizeof(MAExpectedTraceEvent);
+	NSError *error = nil;
+	MATraceReader *reader = [MATraceReader readerWithContentsOfFile:path error:&error];
+	if (!reader) return [NSString stringWithFormat:@"could not read the trace: %@", [error localizedDescription]];
+	// Every record
+	NSString *mismatch = [self checkReader:reader againstEvents:expectedEvents count:expectedCount];
+	if (mismatch) return mismatch;
+	// Seeks, against a linear search
+	UInt64 endTime = (expectedCount > 0) ? expectedEvents[expectedCount-1].hostTime + 2 : 1;
+	for (NSUInteger i = 0; i < kSeekCount; i++) {
+		UInt64 hostTime = ((UInt64)[self.random randomBelow:UINT32_MAX] << 16 | [self.random randomBelow:1 << 16]) % endTime;
+		NSUInteger expectedIndex = 0;
+		while (expectedIndex < expectedCount && expectedEvents[expectedIndex].hostTime < hostTime) expectedIndex++;
+		NSUInteger index = [reader indexOfFirstEventAtOrAfterHostTime:hostTime];
+		if (index != expectedIndex) return [NSString stringWithFormat:@"seeking to %llu gave record %lu instead of %lu", hostTime, (unsigned long)index, (unsigned long)expectedIndex];
+	}
+	// Replaying gives back the recording
+	MATracePlayer *player = [[MATracePlayer alloc] initWithReader:reader];
+	MAArduinoCallbackLog *log = [[MAArduinoCallbackLog alloc] init];
+	player.delegate = log;
+	[player playEventsUpToHostTime:UINT64_MAX];
+	if (![log.events isEqualToData:recording.events]) return @"replayed events differ";
+	if (![log.userSerialBytes isEqualToData:recording.userSerialBytes]) return @"replayed user serial output differs";
+	// Cut off mid-record, losing only that one
+	if (expectedCount == 0) return nil;
+	reader = nil;
+	NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+	off_t length = (off_t)[attributes fileSize] - 1 - [self.random randomBelow:sizeof(MATraceRecord) - 1];
+	if (truncate([path fileSystemRepresentation], length) != 0) return @"could not cut off the trace";
+	reader = [MATraceReader readerWithContentsOfFile:path error:&error];
+	if (!reader) return [NSString stringWithFormat:@"could not read the cut off trace: %@", [error localizedDescription]];
+	return [self checkReader:reader againstEvents:expectedEvents count:expectedCount-1];
+}
+
+- (NSString *)checkReader:(MATraceReader *)reader againstEvents:(const MAExpectedTraceEvent *)expectedEvents count:(NSUInteger)expectedCount
+{
+	if (reader.eventCount != expectedCount) return [NSString stringWithFormat:@"%lu records instead of %lu", (unsigned long)reader.eventCount, (unsigned long)expectedCount];
+	for (NSUInteger i = 0; i < expectedCount; i++) {
+		MATraceEvent event = [reader eventAtIndex:i];
+		const MAExpectedTraceEvent *expectedEvent = &expectedEvents[i];
+		BOOL isSame = (event.hostTime == expectedEvent->hostTime && event.type == expectedEvent->type);
+		if (event.type == MATraceEventUserSerial) {
+			isSame = isSame && event.length == expectedEvent->length && memcmp(event.bytes, expectedEvent->bytes, event.length) == 0;
+		} else {
+			isSame = isSame && event.arguments[0] == expectedEvent->arguments[0] && event.arguments[1] == expectedEvent->arguments[1];
+		}
+		if (!isSame) return [NSString stringWithFormat:@"record %lu differs", (unsigned long)i];
+	}
+	return nil;
+}
+
+#pragma mark - Utility
+
+@end
@@ -0,0 +1,30 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import "MAPlatform.h"
+
+@class MARandom;
+
+// What the machino-gen --verify checks have in common. Each subclass checks one part of Machino in verifyWithOutput:,
+// over iterationCount random iterations (streams, edits or operations, with a default that suits it) drawn from random,
+// which runWithOutput: starts from the seed, so a failing run can be repeated with the seed it printed.
+@interface MAVerifier : NSObject
+
+@property (nonatomic) NSUInteger iterationCount;
+@property (nonatomic) UInt32 seed; // Default: 1
+@property (nonatomic, strong, readonly) MARandom *random;
+
+- (BOOL)runWithOutput:(void(^)(NSString *line))output; // Stops at the first failure
+
+// For subclasses
+- (BOOL)verifyWithOutput:(void(^)(NSString *line))output;
+
+@end
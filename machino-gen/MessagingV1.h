@@ -0,0 +1,148 @@
+#include "Arduino.h"
+
+// Protocol version 1, as Machino's Messaging.h wrote it before the framed version 2. Kept to check that Machino still
+// reads sketches built with it, and to compare the two in machino-gen --telemetry-throughput.
+//
+// Messages are queued in a ring buffer and written out only as fast as the serial port takes them without blocking, so
+// logging barely slows the state machines down. When the buffer is full messages are dropped, and a dropped messages
+// message reports how many once there is room again. Machino defines MESSAGING_BAUD_RATE when uploading and checks it
+// against the hello message; MESSAGING_BUFFER_SIZE has to be a power of two.
+
+#ifndef MESSAGING_BAUD_RATE
+#define MESSAGING_BAUD_RATE 1000000UL
+#endif
+#ifndef MESSAGING_BUFFER_SIZE
+#define MESSAGING_BUFFER_SIZE 128
+#endif
+
+static const int kMessageStartSequenceLength = 3;
+static const byte kMessageStartSequence[] = { 17, 31, 23 };
+static const int kMessageHeaderLength = kMessageStartSequenceLength + 3;
+
+typedef enum {
+	kMessageNone = 0,
+	kMessageIterationStart = 1,
+	kMessageIterationEnd = 2,
+	kMessageCurrentState = 3,
+	kMessageWillCheckCondition = 4,
+	kMessageWillPerformTransition = 5,
+	kMessageWillPerformAction = 6,
+	kMessageDroppedMessages = 7,
+	kMessageHello = 8
+} MessageType;
+
+byte messageBuffer[MESSAGING_BUFFER_SIZE];
+uint16_t messageBufferStart = 0;
+uint16_t messageBufferLength = 0;
+uint16_t droppedMessageCount = 0;
+
+void sendMessageHello();
+
+// -------------
+// -- Utility --
+// -------------
+
+void setupMessaging() {
+	Serial.begin(MESSAGING_BAUD_RATE);
+	sendMessageHello();
+}
+
+void sendBufferedMessages() {
+	// No more than the serial transmit buffer has room for, so this never blocks
+	while (messageBufferLength > 0) {
+		int available = Serial.availableForWrite();
+		if (available <= 0) break;
+		uint16_t length = MESSAGING_BUFFER_SIZE - messageBufferStart; // Up to the end of the ring
+		if (length > messageBufferLength) length = messageBufferLength;
+		if (length > available) length = available;
+		Serial.write(&messageBuffer[messageBufferStart], length);
+		messageBufferStart = (messageBufferStart + length) & (MESSAGING_BUFFER_SIZE - 1);
+		messageBufferLength -= length;
+	}
+}
+
+void writeUInt8(uint8_t value) {
+	messageBuffer[(messageBufferStart + messageBufferLength) & (MESSAGING_BUFFER_SIZE - 1)] = value;
+	messageBufferLength++;
+}
+
+void writeUInt16(uint16_t value) {
+	writeUInt8((value >> 8) & 255);
+	writeUInt8(value & 255);
+}
+
+void writeMessageHeader(MessageType type, uint16_t length) {
+	for (int i = 0; i < kMessageStartSequenceLength; i++) writeUInt8(kMessageStartSequence[i]);
+	writeUInt8(type);
+	writeUInt16(length);
+}
+
+boolean beginMessage(MessageType type, uint16_t length) {
+	if (MESSAGING_BUFFER_SIZE - messageBufferLength < kMessageHeaderLength + length + kMessageHeaderLength + 2) sendBufferedMessages();
+	// Report dropped messages first, so they're reported in order
+	if (droppedMessageCount > 0 && MESSAGING_BUFFER_SIZE - messageBufferLength >= kMessageHeaderLength + 2) {
+		writeMessageHeader(kMessageDroppedMessages, 2);
+		writeUInt16(droppedMessageCount);
+		droppedMessageCount = 0;
+	}
+	if (droppedMessageCount > 0 || MESSAGING_BUFFER_SIZE - messageBufferLength < kMessageHeaderLength + length) {
+		if (droppedMessageCount < 0xFFFF) droppedMessageCount++;
+		return false;
+	}
+	writeMessageHeader(type, length);
+	return true;
+}
+
+void endMessage() {
+	sendBufferedMessages();
+}
+
+// --------------
+// -- Messages --
+// --------------
+
+void sendMessageHello() {
+	if (!beginMessage(kMessageHello, 6)) return;
+	writeUInt16((MESSAGING_BAUD_RATE >> 16) & 0xFFFF);
+	writeUInt16(MESSAGING_BAUD_RATE & 0xFFFF);
+	writeUInt16(MESSAGING_BUFFER_SIZE);
+	endMessage();
+}
+
+void sendMessageIterationStart() {
+	if (!beginMessage(kMessageIterationStart, 0)) return;
+	endMessage();
+}
+
+void sendMessageIterationEnd() {
+	if (!beginMessage(kMessageIterationEnd, 0)) return;
+	endMessage();
+}
+
+void sendMessageCurrentState(int stateID) {
+	if (!beginMessage(kMessageCurrentState, 2)) return;
+	writeUInt16(stateID);
+	endMessage();
+}
+
+boolean sendMessageWillCheckCondition(int transitionID, int conditionID) {
+	if (beginMessage(kMessageWillCheckCondition, 4)) {
+		writeUInt16(transitionID);
+		writeUInt16(conditionID);
+		endMessage();
+	}
+	return true; // To allow message sending from within conditionals
+}
+
+void sendMessageWillPerformTransition(int transitionID) {
+	if (!beginMessage(kMessageWillPerformTransition, 2)) return;
+	writeUInt16(transitionID);
+	endMessage();
+}
+
+void sendMessageWillPerformAction(int transitionID, int index) {
+	if (!beginMessage(kMessageWillPerformAction, 4)) return;
+	writeUInt16(transitionID);
+	writeUInt16(index);
+	endMessage();
+}
\ No newline at end of file
@@ -0,0 +1,655 @@
+//
+// Copyright (c) 2013, Patrick Pijnappel (contact@patrickpijnappel.com)
+//
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted,
+// provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+// CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+// NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#import <Foundation/Foundation.h>
+#import "MASketchBatch.h"
+#import "MABenchmark.h"
+#import "MASyntheticGraph.h"
+#import "MAIncrementalVerifier.h"
+#import "MATableComparison.h"
+#import "MATelemetryOverhead.h"
+#import "MATelemetryThroughput.h"
+#import "MADecoderFuzzer.h"
+#import "MADecoderBenchmark.h"
+#import "MATraceCapture.h"
+#import "MATraceReplay.h"
+#import "MATraceVerifier.h"
+#import "MAProfileCheck.h"
+#import "MASimulationVerifier.h"
+#import "MASimulator.h"
+#import "MASketchBuilder.h"
+#import "MABuildCache.h"
+#import "MACoalescingVerifier.h"
+#import "MASerialVerifier.h"
+#import "MAConsoleVerifier.h"
+#import "MASymbolIDVerifier.h"
+#import "MASymbolNameVerifier.h"
+#import "MADocumentFormatVerifier.h"
+#import "MAReservedNames.h"
+#import "MAStateMachineCodeTemplate.h"
+#import "MADocumentArchive.h"
+
+static NSString * const kUsage =
+	@"usage: machino-gen [options] document.machino ...\n"
+	@"       machino-gen --benchmark [benchmark options]\n"
+	@"       machino-gen --verify <check,...|all> [verify options]\n"
+	@"       machino-gen --compare-tables [compare options]\n"
+	@"       machino-gen --telemetry-overhead [overhead options]\n"
+	@"       machino-gen --telemetry-throughput [throughput options]\n"
+	@"       machino-gen --benchmark-decoder [decoder benchmark options]\n"
+	@"       machino-gen --record-trace --recording <file> -o <trace>\n"
+	@"       machino-gen --replay-trace [replay options] <trace>\n"
+	@"       machino-gen --simulate [simulate options] document.machino\n"
+	@"       machino-gen --build --board <fqbn> [build options] document.machino ...\n"
+	@"       machino-gen --reserved-names-table [--reserved-names <file>] [-o <header>]\n"
+	@"\n"
+	@"Generates an Arduino sketch (<name>/<name>.ino) for every document.\n"
+	@"\n"
+	@"options:\n"
+	@"  -o <directory>            write sketches to <directory> instead of next to each document\n"
+	@"  -j <jobs>                 number of documents to generate at once (default: number of cores)\n"
+	@"  --logging                 insert the logging code used when running from Machino\n"
+	@"  --tables                  write table-driven state machines (needs StateMachineTable.h next to the sketch)\n"
+	@"  --memoize-conditions      check each condition at most once per update (except ones named with a trailing !)\n"
+	@"  --change-only-logging     insert logging code that logs only entered states & changed conditions, plus keyframes\n"
+	@"  --profiling               insert profiling code that sends timing summaries instead of logging events\n"
+	@"  --indent <string>         indent string (default: two spaces)\n"
+	@"  --reserved-names <file>   reserved symbol names (default: the ones built in from ReservedSymbolNames.txt)\n"
+	@"\n"
+	@"benchmark options:\n"
+	@"  --states <n,n,...>        state counts (default: 1000,5000,10000,50000)\n"
+	@"  --density <sparse|dense|both>\n"
+	@"  --machine-size <n>        states per connected state machine (default: 100)\n"
+	@"  --seed <n>                seed for the synthetic graphs (default: 1)\n"
+	@"  --logging                 benchmark with logging code\n"
+	@"  --writers <n,n,...|all>   also time writing the code with this many threads, checking it matches one thread's\n"
+	@"                            (all: 1, 2, 4, ... up to the number of cores)\n"
+	@"\n"
+	@"verify checks (comma separated, or all; each stops at its first failure):\n"
+	@"  incremental               incremental regeneration matches full regeneration on random edits\n"
+	@"  decoder                   decodes random, mutated & split serial recordings of both messaging protocol versions\n"
+	@"  trace                     records random serial recordings into traces, reads, seeks & replays them\n"
+	@"  profiling                 profiles sketches with one slow condition on the host, like --compare-tables\n"
+	@"  simulation                connects to simulated sketches like Machino does, checking their hello & states come in\n"
+	@"  coalescing                frames of coalesced events show the same as the events one by one\n"
+	@"  serial                    ORSSerialPort against a pseudo-terminal pair\n"
+	@"  console                   the bounded console shows the end of the text & keeps all of it in its spill file\n"
+	@"  symbol-ids                ids are dense, kept while objects come & go, and survive archiving\n"
+	@"  symbol-names              names made incrementally match naming every object from scratch\n"
+	@"  document-format           autosaves random edits by appending, reads them back whole & cut off, and times saving\n"
+	@"                            & opening against keyed archives\n"
+	@"\n"
+	@"verify options:\n"
+	@"  --iterations <n>          random edits, streams or operations per check (default: each check's own)\n"
+	@"  --seed <n>                seed for every check (default: 1)\n"
+	@"  --states <n>              states in the graph (incremental, profiling, simulation, coalescing) or to time with\n"
+	@"                            (symbol-names, document-format)\n"
+	@"  --machine-size <n>        states per connected state machine (incremental, profiling, simulation, coalescing)\n"
+	@"  --logging                 incremental: verify with logging code\n"
+	@"  --background              incremental: request the code from MACodeGenerator as the edits come in\n"
+	@"  --lines <n>               console: lines the console keeps (default: 50)\n"
+	@"  --baud <n>                serial: baud rate to set on the port, simulation: to build the sketches for\n"
+	@"                            (default: 1000000)\n"
+	@"\n"
+	@"compare options (builds & runs the switch and table forms on the host with $CXX, or c++):\n"
+	@"  --states <n,n,...>        state counts (default: 100,1000)\n"
+	@"  --density <sparse|dense|both>\n"
+	@"  --machine-size <n>        states per connected state machine (default: 50)\n"
+	@"  --iterations <n>          updates to time (default: 100000)\n"
+	@"  --seed <n>                seed for the synthetic graphs (default: 1)\n"
+	@"  --logging                 compare with logging code, checking both send the same messages\n"
+	@"  --memoize-conditions      compare with memoized conditions\n"
+	@"  --change-only-logging     compare with change-only logging code\n"
+	@"\n"
+	@"overhead options (times sketches without & with logging code on the host, like --compare-tables):\n"
+	@"  --states <n,n,...>        state counts (default: 10,100)\n"
+	@"  --density <sparse|dense|both>\n"
+	@"  --machine-size <n>        states per connected state machine (default: 10)\n"
+	@"  --baud <n,n,...>          serial baud rates (default: 9600,115200,1000000)\n"
+	@"  --iterations <n>          updates to time (default: 20000)\n"
+	@"  --seed <n>                seed for the synthetic graphs (default: 1)\n"
+	@"\n"
+	@"throughput options (logging events per second through each messaging protocol version and with change-only logging,\n"
+	@"like --telemetry-overhead):\n"
+	@"  --states <n,n,...>        state counts (default: 10,100)\n"
+	@"  --density <sparse|dense|both>\n"
+	@"  --machine-size <n>        states per connected state machine (default: 10)\n"
+	@"  --baud <n>                serial baud rate (default: 115200)\n"
+	@"  --iterations <n>          updates to time (default: 20000)\n"
+	@"  --seed <n>                seed for the synthetic graphs (default: 1)\n"
+	@"\n"
+	@"decoder benchmark options (times decoding serial recordings, in MB/s):\n"
+	@"  --recording <file>        a recording of a sketch's serial output (default: synthetic recordings of both versions)\n"
+	@"  --iterations <n>          loop() iterations in the synthetic recordings (default: 200000)\n"
+	@"  --seed <n>                seed for the synthetic recordings (default: 1)\n"
+	@"\n"
+	@"record options (decodes a sketch's serial output into a trace, like Machino does with the TraceDirectory default):\n"
+	@"  --recording <file>        a recording of the serial output, or the serial device itself (set up with stty)\n"
+	@"  -o <trace>                the trace to write\n"
+	@"\n"
+	@"replay options (prints the events in a trace with the time they were received):\n"
+	@"  --speed <x|max>           playback speed (default: 1, real time)\n"
+	@"  --seek <seconds>          start this far into the trace (default: 0)\n"
+	@"\n"
+	@"simulate options (runs the sketch Machino would upload on the host, see SimulatedArduino.h; Serial is a\n"
+	@"pseudo-terminal to connect to, pins that change are printed):\n"
+	@"  --script <file>           inputs, as lines of <milliseconds> <pin> <value>\n"
+	@"  --duration <ms>           stop after this much simulated time (default: run until interrupted)\n"
+	@"  --speed <x|max>           times real time (default: 1, or max with -o)\n"
+	@"  -o <recording>            record the serial output into a file instead\n"
+	@"  --baud <n>                serial baud rate (default: 1000000)\n"
+	@"  --tables, --memoize-conditions, --change-only-logging, --profiling\n"
+	@"\n"
+	@"build options (generates the sketches like without --build, then compiles them with arduino-cli through the build\n"
+	@"cache, so unchanged sketches aren't compiled again):\n"
+	@"  --board <fqbn>            board to build for, like arduino:avr:uno\n"
+	@"  --port <device>           upload to the board on this serial port, unless it already runs the build (one document)\n"
+	@"  --baud <n>                baud rate the sketch says hello at (default: 1000000)\n"
+	@"  --arduino-cli <path>      arduino-cli to use (default: the one in PATH)\n"
+	@"  --cache <directory>       build cache (default: Machino/Builds in the user's caches folder)\n"
+	@"  --cache-size <MB>         size the build cache is kept under (default: 256)\n"
+	@"  -o, --logging, --tables, --memoize-conditions, --change-only-logging, --profiling, --indent\n"
+	@"\n"
+	@"reserved names table options (writes Machino/MAReservedNameTable.h, the built-in reserved names, from a names file):\n"
+	@"  --reserved-names <file>   the names (default: ReservedSymbolNames.txt from the resources)\n"
+	@"  -o <header>               the header to write (default: standard output)\n";
+
+#pragma mark - Output
+
+static void MAPrint(FILE *file, NSString *format, ...) NS_FORMAT_FUNCTION(2,3);
+static void MAPrint(FILE *file, NSString *format, ...)
+{
+	va_list arguments;
+	va_start(arguments, format);
+	NSString *string = [[NSString alloc] initWithFormat:format arguments:arguments];
+	va_end(arguments);
+	fputs([string UTF8String], file);
+	fflush(file);
+}
+
+static int MAFail(NSString *format, ...) NS_FORMAT_FUNCTION(1,2);
+static int MAFail(NSString *format, ...)
+{
+	va_list arguments;
+	va_start(arguments, format);
+	NSString *string = [[NSString alloc] initWithFormat:format arguments:arguments];
+	va_end(arguments);
+	fputs([string UTF8String], stderr);
+	return 1;
+}
+
+#pragma mark - Resources
+
+static NSString *MAResourcePath(NSString *name, NSString *type)
+{
+	// Try 1) the bundle's resources 2) next to the executable 3) the installed share folder
+	NSString *path = [[NSBundle mainBundle] pathForResource:name ofType:type];
+	if (path) return path;
+	NSString *fileName = [name stringByAppendingPathExtension:type];
+	NSString *executableFolder = [[[NSBundle mainBundle] executablePath] stringByDeletingLastPathComponent];
+	NSArray *candidates = @[ [executableFolder stringByAppendingPathComponent:fileName],
+		[[executableFolder stringByAppendingPathComponent:@"../share/machino"] stringByAppendingPathComponent:fileName] ];
+	for (NSString *candidate in candidates) {
+		if ([[NSFileManager defaultManager] fileExistsAtPath:candidate]) return [candidate stringByStandardizingPath];
+	}
+	return nil;
+}
+
+#pragma mark - Modes
+
+static int MARunBenchmark(NSDictionary *options)
+{
+	MABenchmark *benchmark = [[MABenchmark alloc] init];
+	if (options[@"states"]) {
+		NSMutableArray *stateCounts = [NSMutableArray array];
+		for (NSString *count in [options[@"states"] componentsSeparatedByString:@","]) {
+			if ([count integerValue] <= 0) return MAFail(@"invalid state count '%@'\n", count);
+			[stateCounts addObject:@([count integerValue])];
+		}
+		benchmark.stateCounts = stateCounts;
+	}
+	NSString *density = options[@"density"];
+	if ([density isEqual:@"sparse"]) benchmark.densities = @[@(MASyntheticGraphSparse)];
+	else if ([density isEqual:@"dense"]) benchmark.densities = @[@(MASyntheticGraphDense)];
+	else if (density && ![density isEqual:@"both"]) return MAFail(@"invalid density '%@'\n", density);
+	if (options[@"machine-size"]) benchmark.machineSize = MAX([options[@"machine-size"] integerValue], 1);
+	if (options[@"seed"]) benchmark.seed = (UInt32)[options[@"seed"] longLongValue];
+	benchmark.insertLoggingCode = (options[@"logging"] != nil);
+	if ([options[@"writers"] isEqual:@"all"]) {
+		NSMutableArray *writerCounts = [NSMutableArray array];
+		NSUInteger coreCount = [[NSProcessInfo processInfo] activeProcessorCount];
+		for (NSUInteger count = 2; count < coreCount; count *= 2) {
+			[writerCounts addObject:@(count)];
+		}
+		if (coreCount > 1) [writerCounts addObject:@(coreCount)];
+		benchmark.writerCounts = writerCounts;
+	} else if (options[@"writers"]) {
+		NSMutableArray *writerCounts = [NSMutableArray array];
+		for (NSString *count in [options[@"writers"] componentsSeparatedByString:@","]) {
+			if ([count integerValue] <= 0) return MAFail(@"invalid writer count '%@'\n", count);
+			[writerCounts addObject:@([count integerValue])];
+		}
+		benchmark.writerCounts = writerCounts;
+	}
+	BOOL passed = [benchmark runWithOutput:^(NSString *line) {
+		MAPrint(stdout, @"%@\n", line);
+	}];
+	return passed ? 0 : 1;
+}
+
+static MAVerifier *MAVerifierForCheck(NSString *check, NSDictionary *options)
+{
+	NSInteger stateCount = [options[@"states"] integerValue];
+	NSInteger machineSize = MAX([options[@"machine-size"] integerValue], 1);
+	if ([check isEqual:@"incremental"]) {
+		MAIncrementalVerifier *verifier = [[MAIncrementalVerifier alloc] init];
+		if (options[@"states"]) verifier.stateCount = stateCount;
+		if (options[@"machine-size"]) verifier.machineSize = machineSize;
+		verifier.insertLoggingCode = (options[@"logging"] != nil);
+		verifier.generatesInBackground = (options[@"background"] != nil);
+		return verifier;
+	}
+	if ([check isEqual:@"decoder"]) return [[MADecoderFuzzer alloc] init];
+	if ([check isEqual:@"trace"]) return [[MATraceVerifier alloc] init];
+	if ([check isEqual:@"profiling"]) {
+		MAProfileCheck *verifier = [[MAProfileCheck alloc] init];
+		if (options[@"states"]) verifier.stateCount = stateCount;
+		if (options[@"machine-size"]) verifier.machineSize = machineSize;
+		verifier.hostHeaderPath = MAResourcePath(@"HostArduino", @"h");
+		verifier.messagingHeaderPath = MAResourcePath(@"Messaging", @"h");
+		verifier.tableHeaderPath = MAResourcePath(@"StateMachineTable", @"h");
+		return verifier;
+	}
+	if ([check isEqual:@"simulation"]) {
+		MASimulationVerifier *verifier = [[MASimulationVerifier alloc] init];
+		if (options[@"states"]) verifier.stateCount = stateCount;
+		if (options[@"machine-size"]) verifier.machineSize = machineSize;
+		if (options[@"baud"]) verifier.baudRate = [options[@"baud"] integerValue];
+		verifier.arduinoHeaderPath = MAResourcePath(@"SimulatedArduino", @"h");
+		verifier.messagingHeaderPath = MAResourcePath(@"Messaging", @"h");
+		verifier.tableHeaderPath = MAResourcePath(@"StateMachineTable", @"h");
+		return verifier;
+	}
+	if ([check isEqual:@"coalescing"]) {
+		MACoalescingVerifier *verifier = [[MACoalescingVerifier alloc] init];
+		if (options[@"states"]) verifier.stateCount = stateCount;
+		if (options[@"machine-size"]) verifier.machineSize = machineSize;
+		return verifier;
+	}
+	if ([check isEqual:@"serial"]) {
+		MASerialVerifier *verifier = [[MASerialVerifier alloc] init];
+		if (options[@"baud"]) verifier.baudRate = [options[@"baud"] integerValue];
+		return verifier;
+	}
+	if ([check isEqual:@"console"]) {
+		MAConsoleVerifier *verifier = [[MAConsoleVerifier alloc] init];
+		if (options[@"lines"]) verifier.lineCapacity = [options[@"lines"] integerValue];
+		return verifier;
+	}
+	if ([check isEqual:@"symbol-ids"]) return [[MASymbolIDVerifier alloc] init];
+	if ([check isEqual:@"symbol-names"]) {
+		MASymbolNameVerifier *verifier = [[MASymbolNameVerifier alloc] init];
+		if (options[@"states"]) verifier.symbolCount = stateCount;
+		return verifier;
+	}
+	if ([check isEqual:@"document-format"]) {
+		MADocumentFormatVerifier *verifier = [[MADocumentFormatVerifier alloc] init];
+		if (options[@"states"]) verifier.stateCount = stateCount;
+		return verifier;
+	}
+	return nil;
+}
+
+static int MARunVerification(NSDictionary *options)
+{
+	if (options[@"states"] && [options[@"states"] integerValue] <= 0) return MAFail(@"invalid state count '%@'\n", options[@"states"]);
+	if (options[@"lines"] && [options[@"lines"] integerValue] <= 0) return MAFail(@"invalid line count '%@'\n", options[@"lines"]);
+	if (options[@"baud"] && [options[@"baud"] integerValue] <= 0) return MAFail(@"invalid baud rate '%@'\n", options[@"baud"]);
+	NSArray *allChecks = @[@"incremental", @"decoder", @"trace", @"profiling", @"simulation", @"coalescing", @"serial", @"console", @"symbol-ids", @"symbol-names", @"document-format"];
+	NSArray *checks = [options[@"verify"] isEqual:@"all"] ? allChecks : [options[@"verify"] componentsSeparatedByString:@","];
+	NSMutableArray *verifiers = [NSMutableArray array];
+	for (NSString *check in checks) {
+		MAVerifier *verifier = MAVerifierForCheck(check, options);
+		if (!verifier) return MAFail(@"unknown check '%@' (one of %@, or all)\n", check, [allChecks componentsJoinedByString:@", "]);
+		if (options[@"iterations"]) verifier.iterationCount = MAX([options[@"iterations"] integerValue], 1);
+		if (options[@"seed"]) verifier.seed = (UInt32)[options[@"seed"] longLongValue];
+		[verifiers addObject:verifier];
+	}
+	// Run every check even after one fails, prefixing the lines with the check when there are several
+	BOOL passed = YES;
+	for (NSUInteger index = 0; index < [verifiers count]; index++) {
+		NSString *prefix = ([checks count] > 1) ? [checks[index] stringByAppendingString:@": "] : @"";
+		BOOL checkPassed = [verifiers[index] runWithOutput:^(NSString *line) {
+			MAPrint(stdout, @"%@%@\n", prefix, line);
+		}];
+		passed = passed && checkPassed;
+	}
+	return passed ? 0 : 1;
+}
+
+static int MARunTableComparison(NSDictionary *options)
+{
+	MATableComparison *comparison = [[MATableComparison alloc] init];
+	if (options[@"states"]) {
+		NSMutableArray *stateCounts = [NSMutableArray array];
+		for (NSString *count in [options[@"states"] componentsSeparatedByString:@","]) {
+			if ([count integerValue] <= 0) return MAFail(@"invalid state count '%@'\n", count);
+			[stateCounts addObject:@([count integerValue])];
+		}
+		comparison.stateCounts = stateCounts;
+	}
+	NSString *density = options[@"density"];
+	if ([density isEqual:@"sparse"]) comparison.densities = @[@(MASyntheticGraphSparse)];
+	else if ([density isEqual:@"dense"]) comparison.densities = @[@(MASyntheticGraphDense)];
+	else if (density && ![density isEqual:@"both"]) return MAFail(@"invalid density '%@'\n", density);
+	if (options[@"machine-size"]) comparison.machineSize = MAX([options[@"machine-size"] integerValue], 1);
+	if (options[@"iterations"]) comparison.iterationCount = MAX([options[@"iterations"] integerValue], 1);
+	if (options[@"seed"]) comparison.seed = (UInt32)[options[@"seed"] longLongValue];
+	comparison.insertLoggingCode = (options[@"logging"] != nil || options[@"change-only-logging"] != nil);
+	comparison.logsChangesOnly = (options[@"change-only-logging"] != nil);
+	comparison.memoizesConditions = (options[@"memoize-conditions"] != nil);
+	comparison.hostHeaderPath = MAResourcePath(@"HostArduino", @"h");
+	comparison.messagingHeaderPath = MAResourcePath(@"Messaging", @"h");
+	comparison.tableHeaderPath = MAResourcePath(@"StateMachineTable", @"h");
+	BOOL passed = [comparison runWithOutput:^(NSString *line) {
+		MAPrint(stdout, @"%@\n", line);
+	}];
+	return passed ? 0 : 1;
+}
+
+static int MARunTelemetryOverhead(NSDictionary *options)
+{
+	MATelemetryOverhead *overhead = [[MATelemetryOverhead alloc] init];
+	if (options[@"states"]) {
+		NSMutableArray *stateCounts = [NSMutableArray array];
+		for (NSString *count in [options[@"states"] componentsSeparatedByString:@","]) {
+			if ([count integerValue] <= 0) return MAFail(@"invalid state count '%@'\n", count);
+			[stateCounts addObject:@([count integerValue])];
+		}
+		overhead.stateCounts = stateCounts;
+	}
+	if (options[@"baud"]) {
+		NSMutableArray *baudRates = [NSMutableArray array];
+		for (NSString *baudRate in [options[@"baud"] componentsSeparatedByString:@","]) {
+			if ([baudRate integerValue] <= 0) return MAFail(@"invalid baud rate '%@'\n", baudRate);
+			[baudRates addObject:@([baudRate integerValue])];
+		}
+		overhead.baudRates = baudRates;
+	}
+	NSString *density = options[@"density"];
+	if ([density isEqual:@"sparse"]) overhead.densities = @[@(MASyntheticGraphSparse)];
+	else if ([density isEqual:@"dense"]) overhead.densities = @[@(MASyntheticGraphDense)];
+	else if (density && ![density isEqual:@"both"]) return MAFail(@"invalid density '%@'\n", density);
+	if (options[@"machine-size"]) overhead.machineSize = MAX([options[@"machine-size"] integerValue], 1);
+	if (options[@"iterations"]) overhead.iterationCount = MAX([options[@"iterations"] integerValue], 1);
+	if (options[@"seed"]) overhead.seed = (UInt32)[options[@"seed"] longLongValue];
+	overhead.hostHeaderPath = MAResourcePath(@"HostArduino", @"h");
+	overhead.messagingHeaderPath = MAResourcePath(@"Messaging", @"h");
+	BOOL passed = [overhead runWithOutput:^(NSString *line) {
+		MAPrint(stdout, @"%@\n", line);
+	}];
+	return passed ? 0 : 1;
+}
+
+static int MARunTelemetryThroughput(NSDictionary *options)
+{
+	MATelemetryThroughput *throughput = [[MATelemetryThroughput alloc] init];
+	if (options[@"states"]) {
+		NSMutableArray *stateCounts = [NSMutableArray array];
+		for (NSString *count in [options[@"states"] componentsSeparatedByString:@","]) {
+			if ([count integerValue] <= 0) return MAFail(@"invalid state count '%@'\n", count);
+			[stateCounts addObject:@([count integerValue])];
+		}
+		throughput.stateCounts = stateCounts;
+	}
+	if (options[@"baud"]) {
+		if ([options[@"baud"] integerValue] <= 0) return MAFail(@"invalid baud rate '%@'\n", options[@"baud"]);
+		throughput.baudRate = [options[@"baud"] integerValue];
+	}
+	NSString *density = options[@"density"];
+	if ([density isEqual:@"sparse"]) throughput.densities = @[@(MASyntheticGraphSparse)];
+	else if ([density isEqual:@"dense"]) throughput.densities = @[@(MASyntheticGraphDense)];
+	else if (density && ![density isEqual:@"both"]) return MAFail(@"invalid density '%@'\n", density);
+	if (options[@"machine-size"]) throughput.machineSize = MAX([options[@"machine-size"] integerValue], 1);
+	if (options[@"iterations"]) throughput.iterationCount = MAX([options[@"iterations"] integerValue], 1);
+	if (options[@"seed"]) throughput.seed = (UInt32)[options[@"seed"] longLongValue];
+	throughput.hostHeaderPath = MAResourcePath(@"HostArduino", @"h");
+	throughput.messagingHeaderPath = MAResourcePath(@"Messaging", @"h");
+	throughput.version1MessagingHeaderPath = MAResourcePath(@"MessagingV1", @"h");
+	BOOL passed = [throughput runWithOutput:^(NSString *line) {
+		MAPrint(stdout, @"%@\n", line);
+	}];
+	return passed ? 0 : 1;
+}
+
+static int MARunDecoderBenchmark(NSDictionary *options)
+{
+	MADecoderBenchmark *benchmark = [[MADecoderBenchmark alloc] init];
+	benchmark.recordingPath = options[@"recording"];
+	if (options[@"iterations"]) benchmark.iterationCount = MAX([options[@"iterations"] integerValue], 1);
+	if (options[@"seed"]) benchmark.seed = (UInt32)[options[@"seed"] longLongValue];
+	BOOL passed = [benchmark runWithOutput:^(NSString *line) {
+		MAPrint(stdout, @"%@\n", line);
+	}];
+	return passed ? 0 : 1;
+}
+
+static int MARunTraceCapture(NSDictionary *options)
+{
+	if (!options[@"recording"] || !options[@"o"]) return MAFail(@"%@", kUsage);
+	MATraceCapture *capture = [[MATraceCapture alloc] init];
+	capture.inputPath = options[@"recording"];
+	capture.tracePath = options[@"o"];
+	BOOL passed = [capture runWithOutput:^(NSString *line) {
+		MAPrint(stdout, @"%@\n", line);
+	}];
+	return passed ? 0 : 1;
+}
+
+static int MARunTraceReplay(NSDictionary *options, NSArray *paths)
+{
+	if ([paths count] != 1) return MAFail(@"%@", kUsage);
+	MATraceReplay *replay = [[MATraceReplay alloc] init];
+	replay.tracePath = paths[0];
+	NSString *speed = options[@"speed"];
+	if ([speed isEqual:@"max"]) replay.speed = 0;
+	else if (speed && [speed doubleValue] <= 0) return MAFail(@"invalid speed '%@'\n", speed);
+	else if (speed) replay.speed = [speed doubleValue];
+	if (options[@"seek"]) replay.startTime = MAX([options[@"seek"] doubleValue], 0);
+	BOOL passed = [replay runWithOutput:^(NSString *line) {
+		MAPrint(stdout, @"%@\n", line);
+	}];
+	return passed ? 0 : 1;
+}
+
+static int MARunSimulation(NSDictionary *options, NSArray *documentPaths)
+{
+	if ([documentPaths count] != 1) return MAFail(@"%@", kUsage);
+	NSError *error = nil;
+	MADocumentArchive *archive = [MADocumentArchive archiveWithContentsOfFile:documentPaths[0] error:&error];
+	if (!archive) return MAFail(@"%@: %@\n", documentPaths[0], [error localizedDescription] ?: @"could not open");
+	// The sketch Machino would upload
+	MAStateMachineCodeTemplateOptions codeOptions = MAInsertLoggingCode;
+	if (options[@"tables"]) codeOptions |= MATableDrivenStateMachines;
+	if (options[@"memoize-conditions"]) codeOptions |= MAMemoizeConditions;
+	if (options[@"change-only-logging"]) codeOptions |= MAChangeOnlyLogging;
+	if (options[@"profiling"]) codeOptions |= MAProfiling;
+	NSString *code = [MASketchBatch codeForArchive:archive options:codeOptions indentString:options[@"indent"] ?: @"  "];
+	// Build & run
+	MASimulator *simulator = [[MASimulator alloc] init];
+	simulator.arduinoHeaderPath = MAResourcePath(@"SimulatedArduino", @"h");
+	simulator.messagingHeaderPath = MAResourcePath(@"Messaging", @"h");
+	simulator.tableHeaderPath = MAResourcePath(@"StateMachineTable", @"h");
+	simulator.serialOutputPath = options[@"o"];
+	simulator.inputScriptPath = options[@"script"];
+	if (options[@"baud"]) {
+		if ([options[@"baud"] integerValue] <= 0) return MAFail(@"invalid baud rate '%@'\n", options[@"baud"]);
+		simulator.baudRate = [options[@"baud"] integerValue];
+	}
+	NSString *speed = options[@"speed"];
+	if ([speed isEqual:@"max"] || (!speed && simulator.serialOutputPath)) simulator.speed = 0;
+	else if (speed && [speed doubleValue] <= 0) return MAFail(@"invalid speed '%@'\n", speed);
+	else if (speed) simulator.speed = [speed doubleValue];
+	if (options[@"duration"]) simulator.duration = MAX([options[@"duration"] integerValue], 0);
+	simulator.pinHandler = ^(NSString *line) {
+		MAPrint(stdout, @"%@\n", line);
+	};
+	NSString *output = nil;
+	if (![simulator buildCode:code output:&output]) return MAFail(@"%@", output);
+	if (![simulator startWithError:&error]) return MAFail(@"%@\n", [error localizedDescription]);
+	if (simulator.serialPortPath) MAPrint(stdout, @"serial %@\n", simulator.serialPortPath);
+	int status = [simulator waitUntilExit];
+	[simulator terminate];
+	return status;
+}
+
+static int MARunReservedNamesTable(NSDictionary *options)
+{
+	NSString *namesPath = options[@"reserved-names"] ?: MAResourcePath(@"ReservedSymbolNames", @"txt");
+	if (!namesPath) return MAFail(@"ReservedSymbolNames.txt not found, pass it with --reserved-names\n");
+	NSError *error = nil;
+	NSString *namesString = [NSString stringWithContentsOfFile:namesPath encoding:NSUTF8StringEncoding error:&error];
+	if (!namesString) return MAFail(@"%@: %@\n", namesPath, [error localizedDescription]);
+	NSArray *names = MAReservedNamesFromString(namesString);
+	NSString *source = MAReservedNameTableSource(names);
+	if (!source) return MAFail(@"%@: no table for these names (they have to be unique, ascii & without quotes)\n", namesPath);
+	if (options[@"o"]) {
+		if (![source writeToFile:options[@"o"] atomically:YES encoding:NSUTF8StringEncoding error:&error]) return MAFail(@"%@: %@\n", options[@"o"], [error localizedDescription]);
+	} else {
+		MAPrint(stdout, @"%@", source);
+	}
+	// The table only takes effect once it's compiled in
+	BOOL isBuiltIn = [names isEqualToArray:MABuiltInReservedNames()];
+	MAPrint(stderr, @"%lu names, %@\n", (unsigned long)[names count], isBuiltIn ? @"the same as the built-in ones" : @"not the built-in ones yet, rebuild with the new table");
+	return 0;
+}
+
+static MASketchBatch *MASketchBatchForOptions(NSDictionary *options)
+{
+	MASketchBatch *batch = [[MASketchBatch alloc] init];
+	batch.outputDirectory = options[@"o"];
+	batch.insertLoggingCode = (options[@"logging"] != nil || options[@"change-only-logging"] != nil || options[@"profiling"] != nil);
+	batch.logsChangesOnly = (options[@"change-only-logging"] != nil);
+	batch.profiles = (options[@"profiling"] != nil);
+	batch.writesTables = (options[@"tables"] != nil);
+	batch.memoizesConditions = (options[@"memoize-conditions"] != nil);
+	batch.messagingHeaderPath = MAResourcePath(@"Messaging", @"h");
+	batch.tableHeaderPath = MAResourcePath(@"StateMachineTable", @"h");
+	if (options[@"indent"]) batch.indentString = options[@"indent"];
+	if (options[@"j"]) batch.maximumConcurrentJobs = MAX([options[@"j"] integerValue], 1);
+	if (batch.insertLoggingCode && !batch.messagingHeaderPath) MAPrint(stderr, @"warning: Messaging.h not found, sketches won't compile\n");
+	if (batch.writesTables && !batch.tableHeaderPath) MAPrint(stderr, @"warning: StateMachineTable.h not found, sketches won't compile\n");
+	return batch;
+}
+
+static int MARunBatch(NSDictionary *options, NSArray *documentPaths)
+{
+	if ([documentPaths count] == 0) return MAFail(@"%@", kUsage);
+	MASketchBatch *batch = MASketchBatchForOptions(options);
+	NSUInteger failureCount = [batch generateSketchesForDocuments:documentPaths completionHandler:^(NSString *documentPath, NSString *sketchPath, NSError *error) {
+		if (sketchPath) MAPrint(stdout, @"%@ -> %@\n", documentPath, sketchPath);
+		else MAPrint(stderr, @"%@: %@\n", documentPath, [error localizedDescription] ?: @"generation failed");
+	}];
+	return (failureCount == 0) ? 0 : 1;
+}
+
+static int MARunBuild(NSDictionary *options, NSArray *documentPaths)
+{
+	if ([documentPaths count] == 0 || !options[@"board"]) return MAFail(@"%@", kUsage);
+	NSString *port = options[@"port"];
+	if (port && [documentPaths count] > 1) return MAFail(@"can only upload one document to a port\n");
+	MASketchBatch *batch = MASketchBatchForOptions(options);
+	MASketchBuilder *builder = [[MASketchBuilder alloc] init];
+	builder.boardIdentifier = options[@"board"];
+	if (options[@"arduino-cli"]) builder.arduinoCLIPath = options[@"arduino-cli"];
+	if (options[@"cache"]) builder.cache = [[MABuildCache alloc] initWithDirectory:[options[@"cache"] stringByExpandingTildeInPath]];
+	unsigned long baudRate = options[@"baud"] ? (unsigned long)[options[@"baud"] integerValue] : 1000000;
+	if (baudRate == 0) return MAFail(@"invalid baud rate '%@'\n", options[@"baud"]);
+	if (options[@"cache-size"]) builder.cache.maximumSize = (unsigned long long)MAX([options[@"cache-size"] longLongValue], 1) * 1024 * 1024;
+	// Built (& uploaded) as the sketches come in, one at a time
+	__block NSUInteger buildFailureCount = 0;
+	NSUInteger failureCount = [batch generateSketchesForDocuments:documentPaths completionHandler:^(NSString *documentPath, NSString *sketchPath, NSError *error) {
+		if (!sketchPath) {
+			MAPrint(stderr, @"%@: %@\n", documentPath, [error localizedDescription] ?: @"generation failed");
+			return;
+		}
+		NSString *output = nil;
+		MASketchBuild *build = [builder buildSketchAtPath:[sketchPath stringByDeletingLastPathComponent] output:&output error:&error];
+		if (!build) {
+			MAPrint(stderr, @"%@%@: %@\n", output ?: @"", documentPath, [error localizedDescription] ?: @"build failed");
+			buildFailureCount++;
+			return;
+		}
+		MAPrint(stdout, @"%@ -> %@ (build %08X, %@)\n", documentPath, sketchPath, (unsigned int)build.buildID, build.isCached ? @"cached" : @"compiled");
+		if (!port) return;
+		// Only sketches with logging code say hello, and only a cached build can be on the board already
+		if (build.isCached && batch.insertLoggingCode && [MASketchBuilder buildIDRunningOnPort:port baudRate:baudRate timeout:3] == build.buildID) {
+			MAPrint(stdout, @"%@ already runs build %08X\n", port, (unsigned int)build.buildID);
+			return;
+		}
+		output = nil;
+		if (![builder uploadBuild:build toPort:port output:&output error:&error]) {
+			MAPrint(stderr, @"%@%@: %@\n", output ?: @"", port, [error localizedDescription] ?: @"upload failed");
+			buildFailureCount++;
+			return;
+		}
+		MAPrint(stdout, @"uploaded build %08X to %@\n", (unsigned int)build.buildID, port);
+	}];
+	return (failureCount + buildFailureCount == 0) ? 0 : 1;
+}
+
+#pragma mark - Main
+
+int main(int argc, const char *argv[])
+{
+	@autoreleasepool {
+		// Parse arguments
+		NSSet *flags = [NSSet setWithObjects:@"benchmark", @"compare-tables", @"telemetry-overhead", @"telemetry-throughput", @"benchmark-decoder", @"record-trace", @"replay-trace", @"simulate", @"reserved-names-table", @"tables", @"memoize-conditions", @"change-only-logging", @"profiling", @"logging", @"background", @"build", @"help", nil];
+		NSSet *valueOptions = [NSSet setWithObjects:@"o", @"j", @"verify", @"indent", @"reserved-names", @"states", @"density", @"machine-size", @"seed", @"iterations", @"baud", @"recording", @"speed", @"seek", @"script", @"duration", @"lines", @"writers", @"board", @"port", @"arduino-cli", @"cache", @"cache-size", nil];
+		NSMutableDictionary *options = [NSMutableDictionary dictionary];
+		NSMutableArray *documentPaths = [NSMutableArray array];
+		for (int i = 1; i < argc; i++) {
+			NSString *argument = @(argv[i]);
+			if (![argument hasPrefix:@"-"] || [argument length] == 1) {
+				[documentPaths addObject:argument];
+				continue;
+			}
+			NSString *name = [argument stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"-"]];
+			if ([flags containsObject:name] || [name isEqual:@"h"]) {
+				options[name] = @YES;
+			} else if ([valueOptions containsObject:name]) {
+				if (i + 1 >= argc) return MAFail(@"missing value for %@\n", argument);
+				options[name] = @(argv[++i]);
+			} else {
+				return MAFail(@"unknown option %@\n\n%@", argument, kUsage);
+			}
+		}
+		if (options[@"help"] || options[@"h"]) {
+			MAPrint(stdout, @"%@", kUsage);
+			return 0;
+		}
+		// Reserved names (built in, unless they're given)
+		if (options[@"reserved-names-table"]) return MARunReservedNamesTable(options);
+		if (options[@"reserved-names"]) [MAStateMachineCodeTemplate setReservedSymbolNamesPath:options[@"reserved-names"]];
+		// Run
+		if (options[@"benchmark"]) return MARunBenchmark(options);
+		if (options[@"verify"]) return MARunVerification(options);
+		if (options[@"compare-tables"]) return MARunTableComparison(options);
+		if (options[@"telemetry-overhead"]) return MARunTelemetryOverhead(options);
+		if (options[@"telemetry-throughput"]) return MARunTelemetryThroughput(options);
+		if (options[@"benchmark-decoder"]) return MARunDecoderBenchmark(options);
+		if (options[@"record-trace"]) return MARunTraceCapture(options);
+		if (options[@"replay-trace"]) return MARunTraceReplay(options, documentPaths);
+		if (options[@"simulate"]) return MARunSimulation(options, documentPaths);
+		if (options[@"build"]) return MARunBuild(options, documentPaths);
+		return MARunBatch(options, documentPaths);
+	}
+}